@@ -0,0 +1,1240 @@
+//-----------------------------------------------------------------------------
+// File: ddheap.cpp
+//
+// Desc: Reserve then commit linear heap for system memory surfaces.
+//
+//       The heap reserves its full address range with no access rights and
+//       only commits the 64K granules that allocations actually touch. A
+//       per-granule use count tells when a granule goes idle, at which point
+//       it is decommitted so the working set follows the surfaces in use.
+//       Committed granules are mirrored in VMEMHEAP.pAgpCommitMask exactly
+//       like DirectDraw tracks a nonlocal heap.
+//
+//       Every allocation and free is timed so DDHeapGetStats() and
+//       DDHeapDumpJSON() can report latency percentiles alongside the
+//       fragmentation of the free list.
+//
+//       The heap is guarded by a critical section. Small blocks are carved
+//       out of 64K slabs, one size class per slab, and handed out from per
+//       thread magazines that refill from and flush to a shared depot in
+//       batches, so most small allocations and frees never take the lock.
+//       A slab lookup table indexed by granule tells a free which size
+//       class a pointer belongs to without looking at the heap lists, and
+//       an in use bit per block turns away double and stray frees.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include "ddheap.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+//-----------------------------------------------------------------------------
+// Default alignment of a surface start and its pitch in bytes
+//-----------------------------------------------------------------------------
+#define DDHEAP_START_ALIGNMENT 16
+#define DDHEAP_PITCH_ALIGNMENT 4
+
+//-----------------------------------------------------------------------------
+// Latency histogram, 4 buckets per power of two nanoseconds
+//-----------------------------------------------------------------------------
+#define DDHEAP_LATENCY_BUCKETS 128
+
+//-----------------------------------------------------------------------------
+// Small block size classes, powers of two from 256 bytes to DDHEAP_SMALL_LIMIT
+//-----------------------------------------------------------------------------
+#define DDHEAP_SMALL_MINIMUM 256
+#define DDHEAP_SMALL_CLASSES 7
+
+//-----------------------------------------------------------------------------
+// Blocks a thread keeps per size class and how many move to or from the
+// depot at once
+//-----------------------------------------------------------------------------
+#define DDHEAP_MAGAZINE_SIZE 32
+#define DDHEAP_MAGAZINE_BATCH 16
+
+//-----------------------------------------------------------------------------
+// Per thread cache of small blocks, blocks are linked through their first
+// FLATPTR. The counters are also read and cleared by other threads, so they
+// are only changed with Interlocked calls.
+//-----------------------------------------------------------------------------
+struct DDHeapThreadCache {
+	DDHeapThreadCache* pNext; // Next cache owned by the heap
+	LONG lAllocCount;         // Allocations served from this cache
+	LONG lFreeCount;          // Frees taken by this cache
+
+	// Linked list of cached blocks and their count per size class
+	FLATPTR Blocks[DDHEAP_SMALL_CLASSES];
+	DWORD Counts[DDHEAP_SMALL_CLASSES];
+
+	// Latency histograms for allocations and frees on this thread
+	LONG AllocLatency[DDHEAP_LATENCY_BUCKETS];
+	LONG FreeLatency[DDHEAP_LATENCY_BUCKETS];
+};
+
+//-----------------------------------------------------------------------------
+// Private heap state, stored in VMEMHEAP.pvPhysRsrv
+//-----------------------------------------------------------------------------
+struct DDHeapPrivate {
+	BYTE* pBase;         // Start of the reserved address range
+	DWORD dwGranules;    // Number of granules in the range
+	DWORD* pGranuleUse;  // Number of allocations touching each granule
+	BYTE* pCommitMask;   // One bit per committed granule
+	DWORD dwMaskSize;    // Size of pCommitMask in bytes
+	DWORD dwIdleSize;    // Committed bytes with no allocation in them
+	DWORD dwRetainSize;  // Idle bytes allowed before decommitting
+	LONGLONG iFrequency; // QueryPerformanceCounter() ticks per second
+	DWORD dwAllocCount;  // Successful allocations
+	DWORD dwFailCount;   // Failed allocations
+	DWORD dwFreeCount;   // Frees
+
+	// Latency histograms for allocations and frees
+	LONG AllocLatency[DDHEAP_LATENCY_BUCKETS];
+	LONG FreeLatency[DDHEAP_LATENCY_BUCKETS];
+
+	CRITICAL_SECTION csLock;    // Guards everything but the thread caches
+	DWORD dwTlsIndex;           // Thread local slot for DDHeapThreadCache
+	DDHeapThreadCache* pCaches; // All thread caches created for this heap
+	BYTE* pSlabClass;           // Size class + 1 of each slab granule, or 0
+	WORD* pSlabFree;            // Blocks of each slab sitting in the depot
+	LONG* pBlockUsed;           // In use bit per DDHEAP_SMALL_MINIMUM bytes
+
+	// Shared depot of free small blocks per size class
+	FLATPTR Depot[DDHEAP_SMALL_CLASSES];
+	DWORD DepotCount[DDHEAP_SMALL_CLASSES];
+};
+
+//-----------------------------------------------------------------------------
+// Name: GetPrivate()
+// Desc: Return the private heap state, NULL if not a DDHeapCreate() heap
+//-----------------------------------------------------------------------------
+static DDHeapPrivate* GetPrivate(LPVMEMHEAP pvmh)
+{
+	if (pvmh == NULL) {
+		return NULL;
+	}
+	return (DDHeapPrivate*)pvmh->pvPhysRsrv;
+}
+
+//-----------------------------------------------------------------------------
+// Name: AlignUp()
+// Desc: Round a value up to a multiple of the alignment, which doesn't have
+//       to be a power of two
+//-----------------------------------------------------------------------------
+static FLATPTR AlignUp(FLATPTR uValue, DWORD dwAlignment)
+{
+	if (dwAlignment > 1) {
+		FLATPTR uRemainder = uValue % dwAlignment;
+		if (uRemainder) {
+			uValue += dwAlignment - uRemainder;
+		}
+	}
+	return uValue;
+}
+
+//-----------------------------------------------------------------------------
+// Name: HighBit()
+// Desc: Index of the highest set bit, the value must not be zero
+//-----------------------------------------------------------------------------
+static DWORD HighBit(DWORD dwValue)
+{
+	DWORD dwBit = 0;
+	while (dwValue >>= 1) {
+		++dwBit;
+	}
+	return dwBit;
+}
+
+//-----------------------------------------------------------------------------
+// Name: CountBits()
+// Desc: Number of set bits in a value
+//-----------------------------------------------------------------------------
+static DWORD CountBits(DWORD dwValue)
+{
+	DWORD dwCount = 0;
+	while (dwValue) {
+		dwValue &= dwValue - 1;
+		++dwCount;
+	}
+	return dwCount;
+}
+
+//-----------------------------------------------------------------------------
+// Name: StartTimer()
+// Desc: Read the performance counter
+//-----------------------------------------------------------------------------
+static LONGLONG StartTimer(void)
+{
+	LARGE_INTEGER liNow;
+	QueryPerformanceCounter(&liNow);
+	return liNow.QuadPart;
+}
+
+//-----------------------------------------------------------------------------
+// Name: RecordLatency()
+// Desc: Add the time since iStart to a latency histogram. The bucket is
+//       the power of two of the nanoseconds plus the next two bits.
+//-----------------------------------------------------------------------------
+static void RecordLatency(
+	const DDHeapPrivate* pPriv, LONG* pHistogram, LONGLONG iStart)
+{
+	LONGLONG iTicks = StartTimer() - iStart;
+	LONGLONG iNanoseconds = (iTicks * 1000000000) / pPriv->iFrequency;
+	DWORD dwValue;
+	if (iNanoseconds > 0xFFFFFFFF) {
+		dwValue = 0xFFFFFFFF;
+	} else {
+		dwValue = (DWORD)iNanoseconds;
+	}
+	DWORD dwBucket;
+	if (dwValue < 4) {
+		dwBucket = dwValue;
+	} else {
+		DWORD dwBit = HighBit(dwValue);
+		dwBucket = ((dwBit - 1) << 2) + ((dwValue >> (dwBit - 2)) & 3);
+	}
+	InterlockedIncrement(&pHistogram[dwBucket]);
+}
+
+//-----------------------------------------------------------------------------
+// Name: Percentile()
+// Desc: Upper bound in nanoseconds of the bucket holding the requested
+//       percentile, given in 1/10000ths
+//-----------------------------------------------------------------------------
+static DWORD Percentile(const DWORD* pHistogram, DWORD dwRank)
+{
+	LONGLONG iTotal = 0;
+	DWORD i;
+	for (i = 0; i < DDHEAP_LATENCY_BUCKETS; ++i) {
+		iTotal += pHistogram[i];
+	}
+	if (!iTotal) {
+		return 0;
+	}
+	LONGLONG iTarget = ((iTotal * dwRank) + 9999) / 10000;
+	LONGLONG iSeen = 0;
+	for (i = 0; i < (DDHEAP_LATENCY_BUCKETS - 1); ++i) {
+		iSeen += pHistogram[i];
+		if (iSeen >= iTarget) {
+			break;
+		}
+	}
+	// Start of the next bucket minus one
+	++i;
+	if (i < 4) {
+		return i - 1;
+	}
+	DWORD dwBit = (i >> 2) + 1;
+	if (dwBit > 31) {
+		return 0xFFFFFFFF;
+	}
+	return ((4 + (i & 3)) << (dwBit - 2)) - 1;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DecommitGranule()
+// Desc: Return a committed granule's pages to the system
+//-----------------------------------------------------------------------------
+static void DecommitGranule(
+	LPVMEMHEAP pvmh, DDHeapPrivate* pPriv, DWORD dwGranule)
+{
+	VirtualFree(
+		pPriv->pBase + (dwGranule * DDHEAP_GRANULE), DDHEAP_GRANULE, MEM_DECOMMIT);
+	pPriv->pCommitMask[dwGranule >> 3] &= (BYTE)(~(1U << (dwGranule & 7)));
+	pvmh->dwCommitedSize -= DDHEAP_GRANULE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ReleaseGranules()
+// Desc: Drop the use count of a granule range, granules that go idle are
+//       decommitted once more than dwRetainSize bytes are idle
+//-----------------------------------------------------------------------------
+static void ReleaseGranules(
+	LPVMEMHEAP pvmh, DDHeapPrivate* pPriv, DWORD dwFirst, DWORD dwLast)
+{
+	DWORD i;
+	for (i = dwFirst; i <= dwLast; ++i) {
+		if (--pPriv->pGranuleUse[i] == 0) {
+			if ((pPriv->dwIdleSize + DDHEAP_GRANULE) > pPriv->dwRetainSize) {
+				DecommitGranule(pvmh, pPriv, i);
+			} else {
+				pPriv->dwIdleSize += DDHEAP_GRANULE;
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: CommitGranules()
+// Desc: Bump the use count of a granule range and commit any granule that
+//       isn't backed by memory yet. On failure the range is left untouched.
+//-----------------------------------------------------------------------------
+static BOOL CommitGranules(
+	LPVMEMHEAP pvmh, DDHeapPrivate* pPriv, DWORD dwFirst, DWORD dwLast)
+{
+	DWORD i;
+	for (i = dwFirst; i <= dwLast; ++i) {
+		if (pPriv->pGranuleUse[i] == 0) {
+			BYTE bMask = (BYTE)(1U << (i & 7));
+			if (pPriv->pCommitMask[i >> 3] & bMask) {
+				// Reusing an idle granule
+				pPriv->dwIdleSize -= DDHEAP_GRANULE;
+			} else {
+				if (VirtualAlloc(pPriv->pBase + (i * DDHEAP_GRANULE),
+						DDHEAP_GRANULE, MEM_COMMIT, PAGE_READWRITE) == NULL) {
+					if (i != dwFirst) {
+						ReleaseGranules(pvmh, pPriv, dwFirst, i - 1);
+					}
+					return FALSE;
+				}
+				pPriv->pCommitMask[i >> 3] |= bMask;
+				pvmh->dwCommitedSize += DDHEAP_GRANULE;
+			}
+		}
+		++pPriv->pGranuleUse[i];
+	}
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetAlignment()
+// Desc: Start and pitch alignment for surfaces in this heap
+//-----------------------------------------------------------------------------
+static void GetAlignment(
+	LPVMEMHEAP pvmh, DWORD* pStartAlign, DWORD* pPitchAlign)
+{
+	*pStartAlign = DDHEAP_START_ALIGNMENT;
+	*pPitchAlign = DDHEAP_PITCH_ALIGNMENT;
+	if (pvmh->dwFlags & VMEMHEAP_ALIGNMENT) {
+		if (pvmh->Alignment.Offscreen.Linear.dwStartAlignment) {
+			*pStartAlign = pvmh->Alignment.Offscreen.Linear.dwStartAlignment;
+		}
+		if (pvmh->Alignment.Offscreen.Linear.dwPitchAlignment) {
+			*pPitchAlign = pvmh->Alignment.Offscreen.Linear.dwPitchAlignment;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: SmallClass()
+// Desc: Size class for a block, DDHEAP_SMALL_CLASSES if it's too large
+//-----------------------------------------------------------------------------
+static DWORD SmallClass(DWORD dwSize)
+{
+	DWORD dwClass = 0;
+	while ((dwClass < DDHEAP_SMALL_CLASSES) &&
+		((DWORD)(DDHEAP_SMALL_MINIMUM << dwClass) < dwSize)) {
+		++dwClass;
+	}
+	return dwClass;
+}
+
+//-----------------------------------------------------------------------------
+// Name: MarkBlock()
+// Desc: Set or clear the in use bit of a small block. Returns FALSE if the
+//       bit was already in that state. Neighboring blocks share the word and
+//       may belong to other threads, so it's changed with a compare and swap.
+//-----------------------------------------------------------------------------
+static BOOL MarkBlock(const DDHeapPrivate* pPriv, FLATPTR ptr, BOOL bUsed)
+{
+	DWORD dwIndex =
+		(DWORD)((ptr - (FLATPTR)pPriv->pBase) / DDHEAP_SMALL_MINIMUM);
+	LONG* pWord = &pPriv->pBlockUsed[dwIndex >> 5];
+	LONG lBit = (LONG)(1UL << (dwIndex & 31));
+	LONG lOld;
+	LONG lNew;
+	do {
+		lOld = *(volatile LONG*)pWord;
+		if (((lOld & lBit) != 0) == (bUsed != FALSE)) {
+			return FALSE;
+		}
+		lNew = bUsed ? (lOld | lBit) : (lOld & ~lBit);
+	} while (InterlockedCompareExchange(pWord, lNew, lOld) != lOld);
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DepotPush()
+// Desc: Put a small block in the shared depot, the lock must be held
+//-----------------------------------------------------------------------------
+static void DepotPush(DDHeapPrivate* pPriv, DWORD dwClass, FLATPTR ptr)
+{
+	*(FLATPTR*)ptr = pPriv->Depot[dwClass];
+	pPriv->Depot[dwClass] = ptr;
+	++pPriv->DepotCount[dwClass];
+	++pPriv->pSlabFree[(ptr - (FLATPTR)pPriv->pBase) / DDHEAP_GRANULE];
+}
+
+//-----------------------------------------------------------------------------
+// Name: DepotPop()
+// Desc: Take a small block from the shared depot, the lock must be held
+//-----------------------------------------------------------------------------
+static FLATPTR DepotPop(DDHeapPrivate* pPriv, DWORD dwClass)
+{
+	FLATPTR ptr = pPriv->Depot[dwClass];
+	if (ptr) {
+		pPriv->Depot[dwClass] = *(FLATPTR*)ptr;
+		--pPriv->DepotCount[dwClass];
+		--pPriv->pSlabFree[(ptr - (FLATPTR)pPriv->pBase) / DDHEAP_GRANULE];
+	}
+	return ptr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetThreadCache()
+// Desc: Return the calling thread's cache, creating it on first use
+//-----------------------------------------------------------------------------
+static DDHeapThreadCache* GetThreadCache(DDHeapPrivate* pPriv)
+{
+	DDHeapThreadCache* pCache =
+		(DDHeapThreadCache*)TlsGetValue(pPriv->dwTlsIndex);
+	if (pCache == NULL) {
+		pCache =
+			(DDHeapThreadCache*)LocalAlloc(LPTR, sizeof(DDHeapThreadCache));
+		if (pCache) {
+			EnterCriticalSection(&pPriv->csLock);
+			pCache->pNext = pPriv->pCaches;
+			pPriv->pCaches = pCache;
+			LeaveCriticalSection(&pPriv->csLock);
+			TlsSetValue(pPriv->dwTlsIndex, pCache);
+		}
+	}
+	return pCache;
+}
+
+//-----------------------------------------------------------------------------
+// Name: FlushMagazine()
+// Desc: Move cached blocks of a size class back to the depot until only
+//       dwKeep are left, the lock must be held
+//-----------------------------------------------------------------------------
+static void FlushMagazine(DDHeapPrivate* pPriv, DDHeapThreadCache* pCache,
+	DWORD dwClass, DWORD dwKeep)
+{
+	while (pCache->Counts[dwClass] > dwKeep) {
+		FLATPTR ptr = pCache->Blocks[dwClass];
+		pCache->Blocks[dwClass] = *(FLATPTR*)ptr;
+		--pCache->Counts[dwClass];
+		DepotPush(pPriv, dwClass, ptr);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDHeapCreate()
+// Desc: Reserve dwReserveSize bytes of address space and set up the VMEMHEAP
+//       to manage it. Nothing is committed until the first allocation.
+//       dwRetainSize is the amount of idle committed memory kept around to
+//       avoid recommitting on alloc/free churn, 0 decommits immediately.
+//       If VMEMHEAP_ALIGNMENT is already set in dwFlags, the Offscreen
+//       alignment in pvmh->Alignment is honored.
+//-----------------------------------------------------------------------------
+HRESULT DDHeapCreate(LPVMEMHEAP pvmh, DWORD dwReserveSize, DWORD dwRetainSize)
+{
+	if ((pvmh == NULL) || (dwReserveSize == 0) ||
+		(dwReserveSize > (0xFFFFFFFFUL - (DDHEAP_GRANULE - 1)))) {
+		return DDERR_INVALIDPARAMS;
+	}
+
+	// Round up to whole granules
+	dwReserveSize =
+		(dwReserveSize + (DDHEAP_GRANULE - 1)) & ~(DDHEAP_GRANULE - 1);
+	DWORD dwGranules = dwReserveSize / DDHEAP_GRANULE;
+
+	DDHeapPrivate* pPriv =
+		(DDHeapPrivate*)LocalAlloc(LPTR, sizeof(DDHeapPrivate));
+	if (pPriv == NULL) {
+		return DDERR_OUTOFMEMORY;
+	}
+	pPriv->dwGranules = dwGranules;
+	pPriv->dwMaskSize = (dwGranules + 7) >> 3;
+	pPriv->dwRetainSize = dwRetainSize;
+	LARGE_INTEGER liFrequency;
+	QueryPerformanceFrequency(&liFrequency);
+	pPriv->iFrequency = liFrequency.QuadPart;
+	pPriv->pGranuleUse =
+		(DWORD*)LocalAlloc(LPTR, dwGranules * sizeof(DWORD));
+	pPriv->pCommitMask = (BYTE*)LocalAlloc(LPTR, pPriv->dwMaskSize);
+	pPriv->pSlabClass = (BYTE*)LocalAlloc(LPTR, dwGranules);
+	pPriv->pSlabFree = (WORD*)LocalAlloc(LPTR, dwGranules * sizeof(WORD));
+	pPriv->pBlockUsed = (LONG*)LocalAlloc(LPTR,
+		dwGranules * ((DDHEAP_GRANULE / DDHEAP_SMALL_MINIMUM) / 8));
+	pPriv->dwTlsIndex = TlsAlloc();
+	LPVMEML pFree = (LPVMEML)LocalAlloc(LPTR, sizeof(VMEML));
+
+	// Reserve the address range, no pages are backed yet
+	pPriv->pBase =
+		(BYTE*)VirtualAlloc(NULL, dwReserveSize, MEM_RESERVE, PAGE_NOACCESS);
+
+	if ((pPriv->pGranuleUse == NULL) || (pPriv->pCommitMask == NULL) ||
+		(pPriv->pSlabClass == NULL) || (pPriv->pSlabFree == NULL) ||
+		(pPriv->pBlockUsed == NULL) ||
+		(pPriv->dwTlsIndex == TLS_OUT_OF_INDEXES) || (pFree == NULL) ||
+		(pPriv->pBase == NULL)) {
+		if (pPriv->pBase) {
+			VirtualFree(pPriv->pBase, 0, MEM_RELEASE);
+		}
+		if (pFree) {
+			LocalFree(pFree);
+		}
+		if (pPriv->dwTlsIndex != TLS_OUT_OF_INDEXES) {
+			TlsFree(pPriv->dwTlsIndex);
+		}
+		if (pPriv->pBlockUsed) {
+			LocalFree(pPriv->pBlockUsed);
+		}
+		if (pPriv->pSlabFree) {
+			LocalFree(pPriv->pSlabFree);
+		}
+		if (pPriv->pSlabClass) {
+			LocalFree(pPriv->pSlabClass);
+		}
+		if (pPriv->pCommitMask) {
+			LocalFree(pPriv->pCommitMask);
+		}
+		if (pPriv->pGranuleUse) {
+			LocalFree(pPriv->pGranuleUse);
+		}
+		LocalFree(pPriv);
+		return DDERR_OUTOFMEMORY;
+	}
+
+	InitializeCriticalSection(&pPriv->csLock);
+
+	// One free block spanning the whole heap
+	pFree->next = NULL;
+	pFree->ptr = (FLATPTR)pPriv->pBase;
+	pFree->size = dwReserveSize;
+	pFree->bDiscardable = FALSE;
+
+	pvmh->dwFlags = VMEMHEAP_LINEAR | (pvmh->dwFlags & VMEMHEAP_ALIGNMENT);
+	pvmh->stride = 0;
+	pvmh->freeList = pFree;
+	pvmh->allocList = NULL;
+	pvmh->dwTotalSize = dwReserveSize;
+	pvmh->fpGARTLin = (FLATPTR)pPriv->pBase;
+	pvmh->fpGARTDev = (FLATPTR)pPriv->pBase;
+	pvmh->dwCommitedSize = 0;
+	pvmh->dwCoalesceCount = 0;
+	pvmh->pvPhysRsrv = pPriv;
+#if (NTDDI_VERSION >= NTDDI_WINXP)
+	pvmh->pAgpCommitMask = pPriv->pCommitMask;
+	pvmh->dwAgpCommitMaskSize = pPriv->dwMaskSize;
+#endif
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDHeapDestroy()
+// Desc: Release the address range and all bookkeeping. Any pointers still
+//       allocated from the heap become invalid. No other thread may be using
+//       the heap.
+//-----------------------------------------------------------------------------
+void DDHeapDestroy(LPVMEMHEAP pvmh)
+{
+	DDHeapPrivate* pPriv = GetPrivate(pvmh);
+	if (pPriv == NULL) {
+		return;
+	}
+
+	LPVMEML pNode = (LPVMEML)pvmh->freeList;
+	while (pNode) {
+		LPVMEML pNext = pNode->next;
+		LocalFree(pNode);
+		pNode = pNext;
+	}
+	pNode = (LPVMEML)pvmh->allocList;
+	while (pNode) {
+		LPVMEML pNext = pNode->next;
+		LocalFree(pNode);
+		pNode = pNext;
+	}
+
+	DDHeapThreadCache* pCache = pPriv->pCaches;
+	while (pCache) {
+		DDHeapThreadCache* pNextCache = pCache->pNext;
+		LocalFree(pCache);
+		pCache = pNextCache;
+	}
+	TlsFree(pPriv->dwTlsIndex);
+	DeleteCriticalSection(&pPriv->csLock);
+
+	VirtualFree(pPriv->pBase, 0, MEM_RELEASE);
+	LocalFree(pPriv->pBlockUsed);
+	LocalFree(pPriv->pSlabFree);
+	LocalFree(pPriv->pSlabClass);
+	LocalFree(pPriv->pCommitMask);
+	LocalFree(pPriv->pGranuleUse);
+	LocalFree(pPriv);
+
+	pvmh->freeList = NULL;
+	pvmh->allocList = NULL;
+	pvmh->dwTotalSize = 0;
+	pvmh->fpGARTLin = 0;
+	pvmh->fpGARTDev = 0;
+	pvmh->dwCommitedSize = 0;
+	pvmh->pvPhysRsrv = NULL;
+#if (NTDDI_VERSION >= NTDDI_WINXP)
+	pvmh->pAgpCommitMask = NULL;
+	pvmh->dwAgpCommitMaskSize = 0;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Name: AllocBlock()
+// Desc: First fit allocation from the free list, the lock must be held
+//-----------------------------------------------------------------------------
+static FLATPTR AllocBlock(
+	LPVMEMHEAP pvmh, DDHeapPrivate* pPriv, DWORD dwSize, DWORD dwStartAlign)
+{
+	// First fit in the address ordered free list
+	LPVMEML pPrev = NULL;
+	LPVMEML pFree = (LPVMEML)pvmh->freeList;
+	FLATPTR fpStart = 0;
+	while (pFree) {
+		fpStart = AlignUp(pFree->ptr, dwStartAlign);
+		if ((fpStart + dwSize) <= (pFree->ptr + pFree->size)) {
+			break;
+		}
+		pPrev = pFree;
+		pFree = pFree->next;
+	}
+	if (pFree == NULL) {
+		return 0;
+	}
+
+	DWORD dwLead = (DWORD)(fpStart - pFree->ptr);
+	DWORD dwTail = pFree->size - dwLead - dwSize;
+
+	// Get the bookkeeping nodes before touching anything
+	LPVMEML pAlloc;
+	LPVMEML pTail = NULL;
+	if (!dwLead && !dwTail) {
+		pAlloc = pFree;
+	} else {
+		pAlloc = (LPVMEML)LocalAlloc(LPTR, sizeof(VMEML));
+		if (pAlloc == NULL) {
+			return 0;
+		}
+		if (dwLead && dwTail) {
+			pTail = (LPVMEML)LocalAlloc(LPTR, sizeof(VMEML));
+			if (pTail == NULL) {
+				LocalFree(pAlloc);
+				return 0;
+			}
+		}
+	}
+
+	DWORD dwOffset = (DWORD)(fpStart - (FLATPTR)pPriv->pBase);
+	if (!CommitGranules(pvmh, pPriv, dwOffset / DDHEAP_GRANULE,
+			(dwOffset + dwSize - 1) / DDHEAP_GRANULE)) {
+		if (pAlloc != pFree) {
+			LocalFree(pAlloc);
+		}
+		if (pTail) {
+			LocalFree(pTail);
+		}
+		return 0;
+	}
+
+	// Split the free block
+	if (pAlloc == pFree) {
+		if (pPrev) {
+			pPrev->next = pFree->next;
+		} else {
+			pvmh->freeList = pFree->next;
+		}
+	} else if (pTail) {
+		pTail->ptr = fpStart + dwSize;
+		pTail->size = dwTail;
+		pTail->next = pFree->next;
+		pFree->next = pTail;
+		pFree->size = dwLead;
+	} else if (dwLead) {
+		pFree->size = dwLead;
+	} else {
+		pFree->ptr = fpStart + dwSize;
+		pFree->size = dwTail;
+	}
+
+	pAlloc->ptr = fpStart;
+	pAlloc->size = dwSize;
+	pAlloc->bDiscardable = FALSE;
+	pAlloc->next = (LPVMEML)pvmh->allocList;
+	pvmh->allocList = pAlloc;
+	return fpStart;
+}
+
+//-----------------------------------------------------------------------------
+// Name: FreeBlock()
+// Desc: Return a block to the free list, FALSE if it wasn't allocated.
+//       The lock must be held.
+//-----------------------------------------------------------------------------
+static BOOL FreeBlock(LPVMEMHEAP pvmh, DDHeapPrivate* pPriv, FLATPTR ptr)
+{
+	// Find the allocation
+	LPVMEML pPrev = NULL;
+	LPVMEML pNode = (LPVMEML)pvmh->allocList;
+	while (pNode && (pNode->ptr != ptr)) {
+		pPrev = pNode;
+		pNode = pNode->next;
+	}
+	if (pNode == NULL) {
+		return FALSE;
+	}
+	if (pPrev) {
+		pPrev->next = pNode->next;
+	} else {
+		pvmh->allocList = pNode->next;
+	}
+
+	DWORD dwOffset = (DWORD)(ptr - (FLATPTR)pPriv->pBase);
+	ReleaseGranules(pvmh, pPriv, dwOffset / DDHEAP_GRANULE,
+		(dwOffset + pNode->size - 1) / DDHEAP_GRANULE);
+
+	// Insert in address order
+	pPrev = NULL;
+	LPVMEML pNext = (LPVMEML)pvmh->freeList;
+	while (pNext && (pNext->ptr < ptr)) {
+		pPrev = pNext;
+		pNext = pNext->next;
+	}
+
+	// Coalesce with the block before
+	if (pPrev && ((pPrev->ptr + pPrev->size) == ptr)) {
+		pPrev->size += pNode->size;
+		LocalFree(pNode);
+		pNode = pPrev;
+		++pvmh->dwCoalesceCount;
+	} else {
+		pNode->next = pNext;
+		if (pPrev) {
+			pPrev->next = pNode;
+		} else {
+			pvmh->freeList = pNode;
+		}
+	}
+
+	// Coalesce with the block after
+	if (pNext && ((pNode->ptr + pNode->size) == pNext->ptr)) {
+		pNode->size += pNext->size;
+		pNode->next = pNext->next;
+		LocalFree(pNext);
+		++pvmh->dwCoalesceCount;
+	}
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: RefillMagazine()
+// Desc: Move a batch of blocks from the depot into a thread cache, carving
+//       a new slab when the depot runs dry. The lock must be held.
+//-----------------------------------------------------------------------------
+static void RefillMagazine(LPVMEMHEAP pvmh, DDHeapPrivate* pPriv,
+	DDHeapThreadCache* pCache, DWORD dwClass)
+{
+	DWORD dwBlockSize = DDHEAP_SMALL_MINIMUM << dwClass;
+	if (pPriv->DepotCount[dwClass] < DDHEAP_MAGAZINE_BATCH) {
+		FLATPTR fpSlab =
+			AllocBlock(pvmh, pPriv, DDHEAP_GRANULE, DDHEAP_GRANULE);
+		if (fpSlab) {
+			DWORD dwGranule =
+				(DWORD)((fpSlab - (FLATPTR)pPriv->pBase) / DDHEAP_GRANULE);
+			pPriv->pSlabClass[dwGranule] = (BYTE)(dwClass + 1);
+
+			// Push in reverse so blocks come out in address order
+			DWORD dwOffset = DDHEAP_GRANULE;
+			do {
+				dwOffset -= dwBlockSize;
+				DepotPush(pPriv, dwClass, fpSlab + dwOffset);
+			} while (dwOffset);
+		}
+	}
+
+	DWORD dwCount = 0;
+	while (dwCount < DDHEAP_MAGAZINE_BATCH) {
+		FLATPTR ptr = DepotPop(pPriv, dwClass);
+		if (!ptr) {
+			break;
+		}
+		*(FLATPTR*)ptr = pCache->Blocks[dwClass];
+		pCache->Blocks[dwClass] = ptr;
+		++pCache->Counts[dwClass];
+		++dwCount;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: ReleaseIdleSlabs()
+// Desc: Give slabs whose blocks are all in the depot back to the heap, the
+//       lock must be held
+//-----------------------------------------------------------------------------
+static void ReleaseIdleSlabs(LPVMEMHEAP pvmh, DDHeapPrivate* pPriv)
+{
+	// Unlink the blocks of fully free slabs from the depot
+	DWORD dwClass;
+	for (dwClass = 0; dwClass < DDHEAP_SMALL_CLASSES; ++dwClass) {
+		WORD wBlocks =
+			(WORD)(DDHEAP_GRANULE / (DDHEAP_SMALL_MINIMUM << dwClass));
+		FLATPTR* pLink = &pPriv->Depot[dwClass];
+		while (*pLink) {
+			FLATPTR ptr = *pLink;
+			if (pPriv->pSlabFree[(ptr - (FLATPTR)pPriv->pBase) /
+					DDHEAP_GRANULE] == wBlocks) {
+				*pLink = *(FLATPTR*)ptr;
+				--pPriv->DepotCount[dwClass];
+			} else {
+				pLink = (FLATPTR*)ptr;
+			}
+		}
+	}
+
+	// Return those slabs
+	DWORD i;
+	for (i = 0; i < pPriv->dwGranules; ++i) {
+		if (pPriv->pSlabClass[i]) {
+			dwClass = pPriv->pSlabClass[i] - 1U;
+			if (pPriv->pSlabFree[i] ==
+				(DDHEAP_GRANULE / (DDHEAP_SMALL_MINIMUM << dwClass))) {
+				pPriv->pSlabClass[i] = 0;
+				pPriv->pSlabFree[i] = 0;
+				FreeBlock(pvmh, pPriv,
+					(FLATPTR)pPriv->pBase + (i * DDHEAP_GRANULE));
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDHeapAlloc()
+// Desc: Allocate a dwWidth byte wide, dwHeight line tall surface with first
+//       fit. The pitch actually used is returned in lpNewPitch if not NULL.
+//       Returns 0 if the heap is exhausted or memory can't be committed.
+//       Blocks of DDHEAP_SMALL_LIMIT bytes or less come from the calling
+//       thread's magazine without taking the heap lock.
+//-----------------------------------------------------------------------------
+FLATPTR DDHeapAlloc(
+	LPVMEMHEAP pvmh, DWORD dwWidth, DWORD dwHeight, LPLONG lpNewPitch)
+{
+	DDHeapPrivate* pPriv = GetPrivate(pvmh);
+	if ((pPriv == NULL) || (dwWidth == 0) || (dwHeight == 0)) {
+		return 0;
+	}
+
+	LONGLONG iStart = StartTimer();
+	DWORD dwStartAlign;
+	DWORD dwPitchAlign;
+	GetAlignment(pvmh, &dwStartAlign, &dwPitchAlign);
+	FLATPTR uPitch = AlignUp(dwWidth, dwPitchAlign);
+
+	// A surface larger than the whole heap fails below with the others
+	DWORD dwSize = 0;
+	if ((uPitch <= pvmh->dwTotalSize) &&
+		(dwHeight <= (pvmh->dwTotalSize / uPitch))) {
+		dwSize = (DWORD)uPitch * dwHeight;
+		if (lpNewPitch) {
+			*lpNewPitch = (LONG)uPitch;
+		}
+
+		// Small blocks are aligned to their size inside 64K aligned slabs
+		DWORD dwClass = SmallClass(dwSize);
+		if ((dwClass < DDHEAP_SMALL_CLASSES) &&
+			!((DDHEAP_SMALL_MINIMUM << dwClass) % dwStartAlign)) {
+			DDHeapThreadCache* pCache = GetThreadCache(pPriv);
+			if (pCache) {
+				if (!pCache->Counts[dwClass]) {
+					EnterCriticalSection(&pPriv->csLock);
+					RefillMagazine(pvmh, pPriv, pCache, dwClass);
+					LeaveCriticalSection(&pPriv->csLock);
+				}
+				FLATPTR ptr = pCache->Blocks[dwClass];
+				if (ptr) {
+					pCache->Blocks[dwClass] = *(FLATPTR*)ptr;
+					--pCache->Counts[dwClass];
+					MarkBlock(pPriv, ptr, TRUE);
+					RecordLatency(pPriv, pCache->AllocLatency, iStart);
+					InterlockedIncrement(&pCache->lAllocCount);
+					return ptr;
+				}
+			}
+		}
+	}
+
+	EnterCriticalSection(&pPriv->csLock);
+	FLATPTR fpResult = 0;
+	if (dwSize) {
+		fpResult = AllocBlock(pvmh, pPriv, dwSize, dwStartAlign);
+	}
+	RecordLatency(pPriv, pPriv->AllocLatency, iStart);
+	if (fpResult) {
+		++pPriv->dwAllocCount;
+	} else {
+		++pPriv->dwFailCount;
+	}
+	LeaveCriticalSection(&pPriv->csLock);
+	return fpResult;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDHeapFree()
+// Desc: Return a block to the heap, merging it with its free neighbors and
+//       decommitting any granule that no longer holds an allocation
+//-----------------------------------------------------------------------------
+void DDHeapFree(LPVMEMHEAP pvmh, FLATPTR ptr)
+{
+	DDHeapPrivate* pPriv = GetPrivate(pvmh);
+	if ((pPriv == NULL) || (ptr == 0)) {
+		return;
+	}
+
+	FLATPTR fpBase = (FLATPTR)pPriv->pBase;
+	if ((ptr < fpBase) || (ptr >= (fpBase + pvmh->dwTotalSize))) {
+#ifdef _DEBUG
+		OutputDebugStringA("DDHeapFree: pointer is outside the heap\n");
+#endif
+		return;
+	}
+
+	LONGLONG iStart = StartTimer();
+	BYTE bSlabClass = pPriv->pSlabClass[(ptr - fpBase) / DDHEAP_GRANULE];
+	if (bSlabClass) {
+		// Small block, ignore it like FreeBlock() does if it isn't the start
+		// of a block or the block isn't handed out
+		DWORD dwClass = bSlabClass - 1U;
+		if (((ptr - fpBase) % (DDHEAP_SMALL_MINIMUM << dwClass)) ||
+			!MarkBlock(pPriv, ptr, FALSE)) {
+#ifdef _DEBUG
+			OutputDebugStringA("DDHeapFree: small block is not allocated\n");
+#endif
+			return;
+		}
+
+		// Keep it in this thread's magazine
+		DDHeapThreadCache* pCache = GetThreadCache(pPriv);
+		if (pCache) {
+			*(FLATPTR*)ptr = pCache->Blocks[dwClass];
+			pCache->Blocks[dwClass] = ptr;
+			if (++pCache->Counts[dwClass] > DDHEAP_MAGAZINE_SIZE) {
+				EnterCriticalSection(&pPriv->csLock);
+				FlushMagazine(pPriv, pCache, dwClass,
+					DDHEAP_MAGAZINE_SIZE - DDHEAP_MAGAZINE_BATCH);
+				LeaveCriticalSection(&pPriv->csLock);
+			}
+			RecordLatency(pPriv, pCache->FreeLatency, iStart);
+			InterlockedIncrement(&pCache->lFreeCount);
+		} else {
+			EnterCriticalSection(&pPriv->csLock);
+			DepotPush(pPriv, dwClass, ptr);
+			RecordLatency(pPriv, pPriv->FreeLatency, iStart);
+			++pPriv->dwFreeCount;
+			LeaveCriticalSection(&pPriv->csLock);
+		}
+		return;
+	}
+
+	EnterCriticalSection(&pPriv->csLock);
+	BOOL bFreed = FreeBlock(pvmh, pPriv, ptr);
+	if (bFreed) {
+		RecordLatency(pPriv, pPriv->FreeLatency, iStart);
+		++pPriv->dwFreeCount;
+	}
+	LeaveCriticalSection(&pPriv->csLock);
+#ifdef _DEBUG
+	if (!bFreed) {
+		OutputDebugStringA("DDHeapFree: block is not allocated\n");
+	}
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDHeapFlushThreadCache()
+// Desc: Return every block cached by the calling thread to the shared depot.
+//       Threads should call this before exiting so their blocks can be
+//       reused or trimmed.
+//-----------------------------------------------------------------------------
+void DDHeapFlushThreadCache(LPVMEMHEAP pvmh)
+{
+	DDHeapPrivate* pPriv = GetPrivate(pvmh);
+	if (pPriv == NULL) {
+		return;
+	}
+	DDHeapThreadCache* pCache =
+		(DDHeapThreadCache*)TlsGetValue(pPriv->dwTlsIndex);
+	if (pCache) {
+		EnterCriticalSection(&pPriv->csLock);
+		DWORD dwClass;
+		for (dwClass = 0; dwClass < DDHEAP_SMALL_CLASSES; ++dwClass) {
+			FlushMagazine(pPriv, pCache, dwClass, 0);
+		}
+		LeaveCriticalSection(&pPriv->csLock);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDHeapTrim()
+// Desc: Flush the calling thread's cache, hand fully free slabs back to the
+//       heap and decommit every idle granule regardless of the retain size.
+//       Returns the number of bytes given back to the system.
+//-----------------------------------------------------------------------------
+DWORD DDHeapTrim(LPVMEMHEAP pvmh)
+{
+	DDHeapPrivate* pPriv = GetPrivate(pvmh);
+	if (pPriv == NULL) {
+		return 0;
+	}
+
+	DDHeapFlushThreadCache(pvmh);
+	EnterCriticalSection(&pPriv->csLock);
+	ReleaseIdleSlabs(pvmh, pPriv);
+
+	DWORD dwReleased = 0;
+	DWORD i;
+	for (i = 0; i < pPriv->dwGranules; ++i) {
+		if (!pPriv->pGranuleUse[i] &&
+			(pPriv->pCommitMask[i >> 3] & (1U << (i & 7)))) {
+			DecommitGranule(pvmh, pPriv, i);
+			dwReleased += DDHEAP_GRANULE;
+		}
+	}
+	pPriv->dwIdleSize = 0;
+	LeaveCriticalSection(&pPriv->csLock);
+	return dwReleased;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDHeapGetStats()
+// Desc: Fill in a snapshot of the heap's usage, fragmentation and timing.
+//       pStats->dwSize must be set to sizeof(DDHEAPSTATS).
+//-----------------------------------------------------------------------------
+HRESULT DDHeapGetStats(LPVMEMHEAP pvmh, LPDDHEAPSTATS pStats)
+{
+	DDHeapPrivate* pPriv = GetPrivate(pvmh);
+	if ((pPriv == NULL) || (pStats == NULL) ||
+		(pStats->dwSize != sizeof(DDHEAPSTATS))) {
+		return DDERR_INVALIDPARAMS;
+	}
+
+	ZeroMemory(pStats, sizeof(DDHEAPSTATS));
+	pStats->dwSize = sizeof(DDHEAPSTATS);
+	EnterCriticalSection(&pPriv->csLock);
+	pStats->dwTotalSize = pvmh->dwTotalSize;
+	pStats->dwCommitedSize = pvmh->dwCommitedSize;
+	pStats->dwCoalesceCount = pvmh->dwCoalesceCount;
+
+	LPVMEML pNode = (LPVMEML)pvmh->freeList;
+	while (pNode) {
+		pStats->dwFreeSize += pNode->size;
+		if (pNode->size > pStats->dwLargestFree) {
+			pStats->dwLargestFree = pNode->size;
+		}
+		++pStats->dwFreeHistogram[HighBit(pNode->size)];
+		++pStats->dwFreeBlocks;
+		pNode = pNode->next;
+	}
+	if (pStats->dwFreeSize) {
+		pStats->dwFragmentation = 1000 -
+			(DWORD)(((LONGLONG)pStats->dwLargestFree * 1000) /
+				pStats->dwFreeSize);
+	}
+	pNode = (LPVMEML)pvmh->allocList;
+	while (pNode) {
+		++pStats->dwAllocBlocks;
+		pNode = pNode->next;
+	}
+
+	// Slabs are on the allocation list as one block each, count the small
+	// blocks handed out of them instead and the rest as free
+	DWORD dwWords = (DDHEAP_GRANULE / DDHEAP_SMALL_MINIMUM) / 32;
+	DWORD i;
+	for (i = 0; i < pPriv->dwGranules; ++i) {
+		if (pPriv->pSlabClass[i]) {
+			const LONG* pUsed = pPriv->pBlockUsed + (i * dwWords);
+			DWORD dwUsed = 0;
+			DWORD j;
+			for (j = 0; j < dwWords; ++j) {
+				dwUsed += CountBits((DWORD)pUsed[j]);
+			}
+			DWORD dwBlockSize = DDHEAP_SMALL_MINIMUM
+				<< (pPriv->pSlabClass[i] - 1U);
+			pStats->dwAllocBlocks += dwUsed - 1;
+			pStats->dwFreeSize += DDHEAP_GRANULE - (dwUsed * dwBlockSize);
+		}
+	}
+
+	pStats->dwAllocCount = pPriv->dwAllocCount;
+	pStats->dwFailCount = pPriv->dwFailCount;
+	pStats->dwFreeCount = pPriv->dwFreeCount;
+
+	// Merge in the thread caches, their counters are read without their
+	// owners' cooperation so they may be slightly stale
+	DWORD AllocLatency[DDHEAP_LATENCY_BUCKETS];
+	DWORD FreeLatency[DDHEAP_LATENCY_BUCKETS];
+	for (i = 0; i < DDHEAP_LATENCY_BUCKETS; ++i) {
+		AllocLatency[i] = (DWORD)pPriv->AllocLatency[i];
+		FreeLatency[i] = (DWORD)pPriv->FreeLatency[i];
+	}
+	DWORD dwClass;
+	for (dwClass = 0; dwClass < DDHEAP_SMALL_CLASSES; ++dwClass) {
+		pStats->dwCachedSize +=
+			pPriv->DepotCount[dwClass] * (DDHEAP_SMALL_MINIMUM << dwClass);
+	}
+	const DDHeapThreadCache* pCache = pPriv->pCaches;
+	while (pCache) {
+		pStats->dwAllocCount += (DWORD)pCache->lAllocCount;
+		pStats->dwFreeCount += (DWORD)pCache->lFreeCount;
+		for (dwClass = 0; dwClass < DDHEAP_SMALL_CLASSES; ++dwClass) {
+			pStats->dwCachedSize +=
+				pCache->Counts[dwClass] * (DDHEAP_SMALL_MINIMUM << dwClass);
+		}
+		for (i = 0; i < DDHEAP_LATENCY_BUCKETS; ++i) {
+			AllocLatency[i] += (DWORD)pCache->AllocLatency[i];
+			FreeLatency[i] += (DWORD)pCache->FreeLatency[i];
+		}
+		pCache = pCache->pNext;
+	}
+	LeaveCriticalSection(&pPriv->csLock);
+
+	pStats->dwAllocP50 = Percentile(AllocLatency, 5000);
+	pStats->dwAllocP99 = Percentile(AllocLatency, 9900);
+	pStats->dwAllocP999 = Percentile(AllocLatency, 9990);
+	pStats->dwFreeP50 = Percentile(FreeLatency, 5000);
+	pStats->dwFreeP99 = Percentile(FreeLatency, 9900);
+	pStats->dwFreeP999 = Percentile(FreeLatency, 9990);
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDHeapResetStats()
+// Desc: Clear the operation counters and latency histograms. The thread
+//       caches' counters are cleared with InterlockedExchange() since their
+//       owners keep updating them without the lock.
+//-----------------------------------------------------------------------------
+void DDHeapResetStats(LPVMEMHEAP pvmh)
+{
+	DDHeapPrivate* pPriv = GetPrivate(pvmh);
+	if (pPriv) {
+		EnterCriticalSection(&pPriv->csLock);
+		pPriv->dwAllocCount = 0;
+		pPriv->dwFailCount = 0;
+		pPriv->dwFreeCount = 0;
+		ZeroMemory(pPriv->AllocLatency, sizeof(pPriv->AllocLatency));
+		ZeroMemory(pPriv->FreeLatency, sizeof(pPriv->FreeLatency));
+		DDHeapThreadCache* pCache = pPriv->pCaches;
+		while (pCache) {
+			InterlockedExchange(&pCache->lAllocCount, 0);
+			InterlockedExchange(&pCache->lFreeCount, 0);
+			DWORD i;
+			for (i = 0; i < DDHEAP_LATENCY_BUCKETS; ++i) {
+				InterlockedExchange(&pCache->AllocLatency[i], 0);
+				InterlockedExchange(&pCache->FreeLatency[i], 0);
+			}
+			pCache = pCache->pNext;
+		}
+		LeaveCriticalSection(&pPriv->csLock);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// JSON output buffer, counts the full length even when it doesn't fit
+//-----------------------------------------------------------------------------
+struct JSONOutput {
+	LPSTR pBuffer; // Output buffer, can be NULL
+	DWORD dwSize;  // Size of the output buffer
+	DWORD dwUsed;  // Characters generated, without the terminating zero
+};
+
+//-----------------------------------------------------------------------------
+// Name: JSONPrint()
+// Desc: Append formatted text to the JSON output
+//-----------------------------------------------------------------------------
+static void JSONPrint(JSONOutput* pOutput, const char* pFormat, ...)
+{
+	char szText[128];
+	va_list Args;
+	va_start(Args, pFormat);
+	_vsnprintf(szText, sizeof(szText), pFormat, Args);
+	va_end(Args);
+	// _vsnprintf() doesn't terminate text that was cut short
+	szText[sizeof(szText) - 1] = 0;
+
+	const char* pText = szText;
+	while (*pText) {
+		if (pOutput->pBuffer && ((pOutput->dwUsed + 1) < pOutput->dwSize)) {
+			pOutput->pBuffer[pOutput->dwUsed] = *pText;
+		}
+		++pOutput->dwUsed;
+		++pText;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDHeapDumpJSON()
+// Desc: Write the heap statistics as a JSON object. On entry
+//       *lpdwBufferSize is the size of pBuffer, on exit it's the size
+//       needed including the terminating zero. Returns DDERR_MOREDATA if
+//       pBuffer is NULL or too small.
+//-----------------------------------------------------------------------------
+HRESULT DDHeapDumpJSON(LPVMEMHEAP pvmh, LPSTR pBuffer, LPDWORD lpdwBufferSize)
+{
+	if (lpdwBufferSize == NULL) {
+		return DDERR_INVALIDPARAMS;
+	}
+
+	DDHEAPSTATS Stats;
+	Stats.dwSize = sizeof(Stats);
+	HRESULT hr = DDHeapGetStats(pvmh, &Stats);
+	if (FAILED(hr)) {
+		return hr;
+	}
+
+	JSONOutput Output;
+	Output.pBuffer = pBuffer;
+	Output.dwSize = pBuffer ? *lpdwBufferSize : 0;
+	Output.dwUsed = 0;
+
+	JSONPrint(&Output, "{\"total\":%lu,\"free\":%lu,\"committed\":%lu,",
+		Stats.dwTotalSize, Stats.dwFreeSize, Stats.dwCommitedSize);
+	JSONPrint(&Output, "\"largest_free\":%lu,\"fragmentation\":%lu.%03lu,",
+		Stats.dwLargestFree, Stats.dwFragmentation / 1000,
+		Stats.dwFragmentation % 1000);
+	JSONPrint(&Output,
+		"\"free_blocks\":%lu,\"alloc_blocks\":%lu,\"coalesce\":%lu,",
+		Stats.dwFreeBlocks, Stats.dwAllocBlocks, Stats.dwCoalesceCount);
+	JSONPrint(&Output,
+		"\"allocs\":%lu,\"failures\":%lu,\"frees\":%lu,\"cached\":%lu,",
+		Stats.dwAllocCount, Stats.dwFailCount, Stats.dwFreeCount,
+		Stats.dwCachedSize);
+	JSONPrint(&Output,
+		"\"alloc_ns\":{\"p50\":%lu,\"p99\":%lu,\"p999\":%lu},",
+		Stats.dwAllocP50, Stats.dwAllocP99, Stats.dwAllocP999);
+	JSONPrint(&Output,
+		"\"free_ns\":{\"p50\":%lu,\"p99\":%lu,\"p999\":%lu},",
+		Stats.dwFreeP50, Stats.dwFreeP99, Stats.dwFreeP999);
+
+	// Histogram as {"<bucket floor>":count}, empty buckets are skipped
+	JSONPrint(&Output, "\"free_histogram\":{");
+	const char* pSeparator = "";
+	DWORD i;
+	for (i = 0; i < DDHEAP_SIZE_BUCKETS; ++i) {
+		if (Stats.dwFreeHistogram[i]) {
+			JSONPrint(&Output, "%s\"%lu\":%lu", pSeparator, 1UL << i,
+				Stats.dwFreeHistogram[i]);
+			pSeparator = ",";
+		}
+	}
+	JSONPrint(&Output, "}}");
+
+	DWORD dwNeeded = Output.dwUsed + 1;
+	if (pBuffer && *lpdwBufferSize) {
+		pBuffer[(dwNeeded <= *lpdwBufferSize) ? Output.dwUsed
+											  : (*lpdwBufferSize - 1)] = 0;
+	}
+	hr = ((pBuffer == NULL) || (dwNeeded > *lpdwBufferSize)) ? DDERR_MOREDATA
+															 : DD_OK;
+	*lpdwBufferSize = dwNeeded;
+	return hr;
+}
@@ -0,0 +1,119 @@
+/***************************************
+
+	Reserve then commit surface heap
+
+	Manages a large linear system memory heap described by a VMEMHEAP. The
+	whole address range is reserved up front and 64K granules are committed
+	only when a surface first lands in them, the same model DirectDraw uses
+	for nonlocal (AGP) heaps with fpGARTLin, dwCommitedSize and
+	pAgpCommitMask.
+
+	All functions are thread safe. Blocks up to DDHEAP_SMALL_LIMIT bytes are
+	served from per thread magazines so sprite and glyph sized surfaces
+	don't contend on the heap lock.
+
+***************************************/
+
+#ifndef __DDHEAP_H__
+#define __DDHEAP_H__
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include <ddraw.h>
+
+#include <dmemmgr.h>
+
+/***************************************
+
+	Size of a commit granule, one bit in pAgpCommitMask
+
+***************************************/
+
+#define DDHEAP_GRANULE 0x10000UL
+
+/***************************************
+
+	Default number of idle committed bytes kept before decommitting
+
+***************************************/
+
+#define DDHEAP_DEFAULT_RETAIN (DDHEAP_GRANULE * 16)
+
+/***************************************
+
+	Largest block served from the per thread magazines
+
+***************************************/
+
+#define DDHEAP_SMALL_LIMIT 16384
+
+/***************************************
+
+	Number of log2 buckets in the free block histogram
+
+***************************************/
+
+#define DDHEAP_SIZE_BUCKETS 32
+
+/***************************************
+
+	Snapshot of a heap's state, filled in by DDHeapGetStats()
+
+	Latencies are in nanoseconds and accurate to within 25%. The
+	fragmentation index is 1 - (largest free / total free) in 1/1000ths
+	over the free list, 0 when all free memory is one block. Small blocks
+	count one each in dwAllocBlocks and the ones not handed out count in
+	dwFreeSize.
+
+***************************************/
+
+typedef struct _DDHEAPSTATS {
+	DWORD dwSize;          // Size of this structure
+	DWORD dwTotalSize;     // Bytes reserved
+	DWORD dwFreeSize;      // Bytes not allocated
+	DWORD dwCommitedSize;  // Bytes backed by memory
+	DWORD dwLargestFree;   // Largest free block in bytes
+	DWORD dwFreeBlocks;    // Number of free blocks
+	DWORD dwAllocBlocks;   // Number of live allocations
+	DWORD dwFragmentation; // Fragmentation index in 1/1000ths
+	DWORD dwCoalesceCount; // Free block merges
+	DWORD dwAllocCount;    // Successful allocations
+	DWORD dwFailCount;     // Failed allocations
+	DWORD dwFreeCount;     // Frees
+	DWORD dwCachedSize;    // Free small block bytes held in magazines
+	DWORD dwAllocP50;      // Median allocation latency
+	DWORD dwAllocP99;      // 99th percentile allocation latency
+	DWORD dwAllocP999;     // 99.9th percentile allocation latency
+	DWORD dwFreeP50;       // Median free latency
+	DWORD dwFreeP99;       // 99th percentile free latency
+	DWORD dwFreeP999;      // 99.9th percentile free latency
+	DWORD dwFreeHistogram[DDHEAP_SIZE_BUCKETS]; // Free blocks by log2 size
+} DDHEAPSTATS, *LPDDHEAPSTATS;
+
+/* Assume C declarations for C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern HRESULT DDHeapCreate(
+	LPVMEMHEAP pvmh, DWORD dwReserveSize, DWORD dwRetainSize);
+extern void DDHeapDestroy(LPVMEMHEAP pvmh);
+extern FLATPTR DDHeapAlloc(
+	LPVMEMHEAP pvmh, DWORD dwWidth, DWORD dwHeight, LPLONG lpNewPitch);
+extern void DDHeapFree(LPVMEMHEAP pvmh, FLATPTR ptr);
+extern DWORD DDHeapTrim(LPVMEMHEAP pvmh);
+extern void DDHeapFlushThreadCache(LPVMEMHEAP pvmh);
+extern HRESULT DDHeapGetStats(LPVMEMHEAP pvmh, LPDDHEAPSTATS pStats);
+extern void DDHeapResetStats(LPVMEMHEAP pvmh);
+extern HRESULT DDHeapDumpJSON(
+	LPVMEMHEAP pvmh, LPSTR pBuffer, LPDWORD lpdwBufferSize);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -0,0 +1,349 @@
+//-----------------------------------------------------------------------------
+// File: ddpool.cpp
+//
+// Desc: Pool of reusable DirectDraw surfaces.
+//
+//       Each surface created by the pool carries its pool key as private
+//       data, so DDPoolRelease() can file it without the caller repeating
+//       the description. Idle surfaces live in a small hash table for
+//       lookup and in a least recently used list for eviction.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include "ddpool.h"
+#include <stddef.h>
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// Number of hash buckets for idle surfaces, must be a power of two
+//-----------------------------------------------------------------------------
+#define DDPOOL_BUCKETS 64
+
+//-----------------------------------------------------------------------------
+// GUID of the private data holding a surface's DDPoolKey
+// {680892F9-5874-4328-9249-F70C58D06002}
+//-----------------------------------------------------------------------------
+static const GUID s_guidPoolKey = {0x680892f9, 0x5874, 0x4328,
+	{0x92, 0x49, 0xf7, 0x0c, 0x58, 0xd0, 0x60, 0x02}};
+
+//-----------------------------------------------------------------------------
+// What a surface was created with, surfaces are only reused for identical
+// requests. Always zero filled so it can be compared with memcmp().
+//-----------------------------------------------------------------------------
+struct DDPoolKey {
+	DWORD dwWidth;      // Requested width
+	DWORD dwHeight;     // Requested height
+	DWORD dwCaps;       // Requested ddsCaps.dwCaps
+	DWORD dwCaps2;      // Requested ddsCaps.dwCaps2
+	DWORD dwHasFormat;  // TRUE if a pixel format was requested
+	DDPIXELFORMAT ddpf; // Requested pixel format
+	DWORD dwBytes;      // Memory used by the surface, not part of the match
+};
+
+//-----------------------------------------------------------------------------
+// An idle surface
+//-----------------------------------------------------------------------------
+struct DDPoolEntry {
+	DDPoolEntry* pBucketNext; // Next entry in the same hash bucket
+	DDPoolEntry* pLRUPrev;    // More recently released entry
+	DDPoolEntry* pLRUNext;    // Less recently released entry
+	IDirectDrawSurface7* pdds; // The idle surface, holds one reference
+	DDPoolKey Key;             // What it was created with
+	DWORD dwHash;              // Bucket it is filed under
+};
+
+//-----------------------------------------------------------------------------
+// The pool itself
+//-----------------------------------------------------------------------------
+struct DDSurfacePool {
+	IDirectDraw7* pdd;       // Device all surfaces belong to
+	DDPoolEntry* pLRUFirst;  // Most recently released
+	DDPoolEntry* pLRULast;   // Next to be evicted
+	DDPoolEntry* Buckets[DDPOOL_BUCKETS];
+	DDPOOLSTATS Stats;
+};
+
+//-----------------------------------------------------------------------------
+// Name: MakeKey()
+// Desc: Build the pool key for a surface description
+//-----------------------------------------------------------------------------
+static void MakeKey(const DDSURFACEDESC2* pddsd, DDPoolKey* pKey)
+{
+	ZeroMemory(pKey, sizeof(DDPoolKey));
+	if (pddsd->dwFlags & DDSD_WIDTH) {
+		pKey->dwWidth = pddsd->dwWidth;
+	}
+	if (pddsd->dwFlags & DDSD_HEIGHT) {
+		pKey->dwHeight = pddsd->dwHeight;
+	}
+	if (pddsd->dwFlags & DDSD_CAPS) {
+		pKey->dwCaps = pddsd->ddsCaps.dwCaps;
+		pKey->dwCaps2 = pddsd->ddsCaps.dwCaps2;
+	}
+	if (pddsd->dwFlags & DDSD_PIXELFORMAT) {
+		pKey->dwHasFormat = TRUE;
+		pKey->ddpf = pddsd->ddpfPixelFormat;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: HashKey()
+// Desc: Hash the matching part of a key into a bucket index
+//-----------------------------------------------------------------------------
+static DWORD HashKey(const DDPoolKey* pKey)
+{
+	DWORD dwHash = pKey->dwWidth;
+	dwHash = (dwHash * 31) + pKey->dwHeight;
+	dwHash = (dwHash * 31) + pKey->dwCaps;
+	dwHash = (dwHash * 31) + pKey->dwCaps2;
+	dwHash = (dwHash * 31) + pKey->ddpf.dwFlags;
+	dwHash = (dwHash * 31) + pKey->ddpf.dwFourCC;
+	dwHash = (dwHash * 31) + pKey->ddpf.dwRGBBitCount;
+	dwHash ^= dwHash >> 16;
+	return dwHash & (DDPOOL_BUCKETS - 1);
+}
+
+//-----------------------------------------------------------------------------
+// Name: SameKey()
+// Desc: TRUE if two keys describe the same kind of surface
+//-----------------------------------------------------------------------------
+static BOOL SameKey(const DDPoolKey* pKey1, const DDPoolKey* pKey2)
+{
+	return !memcmp(pKey1, pKey2, offsetof(DDPoolKey, dwBytes));
+}
+
+//-----------------------------------------------------------------------------
+// Name: Unlink()
+// Desc: Remove an entry from its hash bucket and the LRU list
+//-----------------------------------------------------------------------------
+static void Unlink(DDSurfacePool* pPool, DDPoolEntry* pEntry)
+{
+	DDPoolEntry** ppLink = &pPool->Buckets[pEntry->dwHash];
+	while (*ppLink != pEntry) {
+		ppLink = &(*ppLink)->pBucketNext;
+	}
+	*ppLink = pEntry->pBucketNext;
+
+	if (pEntry->pLRUPrev) {
+		pEntry->pLRUPrev->pLRUNext = pEntry->pLRUNext;
+	} else {
+		pPool->pLRUFirst = pEntry->pLRUNext;
+	}
+	if (pEntry->pLRUNext) {
+		pEntry->pLRUNext->pLRUPrev = pEntry->pLRUPrev;
+	} else {
+		pPool->pLRULast = pEntry->pLRUPrev;
+	}
+
+	--pPool->Stats.dwIdleSurfaces;
+	pPool->Stats.dwIdleBytes -= pEntry->Key.dwBytes;
+}
+
+//-----------------------------------------------------------------------------
+// Name: Evict()
+// Desc: Drop the least recently released surfaces until the idle memory is
+//       no more than dwMaxIdleBytes
+//-----------------------------------------------------------------------------
+static void Evict(DDSurfacePool* pPool, DWORD dwMaxIdleBytes)
+{
+	while (pPool->pLRULast && (pPool->Stats.dwIdleBytes > dwMaxIdleBytes)) {
+		DDPoolEntry* pEntry = pPool->pLRULast;
+		Unlink(pPool, pEntry);
+		pEntry->pdds->Release();
+		delete pEntry;
+		++pPool->Stats.dwEvictions;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDPoolCreate()
+// Desc: Create an empty pool for surfaces of a DirectDraw object. At most
+//       dwMaxIdleBytes of surface memory is kept around for reuse.
+//-----------------------------------------------------------------------------
+HRESULT DDPoolCreate(
+	IDirectDraw7* pdd, DWORD dwMaxIdleBytes, DDSurfacePool** ppPool)
+{
+	if ((pdd == NULL) || (ppPool == NULL)) {
+		return DDERR_INVALIDPARAMS;
+	}
+
+	DDSurfacePool* pPool = new DDSurfacePool;
+	if (pPool == NULL) {
+		*ppPool = NULL;
+		return DDERR_OUTOFMEMORY;
+	}
+	ZeroMemory(pPool, sizeof(DDSurfacePool));
+	pPool->pdd = pdd;
+	pdd->AddRef();
+	pPool->Stats.dwSize = sizeof(DDPOOLSTATS);
+	pPool->Stats.dwMaxIdleBytes = dwMaxIdleBytes;
+	*ppPool = pPool;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDPoolDestroy()
+// Desc: Release every idle surface and the pool. Surfaces still acquired
+//       stay valid and can be released normally.
+//-----------------------------------------------------------------------------
+void DDPoolDestroy(DDSurfacePool* pPool)
+{
+	if (pPool) {
+		DDPoolPurge(pPool);
+		pPool->pdd->Release();
+		delete pPool;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDPoolAcquire()
+// Desc: Return a surface matching the description, reusing an idle one when
+//       possible. The contents of a reused surface are undefined. Lost
+//       surfaces are restored before they're handed out.
+//-----------------------------------------------------------------------------
+HRESULT DDPoolAcquire(
+	DDSurfacePool* pPool, LPDDSURFACEDESC2 pddsd, IDirectDrawSurface7** ppdds)
+{
+	if ((pPool == NULL) || (pddsd == NULL) || (ppdds == NULL)) {
+		return DDERR_INVALIDPARAMS;
+	}
+	*ppdds = NULL;
+	++pPool->Stats.dwAcquires;
+
+	DDPoolKey Key;
+	MakeKey(pddsd, &Key);
+	DWORD dwHash = HashKey(&Key);
+
+	DDPoolEntry* pEntry = pPool->Buckets[dwHash];
+	while (pEntry) {
+		DDPoolEntry* pNext = pEntry->pBucketNext;
+		if (SameKey(&pEntry->Key, &Key)) {
+			Unlink(pPool, pEntry);
+			IDirectDrawSurface7* pdds = pEntry->pdds;
+			delete pEntry;
+			if (pdds->IsLost() == DDERR_SURFACELOST) {
+				if (FAILED(pdds->Restore())) {
+					// Can't be salvaged, try the next one
+					pdds->Release();
+					pEntry = pNext;
+					continue;
+				}
+				++pPool->Stats.dwRestores;
+			}
+			++pPool->Stats.dwHits;
+			*ppdds = pdds;
+			return DD_OK;
+		}
+		pEntry = pNext;
+	}
+
+	// Nothing to reuse, make a new one
+	IDirectDrawSurface7* pdds;
+	HRESULT hr = pPool->pdd->CreateSurface(pddsd, &pdds, NULL);
+	if (FAILED(hr)) {
+		return hr;
+	}
+	++pPool->Stats.dwCreates;
+
+	DDSURFACEDESC2 ddsd;
+	ZeroMemory(&ddsd, sizeof(ddsd));
+	ddsd.dwSize = sizeof(ddsd);
+	if (SUCCEEDED(pdds->GetSurfaceDesc(&ddsd))) {
+		if (ddsd.dwFlags & DDSD_LINEARSIZE) {
+			Key.dwBytes = ddsd.dwLinearSize;
+		} else {
+			Key.dwBytes = (DWORD)ddsd.lPitch * ddsd.dwHeight;
+		}
+	}
+	pdds->SetPrivateData(s_guidPoolKey, &Key, sizeof(Key), 0);
+	*ppdds = pdds;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDPoolRelease()
+// Desc: Hand a surface from DDPoolAcquire() back for reuse. Surfaces that
+//       weren't made by the pool are simply released. Don't pass surfaces
+//       that were pointed at application memory with SetSurfaceDesc().
+//-----------------------------------------------------------------------------
+void DDPoolRelease(DDSurfacePool* pPool, IDirectDrawSurface7* pdds)
+{
+	if (pdds == NULL) {
+		return;
+	}
+	if (pPool == NULL) {
+		pdds->Release();
+		return;
+	}
+
+	DDPoolKey Key;
+	DWORD dwSize = sizeof(Key);
+	DDPoolEntry* pEntry = NULL;
+	if (SUCCEEDED(pdds->GetPrivateData(s_guidPoolKey, &Key, &dwSize)) &&
+		(dwSize == sizeof(Key)) &&
+		(Key.dwBytes <= pPool->Stats.dwMaxIdleBytes)) {
+		pEntry = new DDPoolEntry;
+	}
+	if (pEntry == NULL) {
+		pdds->Release();
+		return;
+	}
+
+	pEntry->pdds = pdds;
+	pEntry->Key = Key;
+	pEntry->dwHash = HashKey(&Key);
+	pEntry->pBucketNext = pPool->Buckets[pEntry->dwHash];
+	pPool->Buckets[pEntry->dwHash] = pEntry;
+	pEntry->pLRUPrev = NULL;
+	pEntry->pLRUNext = pPool->pLRUFirst;
+	if (pPool->pLRUFirst) {
+		pPool->pLRUFirst->pLRUPrev = pEntry;
+	} else {
+		pPool->pLRULast = pEntry;
+	}
+	pPool->pLRUFirst = pEntry;
+
+	++pPool->Stats.dwReleases;
+	++pPool->Stats.dwIdleSurfaces;
+	pPool->Stats.dwIdleBytes += Key.dwBytes;
+	Evict(pPool, pPool->Stats.dwMaxIdleBytes);
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDPoolPurge()
+// Desc: Release every idle surface, for example after a display mode change
+//       made their pixel formats stale
+//-----------------------------------------------------------------------------
+void DDPoolPurge(DDSurfacePool* pPool)
+{
+	if (pPool) {
+		DWORD dwEvictions = pPool->Stats.dwEvictions;
+		Evict(pPool, 0);
+		pPool->Stats.dwEvictions = dwEvictions;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDPoolGetStats()
+// Desc: Copy out the pool counters. pStats->dwSize must be set to
+//       sizeof(DDPOOLSTATS).
+//-----------------------------------------------------------------------------
+HRESULT DDPoolGetStats(DDSurfacePool* pPool, LPDDPOOLSTATS pStats)
+{
+	if ((pPool == NULL) || (pStats == NULL) ||
+		(pStats->dwSize != sizeof(DDPOOLSTATS))) {
+		return DDERR_INVALIDPARAMS;
+	}
+	*pStats = pPool->Stats;
+	if (pStats->dwAcquires) {
+		pStats->dwReuseRate = (DWORD)(
+			((LONGLONG)pStats->dwHits * 1000) / pStats->dwAcquires);
+	}
+	return DD_OK;
+}
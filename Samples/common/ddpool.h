@@ -0,0 +1,72 @@
+/***************************************
+
+	Pool of reusable DirectDraw surfaces
+
+	Surfaces handed back with DDPoolRelease() are kept per IDirectDraw7 and
+	given out again by DDPoolAcquire() when a request with the same width,
+	height, pixel format and caps comes in, so transient offscreen surfaces
+	don't pay for CreateSurface() and Release() every time. Idle surfaces
+	are evicted least recently used first once they exceed the byte cap.
+
+***************************************/
+
+#ifndef __DDPOOL_H__
+#define __DDPOOL_H__
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include <ddraw.h>
+
+/***************************************
+
+	Opaque pool object
+
+***************************************/
+
+typedef struct DDSurfacePool DDSurfacePool;
+
+/***************************************
+
+	Pool counters, filled in by DDPoolGetStats()
+
+	The reuse rate is hits / acquires in 1/1000ths.
+
+***************************************/
+
+typedef struct _DDPOOLSTATS {
+	DWORD dwSize;          // Size of this structure
+	DWORD dwAcquires;      // Calls to DDPoolAcquire()
+	DWORD dwHits;          // Acquires served from the pool
+	DWORD dwCreates;       // Acquires that called CreateSurface()
+	DWORD dwRestores;      // Pooled surfaces restored after a loss
+	DWORD dwReleases;      // Surfaces handed back to the pool
+	DWORD dwEvictions;     // Idle surfaces dropped to stay under the cap
+	DWORD dwIdleSurfaces;  // Surfaces waiting in the pool
+	DWORD dwIdleBytes;     // Memory held by those surfaces
+	DWORD dwMaxIdleBytes;  // Cap on dwIdleBytes
+	DWORD dwReuseRate;     // Hit rate in 1/1000ths
+} DDPOOLSTATS, *LPDDPOOLSTATS;
+
+/* Assume C declarations for C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern HRESULT DDPoolCreate(
+	IDirectDraw7* pdd, DWORD dwMaxIdleBytes, DDSurfacePool** ppPool);
+extern void DDPoolDestroy(DDSurfacePool* pPool);
+extern HRESULT DDPoolAcquire(DDSurfacePool* pPool, LPDDSURFACEDESC2 pddsd,
+	IDirectDrawSurface7** ppdds);
+extern void DDPoolRelease(DDSurfacePool* pPool, IDirectDrawSurface7* pdds);
+extern void DDPoolPurge(DDSurfacePool* pPool);
+extern HRESULT DDPoolGetStats(DDSurfacePool* pPool, LPDDPOOLSTATS pStats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
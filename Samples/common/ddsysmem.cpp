@@ -0,0 +1,476 @@
+//-----------------------------------------------------------------------------
+// File: ddsysmem.cpp
+//
+// Desc: System memory surfaces with controlled backing.
+//
+//       The pixels are allocated with VirtualAlloc() and handed to
+//       CreateSurface() with DDSD_LPSURFACE. A small COM object that owns
+//       the allocation is attached to the surface as IUnknown private data,
+//       so DirectDraw frees the memory when the surface itself goes away.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include "ddsysmem.h"
+
+//-----------------------------------------------------------------------------
+// Older SDKs predate large pages
+//-----------------------------------------------------------------------------
+#ifndef MEM_LARGE_PAGES
+#define MEM_LARGE_PAGES 0x20000000
+#endif
+
+#ifndef ERROR_WORKING_SET_QUOTA
+#define ERROR_WORKING_SET_QUOTA 1453L
+#endif
+
+//-----------------------------------------------------------------------------
+// Row alignment of the pixels, one cache line
+//-----------------------------------------------------------------------------
+#define DDSYSMEM_PITCH_ALIGNMENT 64
+
+//-----------------------------------------------------------------------------
+// GUID of the private data that owns the pixels
+// {0D4C3B5E-7A21-4F0B-9C38-6E1F2A9B7D41}
+//-----------------------------------------------------------------------------
+static const GUID s_guidSysMemOwner = {0x0d4c3b5e, 0x7a21, 0x4f0b,
+	{0x9c, 0x38, 0x6e, 0x1f, 0x2a, 0x9b, 0x7d, 0x41}};
+
+//-----------------------------------------------------------------------------
+// GUID of the private data holding a plain DDSysMemBlock pointer
+// {5B8E2C17-3D94-4A6E-B1F0-82C7D5E3A96F}
+//-----------------------------------------------------------------------------
+static const GUID s_guidSysMemBlock = {0x5b8e2c17, 0x3d94, 0x4a6e,
+	{0xb1, 0xf0, 0x82, 0xc7, 0xd5, 0xe3, 0xa9, 0x6f}};
+
+//-----------------------------------------------------------------------------
+// IID_IUnknown, kept local so uuid.lib isn't needed
+//-----------------------------------------------------------------------------
+static const GUID s_iidUnknown = {0x00000000, 0x0000, 0x0000,
+	{0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46}};
+
+//-----------------------------------------------------------------------------
+// Pixel memory of one surface, freed on the last Release()
+//-----------------------------------------------------------------------------
+class DDSysMemBlock : public IUnknown {
+public:
+	LONG m_lRefCount;          // COM reference count
+	LPVOID m_pMemory;          // Start of the pixels
+	DWORD m_dwBytes;           // Bytes reserved for the pixels
+	DWORD m_dwPageSize;        // Size of the pages backing them
+	BOOL m_bLargePages;        // TRUE if backed by large pages
+	DWORD m_dwLockCount;       // Outstanding DDSysMemPageLock() calls
+	CRITICAL_SECTION m_csLock; // Guards m_dwLockCount
+
+	DDSysMemBlock(LPVOID pMemory, DWORD dwBytes, DWORD dwPageSize,
+		BOOL bLargePages);
+	~DDSysMemBlock();
+
+	STDMETHOD(QueryInterface)(REFIID riid, LPVOID* ppvObj);
+	STDMETHOD_(ULONG, AddRef)(void);
+	STDMETHOD_(ULONG, Release)(void);
+};
+
+typedef SIZE_T(WINAPI* LPFNGETLARGEPAGEMINIMUM)(void);
+
+//-----------------------------------------------------------------------------
+// Large page size, 0 if large pages can't be used. Found on first use.
+//-----------------------------------------------------------------------------
+static DWORD s_dwLargePageSize;
+static BOOL s_bLargePagesChecked;
+
+//-----------------------------------------------------------------------------
+// Name: DDSysMemBlock()
+// Desc: Take ownership of memory from VirtualAlloc()
+//-----------------------------------------------------------------------------
+DDSysMemBlock::DDSysMemBlock(
+	LPVOID pMemory, DWORD dwBytes, DWORD dwPageSize, BOOL bLargePages):
+	m_lRefCount(1),
+	m_pMemory(pMemory),
+	m_dwBytes(dwBytes),
+	m_dwPageSize(dwPageSize),
+	m_bLargePages(bLargePages),
+	m_dwLockCount(0)
+{
+	InitializeCriticalSection(&m_csLock);
+}
+
+//-----------------------------------------------------------------------------
+// Name: ~DDSysMemBlock()
+// Desc: Undo any outstanding page locks and free the memory
+//-----------------------------------------------------------------------------
+DDSysMemBlock::~DDSysMemBlock()
+{
+	if (m_dwLockCount && !m_bLargePages) {
+		VirtualUnlock(m_pMemory, m_dwBytes);
+	}
+	VirtualFree(m_pMemory, 0, MEM_RELEASE);
+	DeleteCriticalSection(&m_csLock);
+}
+
+//-----------------------------------------------------------------------------
+// Name: QueryInterface()
+// Desc: Only IUnknown is supported
+//-----------------------------------------------------------------------------
+STDMETHODIMP DDSysMemBlock::QueryInterface(REFIID riid, LPVOID* ppvObj)
+{
+	if (ppvObj == NULL) {
+		return E_POINTER;
+	}
+	if (IsEqualIID(riid, s_iidUnknown)) {
+		*ppvObj = static_cast<IUnknown*>(this);
+		AddRef();
+		return S_OK;
+	}
+	*ppvObj = NULL;
+	return E_NOINTERFACE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: AddRef()
+// Desc: Add a reference
+//-----------------------------------------------------------------------------
+STDMETHODIMP_(ULONG) DDSysMemBlock::AddRef(void)
+{
+	return (ULONG)InterlockedIncrement(&m_lRefCount);
+}
+
+//-----------------------------------------------------------------------------
+// Name: Release()
+// Desc: Drop a reference, the memory is freed with the last one
+//-----------------------------------------------------------------------------
+STDMETHODIMP_(ULONG) DDSysMemBlock::Release(void)
+{
+	LONG lRefCount = InterlockedDecrement(&m_lRefCount);
+	if (!lRefCount) {
+		delete this;
+	}
+	return (ULONG)lRefCount;
+}
+
+//-----------------------------------------------------------------------------
+// Name: EnableLockMemoryPrivilege()
+// Desc: Large pages need SeLockMemoryPrivilege enabled in the process token.
+//       The account has to be granted "Lock pages in memory" by policy.
+//-----------------------------------------------------------------------------
+static BOOL EnableLockMemoryPrivilege(void)
+{
+	HANDLE hToken;
+	if (!OpenProcessToken(GetCurrentProcess(),
+			TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken)) {
+		return FALSE;
+	}
+
+	BOOL bResult = FALSE;
+	TOKEN_PRIVILEGES tp;
+	tp.PrivilegeCount = 1;
+	tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	if (LookupPrivilegeValueA(
+			NULL, "SeLockMemoryPrivilege", &tp.Privileges[0].Luid)) {
+		// Succeeds with ERROR_NOT_ALL_ASSIGNED if the account lacks it
+		if (AdjustTokenPrivileges(hToken, FALSE, &tp, 0, NULL, NULL) &&
+			(GetLastError() == ERROR_SUCCESS)) {
+			bResult = TRUE;
+		}
+	}
+	CloseHandle(hToken);
+	return bResult;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSysMemGetLargePageSize()
+// Desc: Return the large page size, or 0 if this process can't use large
+//       pages, either because Windows predates them or the account doesn't
+//       hold "Lock pages in memory"
+//-----------------------------------------------------------------------------
+DWORD DDSysMemGetLargePageSize(void)
+{
+	if (!s_bLargePagesChecked) {
+		// Looked up at runtime so the samples still load on Windows 2000
+		LPFNGETLARGEPAGEMINIMUM pGetLargePageMinimum =
+			(LPFNGETLARGEPAGEMINIMUM)GetProcAddress(
+				GetModuleHandleA("kernel32.dll"), "GetLargePageMinimum");
+		DWORD dwLargePageSize = 0;
+		if (pGetLargePageMinimum && EnableLockMemoryPrivilege()) {
+			dwLargePageSize = (DWORD)pGetLargePageMinimum();
+		}
+		s_dwLargePageSize = dwLargePageSize;
+		s_bLargePagesChecked = TRUE;
+	}
+	return s_dwLargePageSize;
+}
+
+//-----------------------------------------------------------------------------
+// Name: AllocPixels()
+// Desc: Allocate dwBytes of committed memory, on large pages if asked and
+//       possible, otherwise on normal pages
+//-----------------------------------------------------------------------------
+static DDSysMemBlock* AllocPixels(DWORD dwBytes, BOOL bTryLarge)
+{
+	LPVOID pMemory = NULL;
+	DWORD dwPageSize = 0;
+	BOOL bLargePages = FALSE;
+
+	if (bTryLarge) {
+		DWORD dwLargePageSize = DDSysMemGetLargePageSize();
+		if (dwLargePageSize &&
+			(dwBytes <= (0xFFFFFFFFUL - (dwLargePageSize - 1)))) {
+			DWORD dwLargeBytes = (dwBytes + (dwLargePageSize - 1)) &
+				~(dwLargePageSize - 1);
+
+			// Fails when physical memory is too fragmented, so fall back
+			pMemory = VirtualAlloc(NULL, dwLargeBytes,
+				MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (pMemory) {
+				dwBytes = dwLargeBytes;
+				dwPageSize = dwLargePageSize;
+				bLargePages = TRUE;
+			}
+		}
+	}
+
+	if (pMemory == NULL) {
+		pMemory =
+			VirtualAlloc(NULL, dwBytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (pMemory == NULL) {
+			return NULL;
+		}
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		dwPageSize = si.dwPageSize;
+	}
+
+	DDSysMemBlock* pBlock =
+		new DDSysMemBlock(pMemory, dwBytes, dwPageSize, bLargePages);
+	if (pBlock == NULL) {
+		VirtualFree(pMemory, 0, MEM_RELEASE);
+	}
+	return pBlock;
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetBlock()
+// Desc: Find the DDSysMemBlock of a surface, NULL if it wasn't made here
+//-----------------------------------------------------------------------------
+static DDSysMemBlock* GetBlock(IDirectDrawSurface7* pdds)
+{
+	DDSysMemBlock* pBlock;
+	DWORD dwSize = sizeof(pBlock);
+	if (FAILED(pdds->GetPrivateData(s_guidSysMemBlock, &pBlock, &dwSize)) ||
+		(dwSize != sizeof(pBlock))) {
+		return NULL;
+	}
+	return pBlock;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSysMemCreateSurface()
+// Desc: Create a system memory surface whose pixels are owned by this
+//       module. Surfaces of DDSYSMEM_LARGE_THRESHOLD bytes or more are put
+//       on large pages when they're available. Without DDSD_PIXELFORMAT the
+//       display mode's format is used. Only single, uncompressed surfaces
+//       are supported, and SetSurfaceDesc() must not be used on the result.
+//-----------------------------------------------------------------------------
+HRESULT DDSysMemCreateSurface(IDirectDraw7* pdd, LPDDSURFACEDESC2 pddsd,
+	DWORD dwFlags, IDirectDrawSurface7** ppdds)
+{
+	if ((pdd == NULL) || (pddsd == NULL) || (ppdds == NULL) ||
+		((pddsd->dwFlags & (DDSD_WIDTH | DDSD_HEIGHT)) !=
+			(DDSD_WIDTH | DDSD_HEIGHT)) ||
+		!pddsd->dwWidth || !pddsd->dwHeight) {
+		return DDERR_INVALIDPARAMS;
+	}
+	*ppdds = NULL;
+
+	DDSURFACEDESC2 ddsd;
+	ZeroMemory(&ddsd, sizeof(ddsd));
+	ddsd.dwSize = sizeof(ddsd);
+	ddsd.dwFlags = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT | DDSD_PITCH |
+		DDSD_PIXELFORMAT | DDSD_LPSURFACE;
+	ddsd.dwWidth = pddsd->dwWidth;
+	ddsd.dwHeight = pddsd->dwHeight;
+
+	HRESULT hr;
+	if (pddsd->dwFlags & DDSD_PIXELFORMAT) {
+		ddsd.ddpfPixelFormat = pddsd->ddpfPixelFormat;
+	} else {
+		DDSURFACEDESC2 ddsdMode;
+		ZeroMemory(&ddsdMode, sizeof(ddsdMode));
+		ddsdMode.dwSize = sizeof(ddsdMode);
+		if (FAILED(hr = pdd->GetDisplayMode(&ddsdMode))) {
+			return hr;
+		}
+		ddsd.ddpfPixelFormat = ddsdMode.ddpfPixelFormat;
+	}
+	if ((ddsd.ddpfPixelFormat.dwFlags & DDPF_FOURCC) ||
+		!ddsd.ddpfPixelFormat.dwRGBBitCount) {
+		return DDERR_INVALIDPIXELFORMAT;
+	}
+
+	// Client memory has to be a single system memory surface
+	if (pddsd->dwFlags & DDSD_CAPS) {
+		ddsd.ddsCaps = pddsd->ddsCaps;
+		if (ddsd.ddsCaps.dwCaps & (DDSCAPS_COMPLEX | DDSCAPS_MIPMAP)) {
+			return DDERR_INVALIDCAPS;
+		}
+	}
+	ddsd.ddsCaps.dwCaps &=
+		~(DDSCAPS_VIDEOMEMORY | DDSCAPS_LOCALVIDMEM | DDSCAPS_NONLOCALVIDMEM);
+	ddsd.ddsCaps.dwCaps |= DDSCAPS_SYSTEMMEMORY;
+	if (!(ddsd.ddsCaps.dwCaps & (DDSCAPS_TEXTURE | DDSCAPS_OFFSCREENPLAIN))) {
+		ddsd.ddsCaps.dwCaps |= DDSCAPS_OFFSCREENPLAIN;
+	}
+
+	// Size it in 64 bits so a huge surface is refused instead of wrapping
+	// around to a small allocation
+	DWORD dwBitCount = ddsd.ddpfPixelFormat.dwRGBBitCount;
+	ULONGLONG uRowBytes = (((ULONGLONG)ddsd.dwWidth * dwBitCount) + 7) >> 3;
+	ULONGLONG uPitch = (uRowBytes + (DDSYSMEM_PITCH_ALIGNMENT - 1)) &
+		~(ULONGLONG)(DDSYSMEM_PITCH_ALIGNMENT - 1);
+	ULONGLONG uBytes = uPitch * ddsd.dwHeight;
+	if ((uPitch > 0x7FFFFFFFUL) || (uBytes > 0xFFFFFFFFUL)) {
+		return DDERR_INVALIDPARAMS;
+	}
+	ddsd.lPitch = (LONG)uPitch;
+	DWORD dwBytes = (DWORD)uBytes;
+
+	BOOL bTryLarge = FALSE;
+	if (!(dwFlags & DDSYSMEM_NOLARGEPAGES) &&
+		((dwFlags & DDSYSMEM_FORCELARGEPAGES) ||
+			(dwBytes >= DDSYSMEM_LARGE_THRESHOLD))) {
+		bTryLarge = TRUE;
+	}
+	DDSysMemBlock* pBlock = AllocPixels(dwBytes, bTryLarge);
+	if (pBlock == NULL) {
+		return DDERR_OUTOFMEMORY;
+	}
+	ddsd.lpSurface = pBlock->m_pMemory;
+
+	IDirectDrawSurface7* pdds;
+	if (FAILED(hr = pdd->CreateSurface(&ddsd, &pdds, NULL))) {
+		pBlock->Release();
+		return hr;
+	}
+
+	// The surface keeps the block alive from here on. With
+	// DDSPD_IUNKNOWNPOINTER lpData is the interface itself, not its address.
+	IUnknown* pOwner = pBlock;
+	if (FAILED(hr = pdds->SetPrivateData(s_guidSysMemOwner, pOwner,
+				   sizeof(IUnknown*), DDSPD_IUNKNOWNPOINTER)) ||
+		FAILED(hr = pdds->SetPrivateData(
+				   s_guidSysMemBlock, &pBlock, sizeof(pBlock), 0))) {
+		pdds->Release();
+		pBlock->Release();
+		return hr;
+	}
+#ifdef _DEBUG
+	// The surface must still hold the block once this reference is gone
+	if (!pBlock->Release()) {
+		OutputDebugStringA(
+			"DDSysMemCreateSurface: the surface didn't keep its pixels\n");
+	}
+#else
+	pBlock->Release();
+#endif
+	*ppdds = pdds;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSysMemGetInfo()
+// Desc: Describe the memory behind a surface from DDSysMemCreateSurface().
+//       pInfo->dwSize must be set to sizeof(DDSYSMEMINFO).
+//-----------------------------------------------------------------------------
+HRESULT DDSysMemGetInfo(IDirectDrawSurface7* pdds, LPDDSYSMEMINFO pInfo)
+{
+	if ((pdds == NULL) || (pInfo == NULL) ||
+		(pInfo->dwSize != sizeof(DDSYSMEMINFO))) {
+		return DDERR_INVALIDPARAMS;
+	}
+	DDSysMemBlock* pBlock = GetBlock(pdds);
+	if (pBlock == NULL) {
+		return DDERR_INVALIDOBJECT;
+	}
+	pInfo->lpMemory = pBlock->m_pMemory;
+	pInfo->dwBytes = pBlock->m_dwBytes;
+	pInfo->dwPageSize = pBlock->m_dwPageSize;
+	pInfo->bLargePages = pBlock->m_bLargePages;
+	pInfo->dwLockCount = pBlock->m_dwLockCount;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSysMemPageLock()
+// Desc: Pin the pixels in physical memory. Nests like
+//       IDirectDrawSurface7::PageLock(). The working set is grown as needed
+//       so VirtualLock() can succeed. Large pages are never paged out, so
+//       only the count changes for them. Other surfaces are passed on to
+//       IDirectDrawSurface7::PageLock().
+//-----------------------------------------------------------------------------
+HRESULT DDSysMemPageLock(IDirectDrawSurface7* pdds)
+{
+	if (pdds == NULL) {
+		return DDERR_INVALIDPARAMS;
+	}
+	DDSysMemBlock* pBlock = GetBlock(pdds);
+	if (pBlock == NULL) {
+		return pdds->PageLock(0);
+	}
+
+	HRESULT hr = DD_OK;
+	EnterCriticalSection(&pBlock->m_csLock);
+	if (!pBlock->m_dwLockCount && !pBlock->m_bLargePages) {
+		if (!VirtualLock(pBlock->m_pMemory, pBlock->m_dwBytes)) {
+			hr = DDERR_CANTPAGELOCK;
+			if (GetLastError() == ERROR_WORKING_SET_QUOTA) {
+				// Make room in the working set for the pinned pages
+				SIZE_T uMinimum;
+				SIZE_T uMaximum;
+				HANDLE hProcess = GetCurrentProcess();
+				if (GetProcessWorkingSetSize(hProcess, &uMinimum, &uMaximum) &&
+					SetProcessWorkingSetSize(hProcess,
+						uMinimum + pBlock->m_dwBytes,
+						uMaximum + pBlock->m_dwBytes) &&
+					VirtualLock(pBlock->m_pMemory, pBlock->m_dwBytes)) {
+					hr = DD_OK;
+				}
+			}
+		}
+	}
+	if (SUCCEEDED(hr)) {
+		++pBlock->m_dwLockCount;
+	}
+	LeaveCriticalSection(&pBlock->m_csLock);
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSysMemPageUnlock()
+// Desc: Undo a DDSysMemPageLock(), the pixels become pageable again when
+//       the count reaches zero
+//-----------------------------------------------------------------------------
+HRESULT DDSysMemPageUnlock(IDirectDrawSurface7* pdds)
+{
+	if (pdds == NULL) {
+		return DDERR_INVALIDPARAMS;
+	}
+	DDSysMemBlock* pBlock = GetBlock(pdds);
+	if (pBlock == NULL) {
+		return pdds->PageUnlock(0);
+	}
+
+	HRESULT hr = DD_OK;
+	EnterCriticalSection(&pBlock->m_csLock);
+	if (!pBlock->m_dwLockCount) {
+		hr = DDERR_NOTPAGELOCKED;
+	} else if (!--pBlock->m_dwLockCount && !pBlock->m_bLargePages) {
+		VirtualUnlock(pBlock->m_pMemory, pBlock->m_dwBytes);
+	}
+	LeaveCriticalSection(&pBlock->m_csLock);
+	return hr;
+}
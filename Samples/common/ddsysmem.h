@@ -0,0 +1,74 @@
+/***************************************
+
+	System memory surfaces with controlled backing
+
+	Creates system memory surfaces whose pixels live in memory owned by this
+	module instead of DirectDraw, so large back buffers and texture chains can
+	sit on large pages and cut TLB misses on full surface walks.
+	DDSysMemPageLock() pins the pixels in physical memory with VirtualLock(),
+	which IDirectDrawSurface7::PageLock() doesn't do for system memory
+	surfaces on current versions of Windows.
+
+***************************************/
+
+#ifndef __DDSYSMEM_H__
+#define __DDSYSMEM_H__
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include <ddraw.h>
+
+/***************************************
+
+	Surfaces this size or larger try to use large pages
+
+***************************************/
+
+#define DDSYSMEM_LARGE_THRESHOLD (2048UL * 1024UL)
+
+/***************************************
+
+	Flags for DDSysMemCreateSurface()
+
+***************************************/
+
+#define DDSYSMEM_NOLARGEPAGES 0x00000001UL    // Never use large pages
+#define DDSYSMEM_FORCELARGEPAGES 0x00000002UL // Ignore the size threshold
+
+/***************************************
+
+	Where a surface's pixels live, filled in by DDSysMemGetInfo()
+
+***************************************/
+
+typedef struct _DDSYSMEMINFO {
+	DWORD dwSize;       // Size of this structure
+	LPVOID lpMemory;    // Start of the pixels
+	DWORD dwBytes;      // Bytes reserved for the pixels
+	DWORD dwPageSize;   // Size of the pages backing them
+	BOOL bLargePages;   // TRUE if backed by large pages
+	DWORD dwLockCount;  // Outstanding DDSysMemPageLock() calls
+} DDSYSMEMINFO, *LPDDSYSMEMINFO;
+
+/* Assume C declarations for C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern DWORD DDSysMemGetLargePageSize(void);
+extern HRESULT DDSysMemCreateSurface(IDirectDraw7* pdd, LPDDSURFACEDESC2 pddsd,
+	DWORD dwFlags, IDirectDrawSurface7** ppdds);
+extern HRESULT DDSysMemGetInfo(
+	IDirectDrawSurface7* pdds, LPDDSYSMEMINFO pInfo);
+extern HRESULT DDSysMemPageLock(IDirectDrawSurface7* pdds);
+extern HRESULT DDSysMemPageUnlock(IDirectDrawSurface7* pdds);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
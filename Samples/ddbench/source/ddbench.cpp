@@ -0,0 +1,321 @@
+//-----------------------------------------------------------------------------
+// File: ddbench.cpp
+//
+// Desc: Memory benchmarks for system memory surfaces.
+//
+//       Walks a large surface in TLB hostile orders (down columns and at
+//       random) and in plain row order, once for each way of backing the
+//       pixels: DirectDraw's own allocation, 4K pages, 4K pages pinned with
+//       DDSysMemPageLock() and large pages. The time per pixel touched is
+//       shown in a message box and sent to the debugger.
+//-----------------------------------------------------------------------------
+
+#define INITGUID
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include <windows.h>
+
+#include "ddsysmem.h"
+#include "resource.h"
+#include <ddraw.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// Local definitions
+//-----------------------------------------------------------------------------
+#define TITLE "DirectDraw Surface Memory Benchmark"
+
+//-----------------------------------------------------------------------------
+// Default settings
+//-----------------------------------------------------------------------------
+#define SURFACE_WIDTH 4096  // 64MB at 32 bits per pixel, far beyond the
+#define SURFACE_HEIGHT 4096 // reach of the TLB with 4K pages
+#define RANDOM_TOUCHES (4096 * 1024)
+#define PASSES 3 // Best of this many runs is reported
+
+//-----------------------------------------------------------------------------
+// Ways to back the surface
+//-----------------------------------------------------------------------------
+enum eBacking {
+	BACKING_DIRECTDRAW, // Plain CreateSurface() in system memory
+	BACKING_SMALLPAGES, // DDSysMemCreateSurface() on 4K pages
+	BACKING_LOCKED,     // Same, pinned with DDSysMemPageLock()
+	BACKING_LARGEPAGES, // DDSysMemCreateSurface() on large pages
+	BACKING_COUNT
+};
+
+//-----------------------------------------------------------------------------
+// Local data
+//-----------------------------------------------------------------------------
+static const char* s_BackingNames[BACKING_COUNT] = {
+	"DirectDraw", "4K pages", "4K pages, locked", "Large pages"};
+
+static volatile DWORD s_dwSink; // Keeps the reads from being optimized out
+
+//-----------------------------------------------------------------------------
+// Name: AppendText()
+// Desc: Append formatted text to pOutput, a buffer of uSize bytes. Text that
+//       doesn't fit is dropped whole so the buffer stays terminated.
+//-----------------------------------------------------------------------------
+static void AppendText(char* pOutput, size_t uSize, const char* pFormat, ...)
+{
+	size_t uUsed = strlen(pOutput);
+	va_list Args;
+	va_start(Args, pFormat);
+	int iLength = _vsnprintf(pOutput + uUsed, uSize - uUsed, pFormat, Args);
+	va_end(Args);
+
+	// _vsnprintf() doesn't terminate text that was cut short
+	if ((iLength < 0) || ((size_t)iLength >= (uSize - uUsed))) {
+		pOutput[uUsed] = 0;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: ElapsedNanoseconds()
+// Desc: Convert a span of QueryPerformanceCounter() ticks to nanoseconds
+//-----------------------------------------------------------------------------
+static double ElapsedNanoseconds(
+	const LARGE_INTEGER* pStart, const LARGE_INTEGER* pEnd)
+{
+	LARGE_INTEGER liFrequency;
+	QueryPerformanceFrequency(&liFrequency);
+	return (double)(pEnd->QuadPart - pStart->QuadPart) * 1000000000.0 /
+		(double)liFrequency.QuadPart;
+}
+
+//-----------------------------------------------------------------------------
+// Name: WalkRows()
+// Desc: Sum every pixel in memory order, the TLB friendly baseline
+//-----------------------------------------------------------------------------
+static double WalkRows(const BYTE* pBits, LONG lPitch)
+{
+	LARGE_INTEGER liStart;
+	LARGE_INTEGER liEnd;
+	DWORD dwSum = 0;
+
+	QueryPerformanceCounter(&liStart);
+	for (DWORD y = 0; y < SURFACE_HEIGHT; ++y) {
+		const DWORD* pRow = (const DWORD*)(pBits + (y * lPitch));
+		for (DWORD x = 0; x < SURFACE_WIDTH; ++x) {
+			dwSum += pRow[x];
+		}
+	}
+	QueryPerformanceCounter(&liEnd);
+	s_dwSink = dwSum;
+	return ElapsedNanoseconds(&liStart, &liEnd) /
+		((double)SURFACE_WIDTH * SURFACE_HEIGHT);
+}
+
+//-----------------------------------------------------------------------------
+// Name: WalkColumns()
+// Desc: Sum one pixel per cache line going down the columns. Every touch
+//       lands on a different 4K page.
+//-----------------------------------------------------------------------------
+static double WalkColumns(const BYTE* pBits, LONG lPitch)
+{
+	LARGE_INTEGER liStart;
+	LARGE_INTEGER liEnd;
+	DWORD dwSum = 0;
+
+	QueryPerformanceCounter(&liStart);
+	for (DWORD x = 0; x < SURFACE_WIDTH; x += 16) {
+		const BYTE* pColumn = pBits + (x * sizeof(DWORD));
+		for (DWORD y = 0; y < SURFACE_HEIGHT; ++y) {
+			dwSum += *(const DWORD*)(pColumn + (y * lPitch));
+		}
+	}
+	QueryPerformanceCounter(&liEnd);
+	s_dwSink = dwSum;
+	return ElapsedNanoseconds(&liStart, &liEnd) /
+		((double)(SURFACE_WIDTH / 16) * SURFACE_HEIGHT);
+}
+
+//-----------------------------------------------------------------------------
+// Name: WalkRandom()
+// Desc: Increment pixels picked by a linear congruential generator
+//-----------------------------------------------------------------------------
+static double WalkRandom(BYTE* pBits, LONG lPitch)
+{
+	LARGE_INTEGER liStart;
+	LARGE_INTEGER liEnd;
+	DWORD dwSeed = 12345;
+
+	QueryPerformanceCounter(&liStart);
+	for (DWORD i = 0; i < RANDOM_TOUCHES; ++i) {
+		dwSeed = (dwSeed * 1664525) + 1013904223;
+		DWORD x = (dwSeed >> 8) & (SURFACE_WIDTH - 1);
+		DWORD y = (dwSeed >> 20) & (SURFACE_HEIGHT - 1);
+		++*(DWORD*)(pBits + (y * lPitch) + (x * sizeof(DWORD)));
+	}
+	QueryPerformanceCounter(&liEnd);
+	return ElapsedNanoseconds(&liStart, &liEnd) / (double)RANDOM_TOUCHES;
+}
+
+//-----------------------------------------------------------------------------
+// Name: CreateBenchSurface()
+// Desc: Create the test surface with the requested backing
+//-----------------------------------------------------------------------------
+static HRESULT CreateBenchSurface(
+	IDirectDraw7* pDD, eBacking Backing, IDirectDrawSurface7** ppdds)
+{
+	DDSURFACEDESC2 ddsd;
+	ZeroMemory(&ddsd, sizeof(ddsd));
+	ddsd.dwSize = sizeof(ddsd);
+	ddsd.dwFlags = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT | DDSD_PIXELFORMAT;
+	ddsd.ddsCaps.dwCaps = DDSCAPS_OFFSCREENPLAIN | DDSCAPS_SYSTEMMEMORY;
+	ddsd.dwWidth = SURFACE_WIDTH;
+	ddsd.dwHeight = SURFACE_HEIGHT;
+	ddsd.ddpfPixelFormat.dwSize = sizeof(DDPIXELFORMAT);
+	ddsd.ddpfPixelFormat.dwFlags = DDPF_RGB;
+	ddsd.ddpfPixelFormat.dwRGBBitCount = 32;
+	ddsd.ddpfPixelFormat.dwRBitMask = 0x00FF0000;
+	ddsd.ddpfPixelFormat.dwGBitMask = 0x0000FF00;
+	ddsd.ddpfPixelFormat.dwBBitMask = 0x000000FF;
+
+	HRESULT hr;
+	switch (Backing) {
+	case BACKING_DIRECTDRAW:
+		return pDD->CreateSurface(&ddsd, ppdds, NULL);
+
+	case BACKING_SMALLPAGES:
+		return DDSysMemCreateSurface(pDD, &ddsd, DDSYSMEM_NOLARGEPAGES, ppdds);
+
+	case BACKING_LOCKED:
+		if (FAILED(hr = DDSysMemCreateSurface(
+					   pDD, &ddsd, DDSYSMEM_NOLARGEPAGES, ppdds))) {
+			return hr;
+		}
+		// The surface drops the lock when it's released
+		if (FAILED(hr = DDSysMemPageLock(*ppdds))) {
+			(*ppdds)->Release();
+			*ppdds = NULL;
+		}
+		return hr;
+
+	default:
+		if (!DDSysMemGetLargePageSize()) {
+			return DDERR_UNSUPPORTED;
+		}
+		if (FAILED(hr = DDSysMemCreateSurface(
+					   pDD, &ddsd, DDSYSMEM_FORCELARGEPAGES, ppdds))) {
+			return hr;
+		}
+		// The allocation falls back to 4K pages rather than failing
+		DDSYSMEMINFO Info;
+		Info.dwSize = sizeof(Info);
+		if (FAILED(DDSysMemGetInfo(*ppdds, &Info)) || !Info.bLargePages) {
+			(*ppdds)->Release();
+			*ppdds = NULL;
+			return DDERR_OUTOFMEMORY;
+		}
+		return DD_OK;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: RunBackingTests()
+// Desc: Time the three walks over one kind of surface and append a line of
+//       results to pOutput, a buffer of uSize bytes
+//-----------------------------------------------------------------------------
+static void RunBackingTests(
+	IDirectDraw7* pDD, eBacking Backing, char* pOutput, size_t uSize)
+{
+	IDirectDrawSurface7* pdds;
+	HRESULT hr = CreateBenchSurface(pDD, Backing, &pdds);
+	if (FAILED(hr)) {
+		AppendText(pOutput, uSize, "%-18s not available (0x%08lX)\n",
+			s_BackingNames[Backing], (DWORD)hr);
+		return;
+	}
+
+	DDSURFACEDESC2 ddsd;
+	ZeroMemory(&ddsd, sizeof(ddsd));
+	ddsd.dwSize = sizeof(ddsd);
+	if (FAILED(hr = pdds->Lock(NULL, &ddsd, DDLOCK_WAIT, NULL))) {
+		AppendText(pOutput, uSize, "%-18s Lock() failed (0x%08lX)\n",
+			s_BackingNames[Backing], (DWORD)hr);
+		pdds->Release();
+		return;
+	}
+
+	// Touch everything once so page faults aren't part of the timings
+	BYTE* pBits = (BYTE*)ddsd.lpSurface;
+	for (DWORD y = 0; y < SURFACE_HEIGHT; ++y) {
+		ZeroMemory(pBits + (y * ddsd.lPitch), SURFACE_WIDTH * sizeof(DWORD));
+	}
+
+	double dRows = 0.0;
+	double dColumns = 0.0;
+	double dRandom = 0.0;
+	for (DWORD i = 0; i < PASSES; ++i) {
+		double dTime = WalkRows(pBits, ddsd.lPitch);
+		if (!i || (dTime < dRows)) {
+			dRows = dTime;
+		}
+		dTime = WalkColumns(pBits, ddsd.lPitch);
+		if (!i || (dTime < dColumns)) {
+			dColumns = dTime;
+		}
+		dTime = WalkRandom(pBits, ddsd.lPitch);
+		if (!i || (dTime < dRandom)) {
+			dRandom = dTime;
+		}
+	}
+	pdds->Unlock(NULL);
+	pdds->Release();
+
+	AppendText(pOutput, uSize, "%-18s %8.2f %8.2f %8.2f\n",
+		s_BackingNames[Backing], dRows, dColumns, dRandom);
+}
+
+//-----------------------------------------------------------------------------
+// Name: WinMain()
+// Desc: Run every benchmark and show the results
+//-----------------------------------------------------------------------------
+int APIENTRY WinMain(HINSTANCE /* hInstance */, HINSTANCE /* hPrevInstance */,
+	LPSTR /* lpCmdLine */, int /* nCmdShow */)
+{
+	IDirectDraw7* pDD;
+	HRESULT hr = DirectDrawCreateEx(NULL, (VOID**)&pDD, IID_IDirectDraw7, NULL);
+	if (FAILED(hr)) {
+		MessageBoxA(NULL, "DirectDrawCreateEx FAILED", TITLE, MB_OK);
+		return FALSE;
+	}
+	pDD->SetCooperativeLevel(NULL, DDSCL_NORMAL);
+
+	char szOutput[1024];
+	szOutput[0] = 0;
+	DWORD dwLargePageSize = DDSysMemGetLargePageSize();
+	if (dwLargePageSize) {
+		AppendText(szOutput, sizeof(szOutput),
+			"%dx%d 32 bit surface, large pages are %luK\n\n",
+			SURFACE_WIDTH, SURFACE_HEIGHT, dwLargePageSize >> 10);
+	} else {
+		AppendText(szOutput, sizeof(szOutput),
+			"%dx%d 32 bit surface, large pages need the "
+			"\"Lock pages in memory\" right\n\n",
+			SURFACE_WIDTH, SURFACE_HEIGHT);
+	}
+	AppendText(szOutput, sizeof(szOutput),
+		"ns per pixel        Rows  Columns   Random\n");
+
+	// Show something while the tests run, they take a few seconds
+	SetCursor(LoadCursorA(NULL, IDC_WAIT));
+	for (int i = 0; i < BACKING_COUNT; ++i) {
+		RunBackingTests(pDD, (eBacking)i, szOutput, sizeof(szOutput));
+	}
+	pDD->Release();
+
+	OutputDebugStringA(szOutput);
+	MessageBoxA(NULL, szOutput, TITLE, MB_OK);
+	return 0;
+}
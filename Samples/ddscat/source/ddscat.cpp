@@ -0,0 +1,324 @@
+//-----------------------------------------------------------------------------
+// File: ddscat.cpp
+//
+// Desc: Command line catalog of DDS texture libraries.
+//
+//       Keeps an index file of what the header of every DDS file under a
+//       few directories says, and answers questions about them, such as
+//       which textures are DXT1, have no mip maps or are cube maps larger
+//       than 256, from the index alone.
+//
+//       Refreshing a directory only reads the headers of files that are
+//       new or whose size or write time changed, across the work pool, so
+//       after the first scan keeping tens of thousands of files current
+//       costs a directory walk. Queries are a pass over the records in
+//       memory and never open a texture.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include <windows.h>
+
+#include "ddsindex.h"
+#include "dxtcodec.h"
+#include "dxtpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// Default settings
+//-----------------------------------------------------------------------------
+#define INDEX_FILE "ddscat.idx" // Index used without -index
+#define MAX_SCANS 16            // Most -scan directories at once
+
+//-----------------------------------------------------------------------------
+// Settings from the command line
+//-----------------------------------------------------------------------------
+struct CatOptions {
+	const char* pIndexFile;
+	const char* pScanDirs[MAX_SCANS]; // Directories to refresh first
+	DWORD dwScans;
+	DWORD dwThreads; // Pool size, 0 for one per processor
+	BOOL bCountOnly; // Print the totals but not the files
+	DDSINDEXQUERY Query;
+};
+
+//-----------------------------------------------------------------------------
+// Name: ElapsedMilliseconds()
+// Desc: Time between two QueryPerformanceCounter() readings
+//-----------------------------------------------------------------------------
+static double ElapsedMilliseconds(
+	const LARGE_INTEGER* pStart, const LARGE_INTEGER* pEnd)
+{
+	LARGE_INTEGER liFrequency;
+	QueryPerformanceFrequency(&liFrequency);
+	return (double)(pEnd->QuadPart - pStart->QuadPart) * 1000.0 /
+		(double)liFrequency.QuadPart;
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetFormatName()
+// Desc: Short name of the format of an entry, the FourCC if it has one
+//-----------------------------------------------------------------------------
+static void GetFormatName(const DDSINDEXENTRY* pEntry, char* pName)
+{
+	if (pEntry->dwFlags & DDSINDEX_INVALID) {
+		strcpy(pName, "-");
+	} else if (pEntry->dwFourCC == FOURCC_BC7) {
+		strcpy(pName, "BC7");
+	} else if (pEntry->dwFourCC) {
+		DWORD i;
+		for (i = 0; i < 4; ++i) {
+			char cChar = (char)(pEntry->dwFourCC >> (i * 8));
+			pName[i] = (cChar > ' ' && cChar < 127) ? cChar : 0;
+		}
+		pName[i] = 0;
+	} else if ((pEntry->dwFlags & DDSINDEX_UNKNOWN) &&
+		(pEntry->dwFlags & DDSINDEX_DX10)) {
+		sprintf(pName, "DXGI%lu", (unsigned long)pEntry->dwDxgiFormat);
+	} else {
+		sprintf(pName, "RGB%lu", (unsigned long)pEntry->dwBitCount);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: PrintEntry()
+// Desc: One line for a file that matched
+//-----------------------------------------------------------------------------
+static void PrintEntry(const DDSINDEXENTRY* pEntry, const char* pPath)
+{
+	char szSize[40];
+	char szFormat[16];
+	char szShape[24];
+
+	if (pEntry->dwFlags & DDSINDEX_VOLUME) {
+		sprintf(szSize, "%lux%lux%lu", (unsigned long)pEntry->dwWidth,
+			(unsigned long)pEntry->dwHeight, (unsigned long)pEntry->dwDepth);
+		strcpy(szShape, "volume");
+	} else {
+		sprintf(szSize, "%lux%lu", (unsigned long)pEntry->dwWidth,
+			(unsigned long)pEntry->dwHeight);
+		if (pEntry->dwFlags & DDSINDEX_CUBEMAP) {
+			sprintf(szShape, "cube %lu", (unsigned long)pEntry->dwFaces);
+		} else {
+			strcpy(szShape, "2D");
+		}
+	}
+	if (pEntry->dwArraySize > 1) {
+		sprintf(szShape + strlen(szShape), " [%lu]",
+			(unsigned long)pEntry->dwArraySize);
+	}
+	GetFormatName(pEntry, szFormat);
+	if (pEntry->dwFlags & DDSINDEX_INVALID) {
+		printf("%-38s %s\n", "not a DDS file", pPath);
+		return;
+	}
+	printf("%-15s %-7s %2lu  %-10s", szSize, szFormat,
+		(unsigned long)pEntry->dwMipCount, szShape);
+	if (pEntry->dwFlags & DDSINDEX_UNKNOWN) {
+		printf(" %10s", "?");
+	} else {
+		printf(" %8.2f%s", (double)(LONGLONG)pEntry->uPayloadBytes /
+				(1024.0 * 1024.0),
+			(pEntry->dwFlags & DDSINDEX_TRUNCATED) ? " !" : " M");
+	}
+	printf("  %s\n", pPath);
+}
+
+//-----------------------------------------------------------------------------
+// Name: ParseRange()
+// Desc: Read the two numbers after an option, FALSE if they're missing
+//-----------------------------------------------------------------------------
+static BOOL ParseRange(
+	int argc, char** argv, int* pArg, DWORD* pdwMin, DWORD* pdwMax)
+{
+	if (*pArg + 2 >= argc) {
+		return FALSE;
+	}
+	*pdwMin = (DWORD)atol(argv[++*pArg]);
+	*pdwMax = (DWORD)atol(argv[++*pArg]);
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ParseOptions()
+// Desc: Read the command line, FALSE if it doesn't make sense
+//-----------------------------------------------------------------------------
+static BOOL ParseOptions(int argc, char** argv, CatOptions* pOptions)
+{
+	static const struct {
+		const char* pName;
+		DWORD dwFourCC;
+	} s_Formats[] = {{"DXT1", FOURCC_DXT1}, {"DXT2", FOURCC_DXT2},
+		{"DXT3", FOURCC_DXT3}, {"DXT4", FOURCC_DXT4}, {"DXT5", FOURCC_DXT5},
+		{"ATI1", FOURCC_ATI1}, {"ATI2", FOURCC_ATI2}, {"BC7", FOURCC_BC7}};
+	DDSINDEXQUERY* pQuery = &pOptions->Query;
+
+	memset(pOptions, 0, sizeof(CatOptions));
+	pOptions->pIndexFile = INDEX_FILE;
+	for (int i = 1; i < argc; ++i) {
+		const char* pArg = argv[i];
+		if (pArg[0] == '-' || pArg[0] == '/') {
+			++pArg;
+			if (!lstrcmpiA(pArg, "index") && (i + 1 < argc)) {
+				pOptions->pIndexFile = argv[++i];
+			} else if (!lstrcmpiA(pArg, "scan") && (i + 1 < argc) &&
+				pOptions->dwScans < MAX_SCANS) {
+				pOptions->pScanDirs[pOptions->dwScans++] = argv[++i];
+			} else if (!lstrcmpiA(pArg, "threads") && (i + 1 < argc)) {
+				pOptions->dwThreads = (DWORD)atol(argv[++i]);
+			} else if (!lstrcmpiA(pArg, "width")) {
+				if (!ParseRange(argc, argv, &i, &pQuery->dwMinWidth,
+						&pQuery->dwMaxWidth)) {
+					return FALSE;
+				}
+			} else if (!lstrcmpiA(pArg, "height")) {
+				if (!ParseRange(argc, argv, &i, &pQuery->dwMinHeight,
+						&pQuery->dwMaxHeight)) {
+					return FALSE;
+				}
+			} else if (!lstrcmpiA(pArg, "mips")) {
+				if (!ParseRange(argc, argv, &i, &pQuery->dwMinMips,
+						&pQuery->dwMaxMips)) {
+					return FALSE;
+				}
+			} else if (!lstrcmpiA(pArg, "cube")) {
+				pQuery->dwRequire |= DDSINDEX_CUBEMAP;
+			} else if (!lstrcmpiA(pArg, "volume")) {
+				pQuery->dwRequire |= DDSINDEX_VOLUME;
+			} else if (!lstrcmpiA(pArg, "flat")) {
+				pQuery->dwExclude |= DDSINDEX_CUBEMAP | DDSINDEX_VOLUME;
+			} else if (!lstrcmpiA(pArg, "truncated")) {
+				pQuery->dwRequire |= DDSINDEX_TRUNCATED;
+			} else if (!lstrcmpiA(pArg, "invalid")) {
+				pQuery->dwRequire |= DDSINDEX_INVALID;
+			} else if (!lstrcmpiA(pArg, "count")) {
+				pOptions->bCountOnly = TRUE;
+			} else {
+				return FALSE;
+			}
+			continue;
+		}
+		if (!lstrcmpiA(pArg, "RGB")) {
+			pQuery->dwExclude |= DDSINDEX_COMPRESSED | DDSINDEX_UNKNOWN;
+			continue;
+		}
+		DWORD j;
+		for (j = 0; j < sizeof(s_Formats) / sizeof(s_Formats[0]); ++j) {
+			if (!lstrcmpiA(pArg, s_Formats[j].pName)) {
+				pQuery->dwFourCC = s_Formats[j].dwFourCC;
+				break;
+			}
+		}
+		if (j == sizeof(s_Formats) / sizeof(s_Formats[0])) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: main()
+// Desc: Refresh the index if asked to, then list the files that match
+//-----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	CatOptions Options;
+	if (!ParseOptions(argc, argv, &Options)) {
+		printf("Usage: ddscat [-index file] [-scan dir]... [-threads n]\n"
+			   "              [-width min max] [-height min max] "
+			   "[-mips min max]\n"
+			   "              [-cube|-volume|-flat] [-truncated] "
+			   "[-invalid] [-count]\n"
+			   "              [DXT1|DXT2|DXT3|DXT4|DXT5|ATI1|ATI2|BC7|RGB]"
+			   "\n\n"
+			   "Lists the DDS files in the index, ddscat.idx by default, "
+			   "that match every\n"
+			   "condition given. -scan first brings the index up to date "
+			   "with a directory\n"
+			   "tree, only reading the headers of new and changed files. "
+			   "A maximum of 0\n"
+			   "has no limit.\n");
+		return 1;
+	}
+
+	LARGE_INTEGER liStart;
+	LARGE_INTEGER liEnd;
+	QueryPerformanceCounter(&liStart);
+	DDSIndex* pIndex;
+	if (FAILED(DDSIndexOpen(Options.pIndexFile, &pIndex))) {
+		fprintf(stderr, "Can't open the index %s\n", Options.pIndexFile);
+		return 1;
+	}
+	QueryPerformanceCounter(&liEnd);
+	printf("Index       %lu files in %s, %.1f ms to load\n",
+		(unsigned long)DDSIndexGetCount(pIndex), Options.pIndexFile,
+		ElapsedMilliseconds(&liStart, &liEnd));
+
+	int iResult = 0;
+	if (Options.dwScans) {
+		DXTWorkPool* pPool;
+		if (FAILED(DXTPoolCreate(Options.dwThreads, &pPool))) {
+			// Headers can still be read one at a time
+			pPool = NULL;
+		}
+		for (DWORD i = 0; i < Options.dwScans; ++i) {
+			DDSINDEXSTATS Stats;
+			QueryPerformanceCounter(&liStart);
+			HRESULT hr = DDSIndexRefresh(
+				pIndex, Options.pScanDirs[i], pPool, &Stats);
+			QueryPerformanceCounter(&liEnd);
+			if (FAILED(hr)) {
+				fprintf(stderr, "Can't scan %s (error 0x%08lX)\n",
+					Options.pScanDirs[i], (unsigned long)hr);
+				iResult = 2;
+				continue;
+			}
+			printf("Scanned     %s, %lu files, %lu unchanged, %lu read, "
+				   "%lu not DDS, %lu removed, %.1f ms\n",
+				Options.pScanDirs[i], (unsigned long)Stats.dwFiles,
+				(unsigned long)Stats.dwUnchanged, (unsigned long)Stats.dwRead,
+				(unsigned long)Stats.dwInvalid,
+				(unsigned long)Stats.dwRemoved,
+				ElapsedMilliseconds(&liStart, &liEnd));
+		}
+		DXTPoolDestroy(pPool);
+		if (FAILED(DDSIndexSave(pIndex))) {
+			fprintf(stderr, "Can't save the index %s\n", Options.pIndexFile);
+			iResult = 2;
+		}
+	}
+
+	// Count first and print afterwards, so the time is the query alone
+	QueryPerformanceCounter(&liStart);
+	DWORD dwMatches = 0;
+	ULONGLONG uPayloadBytes = 0;
+	DWORD dwEntry = DDSIndexFind(pIndex, &Options.Query, 0);
+	while (dwEntry != DDSINDEX_END) {
+		++dwMatches;
+		uPayloadBytes += DDSIndexGetEntry(pIndex, dwEntry)->uPayloadBytes;
+		dwEntry = DDSIndexFind(pIndex, &Options.Query, dwEntry + 1);
+	}
+	QueryPerformanceCounter(&liEnd);
+
+	if (!Options.bCountOnly) {
+		dwEntry = DDSIndexFind(pIndex, &Options.Query, 0);
+		while (dwEntry != DDSINDEX_END) {
+			PrintEntry(DDSIndexGetEntry(pIndex, dwEntry),
+				DDSIndexGetPath(pIndex, dwEntry));
+			dwEntry = DDSIndexFind(pIndex, &Options.Query, dwEntry + 1);
+		}
+	}
+	printf("Found       %lu of %lu files, %.2f MB of pixels, %.2f ms\n",
+		(unsigned long)dwMatches, (unsigned long)DDSIndexGetCount(pIndex),
+		(double)(LONGLONG)uPayloadBytes / (1024.0 * 1024.0),
+		ElapsedMilliseconds(&liStart, &liEnd));
+	DDSIndexClose(pIndex);
+	return iResult;
+}
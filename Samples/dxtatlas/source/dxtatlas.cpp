@@ -0,0 +1,714 @@
+//-----------------------------------------------------------------------------
+// File: dxtatlas.cpp
+//
+// Desc: Command line texture atlas builder.
+//
+//       Loads bitmaps, and directories of them, with foo_a.bmp as the alpha
+//       of foo.bmp when it's there, optionally turns a color key into
+//       transparency and cuts sprite sheets into cells. Every sprite has
+//       its transparent border trimmed off, they're all packed into one
+//       texture, which is mip mapped and compressed like dxtconv does, and
+//       a table of where each sprite went is written beside the DDS file.
+//
+//       Loading, keying and trimming run as one pool task per bitmap, and
+//       so does copying the sprites into the atlas. The mip levels are
+//       built and compressed across the pool. Time spent in each step is
+//       printed at the end, since this runs on every asset build.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include <windows.h>
+
+#include "ddsfile.h"
+#include "dxtcodec.h"
+#include "dxtpool.h"
+#include "texatlas.h"
+#include "teximage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// Default settings
+//-----------------------------------------------------------------------------
+#define MAX_LEVELS TEX_MAX_LEVELS
+#define DEFAULT_PADDING 2        // Pixels between sprites
+#define DEFAULT_MAX_SIZE 4096    // Largest atlas side
+#define MAX_NAME 64              // Longest sprite name kept
+
+//-----------------------------------------------------------------------------
+// Color key modes
+//-----------------------------------------------------------------------------
+#define KEY_NONE 0               // Use the alpha the bitmap has
+#define KEY_AUTO 1               // The top left pixel is the key
+#define KEY_COLOR 2              // dwKeyColor is the key
+
+//-----------------------------------------------------------------------------
+// One bitmap to take sprites from
+//-----------------------------------------------------------------------------
+struct AtlasInput {
+	char szSrc[MAX_PATH];
+	char szAlpha[MAX_PATH];    // Empty if there's no _a.bmp
+	DWORD dwCellWidth;         // Size of each sprite, 0 for the whole bitmap
+	DWORD dwCellHeight;
+	DWORD dwKey;               // KEY_ mode
+	DWORD dwKeyColor;          // RGB of the key for KEY_COLOR
+	TEXIMAGE Image;            // Loaded pixels, keyed
+	TEXATLASSPRITE* pSprites;  // One per cell, row by row
+	DWORD dwSprites;
+	HRESULT hr;                // First failure, if any
+};
+
+//-----------------------------------------------------------------------------
+// Growable list of bitmaps
+//-----------------------------------------------------------------------------
+struct AtlasInputList {
+	AtlasInput* pInputs;
+	DWORD dwCount;
+	DWORD dwMax;
+};
+
+//-----------------------------------------------------------------------------
+// Settings from the command line
+//-----------------------------------------------------------------------------
+struct AtlasOptions {
+	DWORD dwFourCC;    // Format to write, 0 for ARGB8888
+	DWORD dwQuality;   // DXTC_QUALITY_ flags
+	BOOL bMipMap;      // Build a full mip chain
+	DWORD dwMipFlags;  // TEX_MIP_ flags for the mip chain
+	DWORD dwMipFilter; // TEX_FILTER_ kernel for the mip chain
+	DWORD dwThreads;   // Pool size, 0 for one per processor
+	DWORD dwPadding;   // Pixels between sprites
+	DWORD dwAlign;     // Sprites start on multiples of this, 0 for default
+	DWORD dwMaxSize;   // Largest atlas side
+	DWORD dwFlags;     // TEX_ATLAS_ flags
+	const char* pDestFile;
+	char szTableFile[MAX_PATH];
+};
+
+//-----------------------------------------------------------------------------
+// Context handed to the pool tasks
+//-----------------------------------------------------------------------------
+struct AtlasBuild {
+	AtlasInputList* pList;
+	TEXIMAGE* pAtlas;  // Top level, sprites are copied into it
+};
+
+//-----------------------------------------------------------------------------
+// Name: ElapsedMilliseconds()
+// Desc: Convert a span of QueryPerformanceCounter() ticks to milliseconds
+//-----------------------------------------------------------------------------
+static double ElapsedMilliseconds(
+	const LARGE_INTEGER* pStart, const LARGE_INTEGER* pEnd)
+{
+	LARGE_INTEGER liFrequency;
+	QueryPerformanceFrequency(&liFrequency);
+	return (double)(pEnd->QuadPart - pStart->QuadPart) * 1000.0 /
+		(double)liFrequency.QuadPart;
+}
+
+//-----------------------------------------------------------------------------
+// Name: HasSuffix()
+// Desc: TRUE if pName ends with pSuffix, ignoring case
+//-----------------------------------------------------------------------------
+static BOOL HasSuffix(const char* pName, const char* pSuffix)
+{
+	size_t uName = strlen(pName);
+	size_t uSuffix = strlen(pSuffix);
+	return (uName > uSuffix) &&
+		(lstrcmpiA(pName + (uName - uSuffix), pSuffix) == 0);
+}
+
+//-----------------------------------------------------------------------------
+// Name: AddInput()
+// Desc: Append a bitmap to the list, finding its alpha bitmap, growing the
+//       list as needed. pTemplate has the cell and key settings.
+//-----------------------------------------------------------------------------
+static BOOL AddInput(
+	AtlasInputList* pList, const AtlasInput* pTemplate, const char* pSrc)
+{
+	if (pList->dwCount == pList->dwMax) {
+		DWORD dwMax = pList->dwMax ? pList->dwMax * 2 : 64;
+		AtlasInput* pInputs = new AtlasInput[dwMax];
+		if (!pInputs) {
+			return FALSE;
+		}
+		if (pList->dwCount) {
+			memcpy(pInputs, pList->pInputs,
+				sizeof(AtlasInput) * pList->dwCount);
+		}
+		delete[] pList->pInputs;
+		pList->pInputs = pInputs;
+		pList->dwMax = dwMax;
+	}
+	AtlasInput* pInput = &pList->pInputs[pList->dwCount++];
+	*pInput = *pTemplate;
+	strcpy(pInput->szSrc, pSrc);
+	sprintf(pInput->szAlpha, "%.*s_a.bmp", (int)(strlen(pSrc) - 4), pSrc);
+	WIN32_FIND_DATAA AlphaData;
+	HANDLE hAlpha = FindFirstFileA(pInput->szAlpha, &AlphaData);
+	if (hAlpha != INVALID_HANDLE_VALUE) {
+		FindClose(hAlpha);
+	} else {
+		pInput->szAlpha[0] = 0;
+	}
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ScanDirectory()
+// Desc: Add every bitmap under pSrcDir to the list, except alpha bitmaps
+//-----------------------------------------------------------------------------
+static BOOL ScanDirectory(
+	const char* pSrcDir, const AtlasInput* pTemplate, AtlasInputList* pList)
+{
+	WIN32_FIND_DATAA FindData;
+	char szPattern[MAX_PATH];
+
+	if (strlen(pSrcDir) + 3 > MAX_PATH) {
+		return TRUE;
+	}
+	sprintf(szPattern, "%s\\*", pSrcDir);
+	HANDLE hFind = FindFirstFileA(szPattern, &FindData);
+	if (hFind == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "Nothing found in %s\n", pSrcDir);
+		return TRUE;
+	}
+	BOOL bOk = TRUE;
+	do {
+		const char* pName = FindData.cFileName;
+		char szPath[MAX_PATH];
+		// Room for a separator and for foo.bmp to become foo_a.bmp
+		if (strlen(pSrcDir) + strlen(pName) + 4 > MAX_PATH) {
+			fprintf(stderr, "Path too long: %s\\%s\n", pSrcDir, pName);
+			continue;
+		}
+		sprintf(szPath, "%s\\%s", pSrcDir, pName);
+		if (FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			if (strcmp(pName, ".") && strcmp(pName, "..")) {
+				bOk = ScanDirectory(szPath, pTemplate, pList);
+			}
+		} else if (HasSuffix(pName, ".bmp") && !HasSuffix(pName, "_a.bmp")) {
+			bOk = AddInput(pList, pTemplate, szPath);
+		}
+	} while (bOk && FindNextFileA(hFind, &FindData));
+	FindClose(hFind);
+	return bOk;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ApplyKey()
+// Desc: Make every pixel of the key color transparent black, so it neither
+//       keeps the sprite from being trimmed nor bleeds into the mip levels
+//-----------------------------------------------------------------------------
+static void ApplyKey(TEXIMAGE* pImage, DWORD dwKey, DWORD dwKeyColor)
+{
+	if (dwKey == KEY_NONE) {
+		return;
+	}
+	DWORD* pdwPixels = pImage->pdwPixels;
+	DWORD dwColor = (dwKey == KEY_AUTO) ? pdwPixels[0] : dwKeyColor;
+	dwColor &= 0x00FFFFFF;
+	DWORD dwCount = pImage->dwWidth * pImage->dwHeight;
+	for (DWORD i = 0; i < dwCount; ++i) {
+		if ((pdwPixels[i] & 0x00FFFFFF) == dwColor) {
+			pdwPixels[i] = 0;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: LoadTask()
+// Desc: Pool task, load one bitmap and its alpha, apply its color key, cut
+//       it into cells and trim each one
+//-----------------------------------------------------------------------------
+static void LoadTask(void* pContext, DWORD dwTask)
+{
+	AtlasBuild* pBuild = static_cast<AtlasBuild*>(pContext);
+	AtlasInput* pInput = &pBuild->pList->pInputs[dwTask];
+
+	HRESULT hr = TEXLoadBmp(pInput->szSrc, &pInput->Image);
+	if (SUCCEEDED(hr) && pInput->szAlpha[0]) {
+		hr = TEXLoadAlphaBmp(pInput->szAlpha, &pInput->Image);
+	}
+	DWORD dwCellWidth = pInput->Image.dwWidth;
+	DWORD dwCellHeight = pInput->Image.dwHeight;
+	if (SUCCEEDED(hr)) {
+		ApplyKey(&pInput->Image, pInput->dwKey, pInput->dwKeyColor);
+
+		// Cells that don't fit whole are left out
+		if (pInput->dwCellWidth && pInput->dwCellHeight) {
+			dwCellWidth = pInput->dwCellWidth;
+			dwCellHeight = pInput->dwCellHeight;
+		}
+		pInput->dwSprites = (pInput->Image.dwWidth / dwCellWidth) *
+			(pInput->Image.dwHeight / dwCellHeight);
+		if (!pInput->dwSprites) {
+			hr = DDERR_INVALIDPARAMS;
+		}
+	}
+	if (SUCCEEDED(hr)) {
+		pInput->pSprites = new TEXATLASSPRITE[pInput->dwSprites];
+		if (!pInput->pSprites) {
+			hr = DDERR_OUTOFMEMORY;
+		}
+	}
+	if (SUCCEEDED(hr)) {
+		DWORD dwColumns = pInput->Image.dwWidth / dwCellWidth;
+		LONG lPitch = (LONG)(pInput->Image.dwWidth * 4);
+		for (DWORD i = 0; i < pInput->dwSprites; ++i) {
+			const DWORD* pCell = pInput->Image.pdwPixels +
+				(i / dwColumns) * dwCellHeight * pInput->Image.dwWidth +
+				(i % dwColumns) * dwCellWidth;
+			TEXTrimSprite(pCell, lPitch, dwCellWidth, dwCellHeight,
+				&pInput->pSprites[i]);
+		}
+	}
+	if (FAILED(hr)) {
+		TEXFreeImage(&pInput->Image);
+		pInput->dwSprites = 0;
+	}
+	pInput->hr = hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: CopyTask()
+// Desc: Pool task, copy the trimmed sprites of one bitmap to their places in
+//       the atlas and release the bitmap
+//-----------------------------------------------------------------------------
+static void CopyTask(void* pContext, DWORD dwTask)
+{
+	AtlasBuild* pBuild = static_cast<AtlasBuild*>(pContext);
+	AtlasInput* pInput = &pBuild->pList->pInputs[dwTask];
+	TEXIMAGE* pAtlas = pBuild->pAtlas;
+
+	DWORD dwCellWidth = pInput->dwCellWidth ? pInput->dwCellWidth :
+		pInput->Image.dwWidth;
+	DWORD dwCellHeight = pInput->dwCellHeight ? pInput->dwCellHeight :
+		pInput->Image.dwHeight;
+	DWORD dwColumns = dwCellWidth ? pInput->Image.dwWidth / dwCellWidth : 0;
+	for (DWORD i = 0; i < pInput->dwSprites; ++i) {
+		const TEXATLASSPRITE* pSprite = &pInput->pSprites[i];
+		const DWORD* pSrc = pInput->Image.pdwPixels +
+			((i / dwColumns) * dwCellHeight + pSprite->dwTrimY) *
+				pInput->Image.dwWidth +
+			(i % dwColumns) * dwCellWidth + pSprite->dwTrimX;
+		DWORD* pDest =
+			pAtlas->pdwPixels + pSprite->dwY * pAtlas->dwWidth + pSprite->dwX;
+		for (DWORD y = 0; y < pSprite->dwHeight; ++y) {
+			memcpy(pDest, pSrc, pSprite->dwWidth * 4);
+			pSrc += pInput->Image.dwWidth;
+			pDest += pAtlas->dwWidth;
+		}
+	}
+	TEXFreeImage(&pInput->Image);
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetSpriteName()
+// Desc: Name a sprite after its bitmap, with the cell number after a dot if
+//       the bitmap was cut into cells
+//-----------------------------------------------------------------------------
+static void GetSpriteName(
+	const AtlasInput* pInput, DWORD dwSprite, char* pName)
+{
+	const char* pFile = pInput->szSrc;
+	const char* pSlash = strrchr(pFile, '\\');
+	if (pSlash) {
+		pFile = pSlash + 1;
+	}
+	int iLength = (int)strlen(pFile) - 4;
+	if (iLength > MAX_NAME - 12) {
+		iLength = MAX_NAME - 12;
+	}
+	if (pInput->dwCellWidth && pInput->dwCellHeight) {
+		sprintf(pName, "%.*s.%lu", iLength, pFile, (unsigned long)dwSprite);
+	} else {
+		sprintf(pName, "%.*s", iLength, pFile);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: BuildLevels()
+// Desc: Allocate the levels below the top, build them, then compress every
+//       level in one call. pBlocks gets the compressed levels, unless the
+//       atlas is ARGB8888.
+//-----------------------------------------------------------------------------
+static HRESULT BuildLevels(DXTWorkPool* pPool, const AtlasOptions* pOptions,
+	TEXIMAGE* pLevels, DWORD dwLevels, BYTE** pBlocks, double* pdMipTime,
+	double* pdCompressTime)
+{
+	LARGE_INTEGER liStart;
+	LARGE_INTEGER liMipped;
+	LARGE_INTEGER liCompressed;
+	HRESULT hr = DD_OK;
+	DWORD i;
+
+	QueryPerformanceCounter(&liStart);
+	if (dwLevels > 1) {
+		TEXMIPCHAIN Chain;
+		memset(&Chain, 0, sizeof(Chain));
+		Chain.dwWidth = pLevels[0].dwWidth;
+		Chain.dwHeight = pLevels[0].dwHeight;
+		Chain.dwLevels = dwLevels;
+		for (i = 0; SUCCEEDED(hr) && (i < dwLevels); ++i) {
+			if (i) {
+				const TEXIMAGE* pAbove = &pLevels[i - 1];
+				hr = TEXCreateImage(
+					pAbove->dwWidth > 1 ? pAbove->dwWidth >> 1 : 1,
+					pAbove->dwHeight > 1 ? pAbove->dwHeight >> 1 : 1,
+					&pLevels[i]);
+			}
+			Chain.pLevels[i] = pLevels[i].pdwPixels;
+			Chain.lPitch[i] = (LONG)(pLevels[i].dwWidth * 4);
+		}
+		if (SUCCEEDED(hr)) {
+			hr = TEXBuildMipChains(&Chain, 1, pOptions->dwMipFilter,
+				pOptions->dwMipFlags, pPool);
+		}
+	}
+	QueryPerformanceCounter(&liMipped);
+
+	if (SUCCEEDED(hr) && pOptions->dwFourCC) {
+		DXTCOMPRESSJOB Compress[MAX_LEVELS];
+		for (i = 0; i < dwLevels; ++i) {
+			const TEXIMAGE* pLevel = &pLevels[i];
+			pBlocks[i] = new BYTE[DXTGetImageBytes(
+				pOptions->dwFourCC, pLevel->dwWidth, pLevel->dwHeight)];
+			if (!pBlocks[i]) {
+				hr = DDERR_OUTOFMEMORY;
+				break;
+			}
+			DXTCOMPRESSJOB* pDXT = &Compress[i];
+			memset(pDXT, 0, sizeof(DXTCOMPRESSJOB));
+			pDXT->dwFourCC = pOptions->dwFourCC;
+			pDXT->pSrc = pLevel->pdwPixels;
+			pDXT->lSrcPitch = (LONG)(pLevel->dwWidth * 4);
+			pDXT->dwWidth = pLevel->dwWidth;
+			pDXT->dwHeight = pLevel->dwHeight;
+			pDXT->pDest = pBlocks[i];
+			pDXT->lDestPitch =
+				(LONG)DXTGetPitch(pOptions->dwFourCC, pLevel->dwWidth);
+			// The space around the sprites is transparent
+			pDXT->dwFlags = pOptions->dwQuality | DXTC_BC1_ALPHA;
+		}
+		if (SUCCEEDED(hr)) {
+			hr = DXTCompressImages(pPool, Compress, dwLevels, 0);
+		}
+	}
+	QueryPerformanceCounter(&liCompressed);
+	*pdMipTime = ElapsedMilliseconds(&liStart, &liMipped);
+	*pdCompressTime = ElapsedMilliseconds(&liMipped, &liCompressed);
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ParseOptions()
+// Desc: Read the command line, FALSE if it doesn't make sense. -cell and
+//       -key apply to the inputs after them.
+//-----------------------------------------------------------------------------
+static BOOL ParseOptions(
+	int argc, char** argv, AtlasOptions* pOptions, AtlasInputList* pList)
+{
+	static const struct {
+		const char* pName;
+		DWORD dwFourCC;
+	} s_Formats[] = {{"DXT1", FOURCC_DXT1}, {"DXT2", FOURCC_DXT2},
+		{"DXT3", FOURCC_DXT3}, {"DXT4", FOURCC_DXT4}, {"DXT5", FOURCC_DXT5},
+		{"ATI1", FOURCC_ATI1}, {"ATI2", FOURCC_ATI2}, {"BC7", FOURCC_BC7}};
+	AtlasInput Template;
+
+	memset(pOptions, 0, sizeof(AtlasOptions));
+	pOptions->dwQuality = DXTC_QUALITY_BEST;
+	pOptions->dwPadding = DEFAULT_PADDING;
+	pOptions->dwMaxSize = DEFAULT_MAX_SIZE;
+	memset(&Template, 0, sizeof(Template));
+	for (int i = 1; i < argc; ++i) {
+		const char* pArg = argv[i];
+		if (pArg[0] == '-' || pArg[0] == '/') {
+			++pArg;
+			if (!lstrcmpiA(pArg, "m")) {
+				pOptions->bMipMap = TRUE;
+			} else if (!lstrcmpiA(pArg, "box")) {
+				pOptions->dwMipFilter = TEX_FILTER_BOX;
+			} else if (!lstrcmpiA(pArg, "kaiser")) {
+				pOptions->dwMipFilter = TEX_FILTER_KAISER;
+			} else if (!lstrcmpiA(pArg, "lanczos")) {
+				pOptions->dwMipFilter = TEX_FILTER_LANCZOS;
+			} else if (!lstrcmpiA(pArg, "mitchell")) {
+				pOptions->dwMipFilter = TEX_FILTER_MITCHELL;
+			} else if (!lstrcmpiA(pArg, "srgb")) {
+				pOptions->dwMipFlags |= TEX_MIP_SRGB;
+			} else if (!lstrcmpiA(pArg, "fast")) {
+				pOptions->dwQuality = DXTC_QUALITY_FAST;
+			} else if (!lstrcmpiA(pArg, "normal")) {
+				pOptions->dwQuality = DXTC_QUALITY_NORMAL;
+			} else if (!lstrcmpiA(pArg, "best")) {
+				pOptions->dwQuality = DXTC_QUALITY_BEST;
+			} else if (!lstrcmpiA(pArg, "threads") && (i + 1 < argc)) {
+				pOptions->dwThreads = (DWORD)atol(argv[++i]);
+			} else if (!lstrcmpiA(pArg, "pad") && (i + 1 < argc)) {
+				pOptions->dwPadding = (DWORD)atol(argv[++i]);
+			} else if (!lstrcmpiA(pArg, "align") && (i + 1 < argc)) {
+				pOptions->dwAlign = (DWORD)atol(argv[++i]);
+			} else if (!lstrcmpiA(pArg, "max") && (i + 1 < argc)) {
+				pOptions->dwMaxSize = (DWORD)atol(argv[++i]);
+			} else if (!lstrcmpiA(pArg, "anysize")) {
+				pOptions->dwFlags |= TEX_ATLAS_ANYSIZE;
+			} else if (!lstrcmpiA(pArg, "cell") && (i + 2 < argc)) {
+				Template.dwCellWidth = (DWORD)atol(argv[++i]);
+				Template.dwCellHeight = (DWORD)atol(argv[++i]);
+				if (!Template.dwCellWidth || !Template.dwCellHeight) {
+					Template.dwCellWidth = 0;
+					Template.dwCellHeight = 0;
+				}
+			} else if (!lstrcmpiA(pArg, "key") && (i + 1 < argc)) {
+				const char* pKey = argv[++i];
+				if (!lstrcmpiA(pKey, "none")) {
+					Template.dwKey = KEY_NONE;
+				} else if (!lstrcmpiA(pKey, "auto")) {
+					Template.dwKey = KEY_AUTO;
+				} else {
+					Template.dwKey = KEY_COLOR;
+					Template.dwKeyColor = (DWORD)strtoul(pKey, NULL, 16);
+				}
+			} else {
+				return FALSE;
+			}
+			continue;
+		}
+		DWORD j;
+		for (j = 0; j < sizeof(s_Formats) / sizeof(s_Formats[0]); ++j) {
+			if (!lstrcmpiA(pArg, s_Formats[j].pName)) {
+				pOptions->dwFourCC = s_Formats[j].dwFourCC;
+				break;
+			}
+		}
+		if (j < sizeof(s_Formats) / sizeof(s_Formats[0])) {
+			continue;
+		}
+		if (!pOptions->pDestFile) {
+			if (!HasSuffix(pArg, ".dds") || (strlen(pArg) + 1 > MAX_PATH)) {
+				return FALSE;
+			}
+			pOptions->pDestFile = pArg;
+			sprintf(pOptions->szTableFile, "%.*s.atl",
+				(int)(strlen(pArg) - 4), pArg);
+		} else if (strlen(pArg) + 4 > MAX_PATH) {
+			fprintf(stderr, "Path too long: %s\n", pArg);
+		} else if (HasSuffix(pArg, ".bmp")) {
+			if (!AddInput(pList, &Template, pArg)) {
+				return FALSE;
+			}
+		} else if (!ScanDirectory(pArg, &Template, pList)) {
+			return FALSE;
+		}
+	}
+
+	// Keep blocks of compressed formats to one sprite
+	if (!pOptions->dwAlign) {
+		pOptions->dwAlign = pOptions->dwFourCC ? 4 : 1;
+	}
+	return pOptions->pDestFile && pList->dwCount && pOptions->dwMaxSize;
+}
+
+//-----------------------------------------------------------------------------
+// Name: main()
+// Desc: Build an atlas and print how fast it went
+//-----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	AtlasOptions Options;
+	AtlasInputList List;
+	memset(&List, 0, sizeof(List));
+	if (!ParseOptions(argc, argv, &Options, &List)) {
+		printf("Usage: dxtatlas [-pad n] [-align n] [-max n] [-anysize]\n"
+			   "                [-m [-box|-kaiser|-lanczos|-mitchell] "
+			   "[-srgb]]\n"
+			   "                [-fast|-normal|-best] [-threads n]\n"
+			   "                [DXT1|DXT2|DXT3|DXT4|DXT5|ATI1|ATI2|BC7]\n"
+			   "                out.dds [-cell w h] [-key auto|rrggbb|none] "
+			   "input...\n\n"
+			   "Packs every input .bmp, and every .bmp under input "
+			   "directories, with\n"
+			   "foo_a.bmp as the alpha of foo.bmp, into out.dds, trimmed "
+			   "of transparent\n"
+			   "borders, and writes where each one went to out.atl. "
+			   "-cell cuts the\n"
+			   "bitmaps after it into w by h sprites, -key makes a color "
+			   "transparent,\n"
+			   "auto is the top left pixel. With no format the atlas is "
+			   "ARGB8888.\n");
+		delete[] List.pInputs;
+		return 1;
+	}
+
+	DXTWorkPool* pPool;
+	if (FAILED(DXTPoolCreate(Options.dwThreads, &pPool))) {
+		fprintf(stderr, "Can't start the worker threads\n");
+		delete[] List.pInputs;
+		return 1;
+	}
+
+	LARGE_INTEGER liStart;
+	LARGE_INTEGER liLoaded;
+	LARGE_INTEGER liPacked;
+	LARGE_INTEGER liCopied;
+	LARGE_INTEGER liCompressed;
+	LARGE_INTEGER liWritten;
+	TEXATLASSPRITE* pSprites = NULL;
+	char (*pNames)[MAX_NAME] = NULL;
+	const char** ppNames = NULL;
+	TEXIMAGE Levels[MAX_LEVELS];
+	BYTE* pBlocks[MAX_LEVELS];
+	DWORD dwLevels = 1;
+	DWORD dwWidth = 0;
+	DWORD dwHeight = 0;
+	DWORD dwSprites = 0;
+	DWORD dwEmpty = 0;
+	double dUsed = 0.0;
+	double dMipTime = 0.0;
+	double dCompressTime = 0.0;
+	DWORD i;
+	DWORD j;
+	memset(Levels, 0, sizeof(Levels));
+	memset(pBlocks, 0, sizeof(pBlocks));
+
+	// Load, key and trim every bitmap on the pool
+	AtlasBuild Build;
+	Build.pList = &List;
+	Build.pAtlas = &Levels[0];
+	QueryPerformanceCounter(&liStart);
+	DXTPoolRun(pPool, LoadTask, &Build, List.dwCount);
+	QueryPerformanceCounter(&liLoaded);
+
+	// Gather the sprites in input order, a failed bitmap fails the atlas
+	HRESULT hr = DD_OK;
+	for (i = 0; i < List.dwCount; ++i) {
+		const AtlasInput* pInput = &List.pInputs[i];
+		if (FAILED(pInput->hr)) {
+			fprintf(stderr, "Failed: %s (error 0x%08lX)\n", pInput->szSrc,
+				(unsigned long)(DWORD)pInput->hr);
+			hr = pInput->hr;
+		}
+		dwSprites += pInput->dwSprites;
+	}
+	if (SUCCEEDED(hr)) {
+		pSprites = new TEXATLASSPRITE[dwSprites];
+		pNames = new char[dwSprites][MAX_NAME];
+		ppNames = new const char*[dwSprites];
+		if (!pSprites || !pNames || !ppNames) {
+			hr = DDERR_OUTOFMEMORY;
+		}
+	}
+	if (SUCCEEDED(hr)) {
+		DWORD dwNext = 0;
+		for (i = 0; i < List.dwCount; ++i) {
+			const AtlasInput* pInput = &List.pInputs[i];
+			for (j = 0; j < pInput->dwSprites; ++j) {
+				pSprites[dwNext] = pInput->pSprites[j];
+				GetSpriteName(pInput, j, pNames[dwNext]);
+				ppNames[dwNext] = pNames[dwNext];
+				++dwNext;
+			}
+		}
+		hr = TEXPackAtlas(pSprites, dwSprites, Options.dwPadding,
+			Options.dwAlign, Options.dwMaxSize, Options.dwFlags, &dwWidth,
+			&dwHeight);
+		if (hr == DDERR_TOOBIGSIZE) {
+			fprintf(stderr, "The sprites don't fit in %lu by %lu\n",
+				(unsigned long)Options.dwMaxSize,
+				(unsigned long)Options.dwMaxSize);
+		}
+	}
+	QueryPerformanceCounter(&liPacked);
+
+	// Hand the places back to the bitmaps and copy the sprites over
+	if (SUCCEEDED(hr)) {
+		hr = TEXCreateImage(dwWidth, dwHeight, &Levels[0]);
+	}
+	if (SUCCEEDED(hr)) {
+		memset(Levels[0].pdwPixels, 0, dwWidth * dwHeight * 4);
+		DWORD dwNext = 0;
+		for (i = 0; i < List.dwCount; ++i) {
+			AtlasInput* pInput = &List.pInputs[i];
+			for (j = 0; j < pInput->dwSprites; ++j) {
+				const TEXATLASSPRITE* pSprite = &pSprites[dwNext++];
+				pInput->pSprites[j] = *pSprite;
+				dUsed += (double)pSprite->dwWidth * (double)pSprite->dwHeight;
+				if (!pSprite->dwWidth) {
+					++dwEmpty;
+				}
+			}
+		}
+		DXTPoolRun(pPool, CopyTask, &Build, List.dwCount);
+	}
+	QueryPerformanceCounter(&liCopied);
+
+	if (SUCCEEDED(hr)) {
+		if (Options.bMipMap) {
+			dwLevels = TEXGetMipCount(dwWidth, dwHeight);
+		}
+		hr = BuildLevels(pPool, &Options, Levels, dwLevels, pBlocks,
+			&dMipTime, &dCompressTime);
+	}
+	QueryPerformanceCounter(&liCompressed);
+	if (SUCCEEDED(hr)) {
+		const void* pLevels[MAX_LEVELS];
+		for (i = 0; i < dwLevels; ++i) {
+			pLevels[i] = Options.dwFourCC ? (const void*)pBlocks[i] :
+				Levels[i].pdwPixels;
+		}
+		hr = DDSWriteFile(Options.pDestFile, Options.dwFourCC, dwWidth,
+			dwHeight, dwLevels, pLevels);
+	}
+	if (SUCCEEDED(hr)) {
+		hr = TEXWriteAtlasTable(Options.szTableFile, dwWidth, dwHeight,
+			pSprites, ppNames, dwSprites);
+	}
+	QueryPerformanceCounter(&liWritten);
+
+	if (SUCCEEDED(hr)) {
+		double dTotal = ElapsedMilliseconds(&liStart, &liWritten);
+		printf("Sprites     %lu from %lu bitmaps, %lu empty\n",
+			(unsigned long)dwSprites, (unsigned long)List.dwCount,
+			(unsigned long)dwEmpty);
+		printf("Atlas       %lu x %lu, %lu levels, %.1f%% covered\n",
+			(unsigned long)dwWidth, (unsigned long)dwHeight,
+			(unsigned long)dwLevels,
+			100.0 * dUsed / ((double)dwWidth * (double)dwHeight));
+		printf("Time        %.1f ms load and trim, %.1f ms pack, "
+			   "%.1f ms copy,\n"
+			   "            %.1f ms mip, %.1f ms compress, %.1f ms write\n",
+			ElapsedMilliseconds(&liStart, &liLoaded),
+			ElapsedMilliseconds(&liLoaded, &liPacked),
+			ElapsedMilliseconds(&liPacked, &liCopied), dMipTime,
+			dCompressTime, ElapsedMilliseconds(&liCompressed, &liWritten));
+		printf("Total       %.1f ms on %lu threads\n", dTotal,
+			(unsigned long)DXTPoolGetThreadCount(pPool));
+	} else {
+		fprintf(stderr, "Failed: %s (error 0x%08lX)\n", Options.pDestFile,
+			(unsigned long)(DWORD)hr);
+	}
+
+	for (i = 0; i < MAX_LEVELS; ++i) {
+		TEXFreeImage(&Levels[i]);
+		delete[] pBlocks[i];
+	}
+	for (i = 0; i < List.dwCount; ++i) {
+		TEXFreeImage(&List.pInputs[i].Image);
+		delete[] List.pInputs[i].pSprites;
+	}
+	delete[] ppNames;
+	delete[] pNames;
+	delete[] pSprites;
+	DXTPoolDestroy(pPool);
+	delete[] List.pInputs;
+	return SUCCEEDED(hr) ? 0 : 2;
+}
@@ -0,0 +1,229 @@
+//-----------------------------------------------------------------------------
+// File: dxtbench.cpp
+//
+// Desc: Scaling benchmark for the threaded DXTn encoder.
+//
+//       Compresses every face and mip level of a synthetic cube map with
+//       DXTCompressImages(), once for each thread count from 1 up to the
+//       number of processors. The best time of a few runs, the speedup over
+//       one thread and the parallel efficiency are shown in a message box
+//       and sent to the debugger.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include <windows.h>
+
+#include "dxtcodec.h"
+#include "dxtpool.h"
+#include "resource.h"
+#include <stdio.h>
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// Local definitions
+//-----------------------------------------------------------------------------
+#define TITLE "DXTn Compression Scaling Benchmark"
+
+//-----------------------------------------------------------------------------
+// Default settings
+//-----------------------------------------------------------------------------
+#define FACE_SIZE 256 // Width and height of the top mip level
+#define FACE_COUNT 6  // A full cube map
+#define MAX_LEVELS 16 // Enough mip levels for FACE_SIZE
+#define PASSES 3      // Best of this many runs is reported
+
+//-----------------------------------------------------------------------------
+// Name: ElapsedMilliseconds()
+// Desc: Convert a span of QueryPerformanceCounter() ticks to milliseconds
+//-----------------------------------------------------------------------------
+static double ElapsedMilliseconds(
+	const LARGE_INTEGER* pStart, const LARGE_INTEGER* pEnd)
+{
+	LARGE_INTEGER liFrequency;
+	QueryPerformanceFrequency(&liFrequency);
+	return (double)(pEnd->QuadPart - pStart->QuadPart) * 1000.0 /
+		(double)liFrequency.QuadPart;
+}
+
+//-----------------------------------------------------------------------------
+// Name: FillFace()
+// Desc: Smooth gradients with some noise, so the encoder has real work to
+//       do on every block
+//-----------------------------------------------------------------------------
+static void FillFace(DWORD* pPixels, DWORD dwSize, DWORD dwFace)
+{
+	DWORD dwSeed = 12345 + dwFace;
+	for (DWORD y = 0; y < dwSize; ++y) {
+		for (DWORD x = 0; x < dwSize; ++x) {
+			dwSeed = (dwSeed * 1664525) + 1013904223;
+			DWORD dwNoise = (dwSeed >> 24) & 31;
+			DWORD dwRed = ((x * 255) / dwSize + dwNoise) & 0xFF;
+			DWORD dwGreen = ((y * 255) / dwSize + dwFace * 40) & 0xFF;
+			DWORD dwBlue = (((x + y) * 127) / dwSize + dwNoise) & 0xFF;
+			DWORD dwAlpha = (x ^ y) & 0xFF;
+			pPixels[(y * dwSize) + x] =
+				(dwAlpha << 24) | (dwRed << 16) | (dwGreen << 8) | dwBlue;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: BuildJobs()
+// Desc: Allocate the source and destination of every face and mip level.
+//       Smaller levels reuse the top of their face's pixels, their content
+//       doesn't matter for timing. Returns the number of jobs.
+//-----------------------------------------------------------------------------
+static DWORD BuildJobs(DXTCOMPRESSJOB* pJobs, DWORD dwFourCC)
+{
+	DWORD dwJobs = 0;
+	for (DWORD dwFace = 0; dwFace < FACE_COUNT; ++dwFace) {
+		DWORD* pPixels =
+			(DWORD*)GlobalAlloc(GMEM_FIXED, FACE_SIZE * FACE_SIZE * sizeof(DWORD));
+		if (pPixels == NULL) {
+			break;
+		}
+		FillFace(pPixels, FACE_SIZE, dwFace);
+		DWORD dwSize = FACE_SIZE;
+		for (;;) {
+			DXTCOMPRESSJOB* pJob = &pJobs[dwJobs];
+			pJob->dwFourCC = dwFourCC;
+			pJob->pSrc = pPixels;
+			pJob->lSrcPitch = (LONG)(dwSize * sizeof(DWORD));
+			pJob->dwWidth = dwSize;
+			pJob->dwHeight = dwSize;
+			pJob->pDest = GlobalAlloc(
+				GMEM_FIXED, DXTGetImageBytes(dwFourCC, dwSize, dwSize));
+			pJob->lDestPitch = (LONG)DXTGetPitch(dwFourCC, dwSize);
+			pJob->dwFlags = 0;
+			if (pJob->pDest == NULL) {
+				if (dwSize == FACE_SIZE) {
+					GlobalFree(pPixels);
+				}
+				break;
+			}
+			++dwJobs;
+			if (dwSize == 1) {
+				break;
+			}
+			dwSize >>= 1;
+		}
+	}
+	return dwJobs;
+}
+
+//-----------------------------------------------------------------------------
+// Name: FreeJobs()
+// Desc: Release everything BuildJobs() allocated
+//-----------------------------------------------------------------------------
+static void FreeJobs(DXTCOMPRESSJOB* pJobs, DWORD dwJobs)
+{
+	for (DWORD i = 0; i < dwJobs; ++i) {
+		GlobalFree(pJobs[i].pDest);
+		// The top level of each face owns the pixels
+		if (pJobs[i].dwWidth == FACE_SIZE) {
+			GlobalFree((HGLOBAL)pJobs[i].pSrc);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: TimeThreads()
+// Desc: Best time in milliseconds to compress every job with a pool of
+//       dwThreads threads, or a negative number if the pool can't be made
+//-----------------------------------------------------------------------------
+static double TimeThreads(DXTCOMPRESSJOB* pJobs, DWORD dwJobs, DWORD dwThreads)
+{
+	DXTWorkPool* pPool;
+	if (FAILED(DXTPoolCreate(dwThreads, &pPool)) ||
+		(DXTPoolGetThreadCount(pPool) != dwThreads)) {
+		DXTPoolDestroy(pPool);
+		return -1.0;
+	}
+
+	double dBest = 0.0;
+	for (DWORD i = 0; i < PASSES; ++i) {
+		LARGE_INTEGER liStart;
+		LARGE_INTEGER liEnd;
+		QueryPerformanceCounter(&liStart);
+		DXTCompressImages(pPool, pJobs, dwJobs, 0);
+		QueryPerformanceCounter(&liEnd);
+		double dTime = ElapsedMilliseconds(&liStart, &liEnd);
+		if (!i || (dTime < dBest)) {
+			dBest = dTime;
+		}
+	}
+	DXTPoolDestroy(pPool);
+	return dBest;
+}
+
+//-----------------------------------------------------------------------------
+// Name: WinMain()
+// Desc: Run the benchmark for every thread count and show the results
+//-----------------------------------------------------------------------------
+int APIENTRY WinMain(HINSTANCE /* hInstance */, HINSTANCE /* hPrevInstance */,
+	LPSTR /* lpCmdLine */, int /* nCmdShow */)
+{
+	DXTCOMPRESSJOB Jobs[FACE_COUNT * MAX_LEVELS];
+	DWORD dwLevels = 1;
+	for (DWORD dwSize = FACE_SIZE; dwSize > 1; dwSize >>= 1) {
+		++dwLevels;
+	}
+	DWORD dwJobs = BuildJobs(Jobs, FOURCC_DXT5);
+	if (dwJobs != (FACE_COUNT * dwLevels)) {
+		FreeJobs(Jobs, dwJobs);
+		MessageBoxA(NULL, "Out of memory", TITLE, MB_OK);
+		return FALSE;
+	}
+
+	DWORD dwProcessors = DXTPoolGetProcessorCount();
+	char szOutput[4096];
+	sprintf(szOutput,
+		"DXT5 cube map, %d faces of %dx%d with %lu mip levels each\n"
+		"%lu processors\n\n"
+		"Threads        ms  Speedup  Efficiency\n",
+		FACE_COUNT, FACE_SIZE, FACE_SIZE, dwLevels, dwProcessors);
+
+	// Show something while the tests run, they take a while
+	SetCursor(LoadCursorA(NULL, IDC_WAIT));
+	double dSingle = 0.0;
+	for (DWORD dwThreads = 1; dwThreads <= dwProcessors; ++dwThreads) {
+		size_t uUsed = strlen(szOutput);
+		char* pEnd = szOutput + uUsed;
+		size_t uLeft = sizeof(szOutput) - uUsed;
+		double dTime = TimeThreads(Jobs, dwJobs, dwThreads);
+		int iLength;
+		if (dTime < 0.0) {
+			iLength =
+				_snprintf(pEnd, uLeft, "%7lu  not available\n", dwThreads);
+		} else {
+			if (dwThreads == 1) {
+				dSingle = dTime;
+			}
+			double dSpeedup = dSingle / dTime;
+			iLength = _snprintf(pEnd, uLeft, "%7lu %9.1f %8.2f %10.0f%%\n",
+				dwThreads, dTime, dSpeedup,
+				(dSpeedup * 100.0) / (double)dwThreads);
+		}
+
+		// Machines with lots of processors stop once the table is full,
+		// _snprintf() doesn't terminate a row that was cut short
+		if ((iLength < 0) || ((size_t)iLength >= uLeft)) {
+			*pEnd = 0;
+			break;
+		}
+		if (dTime < 0.0) {
+			break;
+		}
+	}
+	FreeJobs(Jobs, dwJobs);
+
+	OutputDebugStringA(szOutput);
+	MessageBoxA(NULL, szOutput, TITLE, MB_OK);
+	return 0;
+}
@@ -0,0 +1 @@
+#define IDI_MAIN_ICON                   101
@@ -0,0 +1,1333 @@
+//-----------------------------------------------------------------------------
+// File: dxtconv.cpp
+//
+// Desc: Command line batch converter from bitmaps to DDS textures.
+//
+//       Walks a directory tree for .bmp files, merges in foo_a.bmp as the
+//       alpha of foo.bmp when it's there, optionally builds mip maps,
+//       compresses and writes foo.dds to the same place in an output tree.
+//       Everything goes through texlib, there's no window, DirectDraw
+//       object or MFC document involved.
+//
+//       Files are done in batches. Loading, alpha and mip generation run as
+//       one pool task per file, then the levels of every file in the batch
+//       are compressed with a single DXTCompressImages() call, which cuts
+//       large levels into bands so one big texture still uses every core.
+//       Writing is one task per file again. Throughput is printed at the
+//       end.
+//
+//       With a cache directory, each level's source pixels are hashed with
+//       the format and quality while loading. Levels already in the cache
+//       are copied from it instead of compressed, new ones are added to it
+//       while writing.
+//
+//       Bitmaps over the streaming limit never load whole. They're read a
+//       band of rows at a time into a mip stream, and each band of each
+//       level is compressed across the pool and written straight to its
+//       place in the DDS file, so memory stays at a few bands per level
+//       however large the texture is.
+//
+//       Volume textures, DDS files with more than one slice, are read from
+//       the tree too. They're converted a round of top level slices at a
+//       time: the slices are decoded on the pool, each level below gets as
+//       many new slices as the slices above it pair up for, one task per
+//       slice, and every new slice of every level is compressed in one
+//       call and written to its place. A level only keeps a slice that's
+//       still waiting for its pair, so a 256x256x256 volume or a far larger
+//       one never has its whole chain in memory.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include <windows.h>
+
+#include "ddsfile.h"
+#include "dxtcache.h"
+#include "dxtcodec.h"
+#include "dxtpool.h"
+#include "teximage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// Default settings
+//-----------------------------------------------------------------------------
+#define MAX_LEVELS 16            // Enough mip levels for any bitmap
+#define BATCH_FILES 64           // Most files loaded at once
+#define BATCH_BYTES (64 << 20)   // Most bitmap bytes loaded at once
+#define CACHE_MEGABYTES 1024     // Default size limit of the block cache
+#define STREAM_MEGABYTES 256     // Default size above which files stream
+#define STREAM_ROWS 256          // Rows read, filtered and written at once
+
+//-----------------------------------------------------------------------------
+// Settings from the command line
+//-----------------------------------------------------------------------------
+struct ConvOptions {
+	DWORD dwFourCC;  // Format to write, 0 for ARGB8888
+	DWORD dwQuality; // DXTC_QUALITY_ flags
+	BOOL bMipMap;    // Build a full mip chain
+	DWORD dwMipFlags; // TEX_MIP_ flags for the mip chain
+	DWORD dwMipFilter; // TEX_FILTER_ kernel for the mip chain
+	DWORD dwThreads; // Pool size, 0 for one per processor
+	const char* pCacheDir; // Block cache directory, NULL for none
+	DWORD dwCacheMegabytes;
+	DWORD dwStreamMegabytes; // Bitmaps larger than this stream
+	const char* pSrcDir;
+	const char* pDestDir;
+};
+
+//-----------------------------------------------------------------------------
+// One bitmap found in the source tree
+//-----------------------------------------------------------------------------
+struct ConvFile {
+	char szSrc[MAX_PATH];
+	char szAlpha[MAX_PATH]; // Empty if there's no _a.bmp
+	char szDest[MAX_PATH];
+	DWORD dwBytes;          // Size of the bitmap and its alpha bitmap
+	BOOL bVolume;           // szSrc is a DDS volume texture, not a bitmap
+};
+
+//-----------------------------------------------------------------------------
+// Growable list of bitmaps
+//-----------------------------------------------------------------------------
+struct ConvFileList {
+	ConvFile* pFiles;
+	DWORD dwCount;
+	DWORD dwMax;
+};
+
+//-----------------------------------------------------------------------------
+// A file being converted, from load to write
+//-----------------------------------------------------------------------------
+struct ConvJob {
+	const ConvFile* pFile;
+	HRESULT hr;                   // First failure, if any
+	DWORD dwWidth;                // Size of the top level
+	DWORD dwHeight;
+	DWORD dwLevels;               // Mip levels in Levels and pBlocks
+	TEXIMAGE Levels[MAX_LEVELS];  // ARGB8888 pixels of each level
+	BYTE* pBlocks[MAX_LEVELS];    // Compressed levels, NULL for ARGB8888
+	DXTCOMPRESSJOB Compress[MAX_LEVELS]; // How each level is compressed
+	DXTCACHEKEY Keys[MAX_LEVELS]; // Cache key of each level
+	BOOL bCached[MAX_LEVELS];     // Level came from the cache
+	DWORD dwBytesOut;             // Size of the DDS file written
+};
+
+//-----------------------------------------------------------------------------
+// Context handed to the pool tasks
+//-----------------------------------------------------------------------------
+struct ConvBatch {
+	ConvJob* pJobs;
+	DWORD dwJobs;
+	const ConvOptions* pOptions;
+	DXTCache* pCache;             // NULL if there's no cache
+};
+
+//-----------------------------------------------------------------------------
+// A file being streamed, handed to the mip stream's band callback
+//-----------------------------------------------------------------------------
+struct ConvStream {
+	const ConvOptions* pOptions;
+	DXTWorkPool* pPool;
+	DDSWriter* pWriter;
+	DWORD dwWidth;                // Width of the top level
+	BYTE* pBlocks;                // One band compressed, NULL for ARGB8888
+};
+
+//-----------------------------------------------------------------------------
+// One mip level of a volume being converted. The slices are the ones read
+// or filtered this round, after any left from the last round that are still
+// waiting to be paired up for the level below.
+//-----------------------------------------------------------------------------
+struct VolumeLevel {
+	DWORD dwWidth;
+	DWORD dwHeight;
+	DWORD dwDepth;
+	TEXIMAGE* pSlices;            // Room for ConvVolume::dwMaxSlices
+	BYTE* pBlocks;                // Compressed slices, NULL for ARGB8888
+	DWORD dwSliceBlocks;          // Bytes of one slice in pBlocks
+	DWORD dwFirstSlice;           // Slice number of pSlices[0]
+	DWORD dwHeld;                 // Slices in pSlices
+	DWORD dwNew;                  // Of those, the last ones are this round's
+};
+
+//-----------------------------------------------------------------------------
+// A volume texture being converted, handed to the pool tasks
+//-----------------------------------------------------------------------------
+struct ConvVolume {
+	const ConvOptions* pOptions;
+	DWORD dwSrcFourCC;            // Format read, 0 for 32-bit RGB
+	DWORD dwShift[4];             // 32-bit RGB, where A, R, G and B are
+	BOOL bOpaque;                 // 32-bit RGB with no alpha
+	BYTE* pRaw;                   // Compressed slices as read
+	DWORD dwRawBytes;             // Bytes of one slice in pRaw
+	DWORD dwMaxSlices;            // Top level slices per round, plus one
+	DWORD dwLevels;
+	DWORD dwTaskLevel;            // Level VolumeMipTask() reads
+	VolumeLevel Levels[MAX_LEVELS];
+};
+
+//-----------------------------------------------------------------------------
+// Totals for the whole run
+//-----------------------------------------------------------------------------
+struct ConvStats {
+	DWORD dwFilesOk;
+	DWORD dwFilesFailed;
+	double dPixels;      // Top level pixels of the converted files
+	double dBytesIn;
+	double dBytesOut;
+	double dLoadTime;    // Milliseconds spent in each phase
+	double dCompressTime;
+	double dWriteTime;
+	DWORD dwFilesStreamed;
+	double dStreamTime;  // Reading to writing of the streamed files
+};
+
+//-----------------------------------------------------------------------------
+// Name: ElapsedMilliseconds()
+// Desc: Convert a span of QueryPerformanceCounter() ticks to milliseconds
+//-----------------------------------------------------------------------------
+static double ElapsedMilliseconds(
+	const LARGE_INTEGER* pStart, const LARGE_INTEGER* pEnd)
+{
+	LARGE_INTEGER liFrequency;
+	QueryPerformanceFrequency(&liFrequency);
+	return (double)(pEnd->QuadPart - pStart->QuadPart) * 1000.0 /
+		(double)liFrequency.QuadPart;
+}
+
+//-----------------------------------------------------------------------------
+// Name: HasSuffix()
+// Desc: TRUE if pName ends with pSuffix, ignoring case
+//-----------------------------------------------------------------------------
+static BOOL HasSuffix(const char* pName, const char* pSuffix)
+{
+	size_t uName = strlen(pName);
+	size_t uSuffix = strlen(pSuffix);
+	return (uName > uSuffix) &&
+		(lstrcmpiA(pName + (uName - uSuffix), pSuffix) == 0);
+}
+
+//-----------------------------------------------------------------------------
+// Name: AddFile()
+// Desc: Append a bitmap to the list, growing it as needed
+//-----------------------------------------------------------------------------
+static BOOL AddFile(ConvFileList* pList, const ConvFile* pFile)
+{
+	if (pList->dwCount == pList->dwMax) {
+		DWORD dwMax = pList->dwMax ? pList->dwMax * 2 : 256;
+		ConvFile* pFiles = new ConvFile[dwMax];
+		if (!pFiles) {
+			return FALSE;
+		}
+		if (pList->dwCount) {
+			memcpy(pFiles, pList->pFiles, sizeof(ConvFile) * pList->dwCount);
+		}
+		delete[] pList->pFiles;
+		pList->pFiles = pFiles;
+		pList->dwMax = dwMax;
+	}
+	pList->pFiles[pList->dwCount++] = *pFile;
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ScanDirectory()
+// Desc: Add every bitmap under pSrcDir to the list, except alpha bitmaps,
+//       and every volume texture, and make the matching directories under
+//       pDestDir
+//-----------------------------------------------------------------------------
+static BOOL ScanDirectory(
+	const char* pSrcDir, const char* pDestDir, ConvFileList* pList)
+{
+	WIN32_FIND_DATAA FindData;
+	char szPattern[MAX_PATH];
+
+	CreateDirectoryA(pDestDir, NULL);
+	if (strlen(pSrcDir) + 3 > MAX_PATH) {
+		return TRUE;
+	}
+	sprintf(szPattern, "%s\\*", pSrcDir);
+	HANDLE hFind = FindFirstFileA(szPattern, &FindData);
+	if (hFind == INVALID_HANDLE_VALUE) {
+		return TRUE;
+	}
+	BOOL bOk = TRUE;
+	do {
+		const char* pName = FindData.cFileName;
+		// Room for a separator and for foo.bmp to become foo_a.bmp
+		if ((strlen(pSrcDir) + strlen(pName) + 4 > MAX_PATH) ||
+			(strlen(pDestDir) + strlen(pName) + 4 > MAX_PATH)) {
+			fprintf(stderr, "Path too long: %s\\%s\n", pSrcDir, pName);
+			continue;
+		}
+		if (FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			char szSrcSub[MAX_PATH];
+			char szDestSub[MAX_PATH];
+			if (!strcmp(pName, ".") || !strcmp(pName, "..")) {
+				continue;
+			}
+			sprintf(szSrcSub, "%s\\%s", pSrcDir, pName);
+			sprintf(szDestSub, "%s\\%s", pDestDir, pName);
+			bOk = ScanDirectory(szSrcSub, szDestSub, pList);
+		} else if (HasSuffix(pName, ".bmp") && !HasSuffix(pName, "_a.bmp")) {
+			ConvFile File;
+			size_t uBase = strlen(pName) - 4;
+			File.bVolume = FALSE;
+			sprintf(File.szSrc, "%s\\%s", pSrcDir, pName);
+			sprintf(File.szDest, "%s\\%.*s.dds", pDestDir, (int)uBase, pName);
+			sprintf(File.szAlpha, "%s\\%.*s_a.bmp", pSrcDir, (int)uBase, pName);
+			// Files over 4 GB count as 4 GB, which streams them anyway
+			File.dwBytes =
+				FindData.nFileSizeHigh ? 0xFFFFFFFF : FindData.nFileSizeLow;
+			WIN32_FIND_DATAA AlphaData;
+			HANDLE hAlpha = FindFirstFileA(File.szAlpha, &AlphaData);
+			if (hAlpha != INVALID_HANDLE_VALUE) {
+				DWORD dwAlphaBytes = AlphaData.nFileSizeHigh ?
+					0xFFFFFFFF : AlphaData.nFileSizeLow;
+				File.dwBytes = dwAlphaBytes > 0xFFFFFFFF - File.dwBytes ?
+					0xFFFFFFFF : File.dwBytes + dwAlphaBytes;
+				FindClose(hAlpha);
+			} else {
+				File.szAlpha[0] = 0;
+			}
+			bOk = AddFile(pList, &File);
+		} else if (HasSuffix(pName, ".dds")) {
+			// Only the header is read, 2D textures are left alone
+			ConvFile File;
+			DDSReader* pReader;
+			sprintf(File.szSrc, "%s\\%s", pSrcDir, pName);
+			sprintf(File.szDest, "%s\\%s", pDestDir, pName);
+			File.szAlpha[0] = 0;
+			File.dwBytes =
+				FindData.nFileSizeHigh ? 0xFFFFFFFF : FindData.nFileSizeLow;
+			File.bVolume = TRUE;
+			if (SUCCEEDED(DDSOpenReader(File.szSrc, &pReader))) {
+				if (DDSGetReaderHeader(pReader)->dwDepth > 1) {
+					bOk = AddFile(pList, &File);
+				}
+				DDSCloseReader(pReader);
+			}
+		}
+	} while (bOk && FindNextFileA(hFind, &FindData));
+	FindClose(hFind);
+	return bOk;
+}
+
+//-----------------------------------------------------------------------------
+// Name: FreeJob()
+// Desc: Release the pixels and blocks of a file
+//-----------------------------------------------------------------------------
+static void FreeJob(ConvJob* pJob)
+{
+	for (DWORD i = 0; i < MAX_LEVELS; ++i) {
+		TEXFreeImage(&pJob->Levels[i]);
+		delete[] pJob->pBlocks[i];
+		pJob->pBlocks[i] = NULL;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: InitCompressJob()
+// Desc: Describe how one level is compressed into its blocks
+//-----------------------------------------------------------------------------
+static void InitCompressJob(const ConvOptions* pOptions,
+	const TEXIMAGE* pLevel, BYTE* pBlocks, DXTCOMPRESSJOB* pDXT)
+{
+	memset(pDXT, 0, sizeof(DXTCOMPRESSJOB));
+	pDXT->dwFourCC = pOptions->dwFourCC;
+	pDXT->pSrc = pLevel->pdwPixels;
+	pDXT->lSrcPitch = (LONG)(pLevel->dwWidth * 4);
+	pDXT->dwWidth = pLevel->dwWidth;
+	pDXT->dwHeight = pLevel->dwHeight;
+	pDXT->pDest = pBlocks;
+	pDXT->lDestPitch = (LONG)DXTGetPitch(pOptions->dwFourCC, pLevel->dwWidth);
+	// Bitmaps load as ARGB, the same as in DxTex
+	pDXT->dwFlags = pOptions->dwQuality | DXTC_BC1_ALPHA;
+}
+
+//-----------------------------------------------------------------------------
+// Name: LoadTask()
+// Desc: Pool task, load one bitmap and its alpha, build its mip levels and
+//       allocate the blocks they'll be compressed into
+//-----------------------------------------------------------------------------
+static void LoadTask(void* pContext, DWORD dwTask)
+{
+	ConvBatch* pBatch = static_cast<ConvBatch*>(pContext);
+	ConvJob* pJob = &pBatch->pJobs[dwTask];
+	const ConvOptions* pOptions = pBatch->pOptions;
+
+	HRESULT hr = TEXLoadBmp(pJob->pFile->szSrc, &pJob->Levels[0]);
+	if (SUCCEEDED(hr) && pJob->pFile->szAlpha[0]) {
+		hr = TEXLoadAlphaBmp(pJob->pFile->szAlpha, &pJob->Levels[0]);
+	}
+	if (SUCCEEDED(hr)) {
+		pJob->dwWidth = pJob->Levels[0].dwWidth;
+		pJob->dwHeight = pJob->Levels[0].dwHeight;
+		pJob->dwLevels = 1;
+		if (pOptions->bMipMap) {
+			pJob->dwLevels = TEXGetMipCount(
+				pJob->Levels[0].dwWidth, pJob->Levels[0].dwHeight);
+		}
+		for (DWORD i = 1; SUCCEEDED(hr) && (i < pJob->dwLevels); ++i) {
+			const TEXIMAGE* pSrc = &pJob->Levels[i - 1];
+			hr = TEXCreateImage(pSrc->dwWidth > 1 ? pSrc->dwWidth >> 1 : 1,
+				pSrc->dwHeight > 1 ? pSrc->dwHeight >> 1 : 1, &pJob->Levels[i]);
+			// Files are already spread over the pool, so each one filters
+			// on the thread it loaded on
+			if (SUCCEEDED(hr)) {
+				hr = TEXFilterMip(pSrc->pdwPixels, (LONG)(pSrc->dwWidth * 4),
+					pSrc->dwWidth, pSrc->dwHeight, pJob->Levels[i].pdwPixels,
+					(LONG)(pJob->Levels[i].dwWidth * 4), pOptions->dwMipFilter,
+					pOptions->dwMipFlags, NULL);
+			}
+		}
+	}
+	for (DWORD i = 0; SUCCEEDED(hr) && pOptions->dwFourCC &&
+		(i < pJob->dwLevels); ++i) {
+		pJob->pBlocks[i] = new BYTE[DXTGetImageBytes(pOptions->dwFourCC,
+			pJob->Levels[i].dwWidth, pJob->Levels[i].dwHeight)];
+		if (!pJob->pBlocks[i]) {
+			hr = DDERR_OUTOFMEMORY;
+			break;
+		}
+		InitCompressJob(pOptions, &pJob->Levels[i], pJob->pBlocks[i],
+			&pJob->Compress[i]);
+		if (pBatch->pCache) {
+			DXTCacheGetKey(&pJob->Compress[i], &pJob->Keys[i]);
+			pJob->bCached[i] =
+				DXTCacheLoad(pBatch->pCache, &pJob->Keys[i], &pJob->Compress[i]);
+		}
+	}
+	if (FAILED(hr)) {
+		FreeJob(pJob);
+	}
+	pJob->hr = hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: WriteTask()
+// Desc: Pool task, save one converted file and release its memory
+//-----------------------------------------------------------------------------
+static void WriteTask(void* pContext, DWORD dwTask)
+{
+	ConvBatch* pBatch = static_cast<ConvBatch*>(pContext);
+	ConvJob* pJob = &pBatch->pJobs[dwTask];
+	DWORD dwFourCC = pBatch->pOptions->dwFourCC;
+
+	if (SUCCEEDED(pJob->hr) && pBatch->pCache) {
+		for (DWORD i = 0; dwFourCC && (i < pJob->dwLevels); ++i) {
+			if (!pJob->bCached[i]) {
+				DXTCacheStore(
+					pBatch->pCache, &pJob->Keys[i], &pJob->Compress[i]);
+			}
+		}
+	}
+	if (SUCCEEDED(pJob->hr)) {
+		const void* pLevels[MAX_LEVELS];
+		pJob->dwBytesOut = 4 + sizeof(DDSFILEHEADER);
+		if (DDSNeedsDX10Header(dwFourCC)) {
+			pJob->dwBytesOut += sizeof(DDSHEADERDX10);
+		}
+		for (DWORD i = 0; i < pJob->dwLevels; ++i) {
+			const TEXIMAGE* pLevel = &pJob->Levels[i];
+			pLevels[i] =
+				dwFourCC ? (const void*)pJob->pBlocks[i] : pLevel->pdwPixels;
+			pJob->dwBytesOut +=
+				DDSGetLevelBytes(dwFourCC, pLevel->dwWidth, pLevel->dwHeight);
+		}
+		pJob->hr = DDSWriteFile(pJob->pFile->szDest, dwFourCC,
+			pJob->Levels[0].dwWidth, pJob->Levels[0].dwHeight,
+			pJob->dwLevels, pLevels);
+	}
+	FreeJob(pJob);
+}
+
+//-----------------------------------------------------------------------------
+// Name: CompressBatch()
+// Desc: Compress every level of every loaded file that didn't come from the
+//       cache in one call, so the bands of all of them share the pool
+//-----------------------------------------------------------------------------
+static void CompressBatch(DXTWorkPool* pPool, ConvBatch* pBatch)
+{
+	DWORD dwCount = 0;
+	DWORD i;
+	DWORD dwLevel;
+	for (i = 0; i < pBatch->dwJobs; ++i) {
+		const ConvJob* pJob = &pBatch->pJobs[i];
+		for (dwLevel = 0; SUCCEEDED(pJob->hr) && (dwLevel < pJob->dwLevels);
+			 ++dwLevel) {
+			if (!pJob->bCached[dwLevel]) {
+				++dwCount;
+			}
+		}
+	}
+	if (!dwCount) {
+		return;
+	}
+
+	// DXTCompressImages() takes one array, the results are copied back
+	DXTCOMPRESSJOB* pCompress = new DXTCOMPRESSJOB[dwCount];
+	HRESULT hr = DDERR_OUTOFMEMORY;
+	if (pCompress) {
+		DWORD dwNext = 0;
+		for (i = 0; i < pBatch->dwJobs; ++i) {
+			const ConvJob* pJob = &pBatch->pJobs[i];
+			for (dwLevel = 0;
+				 SUCCEEDED(pJob->hr) && (dwLevel < pJob->dwLevels); ++dwLevel) {
+				if (!pJob->bCached[dwLevel]) {
+					pCompress[dwNext++] = pJob->Compress[dwLevel];
+				}
+			}
+		}
+		hr = DXTCompressImages(pPool, pCompress, dwCount, 0);
+		dwNext = 0;
+		for (i = 0; i < pBatch->dwJobs; ++i) {
+			ConvJob* pJob = &pBatch->pJobs[i];
+			for (dwLevel = 0;
+				 SUCCEEDED(pJob->hr) && (dwLevel < pJob->dwLevels); ++dwLevel) {
+				if (!pJob->bCached[dwLevel]) {
+					pJob->Compress[dwLevel] = pCompress[dwNext++];
+				}
+			}
+		}
+		delete[] pCompress;
+	}
+	if (FAILED(hr)) {
+		for (i = 0; i < pBatch->dwJobs; ++i) {
+			if (SUCCEEDED(pBatch->pJobs[i].hr)) {
+				pBatch->pJobs[i].hr = hr;
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: IsStreamed()
+// Desc: TRUE if a file is too large to load whole, or a volume, which is
+//       always converted a round of slices at a time
+//-----------------------------------------------------------------------------
+static BOOL IsStreamed(const ConvOptions* pOptions, const ConvFile* pFile)
+{
+	return pFile->bVolume ||
+		(ULONGLONG)pFile->dwBytes >
+		((ULONGLONG)pOptions->dwStreamMegabytes << 20);
+}
+
+//-----------------------------------------------------------------------------
+// Name: StreamBand()
+// Desc: Mip stream callback, compress one band of a level across the pool
+//       and write it to its place in the file
+//-----------------------------------------------------------------------------
+static HRESULT StreamBand(void* pContext, DWORD dwLevel, DWORD dwFirstRow,
+	DWORD dwRows, const void* pRows, LONG lPitch)
+{
+	ConvStream* pStream = static_cast<ConvStream*>(pContext);
+	const ConvOptions* pOptions = pStream->pOptions;
+	if (!pOptions->dwFourCC) {
+		return DDSWriteRows(
+			pStream->pWriter, dwLevel, 0, dwFirstRow, dwRows, pRows);
+	}
+
+	// The rows are packed, so they pass for a short image
+	TEXIMAGE Band;
+	DXTCOMPRESSJOB Compress;
+	Band.dwWidth = pStream->dwWidth >> dwLevel;
+	Band.dwWidth = Band.dwWidth ? Band.dwWidth : 1;
+	Band.dwHeight = dwRows;
+	Band.pdwPixels = static_cast<DWORD*>(const_cast<void*>(pRows));
+	if (lPitch != (LONG)(Band.dwWidth * 4)) {
+		return DDERR_INVALIDPARAMS;
+	}
+	InitCompressJob(pOptions, &Band, pStream->pBlocks, &Compress);
+	HRESULT hr = DXTCompressImages(pStream->pPool, &Compress, 1, 0);
+	if (SUCCEEDED(hr)) {
+		hr = DDSWriteRows(pStream->pWriter, dwLevel, 0, dwFirstRow, dwRows,
+			pStream->pBlocks);
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: StreamFile()
+// Desc: Convert one file a band of rows at a time, from reading the bitmap
+//       to writing the DDS file, and set the top level pixels and the size
+//       of the file written
+//-----------------------------------------------------------------------------
+static HRESULT StreamFile(DXTWorkPool* pPool, const ConvOptions* pOptions,
+	const ConvFile* pFile, double* pdPixels, double* pdBytesOut)
+{
+	TEXBmpReader* pColor = NULL;
+	TEXBmpReader* pAlpha = NULL;
+	TEXMipStream* pMips = NULL;
+	DWORD* pdwAlpha = NULL;
+	ConvStream Stream;
+	DWORD dwWidth = 0;
+	DWORD dwHeight = 0;
+	DWORD dwLevels = 1;
+	DWORD i;
+
+	memset(&Stream, 0, sizeof(Stream));
+	Stream.pOptions = pOptions;
+	Stream.pPool = pPool;
+	HRESULT hr = TEXOpenBmp(pFile->szSrc, &pColor);
+	if (SUCCEEDED(hr)) {
+		TEXGetBmpSize(pColor, &dwWidth, &dwHeight);
+		Stream.dwWidth = dwWidth;
+		if (pOptions->bMipMap) {
+			dwLevels = TEXGetMipCount(dwWidth, dwHeight);
+		}
+	}
+	if (SUCCEEDED(hr) && pFile->szAlpha[0]) {
+		hr = TEXOpenBmp(pFile->szAlpha, &pAlpha);
+		if (SUCCEEDED(hr)) {
+			DWORD dwAlphaWidth;
+			DWORD dwAlphaHeight;
+			TEXGetBmpSize(pAlpha, &dwAlphaWidth, &dwAlphaHeight);
+			if (dwAlphaWidth != dwWidth || dwAlphaHeight != dwHeight) {
+				hr = DDERR_INVALIDPARAMS;
+			}
+		}
+		if (SUCCEEDED(hr)) {
+			pdwAlpha = new DWORD[dwWidth * STREAM_ROWS];
+			if (!pdwAlpha) {
+				hr = DDERR_OUTOFMEMORY;
+			}
+		}
+	}
+	if (SUCCEEDED(hr) && pOptions->dwFourCC) {
+		Stream.pBlocks = new BYTE[DXTGetImageBytes(
+			pOptions->dwFourCC, dwWidth, STREAM_ROWS)];
+		if (!Stream.pBlocks) {
+			hr = DDERR_OUTOFMEMORY;
+		}
+	}
+	if (SUCCEEDED(hr)) {
+		hr = DDSCreateWriter(pFile->szDest, pOptions->dwFourCC, dwWidth,
+			dwHeight, 1, dwLevels, &Stream.pWriter);
+	}
+	if (SUCCEEDED(hr)) {
+		hr = TEXCreateMipStream(dwWidth, dwHeight, dwLevels, STREAM_ROWS,
+			pOptions->dwMipFilter, pOptions->dwMipFlags, StreamBand, &Stream,
+			pPool, &pMips);
+	}
+
+	// Read straight into the stream's window, it sends the bands on
+	DWORD y = 0;
+	while (SUCCEEDED(hr) && (y < dwHeight)) {
+		void* pRows;
+		LONG lPitch;
+		DWORD dwRows;
+		hr = TEXLockMipStream(pMips, &pRows, &lPitch, &dwRows);
+		if (SUCCEEDED(hr)) {
+			if (dwRows > STREAM_ROWS) {
+				dwRows = STREAM_ROWS;
+			}
+			hr = TEXReadBmpRows(pColor, dwRows, pRows, lPitch);
+		}
+		if (SUCCEEDED(hr) && pAlpha) {
+			hr = TEXReadBmpRows(pAlpha, dwRows, pdwAlpha, (LONG)(dwWidth * 4));
+			if (SUCCEEDED(hr)) {
+				TEXCopyAlpha(pdwAlpha, (LONG)(dwWidth * 4), pRows, lPitch,
+					dwWidth, dwRows);
+			}
+		}
+		if (SUCCEEDED(hr)) {
+			hr = TEXUnlockMipStream(pMips, dwRows);
+		}
+		y += dwRows;
+	}
+
+	TEXDestroyMipStream(pMips);
+	if (Stream.pWriter) {
+		HRESULT hrClose = DDSCloseWriter(Stream.pWriter);
+		if (SUCCEEDED(hr)) {
+			hr = hrClose;
+		}
+		// Don't leave a full size file with holes in it behind
+		if (FAILED(hr)) {
+			DeleteFileA(pFile->szDest);
+		}
+	}
+	delete[] Stream.pBlocks;
+	delete[] pdwAlpha;
+	TEXCloseBmp(pAlpha);
+	TEXCloseBmp(pColor);
+
+	*pdPixels = (double)dwWidth * (double)dwHeight;
+	*pdBytesOut = 4.0 + sizeof(DDSFILEHEADER);
+	if (DDSNeedsDX10Header(pOptions->dwFourCC)) {
+		*pdBytesOut += sizeof(DDSHEADERDX10);
+	}
+	for (i = 0; i < dwLevels; ++i) {
+		DWORD dwLevelWidth = dwWidth >> i ? dwWidth >> i : 1;
+		DWORD dwLevelHeight = dwHeight >> i ? dwHeight >> i : 1;
+		*pdBytesOut += pOptions->dwFourCC ?
+			(double)DXTGetImageBytes(
+				pOptions->dwFourCC, dwLevelWidth, dwLevelHeight) :
+			(double)dwLevelWidth * dwLevelHeight * 4.0;
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetMaskShift()
+// Desc: Where an 8 bit channel mask starts, 32 if it isn't one
+//-----------------------------------------------------------------------------
+static DWORD GetMaskShift(DWORD dwMask)
+{
+	DWORD dwShift;
+	for (dwShift = 0; dwShift < 32; dwShift += 8) {
+		if (dwMask == (0xFFU << dwShift)) {
+			break;
+		}
+	}
+	return dwShift;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DecodeSliceTask()
+// Desc: Pool task, turn one top level slice read this round into ARGB8888
+//-----------------------------------------------------------------------------
+static void DecodeSliceTask(void* pContext, DWORD dwTask)
+{
+	ConvVolume* pVolume = static_cast<ConvVolume*>(pContext);
+	VolumeLevel* pLevel = &pVolume->Levels[0];
+	TEXIMAGE* pSlice =
+		&pLevel->pSlices[pLevel->dwHeld - pLevel->dwNew + dwTask];
+
+	// The format was checked when the file was opened, this can't fail
+	if (pVolume->dwSrcFourCC) {
+		DXTDecompressImage(pVolume->dwSrcFourCC,
+			pVolume->pRaw + dwTask * pVolume->dwRawBytes,
+			(LONG)DXTGetPitch(pVolume->dwSrcFourCC, pSlice->dwWidth),
+			pSlice->dwWidth, pSlice->dwHeight, NULL, pSlice->pdwPixels,
+			(LONG)(pSlice->dwWidth * 4), 0);
+		return;
+	}
+
+	// 32-bit RGB was read straight into the slice, move the channels
+	const DWORD* pdwShift = pVolume->dwShift;
+	if (!pVolume->bOpaque && pdwShift[0] == 24 && pdwShift[1] == 16 &&
+		pdwShift[2] == 8 && pdwShift[3] == 0) {
+		return;
+	}
+	DWORD dwCount = pSlice->dwWidth * pSlice->dwHeight;
+	for (DWORD i = 0; i < dwCount; ++i) {
+		DWORD dwPixel = pSlice->pdwPixels[i];
+		DWORD dwAlpha = pVolume->bOpaque ?
+			0xFF000000 : ((dwPixel >> pdwShift[0]) & 0xFF) << 24;
+		pSlice->pdwPixels[i] = dwAlpha |
+			(((dwPixel >> pdwShift[1]) & 0xFF) << 16) |
+			(((dwPixel >> pdwShift[2]) & 0xFF) << 8) |
+			((dwPixel >> pdwShift[3]) & 0xFF);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: VolumeMipTask()
+// Desc: Pool task, build one new slice of the level below dwTaskLevel from
+//       the two slices above it
+//-----------------------------------------------------------------------------
+static void VolumeMipTask(void* pContext, DWORD dwTask)
+{
+	ConvVolume* pVolume = static_cast<ConvVolume*>(pContext);
+	const VolumeLevel* pSrc = &pVolume->Levels[pVolume->dwTaskLevel];
+	VolumeLevel* pDest = &pVolume->Levels[pVolume->dwTaskLevel + 1];
+	DWORD dwIndex = pDest->dwHeld - pDest->dwNew + dwTask;
+
+	// Once the volume is a single slice deep, it pairs with itself
+	DWORD dwSlice = pDest->dwFirstSlice + dwIndex;
+	DWORD dwFirst = pSrc->dwDepth > 1 ? dwSlice * 2 : 0;
+	DWORD dwSecond = pSrc->dwDepth > 1 ? dwFirst + 1 : 0;
+	const TEXIMAGE* pSlice1 = &pSrc->pSlices[dwFirst - pSrc->dwFirstSlice];
+	const TEXIMAGE* pSlice2 = &pSrc->pSlices[dwSecond - pSrc->dwFirstSlice];
+	TEXGenerateVolumeMip(pSlice1->pdwPixels, pSlice2->pdwPixels,
+		(LONG)(pSrc->dwWidth * 4), pSrc->dwWidth, pSrc->dwHeight,
+		pDest->pSlices[dwIndex].pdwPixels, (LONG)(pDest->dwWidth * 4),
+		pVolume->pOptions->dwMipFlags);
+}
+
+//-----------------------------------------------------------------------------
+// Name: OpenVolume()
+// Desc: Work out the levels of a volume and allocate everything a round
+//       needs, for ConvertVolume()
+//-----------------------------------------------------------------------------
+static HRESULT OpenVolume(DXTWorkPool* pPool, const DDSFILEHEADER* pHeader,
+	ConvVolume* pVolume)
+{
+	const ConvOptions* pOptions = pVolume->pOptions;
+	const DDPIXELFORMAT* pddpf = &pHeader->ddpfPixelFormat;
+	DWORD i;
+	DWORD j;
+
+	if (pddpf->dwFlags & DDPF_FOURCC) {
+		pVolume->dwSrcFourCC = pddpf->dwFourCC;
+	} else {
+		pVolume->dwShift[0] = GetMaskShift(pddpf->dwRGBAlphaBitMask);
+		pVolume->dwShift[1] = GetMaskShift(pddpf->dwRBitMask);
+		pVolume->dwShift[2] = GetMaskShift(pddpf->dwGBitMask);
+		pVolume->dwShift[3] = GetMaskShift(pddpf->dwBBitMask);
+		pVolume->bOpaque = !(pddpf->dwFlags & DDPF_ALPHAPIXELS) ||
+			pVolume->dwShift[0] == 32;
+		for (i = 1; i < 4; ++i) {
+			if (pVolume->dwShift[i] == 32) {
+				return DDERR_INVALIDPIXELFORMAT;
+			}
+		}
+	}
+
+	// A round is a slice per thread, as many as the batch size allows, but
+	// at least a pair so the level below always gets a new slice
+	ULONGLONG uSliceBytes =
+		(ULONGLONG)pHeader->dwWidth * pHeader->dwHeight * 4;
+	DWORD dwRound = DXTPoolGetThreadCount(pPool);
+	if (dwRound > BATCH_BYTES / uSliceBytes) {
+		dwRound = (DWORD)(BATCH_BYTES / uSliceBytes);
+	}
+	if (dwRound < 2) {
+		dwRound = 2;
+	}
+	pVolume->dwMaxSlices = dwRound + 1;
+	if (pVolume->dwSrcFourCC) {
+		pVolume->dwRawBytes = DXTGetImageBytes(
+			pVolume->dwSrcFourCC, pHeader->dwWidth, pHeader->dwHeight);
+		pVolume->pRaw = new BYTE[pVolume->dwRawBytes * dwRound];
+		if (!pVolume->pRaw) {
+			return DDERR_OUTOFMEMORY;
+		}
+	}
+
+	// The widest of width and depth goes with the height, they all halve
+	pVolume->dwLevels = 1;
+	if (pOptions->bMipMap) {
+		pVolume->dwLevels = TEXGetMipCount(
+			pHeader->dwWidth > pHeader->dwDepth ? pHeader->dwWidth :
+												  pHeader->dwDepth,
+			pHeader->dwHeight);
+	}
+	for (i = 0; i < pVolume->dwLevels; ++i) {
+		VolumeLevel* pLevel = &pVolume->Levels[i];
+		pLevel->dwWidth = pHeader->dwWidth >> i ? pHeader->dwWidth >> i : 1;
+		pLevel->dwHeight =
+			pHeader->dwHeight >> i ? pHeader->dwHeight >> i : 1;
+		pLevel->dwDepth = pHeader->dwDepth >> i ? pHeader->dwDepth >> i : 1;
+		pLevel->pSlices = new TEXIMAGE[pVolume->dwMaxSlices];
+		if (!pLevel->pSlices) {
+			return DDERR_OUTOFMEMORY;
+		}
+		memset(pLevel->pSlices, 0, sizeof(TEXIMAGE) * pVolume->dwMaxSlices);
+		for (j = 0; j < pVolume->dwMaxSlices; ++j) {
+			HRESULT hr = TEXCreateImage(
+				pLevel->dwWidth, pLevel->dwHeight, &pLevel->pSlices[j]);
+			if (FAILED(hr)) {
+				return hr;
+			}
+		}
+		if (pOptions->dwFourCC) {
+			pLevel->dwSliceBlocks = DXTGetImageBytes(
+				pOptions->dwFourCC, pLevel->dwWidth, pLevel->dwHeight);
+			pLevel->pBlocks =
+				new BYTE[pLevel->dwSliceBlocks * pVolume->dwMaxSlices];
+			if (!pLevel->pBlocks) {
+				return DDERR_OUTOFMEMORY;
+			}
+		}
+	}
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: CloseVolume()
+// Desc: Release everything OpenVolume() allocated, even if it failed
+//-----------------------------------------------------------------------------
+static void CloseVolume(ConvVolume* pVolume)
+{
+	for (DWORD i = 0; i < MAX_LEVELS; ++i) {
+		VolumeLevel* pLevel = &pVolume->Levels[i];
+		if (pLevel->pSlices) {
+			for (DWORD j = 0; j < pVolume->dwMaxSlices; ++j) {
+				TEXFreeImage(&pLevel->pSlices[j]);
+			}
+		}
+		delete[] pLevel->pSlices;
+		delete[] pLevel->pBlocks;
+	}
+	delete[] pVolume->pRaw;
+}
+
+//-----------------------------------------------------------------------------
+// Name: FilterVolumeLevels()
+// Desc: Build every slice of every level below the top that this round's
+//       slices complete, a level at a time with one task per slice
+//-----------------------------------------------------------------------------
+static void FilterVolumeLevels(DXTWorkPool* pPool, ConvVolume* pVolume)
+{
+	for (DWORD i = 0; i + 1 < pVolume->dwLevels; ++i) {
+		const VolumeLevel* pSrc = &pVolume->Levels[i];
+		VolumeLevel* pDest = &pVolume->Levels[i + 1];
+		DWORD dwHave = pSrc->dwFirstSlice + pSrc->dwHeld;
+		DWORD dwSlice = pDest->dwFirstSlice + pDest->dwHeld;
+		pDest->dwNew = 0;
+		while (dwSlice < pDest->dwDepth &&
+			(pSrc->dwDepth > 1 ? dwSlice * 2 + 1 : 0) < dwHave) {
+			++pDest->dwNew;
+			++dwSlice;
+		}
+		pDest->dwHeld += pDest->dwNew;
+		pVolume->dwTaskLevel = i;
+		DXTPoolRun(pPool, VolumeMipTask, pVolume, pDest->dwNew);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: WriteVolumeLevels()
+// Desc: Compress every new slice of every level in one call, so they share
+//       the pool, and write them out
+//-----------------------------------------------------------------------------
+static HRESULT WriteVolumeLevels(DXTWorkPool* pPool, ConvVolume* pVolume,
+	DXTCOMPRESSJOB* pCompress, DDSWriter* pWriter)
+{
+	const ConvOptions* pOptions = pVolume->pOptions;
+	DWORD dwCount = 0;
+	DWORD i;
+	DWORD j;
+	HRESULT hr = DD_OK;
+
+	for (i = 0; pOptions->dwFourCC && (i < pVolume->dwLevels); ++i) {
+		VolumeLevel* pLevel = &pVolume->Levels[i];
+		for (j = pLevel->dwHeld - pLevel->dwNew; j < pLevel->dwHeld; ++j) {
+			InitCompressJob(pOptions, &pLevel->pSlices[j],
+				pLevel->pBlocks + j * pLevel->dwSliceBlocks,
+				&pCompress[dwCount++]);
+		}
+	}
+	if (dwCount) {
+		hr = DXTCompressImages(pPool, pCompress, dwCount, 0);
+	}
+	for (i = 0; SUCCEEDED(hr) && (i < pVolume->dwLevels); ++i) {
+		const VolumeLevel* pLevel = &pVolume->Levels[i];
+		for (j = pLevel->dwHeld - pLevel->dwNew;
+			 SUCCEEDED(hr) && (j < pLevel->dwHeld); ++j) {
+			const void* pData = pOptions->dwFourCC ?
+				(const void*)(pLevel->pBlocks + j * pLevel->dwSliceBlocks) :
+				pLevel->pSlices[j].pdwPixels;
+			hr = DDSWriteRows(pWriter, i, pLevel->dwFirstSlice + j, 0,
+				pLevel->dwHeight, pData);
+		}
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DropVolumeSlices()
+// Desc: Let go of the slices no level below needs any more, keeping the one
+//       that's still waiting for its pair
+//-----------------------------------------------------------------------------
+static void DropVolumeSlices(ConvVolume* pVolume)
+{
+	for (DWORD i = 0; i < pVolume->dwLevels; ++i) {
+		VolumeLevel* pLevel = &pVolume->Levels[i];
+		DWORD dwKeep = pLevel->dwFirstSlice + pLevel->dwHeld;
+		if (i + 1 < pVolume->dwLevels) {
+			const VolumeLevel* pBelow = &pVolume->Levels[i + 1];
+			DWORD dwNext = pBelow->dwFirstSlice + pBelow->dwHeld;
+			if (dwNext < pBelow->dwDepth) {
+				dwKeep = pLevel->dwDepth > 1 ? dwNext * 2 : 0;
+			}
+		}
+
+		// Swapped rather than copied, every slot keeps its own pixels
+		DWORD dwDrop = dwKeep - pLevel->dwFirstSlice;
+		for (DWORD j = dwDrop; j < pLevel->dwHeld; ++j) {
+			TEXIMAGE Slice = pLevel->pSlices[j - dwDrop];
+			pLevel->pSlices[j - dwDrop] = pLevel->pSlices[j];
+			pLevel->pSlices[j] = Slice;
+		}
+		pLevel->dwFirstSlice += dwDrop;
+		pLevel->dwHeld -= dwDrop;
+		pLevel->dwNew = 0;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: ConvertVolume()
+// Desc: Convert a DDS volume texture a round of top level slices at a time,
+//       mip levels built with a 2x2x2 box whatever filter was picked, and
+//       set the top level pixels and the size of the file written
+//-----------------------------------------------------------------------------
+static HRESULT ConvertVolume(DXTWorkPool* pPool, const ConvOptions* pOptions,
+	const ConvFile* pFile, double* pdPixels, double* pdBytesOut)
+{
+	DDSReader* pReader = NULL;
+	DDSWriter* pWriter = NULL;
+	DXTCOMPRESSJOB* pCompress = NULL;
+	DDSFILEHEADER Header;
+	ConvVolume Volume;
+	DWORD i;
+
+	memset(&Header, 0, sizeof(Header));
+	memset(&Volume, 0, sizeof(Volume));
+	Volume.pOptions = pOptions;
+	HRESULT hr = DDSOpenReader(pFile->szSrc, &pReader);
+	if (SUCCEEDED(hr)) {
+		Header = *DDSGetReaderHeader(pReader);
+		hr = OpenVolume(pPool, &Header, &Volume);
+	}
+	if (SUCCEEDED(hr) && pOptions->dwFourCC) {
+		pCompress = new DXTCOMPRESSJOB[Volume.dwMaxSlices * Volume.dwLevels];
+		if (!pCompress) {
+			hr = DDERR_OUTOFMEMORY;
+		}
+	}
+	if (SUCCEEDED(hr)) {
+		hr = DDSCreateWriter(pFile->szDest, pOptions->dwFourCC,
+			Header.dwWidth, Header.dwHeight, Header.dwDepth, Volume.dwLevels,
+			&pWriter);
+	}
+
+	// Read a round, decode it across the pool, and pass it down the levels
+	VolumeLevel* pTop = &Volume.Levels[0];
+	DWORD z = 0;
+	while (SUCCEEDED(hr) && (z < Header.dwDepth)) {
+		DWORD dwCount = Volume.dwMaxSlices - 1 - pTop->dwHeld;
+		if (dwCount > Header.dwDepth - z) {
+			dwCount = Header.dwDepth - z;
+		}
+		for (i = 0; SUCCEEDED(hr) && (i < dwCount); ++i) {
+			void* pData = Volume.pRaw ?
+				(void*)(Volume.pRaw + i * Volume.dwRawBytes) :
+				pTop->pSlices[pTop->dwHeld + i].pdwPixels;
+			hr = DDSReadSlice(pReader, z + i, pData);
+		}
+		if (SUCCEEDED(hr)) {
+			pTop->dwHeld += dwCount;
+			pTop->dwNew = dwCount;
+			DXTPoolRun(pPool, DecodeSliceTask, &Volume, dwCount);
+			FilterVolumeLevels(pPool, &Volume);
+			hr = WriteVolumeLevels(pPool, &Volume, pCompress, pWriter);
+			DropVolumeSlices(&Volume);
+		}
+		z += dwCount;
+	}
+
+	if (pWriter) {
+		HRESULT hrClose = DDSCloseWriter(pWriter);
+		if (SUCCEEDED(hr)) {
+			hr = hrClose;
+		}
+		if (FAILED(hr)) {
+			DeleteFileA(pFile->szDest);
+		}
+	}
+	delete[] pCompress;
+	CloseVolume(&Volume);
+	DDSCloseReader(pReader);
+
+	*pdPixels = (double)Header.dwWidth * (double)Header.dwHeight *
+		(double)Header.dwDepth;
+	*pdBytesOut = 4.0 + sizeof(DDSFILEHEADER);
+	if (DDSNeedsDX10Header(pOptions->dwFourCC)) {
+		*pdBytesOut += sizeof(DDSHEADERDX10);
+	}
+	for (i = 0; i < Volume.dwLevels; ++i) {
+		const VolumeLevel* pLevel = &Volume.Levels[i];
+		*pdBytesOut += (double)pLevel->dwDepth *
+			(double)DDSGetLevelBytes(
+				pOptions->dwFourCC, pLevel->dwWidth, pLevel->dwHeight);
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ConvertFiles()
+// Desc: Run the files through load, compress and write in batches
+//-----------------------------------------------------------------------------
+static void ConvertFiles(DXTWorkPool* pPool, DXTCache* pCache,
+	const ConvOptions* pOptions, const ConvFileList* pList, ConvStats* pStats)
+{
+	ConvJob* pJobs = new ConvJob[BATCH_FILES];
+	if (!pJobs) {
+		pStats->dwFilesFailed = pList->dwCount;
+		return;
+	}
+
+	DWORD dwFirst = 0;
+	while (dwFirst < pList->dwCount) {
+		// Files over the limit go on their own, a band at a time
+		const ConvFile* pFile = &pList->pFiles[dwFirst];
+		if (IsStreamed(pOptions, pFile)) {
+			LARGE_INTEGER liStreamStart;
+			LARGE_INTEGER liStreamEnd;
+			double dPixels;
+			double dBytesOut;
+			HRESULT hr;
+			QueryPerformanceCounter(&liStreamStart);
+			if (pFile->bVolume) {
+				hr = ConvertVolume(
+					pPool, pOptions, pFile, &dPixels, &dBytesOut);
+			} else {
+				hr = StreamFile(pPool, pOptions, pFile, &dPixels, &dBytesOut);
+			}
+			QueryPerformanceCounter(&liStreamEnd);
+			pStats->dStreamTime +=
+				ElapsedMilliseconds(&liStreamStart, &liStreamEnd);
+			pStats->dBytesIn += (double)pFile->dwBytes;
+			if (SUCCEEDED(hr)) {
+				++pStats->dwFilesOk;
+				++pStats->dwFilesStreamed;
+				pStats->dPixels += dPixels;
+				pStats->dBytesOut += dBytesOut;
+			} else {
+				++pStats->dwFilesFailed;
+				fprintf(stderr, "Failed: %s (error 0x%08lX)\n", pFile->szSrc,
+					(unsigned long)(DWORD)hr);
+			}
+			++dwFirst;
+			continue;
+		}
+
+		ConvBatch Batch;
+		LARGE_INTEGER liStart;
+		LARGE_INTEGER liLoaded;
+		LARGE_INTEGER liCompressed;
+		LARGE_INTEGER liWritten;
+		DWORD dwBytes = 0;
+		DWORD i;
+
+		// At least one file, however large
+		Batch.pJobs = pJobs;
+		Batch.dwJobs = 0;
+		Batch.pOptions = pOptions;
+		Batch.pCache = pCache;
+		while ((dwFirst + Batch.dwJobs < pList->dwCount) &&
+			(Batch.dwJobs < BATCH_FILES) &&
+			!IsStreamed(pOptions, &pList->pFiles[dwFirst + Batch.dwJobs]) &&
+			(!Batch.dwJobs ||
+				(dwBytes + pList->pFiles[dwFirst + Batch.dwJobs].dwBytes <=
+					BATCH_BYTES))) {
+			ConvJob* pJob = &pJobs[Batch.dwJobs];
+			memset(pJob, 0, sizeof(ConvJob));
+			pJob->pFile = &pList->pFiles[dwFirst + Batch.dwJobs];
+			dwBytes += pJob->pFile->dwBytes;
+			++Batch.dwJobs;
+		}
+
+		QueryPerformanceCounter(&liStart);
+		DXTPoolRun(pPool, LoadTask, &Batch, Batch.dwJobs);
+		QueryPerformanceCounter(&liLoaded);
+		if (pOptions->dwFourCC) {
+			CompressBatch(pPool, &Batch);
+		}
+		QueryPerformanceCounter(&liCompressed);
+		DXTPoolRun(pPool, WriteTask, &Batch, Batch.dwJobs);
+		QueryPerformanceCounter(&liWritten);
+
+		pStats->dLoadTime += ElapsedMilliseconds(&liStart, &liLoaded);
+		pStats->dCompressTime +=
+			ElapsedMilliseconds(&liLoaded, &liCompressed);
+		pStats->dWriteTime += ElapsedMilliseconds(&liCompressed, &liWritten);
+
+		// Report in file order, whichever thread got there first
+		for (i = 0; i < Batch.dwJobs; ++i) {
+			const ConvJob* pJob = &pJobs[i];
+			pStats->dBytesIn += (double)pJob->pFile->dwBytes;
+			if (SUCCEEDED(pJob->hr)) {
+				++pStats->dwFilesOk;
+				pStats->dPixels +=
+					(double)pJob->dwWidth * (double)pJob->dwHeight;
+				pStats->dBytesOut += (double)pJob->dwBytesOut;
+			} else {
+				++pStats->dwFilesFailed;
+				fprintf(stderr, "Failed: %s (error 0x%08lX)\n",
+					pJob->pFile->szSrc, (unsigned long)(DWORD)pJob->hr);
+			}
+		}
+		dwFirst += Batch.dwJobs;
+	}
+	delete[] pJobs;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ParseOptions()
+// Desc: Read the command line, FALSE if it doesn't make sense
+//-----------------------------------------------------------------------------
+static BOOL ParseOptions(int argc, char** argv, ConvOptions* pOptions)
+{
+	static const struct {
+		const char* pName;
+		DWORD dwFourCC;
+	} s_Formats[] = {{"DXT1", FOURCC_DXT1}, {"DXT2", FOURCC_DXT2},
+		{"DXT3", FOURCC_DXT3}, {"DXT4", FOURCC_DXT4}, {"DXT5", FOURCC_DXT5},
+		{"ATI1", FOURCC_ATI1}, {"ATI2", FOURCC_ATI2}, {"BC7", FOURCC_BC7}};
+
+	memset(pOptions, 0, sizeof(ConvOptions));
+	pOptions->dwQuality = DXTC_QUALITY_BEST;
+	pOptions->dwCacheMegabytes = CACHE_MEGABYTES;
+	pOptions->dwStreamMegabytes = STREAM_MEGABYTES;
+	for (int i = 1; i < argc; ++i) {
+		const char* pArg = argv[i];
+		if (pArg[0] == '-' || pArg[0] == '/') {
+			++pArg;
+			if (!lstrcmpiA(pArg, "m")) {
+				pOptions->bMipMap = TRUE;
+			} else if (!lstrcmpiA(pArg, "box")) {
+				pOptions->dwMipFilter = TEX_FILTER_BOX;
+			} else if (!lstrcmpiA(pArg, "kaiser")) {
+				pOptions->dwMipFilter = TEX_FILTER_KAISER;
+			} else if (!lstrcmpiA(pArg, "lanczos")) {
+				pOptions->dwMipFilter = TEX_FILTER_LANCZOS;
+			} else if (!lstrcmpiA(pArg, "mitchell")) {
+				pOptions->dwMipFilter = TEX_FILTER_MITCHELL;
+			} else if (!lstrcmpiA(pArg, "srgb")) {
+				pOptions->dwMipFlags |= TEX_MIP_SRGB;
+			} else if (!lstrcmpiA(pArg, "fast")) {
+				pOptions->dwQuality = DXTC_QUALITY_FAST;
+			} else if (!lstrcmpiA(pArg, "normal")) {
+				pOptions->dwQuality = DXTC_QUALITY_NORMAL;
+			} else if (!lstrcmpiA(pArg, "best")) {
+				pOptions->dwQuality = DXTC_QUALITY_BEST;
+			} else if (!lstrcmpiA(pArg, "threads") && (i + 1 < argc)) {
+				pOptions->dwThreads = (DWORD)atol(argv[++i]);
+			} else if (!lstrcmpiA(pArg, "cache") && (i + 1 < argc)) {
+				pOptions->pCacheDir = argv[++i];
+			} else if (!lstrcmpiA(pArg, "cachesize") && (i + 1 < argc)) {
+				pOptions->dwCacheMegabytes = (DWORD)atol(argv[++i]);
+			} else if (!lstrcmpiA(pArg, "stream") && (i + 1 < argc)) {
+				pOptions->dwStreamMegabytes = (DWORD)atol(argv[++i]);
+			} else {
+				return FALSE;
+			}
+			continue;
+		}
+		DWORD j;
+		for (j = 0; j < sizeof(s_Formats) / sizeof(s_Formats[0]); ++j) {
+			if (!lstrcmpiA(pArg, s_Formats[j].pName)) {
+				pOptions->dwFourCC = s_Formats[j].dwFourCC;
+				break;
+			}
+		}
+		if (j < sizeof(s_Formats) / sizeof(s_Formats[0])) {
+			continue;
+		}
+		if (!pOptions->pSrcDir) {
+			pOptions->pSrcDir = pArg;
+		} else if (!pOptions->pDestDir) {
+			pOptions->pDestDir = pArg;
+		} else {
+			return FALSE;
+		}
+	}
+	return pOptions->pDestDir != NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Name: main()
+// Desc: Convert a tree of bitmaps and print how fast it went
+//-----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	ConvOptions Options;
+	if (!ParseOptions(argc, argv, &Options)) {
+		printf("Usage: dxtconv [-m [-box|-kaiser|-lanczos|-mitchell] [-srgb]]\n"
+			   "               [-fast|-normal|-best] [-threads n]\n"
+			   "               [-cache dir [-cachesize mb]] [-stream mb]\n"
+			   "               [DXT1|DXT2|DXT3|DXT4|DXT5|ATI1|ATI2|BC7]\n"
+			   "               indir outdir\n\n"
+			   "Converts every .bmp under indir, with foo_a.bmp as the "
+			   "alpha of foo.bmp,\n"
+			   "to a .dds under outdir. With no format the DDS files are "
+			   "ARGB8888.\n"
+			   "With -cache, levels that were compressed before are copied "
+			   "from dir.\n"
+			   "Bitmaps over the -stream size, 256 MB by default, are "
+			   "converted a band\n"
+			   "of rows at a time instead of loaded whole. Volume .dds "
+			   "files are converted\n"
+			   "a few slices at a time, with box filtered mips.\n");
+		return 1;
+	}
+
+	LARGE_INTEGER liStart;
+	LARGE_INTEGER liScanned;
+	LARGE_INTEGER liEnd;
+	ConvFileList List;
+	memset(&List, 0, sizeof(List));
+	QueryPerformanceCounter(&liStart);
+	if (!ScanDirectory(Options.pSrcDir, Options.pDestDir, &List)) {
+		fprintf(stderr, "Out of memory\n");
+		delete[] List.pFiles;
+		return 1;
+	}
+	QueryPerformanceCounter(&liScanned);
+
+	DXTWorkPool* pPool;
+	if (FAILED(DXTPoolCreate(Options.dwThreads, &pPool))) {
+		fprintf(stderr, "Can't start the worker threads\n");
+		delete[] List.pFiles;
+		return 1;
+	}
+
+	// A cache that can't be opened only costs time, carry on without it
+	DXTCache* pCache = NULL;
+	if (Options.pCacheDir && Options.dwFourCC) {
+		CreateDirectoryA(Options.pCacheDir, NULL);
+		if (FAILED(DXTCacheOpen(
+				Options.pCacheDir, Options.dwCacheMegabytes, &pCache))) {
+			fprintf(stderr, "Can't open the cache in %s\n", Options.pCacheDir);
+			pCache = NULL;
+		}
+	}
+
+	ConvStats Stats;
+	memset(&Stats, 0, sizeof(Stats));
+	ConvertFiles(pPool, pCache, &Options, &List, &Stats);
+	QueryPerformanceCounter(&liEnd);
+
+	double dScan = ElapsedMilliseconds(&liStart, &liScanned);
+	double dTotal = ElapsedMilliseconds(&liStart, &liEnd);
+	double dSeconds = dTotal > 0.0 ? dTotal / 1000.0 : 0.001;
+	printf("Files       %lu converted, %lu failed\n",
+		(unsigned long)Stats.dwFilesOk, (unsigned long)Stats.dwFilesFailed);
+	printf("Threads     %lu\n", (unsigned long)DXTPoolGetThreadCount(pPool));
+	printf("Pixels      %.2f megapixels\n", Stats.dPixels / 1000000.0);
+	printf("Data        %.2f MB in, %.2f MB out\n",
+		Stats.dBytesIn / (1024.0 * 1024.0),
+		Stats.dBytesOut / (1024.0 * 1024.0));
+	printf("Time        %.1f ms scan, %.1f ms load and mip, "
+		   "%.1f ms compress, %.1f ms write\n",
+		dScan, Stats.dLoadTime, Stats.dCompressTime, Stats.dWriteTime);
+	if (Stats.dwFilesStreamed) {
+		printf("Streamed    %lu files, %.1f ms\n",
+			(unsigned long)Stats.dwFilesStreamed, Stats.dStreamTime);
+	}
+	printf("Throughput  %.2f MPix/s, %.1f files/s, %.1f ms total\n",
+		Stats.dPixels / 1000000.0 / dSeconds,
+		(double)Stats.dwFilesOk / dSeconds, dTotal);
+	if (pCache) {
+		DXTCACHESTATS CacheStats;
+		DXTCacheGetStats(pCache, &CacheStats);
+		DWORD dwLookups = CacheStats.dwHits + CacheStats.dwMisses;
+		printf("Cache       %lu of %lu levels hit (%.1f%%), %.2f MB copied, "
+			   "%lu stored, %lu evicted\n",
+			(unsigned long)CacheStats.dwHits, (unsigned long)dwLookups,
+			dwLookups ? 100.0 * CacheStats.dwHits / dwLookups : 0.0,
+			(double)CacheStats.uHitBytes / (1024.0 * 1024.0),
+			(unsigned long)CacheStats.dwStores,
+			(unsigned long)CacheStats.dwEvictions);
+		printf("            %lu entries, %.2f MB\n",
+			(unsigned long)CacheStats.dwEntries,
+			(double)CacheStats.uBytes / (1024.0 * 1024.0));
+		DXTCacheClose(pCache);
+	}
+
+	DXTPoolDestroy(pPool);
+	delete[] List.pFiles;
+	return Stats.dwFilesFailed ? 2 : 0;
+}
@@ -8,6 +8,8 @@
 #include "ChildFrm.h"
 #include "dxtexDoc.h"
 #include "dxtexView.h"
+#include "dxtcodec.h"
+#include "teximage.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -77,6 +79,11 @@ CDxtexCommandLineInfo::CDxtexCommandLineInfo(VOID)
 	m_dwFourCC = 0;
 	m_bAlphaComing = FALSE;
 	m_bMipMap = FALSE;
+	m_dwQuality = 0;
+	m_dwTimeBudget = 0;
+	m_bTimeBudgetComing = FALSE;
+	m_bSRGBMips = FALSE;
+	m_dwMipFilter = TEX_FILTER_COUNT;
 }
 
 
@@ -102,6 +109,61 @@ void CDxtexCommandLineInfo::ParseParam(const TCHAR* pszParam,BOOL bFlag,BOOL bLa
 	{
 		m_dwFourCC = FOURCC_DXT5;
 	}
+	else if (lstrcmpiA(pszParam, "ATI1") == 0)
+	{
+		m_dwFourCC = FOURCC_ATI1;
+	}
+	else if (lstrcmpiA(pszParam, "ATI2") == 0)
+	{
+		m_dwFourCC = FOURCC_ATI2;
+	}
+	else if (lstrcmpiA(pszParam, "BC7") == 0)
+	{
+		m_dwFourCC = FOURCC_BC7;
+	}
+	else if (bFlag && lstrcmpiA(pszParam, "fast") == 0)
+	{
+		m_dwQuality = DXTC_QUALITY_FAST;
+	}
+	else if (bFlag && lstrcmpiA(pszParam, "normal") == 0)
+	{
+		m_dwQuality = DXTC_QUALITY_NORMAL;
+	}
+	else if (bFlag && lstrcmpiA(pszParam, "best") == 0)
+	{
+		m_dwQuality = DXTC_QUALITY_BEST;
+	}
+	else if (bFlag && lstrcmpiA(pszParam, "box") == 0)
+	{
+		m_dwMipFilter = TEX_FILTER_BOX;
+	}
+	else if (bFlag && lstrcmpiA(pszParam, "kaiser") == 0)
+	{
+		m_dwMipFilter = TEX_FILTER_KAISER;
+	}
+	else if (bFlag && lstrcmpiA(pszParam, "lanczos") == 0)
+	{
+		m_dwMipFilter = TEX_FILTER_LANCZOS;
+	}
+	else if (bFlag && lstrcmpiA(pszParam, "mitchell") == 0)
+	{
+		m_dwMipFilter = TEX_FILTER_MITCHELL;
+	}
+	else if (bFlag && lstrcmpiA(pszParam, "srgb") == 0)
+	{
+		m_bSRGBMips = TRUE;
+	}
+	else if (bFlag && lstrcmpiA(pszParam, "budget") == 0)
+	{
+		m_bTimeBudgetComing = TRUE;
+	}
+	else if (!bFlag && m_bTimeBudgetComing)
+	{
+		m_dwTimeBudget = (DWORD)atol(pszParam);
+		m_bTimeBudgetComing = FALSE;
+		ParseLast(bLast); // Keep the number from being taken as a file name
+		return;
+	}
 	else if (bFlag && tolower(pszParam[0]) == 'a')
 	{
 		m_bAlphaComing = TRUE;
@@ -131,8 +193,22 @@ void CDxtexCommandLineInfo::ParseParam(const TCHAR* pszParam,BOOL bFlag,BOOL bLa
 BEGIN_MESSAGE_MAP(CDxtexApp, CWinApp)
 	//{{AFX_MSG_MAP(CDxtexApp)
 	ON_COMMAND(ID_APP_ABOUT, OnAppAbout)
-		// NOTE - the ClassWizard will add and remove mapping macros here.
-		//    DO NOT EDIT what you see in these blocks of generated code!
+	ON_COMMAND(ID_FORMAT_QUALITYFAST, OnFormatQualityFast)
+	ON_COMMAND(ID_FORMAT_QUALITYNORMAL, OnFormatQualityNormal)
+	ON_COMMAND(ID_FORMAT_QUALITYBEST, OnFormatQualityBest)
+	ON_UPDATE_COMMAND_UI(ID_FORMAT_QUALITYFAST, OnUpdateFormatQualityFast)
+	ON_UPDATE_COMMAND_UI(ID_FORMAT_QUALITYNORMAL, OnUpdateFormatQualityNormal)
+	ON_UPDATE_COMMAND_UI(ID_FORMAT_QUALITYBEST, OnUpdateFormatQualityBest)
+	ON_COMMAND(ID_FORMAT_SRGBMIPMAPS, OnFormatSRGBMipMaps)
+	ON_UPDATE_COMMAND_UI(ID_FORMAT_SRGBMIPMAPS, OnUpdateFormatSRGBMipMaps)
+	ON_COMMAND(ID_FORMAT_FILTERBOX, OnFormatFilterBox)
+	ON_COMMAND(ID_FORMAT_FILTERKAISER, OnFormatFilterKaiser)
+	ON_COMMAND(ID_FORMAT_FILTERLANCZOS, OnFormatFilterLanczos)
+	ON_COMMAND(ID_FORMAT_FILTERMITCHELL, OnFormatFilterMitchell)
+	ON_UPDATE_COMMAND_UI(ID_FORMAT_FILTERBOX, OnUpdateFormatFilterBox)
+	ON_UPDATE_COMMAND_UI(ID_FORMAT_FILTERKAISER, OnUpdateFormatFilterKaiser)
+	ON_UPDATE_COMMAND_UI(ID_FORMAT_FILTERLANCZOS, OnUpdateFormatFilterLanczos)
+	ON_UPDATE_COMMAND_UI(ID_FORMAT_FILTERMITCHELL, OnUpdateFormatFilterMitchell)
 	//}}AFX_MSG_MAP
 	// Standard file based document commands
 	ON_COMMAND(ID_FILE_OPEN, CWinApp::OnFileOpen)
@@ -146,6 +222,11 @@ CDxtexApp::CDxtexApp()
 	// Place all significant initialization in InitInstance
 	m_pdd = NULL;
 	m_pd3d = NULL;
+	m_ppool = NULL;
+	m_dwQuality = DXTC_QUALITY_BEST;
+	m_dwTimeBudget = 0;
+	m_dwMipFlags = 0;
+	m_dwMipFilter = TEX_FILTER_BOX;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -155,6 +236,7 @@ CDxtexApp::~CDxtexApp()
 {
 	ReleasePpo(&m_pdd);
 	ReleasePpo(&m_pd3d);
+	DXTPoolDestroy(m_ppool);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -202,6 +284,10 @@ BOOL CDxtexApp::InitInstance()
 	if (FAILED(hr = m_pdd->QueryInterface(IID_IDirect3D7, (VOID**)&m_pd3d)))
 		return FALSE;
 
+	// One compression thread per processor.  Without a pool everything
+	// still works, just on this thread.
+	DXTPoolCreate(0, &m_ppool);
+
 	// Parse command line for standard shell commands, DDE, file open
 	CDxtexCommandLineInfo cmdInfo;
 	ParseCommandLine(cmdInfo);
@@ -209,6 +295,20 @@ BOOL CDxtexApp::InitInstance()
 	if (cmdInfo.m_nShellCommand == CCommandLineInfo::FileNew)
 		cmdInfo.m_nShellCommand = CCommandLineInfo::FileNothing;
 
+	// A tier given on the command line is for this run only
+	m_dwQuality = GetProfileInt("Settings", "Quality", DXTC_QUALITY_BEST);
+	if (cmdInfo.m_dwQuality != 0)
+		m_dwQuality = cmdInfo.m_dwQuality;
+	m_dwTimeBudget = cmdInfo.m_dwTimeBudget;
+	m_dwMipFlags = GetProfileInt("Settings", "MipFlags", 0);
+	if (cmdInfo.m_bSRGBMips)
+		m_dwMipFlags |= TEX_MIP_SRGB;
+	m_dwMipFilter = GetProfileInt("Settings", "MipFilter", TEX_FILTER_BOX);
+	if (cmdInfo.m_dwMipFilter < TEX_FILTER_COUNT)
+		m_dwMipFilter = cmdInfo.m_dwMipFilter;
+	else if (m_dwMipFilter >= TEX_FILTER_COUNT)
+		m_dwMipFilter = TEX_FILTER_BOX;
+
 	// Dispatch commands specified on the command line
 	if (!ProcessShellCommand(cmdInfo))
 		return FALSE;
@@ -343,3 +443,104 @@ void CDxtexApp::OnAppAbout()
 	CAboutDlg aboutDlg;
 	aboutDlg.DoModal();
 }
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CDxtexApp compression quality
+
+VOID CDxtexApp::SetQuality(DWORD dwQuality)
+{
+	m_dwQuality = dwQuality;
+	WriteProfileInt("Settings", "Quality", dwQuality);
+}
+
+void CDxtexApp::OnFormatQualityFast()
+{
+	SetQuality(DXTC_QUALITY_FAST);
+}
+
+void CDxtexApp::OnFormatQualityNormal()
+{
+	SetQuality(DXTC_QUALITY_NORMAL);
+}
+
+void CDxtexApp::OnFormatQualityBest()
+{
+	SetQuality(DXTC_QUALITY_BEST);
+}
+
+void CDxtexApp::OnUpdateFormatQualityFast(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetRadio(m_dwQuality == DXTC_QUALITY_FAST);
+}
+
+void CDxtexApp::OnUpdateFormatQualityNormal(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetRadio(m_dwQuality == DXTC_QUALITY_NORMAL);
+}
+
+void CDxtexApp::OnUpdateFormatQualityBest(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetRadio(m_dwQuality == DXTC_QUALITY_BEST);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////
+// CDxtexApp mip map filtering
+
+void CDxtexApp::OnFormatSRGBMipMaps()
+{
+	m_dwMipFlags ^= TEX_MIP_SRGB;
+	WriteProfileInt("Settings", "MipFlags", m_dwMipFlags);
+}
+
+void CDxtexApp::OnUpdateFormatSRGBMipMaps(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetCheck((m_dwMipFlags & TEX_MIP_SRGB) != 0);
+}
+
+VOID CDxtexApp::SetMipFilter(DWORD dwFilter)
+{
+	m_dwMipFilter = dwFilter;
+	WriteProfileInt("Settings", "MipFilter", dwFilter);
+}
+
+void CDxtexApp::OnFormatFilterBox()
+{
+	SetMipFilter(TEX_FILTER_BOX);
+}
+
+void CDxtexApp::OnFormatFilterKaiser()
+{
+	SetMipFilter(TEX_FILTER_KAISER);
+}
+
+void CDxtexApp::OnFormatFilterLanczos()
+{
+	SetMipFilter(TEX_FILTER_LANCZOS);
+}
+
+void CDxtexApp::OnFormatFilterMitchell()
+{
+	SetMipFilter(TEX_FILTER_MITCHELL);
+}
+
+void CDxtexApp::OnUpdateFormatFilterBox(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetRadio(m_dwMipFilter == TEX_FILTER_BOX);
+}
+
+void CDxtexApp::OnUpdateFormatFilterKaiser(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetRadio(m_dwMipFilter == TEX_FILTER_KAISER);
+}
+
+void CDxtexApp::OnUpdateFormatFilterLanczos(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetRadio(m_dwMipFilter == TEX_FILTER_LANCZOS);
+}
+
+void CDxtexApp::OnUpdateFormatFilterMitchell(CCmdUI* pCmdUI)
+{
+	pCmdUI->SetRadio(m_dwMipFilter == TEX_FILTER_MITCHELL);
+}
@@ -13,6 +13,7 @@
 #endif
 
 #include "resource.h"       // main symbols
+#include "dxtpool.h"
 
 #ifndef ReleasePpo
 	#define ReleasePpo(ppo) \
@@ -48,6 +49,11 @@ public:
 	DWORD m_dwFourCC;
 	BOOL m_bAlphaComing;
 	BOOL m_bMipMap;
+	DWORD m_dwQuality; // DXTC_QUALITY_ tier, 0 keeps the saved setting
+	DWORD m_dwTimeBudget; // Milliseconds per texture, 0 for no limit
+	BOOL m_bTimeBudgetComing;
+	BOOL m_bSRGBMips; // Average mips as linear light for this run
+	DWORD m_dwMipFilter; // TEX_FILTER_ kernel, TEX_FILTER_COUNT keeps the saved one
 
 	CDxtexCommandLineInfo::CDxtexCommandLineInfo(VOID);
 	virtual void ParseParam(const TCHAR* pszParam, BOOL bFlag, BOOL bLast);
@@ -66,6 +72,11 @@ public:
 	virtual ~CDxtexApp();
 	LPDIRECTDRAW7 Pdd(VOID) { return m_pdd; }
 	LPDIRECT3D7 Pd3d(VOID) { return m_pd3d; }
+	DXTWorkPool* Ppool(VOID) { return m_ppool; }
+	DWORD DwQuality(VOID) { return m_dwQuality; }
+	DWORD DwTimeBudget(VOID) { return m_dwTimeBudget; }
+	DWORD DwMipFlags(VOID) { return m_dwMipFlags; }
+	DWORD DwMipFilter(VOID) { return m_dwMipFilter; }
 
 // Overrides
 	// ClassWizard generated virtual function overrides
@@ -77,13 +88,35 @@ public:
 // Implementation
 	//{{AFX_MSG(CDxtexApp)
 	afx_msg void OnAppAbout();
-		// NOTE - the ClassWizard will add and remove member functions here.
-		//    DO NOT EDIT what you see in these blocks of generated code !
+	afx_msg void OnFormatQualityFast();
+	afx_msg void OnFormatQualityNormal();
+	afx_msg void OnFormatQualityBest();
+	afx_msg void OnUpdateFormatQualityFast(CCmdUI* pCmdUI);
+	afx_msg void OnUpdateFormatQualityNormal(CCmdUI* pCmdUI);
+	afx_msg void OnUpdateFormatQualityBest(CCmdUI* pCmdUI);
+	afx_msg void OnFormatSRGBMipMaps();
+	afx_msg void OnUpdateFormatSRGBMipMaps(CCmdUI* pCmdUI);
+	afx_msg void OnFormatFilterBox();
+	afx_msg void OnFormatFilterKaiser();
+	afx_msg void OnFormatFilterLanczos();
+	afx_msg void OnFormatFilterMitchell();
+	afx_msg void OnUpdateFormatFilterBox(CCmdUI* pCmdUI);
+	afx_msg void OnUpdateFormatFilterKaiser(CCmdUI* pCmdUI);
+	afx_msg void OnUpdateFormatFilterLanczos(CCmdUI* pCmdUI);
+	afx_msg void OnUpdateFormatFilterMitchell(CCmdUI* pCmdUI);
 	//}}AFX_MSG
 	DECLARE_MESSAGE_MAP()
 private:
 	LPDIRECTDRAW7 m_pdd;
 	LPDIRECT3D7 m_pd3d;
+	DXTWorkPool* m_ppool; // Threads shared by compression jobs, may be NULL
+	DWORD m_dwQuality; // DXTC_QUALITY_ tier used by Compress
+	DWORD m_dwTimeBudget; // Milliseconds per texture, 0 for no limit
+	DWORD m_dwMipFlags; // TEX_MIP_ flags used by GenerateMip
+	DWORD m_dwMipFilter; // TEX_FILTER_ kernel used by GenerateMip
+
+	VOID SetQuality(DWORD dwQuality);
+	VOID SetMipFilter(DWORD dwFilter);
 };
 
 
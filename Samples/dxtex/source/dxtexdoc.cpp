@@ -5,6 +5,10 @@
 #include "dxtex.h"
 
 #include "dxtexDoc.h"
+#include "dxtcodec.h"
+#include "ddsfile.h"
+#include "dxtsurf.h"
+#include "teximage.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -12,6 +16,126 @@
 static char THIS_FILE[] = __FILE__;
 #endif
 
+// Cube map faces in the order they are stored
+static const DWORD s_dwCubeMapFaces[6] =
+{
+	DDSCAPS2_CUBEMAP_POSITIVEX,
+	DDSCAPS2_CUBEMAP_NEGATIVEX,
+	DDSCAPS2_CUBEMAP_POSITIVEY,
+	DDSCAPS2_CUBEMAP_NEGATIVEY,
+	DDSCAPS2_CUBEMAP_POSITIVEZ,
+	DDSCAPS2_CUBEMAP_NEGATIVEZ,
+};
+
+// DirectDraw only creates surfaces in the DXTn FourCCs, so ATI1, ATI2 and
+// BC7 are kept in a DXTn surface with the same block size
+static DWORD CarrierFourCC(DWORD dwFourCC)
+{
+	if (dwFourCC == FOURCC_ATI1)
+		return FOURCC_DXT1;
+	if (dwFourCC == FOURCC_ATI2 || dwFourCC == FOURCC_BC7)
+		return FOURCC_DXT5;
+	return dwFourCC;
+}
+
+// Read the DX10 header that follows pddsd and put the format it names into
+// pddsd, so the rest of the load goes the legacy way.  Texture arrays and
+// formats DxTex can't hold fail, volumes come back with DDSCAPS2_VOLUME.
+static HRESULT ReadDX10Header(CArchive& ar, DDSURFACEDESC2* pddsd)
+{
+	DDSHEADERDX10 dx10;
+
+	if (ar.Read(&dx10, sizeof(dx10)) != sizeof(dx10))
+		return E_FAIL;
+	return DDSReadDX10Header(&dx10, &pddsd->ddpfPixelFormat, &pddsd->ddsCaps);
+}
+
+// DirectDraw 7 has no volume surfaces, so volume textures are left to
+// DXTConv.  The user is told why and the open is abandoned quietly, instead
+// of with the invalid file format message.
+static VOID RefuseVolume(VOID)
+{
+	AfxMessageBox(ID_ERROR_VOLUME);
+	AfxThrowUserException();
+}
+
+// Copy dwHeight rows of dwRowBytes between images with their own pitches
+static VOID CopyRows(const VOID* pSrc, LONG lSrcPitch, VOID* pDest, LONG lDestPitch, DWORD dwRowBytes, DWORD dwHeight)
+{
+	const BYTE* pbSrc = (const BYTE*)pSrc;
+	BYTE* pbDest = (BYTE*)pDest;
+	for (DWORD y = 0; y < dwHeight; y++)
+	{
+		memcpy(pbDest, pbSrc, dwRowBytes);
+		pbSrc += lSrcPitch;
+		pbDest += lDestPitch;
+	}
+}
+
+// Decode a block compressed surface into a 32-bit ARGB surface of the same
+// size with the built-in decoder.  DXT2 and DXT4 color is divided by alpha
+// again, so the result can go to the encoder like any other ARGB image.
+static HRESULT DecodeLevel(LPDIRECTDRAWSURFACE7 pddsSrc, LPDIRECTDRAWSURFACE7 pddsDest, DWORD dwFourCC)
+{
+	HRESULT hr;
+	DDSURFACEDESC2 ddsdSrc;
+	DDSURFACEDESC2 ddsdDest;
+
+	ZeroMemory(&ddsdSrc, sizeof(ddsdSrc));
+	ddsdSrc.dwSize = sizeof(ddsdSrc);
+	ZeroMemory(&ddsdDest, sizeof(ddsdDest));
+	ddsdDest.dwSize = sizeof(ddsdDest);
+	if (FAILED(hr = pddsSrc->Lock(NULL, &ddsdSrc, DDLOCK_WAIT | DDLOCK_READONLY, NULL)))
+		return hr;
+	if (FAILED(hr = pddsDest->Lock(NULL, &ddsdDest, DDLOCK_WAIT | DDLOCK_WRITEONLY, NULL)))
+	{
+		pddsSrc->Unlock(NULL);
+		return hr;
+	}
+	hr = DXTDecompressImage(dwFourCC, ddsdSrc.lpSurface,
+		DXTSurfaceGetPitch(&ddsdSrc, dwFourCC), ddsdSrc.dwWidth, ddsdSrc.dwHeight,
+		NULL, ddsdDest.lpSurface, ddsdDest.lPitch, 0);
+	if (SUCCEEDED(hr) && (dwFourCC == FOURCC_DXT2 || dwFourCC == FOURCC_DXT4))
+	{
+		BYTE* pbRow = (BYTE*)ddsdDest.lpSurface;
+		for (DWORD y = 0; y < ddsdDest.dwHeight; y++)
+		{
+			DWORD* pdwTexel = (DWORD*)pbRow;
+			for (DWORD x = 0; x < ddsdDest.dwWidth; x++)
+			{
+				// Fully transparent texels stay black
+				DWORD dwAlpha = pdwTexel[x] >> 24;
+				DWORD dwTexel = pdwTexel[x] & 0xff000000;
+				if (dwAlpha != 0)
+				{
+					for (DWORD dwShift = 0; dwShift < 24; dwShift += 8)
+					{
+						DWORD dwColor = (pdwTexel[x] >> dwShift) & 0xff;
+						dwColor = (dwColor * 255 + dwAlpha / 2) / dwAlpha;
+						dwTexel |= (dwColor > 255 ? 255 : dwColor) << dwShift;
+					}
+				}
+				pdwTexel[x] = dwTexel;
+			}
+			pbRow += ddsdDest.lPitch;
+		}
+	}
+	pddsDest->Unlock(NULL);
+	pddsSrc->Unlock(NULL);
+	return hr;
+}
+
+// A mip level waiting to be compressed.  Both surfaces stay locked until
+// ReleaseLevels.
+struct COMPRESSLEVEL
+{
+	LPDIRECTDRAWSURFACE7 pddsSrc; // Source, or a 32-bit ARGB copy of it
+	LPDIRECTDRAWSURFACE7 pddsDest; // DXTn surface being written
+	DWORD dwFace; // Index into s_dwCubeMapFaces, 0 if not a cube map
+	LONG lwMip; // 0 = top
+	DXTCOMPRESSJOB job; // Locked pixels of both
+};
+
 /////////////////////////////////////////////////////////////////////////////
 // CDxtexDoc
 
@@ -26,6 +150,9 @@ BEGIN_MESSAGE_MAP(CDxtexDoc, CDocument)
 	ON_COMMAND(ID_FORMAT_DXT3, OnFormatDxt3)
 	ON_COMMAND(ID_FORMAT_DXT4, OnFormatDxt4)
 	ON_COMMAND(ID_FORMAT_DXT5, OnFormatDxt5)
+	ON_COMMAND(ID_FORMAT_ATI1, OnFormatAti1)
+	ON_COMMAND(ID_FORMAT_ATI2, OnFormatAti2)
+	ON_COMMAND(ID_FORMAT_BC7, OnFormatBc7)
 	ON_COMMAND(ID_FORMAT_CHANGECUBEMAPFACES, OnFormatChangeCubeMapFaces)
 	ON_UPDATE_COMMAND_UI(ID_FILE_OPENALPHA, OnUpdateFileOpenAlpha)
 	ON_UPDATE_COMMAND_UI(ID_FORMAT_GENERATEMIPMAPS, OnUpdateFormatGenerateMipmaps)
@@ -59,10 +186,20 @@ CDxtexDoc::CDxtexDoc()
 	m_numMips = 0;
 	m_dwCubeMapFlags = 0;
 	m_bTitleModsChanged = FALSE;
+	m_dwCarrierFourCC = 0;
+	m_pddsMapped = NULL;
+	ZeroMemory(&m_mapping, sizeof(m_mapping));
+	ZeroMemory(m_dwLevelsLoaded, sizeof(m_dwLevelsLoaded));
+	m_pchainOrig = NULL;
+	m_pchainNew = NULL;
+	ForgetCompressError();
 }
 
 CDxtexDoc::~CDxtexDoc()
 {
+	UnmapDDS();
+	DXTChainDestroy(m_pchainOrig);
+	DXTChainDestroy(m_pchainNew);
 	ReleasePpo(&m_pddsOrig);
 	ReleasePpo(&m_pddsNew);
 }
@@ -75,6 +212,27 @@ BOOL CDxtexDoc::OnNewDocument()
 	return TRUE;
 }
 
+BOOL CDxtexDoc::OnSaveDocument(LPCTSTR lpszPathName)
+{
+	HRESULT hr;
+	LPDIRECTDRAWSURFACE7 pdds;
+
+	// The mapping keeps writers out of the file, which may be the one
+	// being saved over, and everything has to be in memory to save it
+	if (FAILED(LoadAllLevels()))
+		return FALSE;
+
+	// DDS files are written through a mapped view rather than a CArchive
+	pdds = (m_pddsNew == NULL ? m_pddsOrig : m_pddsNew);
+	if (FAILED(hr = SaveDDS(pdds, lpszPathName)))
+	{
+		ReportSaveLoadException(lpszPathName, NULL, TRUE, AFX_IDP_FAILED_TO_SAVE_DOC);
+		return FALSE;
+	}
+	SetModifiedFlag(FALSE);
+	return TRUE;
+}
+
 
 /////////////////////////////////////////////////////////////////////////////
 // CDxtexDoc serialization
@@ -85,9 +243,8 @@ void CDxtexDoc::Serialize(CArchive& ar)
 	
 	if (ar.IsStoring())
 	{
-		LPDIRECTDRAWSURFACE7 pdds;
-		pdds = (m_pddsNew == NULL ? m_pddsOrig : m_pddsNew);
-		SaveDDS(pdds, ar);
+		// OnSaveDocument writes the file itself
+		ASSERT(FALSE);
 	}
 	else
 	{
@@ -107,8 +264,11 @@ void CDxtexDoc::Serialize(CArchive& ar)
 		}
 		else if (lstrcmpi(pszExt, ".dds") == 0)
 		{
+			UnmapDDS();
 			ReleasePpo(&m_pddsOrig);
 			ReleasePpo(&m_pddsNew);
+			m_dwCarrierFourCC = 0;
+			ForgetCompressError();
 			if (FAILED(hr = LoadDDS(&m_pddsOrig, ar)))
 				AfxThrowArchiveException(CArchiveException::badIndex); // invalid file format
 		}
@@ -120,23 +280,32 @@ void CDxtexDoc::Serialize(CArchive& ar)
 }
 
 
-HRESULT CDxtexDoc::SaveDDS(LPDIRECTDRAWSURFACE7 pdds, CArchive& ar)
+// Write the texture in one pass: the file is created at its final size and
+// mapped, and every level of every face is copied straight into it.
+HRESULT CDxtexDoc::SaveDDS(LPDIRECTDRAWSURFACE7 pdds, LPCTSTR lpszPathName)
 {
 	HRESULT hr;
 	DDSURFACEDESC2 ddsd;
-	DWORD dwMagic;
-	DWORD dwTopCubeFace;
+	DDSFILEHEADER header;
+	DDSHEADERDX10 dx10;
+	DDSMAPPING mapping;
+	LPDIRECTDRAWSURFACE7 pddsFaceTop;
+	DWORD dwFace;
+	INT i;
 
-	dwMagic = MAKEFOURCC('D','D','S',' ');
-	ar.Write(&dwMagic, sizeof(dwMagic));
 	ZeroMemory(&ddsd, sizeof(ddsd));
 	ddsd.dwSize = sizeof(ddsd);
 	if (FAILED(hr = pdds->GetSurfaceDesc(&ddsd)))
 		return hr;
 
-	// If this is a cube map, remember which cubemap face is the "top" one
-	dwTopCubeFace = ddsd.ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP_ALLFACES;
-	
+	// ATI1, ATI2 and BC7 are written under their own FourCC, not the
+	// carrier's.  BC7 doesn't have one and goes in a DX10 header.
+	if (pdds == m_pddsNew && m_dwCarrierFourCC != 0)
+		ddsd.ddpfPixelFormat.dwFourCC = m_dwCarrierFourCC;
+	DDSInitDX10Header(ddsd.ddpfPixelFormat.dwFourCC, m_dwCubeMapFlags != 0, &dx10);
+	if (DDSNeedsDX10Header(ddsd.ddpfPixelFormat.dwFourCC))
+		ddsd.ddpfPixelFormat.dwFourCC = FOURCC_DX10;
+
 	// Mask out all caps indicating image uses, and only
 	// keep those intrinsic to the image
 	// e.g., remove DDSCAPS_SYSTEMMEMORY, but keep DDSCAPS_MIPMAP
@@ -149,115 +318,64 @@ HRESULT CDxtexDoc::SaveDDS(LPDIRECTDRAWSURFACE7 pdds, CArchive& ar)
 	// of the cube map faces.  But we want to store all faces in the file's DDSD:
 	ddsd.ddsCaps.dwCaps2 |= m_dwCubeMapFlags;
 
-	ar.Write(&ddsd, sizeof(ddsd));
-
-	// Write out top level, along with any mips
-	if (FAILED(hr = SaveAllMipSurfaces(pdds, ar)))
+	// The file's header is laid out like DDSURFACEDESC2
+	memcpy(&header, &ddsd, sizeof(header));
+	if (FAILED(hr = DDSCreateMappedFile(lpszPathName, &header, &dx10, &mapping)))
 		return hr;
 
-	// Save additional cubemap faces, if any
-	if (m_dwCubeMapFlags != dwTopCubeFace)
+	// Faces go in the file in the order of their cap bits
+	if (m_dwCubeMapFlags == 0)
 	{
-		LPDIRECTDRAWSURFACE7 pddsFaceTop = NULL;
-
-		if ((m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_POSITIVEX) && !(dwTopCubeFace & DDSCAPS2_CUBEMAP_POSITIVEX))
-		{
-			if (FAILED(hr = GetTopCubeFace(pdds, DDSCAPS2_CUBEMAP_POSITIVEX, &pddsFaceTop)))
-				return hr;
-			if (FAILED(hr = SaveAllMipSurfaces(pddsFaceTop, ar)))
-				return hr;
-			ReleasePpo(&pddsFaceTop);
-		}
-		if ((m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_NEGATIVEX) && !(dwTopCubeFace & DDSCAPS2_CUBEMAP_NEGATIVEX))
-		{
-			if (FAILED(hr = GetTopCubeFace(pdds, DDSCAPS2_CUBEMAP_NEGATIVEX, &pddsFaceTop)))
-				return hr;
-			if (FAILED(hr = SaveAllMipSurfaces(pddsFaceTop, ar)))
-				return hr;
-			ReleasePpo(&pddsFaceTop);
-		}
-		if ((m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_POSITIVEY) && !(dwTopCubeFace & DDSCAPS2_CUBEMAP_POSITIVEY))
-		{
-			if (FAILED(hr = GetTopCubeFace(pdds, DDSCAPS2_CUBEMAP_POSITIVEY, &pddsFaceTop)))
-				return hr;
-			if (FAILED(hr = SaveAllMipSurfaces(pddsFaceTop, ar)))
-				return hr;
-			ReleasePpo(&pddsFaceTop);
-		}
-		if ((m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_NEGATIVEY) && !(dwTopCubeFace & DDSCAPS2_CUBEMAP_NEGATIVEY))
-		{
-			if (FAILED(hr = GetTopCubeFace(pdds, DDSCAPS2_CUBEMAP_NEGATIVEY, &pddsFaceTop)))
-				return hr;
-			if (FAILED(hr = SaveAllMipSurfaces(pddsFaceTop, ar)))
-				return hr;
-			ReleasePpo(&pddsFaceTop);
-		}
-		if ((m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_POSITIVEZ) && !(dwTopCubeFace & DDSCAPS2_CUBEMAP_POSITIVEZ))
-		{
-			if (FAILED(hr = GetTopCubeFace(pdds, DDSCAPS2_CUBEMAP_POSITIVEZ, &pddsFaceTop)))
-				return hr;
-			if (FAILED(hr = SaveAllMipSurfaces(pddsFaceTop, ar)))
-				return hr;
-			ReleasePpo(&pddsFaceTop);
-		}
-		if ((m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_NEGATIVEZ) && !(dwTopCubeFace & DDSCAPS2_CUBEMAP_NEGATIVEZ))
+		hr = SaveAllMipSurfaces(pdds, &mapping, 0);
+	}
+	else
+	{
+		for (i = 0; i < 6 && SUCCEEDED(hr); i++)
 		{
-			if (FAILED(hr = GetTopCubeFace(pdds, DDSCAPS2_CUBEMAP_NEGATIVEZ, &pddsFaceTop)))
-				return hr;
-			if (FAILED(hr = SaveAllMipSurfaces(pddsFaceTop, ar)))
-				return hr;
-			ReleasePpo(&pddsFaceTop);
+			if ((m_dwCubeMapFlags & s_dwCubeMapFaces[i]) == 0)
+				continue;
+			dwFace = DDSGetMappedFace(&mapping, s_dwCubeMapFaces[i]);
+			if (SUCCEEDED(hr = GetTopCubeFace(pdds, s_dwCubeMapFaces[i], &pddsFaceTop)))
+			{
+				hr = SaveAllMipSurfaces(pddsFaceTop, &mapping, dwFace);
+				ReleasePpo(&pddsFaceTop);
+			}
 		}
 	}
-
-	return S_OK;
+	// The file is written beside the old one and only replaces it once it's
+	// on disk, a failed save deletes just the new file
+	if (SUCCEEDED(hr))
+		hr = DDSCommitMappedFile(&mapping);
+	else
+		DDSUnmapFile(&mapping);
+	return hr;
 }
 
 
-HRESULT CDxtexDoc::SaveAllMipSurfaces(LPDIRECTDRAWSURFACE7 pddsTop, CArchive& ar)
+// Copy every mip level of one face into the mapped file, dropping the
+// padding at the end of each row
+HRESULT CDxtexDoc::SaveAllMipSurfaces(LPDIRECTDRAWSURFACE7 pddsTop, DDSMAPPING* pMapping, DWORD dwFace)
 {
 	HRESULT hr;
-	DDSCAPS2 ddsCaps;
-	LPDIRECTDRAWSURFACE7 pdds;
-	LPDIRECTDRAWSURFACE7 pdds2;
+	LPDIRECTDRAWSURFACE7 pddsLevel;
 	DDSURFACEDESC2 ddsd;
+	DWORD dwLevel;
 
-	pdds = pddsTop;
-	pdds->AddRef();
-
-	ZeroMemory(&ddsCaps, sizeof(ddsCaps));
-	ddsCaps.dwCaps = DDSCAPS_TEXTURE;
-	ddsCaps.dwCaps2 = DDSCAPS2_MIPMAPSUBLEVEL;
-
-	while (TRUE)
+	for (dwLevel = 0; dwLevel < pMapping->dwLevels; dwLevel++)
 	{
+		if (FAILED(hr = GetNthMipMap(pddsTop, dwLevel, &pddsLevel)))
+			return hr;
 		ZeroMemory(&ddsd, sizeof(ddsd));
 		ddsd.dwSize = sizeof(ddsd);
-		hr = pdds->Lock(NULL, &ddsd, DDLOCK_WAIT, NULL);
-		if (ddsd.dwFlags & DDSD_LINEARSIZE)
+		if (FAILED(hr = pddsLevel->Lock(NULL, &ddsd, DDLOCK_WAIT | DDLOCK_READONLY, NULL)))
 		{
-			ar.Write(ddsd.lpSurface, ddsd.dwLinearSize);
-		}
-		else 
-		{
-			DWORD yp;
-			BYTE* pbSrc = (BYTE*)ddsd.lpSurface;
-			LONG dataBytesPerRow = ddsd.dwWidth * ddsd.ddpfPixelFormat.dwRGBBitCount / 8;
-			for (yp = 0; yp < ddsd.dwHeight; yp++)
-			{
-				ar.Write(pbSrc, dataBytesPerRow);
-				pbSrc += ddsd.lPitch;
-			}
-		}
-		pdds->Unlock(NULL);
-
-		if (FAILED(hr = pdds->GetAttachedSurface(&ddsCaps, &pdds2)))
-		{
-			ReleasePpo(&pdds);
-			break;
+			ReleasePpo(&pddsLevel);
+			return hr;
 		}
-		ReleasePpo(&pdds);
-		pdds = pdds2;
+		DDSFillMappedLevel(pMapping, dwFace, dwLevel, ddsd.lpSurface,
+			DXTSurfaceGetPitch(&ddsd, pMapping->dwFourCC));
+		pddsLevel->Unlock(NULL);
+		ReleasePpo(&pddsLevel);
 	}
 	return S_OK;
 }
@@ -270,6 +388,18 @@ HRESULT CDxtexDoc::LoadDDS(LPDIRECTDRAWSURFACE7* ppdds, CArchive& ar)
 	LPDIRECTDRAWSURFACE7 pdds;
 	DDSURFACEDESC2 ddsd;
 	DWORD dwTopCubeFace;
+	DWORD dwFourCC = 0;
+
+	// Files the mapping can't lay out are still read the old way
+	if (SUCCEEDED(DDSMapFile(ar.GetFile()->GetFilePath(), &m_mapping)))
+	{
+		if (m_mapping.Header.ddsCaps.dwCaps2 & DDSCAPS2_VOLUME)
+		{
+			DDSUnmapFile(&m_mapping);
+			RefuseVolume();
+		}
+		return LoadMappedDDS(ppdds);
+	}
 
 	ar.Read(&dwMagic, sizeof(dwMagic));
 	if (dwMagic != MAKEFOURCC('D','D','S',' '))
@@ -277,6 +407,19 @@ HRESULT CDxtexDoc::LoadDDS(LPDIRECTDRAWSURFACE7* ppdds, CArchive& ar)
 	ar.Read(&ddsd, sizeof(ddsd));
 	if (ddsd.dwSize != sizeof(ddsd))
 		return E_FAIL;
+	if ((ddsd.ddpfPixelFormat.dwFlags & DDPF_FOURCC) &&
+		ddsd.ddpfPixelFormat.dwFourCC == FOURCC_DX10)
+	{
+		if (FAILED(hr = ReadDX10Header(ar, &ddsd)))
+			return hr;
+	}
+	if (ddsd.ddsCaps.dwCaps2 & DDSCAPS2_VOLUME)
+		RefuseVolume();
+	if (ddsd.ddpfPixelFormat.dwFlags & DDPF_FOURCC)
+	{
+		dwFourCC = ddsd.ddpfPixelFormat.dwFourCC;
+		ddsd.ddpfPixelFormat.dwFourCC = CarrierFourCC(dwFourCC);
+	}
 	ddsd.ddsCaps.dwCaps |= DDSCAPS_SYSTEMMEMORY;
 	ddsd.dwFlags = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT | DDSD_PIXELFORMAT;
 	m_dwWidth = ddsd.dwWidth;
@@ -350,11 +493,165 @@ HRESULT CDxtexDoc::LoadDDS(LPDIRECTDRAWSURFACE7* ppdds, CArchive& ar)
 		}
 	}
 
+	// ATI1, ATI2 and BC7 files open as the compressed image of a decoded
+	// original, so everything that Blts from the original still works
+	if (CarrierFourCC(dwFourCC) != dwFourCC)
+	{
+		LPDIRECTDRAWSURFACE7 pddsDecoded = NULL;
+		if (FAILED(hr = DecodeCarrier(pdds, dwFourCC, &pddsDecoded)))
+		{
+			ReleasePpo(&pdds);
+			return hr;
+		}
+		m_pddsNew = pdds;
+		m_dwCarrierFourCC = dwFourCC;
+		pdds = pddsDecoded;
+	}
+
+	*ppdds = pdds;
+	return S_OK;
+}
+
+
+// Create the surfaces for a mapped DDS file without reading any of its
+// levels.  LoadLevel copies each one in the first time it's shown, and
+// LoadAllLevels copies the rest before anything edits or saves the texture.
+// ATI1, ATI2 and BC7 files are decoded for the original, so they're copied
+// in whole right away.
+HRESULT CDxtexDoc::LoadMappedDDS(LPDIRECTDRAWSURFACE7* ppdds)
+{
+	HRESULT hr;
+	LPDIRECTDRAWSURFACE7 pdds;
+	DDSURFACEDESC2 ddsd;
+	DWORD dwFourCC = m_mapping.dwFourCC;
+
+	// The file's header is laid out like DDSURFACEDESC2
+	ZeroMemory(&ddsd, sizeof(ddsd));
+	memcpy(&ddsd, &m_mapping.Header, sizeof(m_mapping.Header));
+	if (dwFourCC != 0)
+		ddsd.ddpfPixelFormat.dwFourCC = CarrierFourCC(dwFourCC);
+	ddsd.ddsCaps.dwCaps |= DDSCAPS_SYSTEMMEMORY;
+	ddsd.dwFlags = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT | DDSD_PIXELFORMAT;
+	m_dwWidth = ddsd.dwWidth;
+	m_dwHeight = ddsd.dwHeight;
+	m_dwCubeMapFlags = (ddsd.ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP_ALLFACES);
+	if (FAILED(hr = PDxtexApp()->Pdd()->CreateSurface(&ddsd, &pdds, NULL)))
+	{
+		DDSUnmapFile(&m_mapping);
+		return hr;
+	}
+	m_numMips = m_mapping.dwLevels;
+	m_pddsMapped = pdds;
+	m_pddsMapped->AddRef();
+	ZeroMemory(m_dwLevelsLoaded, sizeof(m_dwLevelsLoaded));
+
+	if (CarrierFourCC(dwFourCC) != dwFourCC)
+	{
+		LPDIRECTDRAWSURFACE7 pddsDecoded = NULL;
+		if (FAILED(hr = LoadAllLevels()) ||
+			FAILED(hr = DecodeCarrier(pdds, dwFourCC, &pddsDecoded)))
+		{
+			UnmapDDS();
+			ReleasePpo(&pdds);
+			return hr;
+		}
+		m_pddsNew = pdds;
+		m_dwCarrierFourCC = dwFourCC;
+		pdds = pddsDecoded;
+	}
+
 	*ppdds = pdds;
 	return S_OK;
 }
 
 
+// Copy one mip level of one face of the original in from the mapped file,
+// unless it's been copied already.  dwCubeMapFace is a DDSCAPS2_CUBEMAP_
+// face, ignored if the texture isn't a cube map.
+HRESULT CDxtexDoc::LoadLevel(DWORD dwCubeMapFace, LONG lwMip)
+{
+	HRESULT hr;
+	LPDIRECTDRAWSURFACE7 pddsFaceTop = NULL;
+	LPDIRECTDRAWSURFACE7 pddsLevel = NULL;
+	DDSURFACEDESC2 ddsd;
+	DWORD dwFace = 0;
+
+	if (m_pddsMapped == NULL || lwMip < 0 || (DWORD)lwMip >= m_mapping.dwLevels)
+		return S_OK;
+	if (m_dwCubeMapFlags != 0)
+	{
+		if ((dwCubeMapFace & m_dwCubeMapFlags) == 0)
+			return S_OK;
+		dwFace = DDSGetMappedFace(&m_mapping, dwCubeMapFace);
+	}
+	if (m_dwLevelsLoaded[dwFace] & (1 << lwMip))
+		return S_OK;
+
+	if (m_dwCubeMapFlags == 0)
+	{
+		pddsFaceTop = m_pddsMapped;
+		pddsFaceTop->AddRef();
+	}
+	else if (FAILED(hr = GetTopCubeFace(m_pddsMapped, dwCubeMapFace, &pddsFaceTop)))
+	{
+		return hr;
+	}
+	hr = GetNthMipMap(pddsFaceTop, lwMip, &pddsLevel);
+	ReleasePpo(&pddsFaceTop);
+	if (FAILED(hr))
+		return hr;
+
+	ZeroMemory(&ddsd, sizeof(ddsd));
+	ddsd.dwSize = sizeof(ddsd);
+	if (FAILED(hr = pddsLevel->Lock(NULL, &ddsd, DDLOCK_WAIT | DDLOCK_WRITEONLY, NULL)))
+	{
+		ReleasePpo(&pddsLevel);
+		return hr;
+	}
+	DDSCopyMappedLevel(&m_mapping, dwFace, lwMip, ddsd.lpSurface,
+		DXTSurfaceGetPitch(&ddsd, m_mapping.dwFourCC));
+	pddsLevel->Unlock(NULL);
+	ReleasePpo(&pddsLevel);
+	m_dwLevelsLoaded[dwFace] |= (1 << lwMip);
+	return S_OK;
+}
+
+
+// Copy in every level that hasn't been shown yet and let go of the file
+HRESULT CDxtexDoc::LoadAllLevels(VOID)
+{
+	HRESULT hr;
+	LONG lwMip;
+	INT i;
+
+	if (m_pddsMapped == NULL)
+		return S_OK;
+	for (lwMip = 0; lwMip < (LONG)m_mapping.dwLevels; lwMip++)
+	{
+		if (m_dwCubeMapFlags == 0)
+		{
+			if (FAILED(hr = LoadLevel(0, lwMip)))
+				return hr;
+			continue;
+		}
+		for (i = 0; i < 6; i++)
+		{
+			if (FAILED(hr = LoadLevel(s_dwCubeMapFaces[i], lwMip)))
+				return hr;
+		}
+	}
+	UnmapDDS();
+	return S_OK;
+}
+
+
+VOID CDxtexDoc::UnmapDDS(VOID)
+{
+	ReleasePpo(&m_pddsMapped);
+	DDSUnmapFile(&m_mapping);
+}
+
+
 HRESULT CDxtexDoc::LoadAllMipSurfaces(LPDIRECTDRAWSURFACE7 pddsTop, CArchive& ar)
 {
 	HRESULT hr;
@@ -418,7 +715,7 @@ HRESULT CDxtexDoc::LoadBmp(CString& strPath)
 	if (FAILED(hr = CreateSurfaceFromBmp(strPath, &pdds)))
 		return hr;
 
-	// Ensure that source image dimensions are power of 2
+	// Any size will do, mip levels round odd sizes down
 	ZeroMemory(&ddsd, sizeof(ddsd));
 	ddsd.dwSize = sizeof(ddsd);
 	if (FAILED(hr = pdds->GetSurfaceDesc(&ddsd)))
@@ -426,20 +723,6 @@ HRESULT CDxtexDoc::LoadBmp(CString& strPath)
 		ReleasePpo(&pdds);
 		return hr;
 	}
-	LONG lwTempW;
-	LONG lwTempH;
-	lwTempW = ddsd.dwWidth;
-	lwTempH = ddsd.dwHeight;
-	while ((lwTempW & 1) == 0)
-		lwTempW = lwTempW >> 1;
-	while ((lwTempH & 1) == 0)
-		lwTempH = lwTempH >> 1;
-	if (lwTempW != 1 || lwTempH != 1)
-	{
-		AfxMessageBox(ID_ERROR_NOTPOW2);
-		ReleasePpo(&pdds);
-		return E_FAIL;
-	}
 
 	ReleasePpo(&m_pddsOrig);
 	m_pddsOrig = pdds;
@@ -469,6 +752,8 @@ HRESULT CDxtexDoc::LoadAlphaBmp(CString& strPath)
 {
 	HRESULT hr;
 
+	if (FAILED(hr = LoadAllLevels()))
+		return hr;
 	if (FAILED(hr = LoadAlphaIntoSurface(strPath, m_pddsOrig)))
 		return hr;
 
@@ -486,34 +771,22 @@ HRESULT CDxtexDoc::Compress(DWORD dwFourCC, BOOL bSwitchView)
 	LPDIRECTDRAWSURFACE7 pddsSrc2 = NULL;
 	LPDIRECTDRAWSURFACE7 pddsDest = NULL;
 	LPDIRECTDRAWSURFACE7 pddsDest2 = NULL;
+	CPtrArray levels;
+	INT i;
 	
+	if (FAILED(hr = LoadAllLevels()))
+		return hr;
 	ReleasePpo(&m_pddsNew);
+	m_dwCarrierFourCC = 0;
+	ForgetCompressError();
 	
 	ZeroMemory(&ddsdOrig, sizeof(ddsdOrig));
 	ddsdOrig.dwSize = sizeof(ddsdOrig);
 	if (FAILED(hr = m_pddsOrig->GetSurfaceDesc(&ddsdOrig)))
 		return hr;
 
-	// If source is DXT2 or DXT4, we can't convert to anything with nonpremult
-	// alpha because of premult -> nonpremult Blt issues.  We can convert to 
-	// DXT1, but RGB will be affected by alpha
-	if ((ddsdOrig.ddpfPixelFormat.dwFlags & DDPF_FOURCC) &&
-		(ddsdOrig.ddpfPixelFormat.dwFourCC == FOURCC_DXT2 ||
-		 ddsdOrig.ddpfPixelFormat.dwFourCC == FOURCC_DXT4))
-	{
-		if (dwFourCC == FOURCC_DXT1)
-		{
-			AfxMessageBox(ID_ERROR_PREMULTTODXT1);
-		}
-		else if (dwFourCC != FOURCC_DXT2 &&
-			dwFourCC != FOURCC_DXT4)
-		{
-			AfxMessageBox(ID_ERROR_PREMULTALPHA);
-			return S_OK;
-		}
-	}
-
-	// Make m_pddsNew exactly like m_pddsOrig except in specified DXTn format
+	// Make m_pddsNew exactly like m_pddsOrig except in specified DXTn format,
+	// or in the carrier format for ATI1, ATI2 and BC7
 	ddsdComp = ddsdOrig;
 	ddsdComp.dwFlags = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT | DDSD_PIXELFORMAT;
 	if (m_dwCubeMapFlags != 0)
@@ -521,87 +794,41 @@ HRESULT CDxtexDoc::Compress(DWORD dwFourCC, BOOL bSwitchView)
 	ZeroMemory(&ddsdComp.ddpfPixelFormat, sizeof(ddsdComp.ddpfPixelFormat));
 	ddsdComp.ddpfPixelFormat.dwSize = sizeof(DDPIXELFORMAT);
 	ddsdComp.ddpfPixelFormat.dwFlags = DDPF_FOURCC;
-	ddsdComp.ddpfPixelFormat.dwFourCC = dwFourCC;
+	ddsdComp.ddpfPixelFormat.dwFourCC = CarrierFourCC(dwFourCC);
 
 	if (FAILED(hr = PDxtexApp()->Pdd()->CreateSurface(&ddsdComp, &m_pddsNew, NULL)))
 		return hr;
+	if (ddsdComp.ddpfPixelFormat.dwFourCC != dwFourCC)
+		m_dwCarrierFourCC = dwFourCC;
 
+	// Every face and mip level is locked and queued first, then all of them
+	// are compressed together so the work spreads over every processor
 	if (m_dwCubeMapFlags == 0)
 	{
-		if (FAILED(BltAllLevels(m_pddsOrig, m_pddsNew)))
-			return hr;
+		hr = CompressAllLevels(m_pddsOrig, m_pddsNew, dwFourCC, 0, &levels);
 	}
 	else
 	{
 		LPDIRECTDRAWSURFACE7 pddsSrcFaceTop = NULL;
 		LPDIRECTDRAWSURFACE7 pddsDestFaceTop = NULL;
-		if (m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_NEGATIVEX)
-		{
-			if (FAILED(hr = GetTopCubeFace(m_pddsOrig, DDSCAPS2_CUBEMAP_NEGATIVEX, &pddsSrcFaceTop)))
-				return hr;
-			if (FAILED(hr = GetTopCubeFace(m_pddsNew, DDSCAPS2_CUBEMAP_NEGATIVEX, &pddsDestFaceTop)))
-				return hr;
-			if (FAILED(hr = BltAllLevels(pddsSrcFaceTop, pddsDestFaceTop)))
-				return hr;
-			ReleasePpo(&pddsSrcFaceTop);
-			ReleasePpo(&pddsDestFaceTop);
-		}
-		if (m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_POSITIVEX)
-		{
-			if (FAILED(hr = GetTopCubeFace(m_pddsOrig, DDSCAPS2_CUBEMAP_POSITIVEX, &pddsSrcFaceTop)))
-				return hr;
-			if (FAILED(hr = GetTopCubeFace(m_pddsNew, DDSCAPS2_CUBEMAP_POSITIVEX, &pddsDestFaceTop)))
-				return hr;
-			if (FAILED(hr = BltAllLevels(pddsSrcFaceTop, pddsDestFaceTop)))
-				return hr;
-			ReleasePpo(&pddsSrcFaceTop);
-			ReleasePpo(&pddsDestFaceTop);
-		}
-		if (m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_NEGATIVEY)
-		{
-			if (FAILED(hr = GetTopCubeFace(m_pddsOrig, DDSCAPS2_CUBEMAP_NEGATIVEY, &pddsSrcFaceTop)))
-				return hr;
-			if (FAILED(hr = GetTopCubeFace(m_pddsNew, DDSCAPS2_CUBEMAP_NEGATIVEY, &pddsDestFaceTop)))
-				return hr;
-			if (FAILED(hr = BltAllLevels(pddsSrcFaceTop, pddsDestFaceTop)))
-				return hr;
-			ReleasePpo(&pddsSrcFaceTop);
-			ReleasePpo(&pddsDestFaceTop);
-		}
-		if (m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_POSITIVEY)
-		{
-			if (FAILED(hr = GetTopCubeFace(m_pddsOrig, DDSCAPS2_CUBEMAP_POSITIVEY, &pddsSrcFaceTop)))
-				return hr;
-			if (FAILED(hr = GetTopCubeFace(m_pddsNew, DDSCAPS2_CUBEMAP_POSITIVEY, &pddsDestFaceTop)))
-				return hr;
-			if (FAILED(hr = BltAllLevels(pddsSrcFaceTop, pddsDestFaceTop)))
-				return hr;
-			ReleasePpo(&pddsSrcFaceTop);
-			ReleasePpo(&pddsDestFaceTop);
-		}
-		if (m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_NEGATIVEZ)
-		{
-			if (FAILED(hr = GetTopCubeFace(m_pddsOrig, DDSCAPS2_CUBEMAP_NEGATIVEZ, &pddsSrcFaceTop)))
-				return hr;
-			if (FAILED(hr = GetTopCubeFace(m_pddsNew, DDSCAPS2_CUBEMAP_NEGATIVEZ, &pddsDestFaceTop)))
-				return hr;
-			if (FAILED(hr = BltAllLevels(pddsSrcFaceTop, pddsDestFaceTop)))
-				return hr;
-			ReleasePpo(&pddsSrcFaceTop);
-			ReleasePpo(&pddsDestFaceTop);
-		}
-		if (m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_POSITIVEZ)
+		for (i = 0; i < 6 && SUCCEEDED(hr); i++)
 		{
-			if (FAILED(hr = GetTopCubeFace(m_pddsOrig, DDSCAPS2_CUBEMAP_POSITIVEZ, &pddsSrcFaceTop)))
-				return hr;
-			if (FAILED(hr = GetTopCubeFace(m_pddsNew, DDSCAPS2_CUBEMAP_POSITIVEZ, &pddsDestFaceTop)))
-				return hr;
-			if (FAILED(hr = BltAllLevels(pddsSrcFaceTop, pddsDestFaceTop)))
-				return hr;
+			if ((m_dwCubeMapFlags & s_dwCubeMapFaces[i]) == 0)
+				continue;
+			if (SUCCEEDED(hr = GetTopCubeFace(m_pddsOrig, s_dwCubeMapFaces[i], &pddsSrcFaceTop)) &&
+				SUCCEEDED(hr = GetTopCubeFace(m_pddsNew, s_dwCubeMapFaces[i], &pddsDestFaceTop)))
+			{
+				hr = CompressAllLevels(pddsSrcFaceTop, pddsDestFaceTop, dwFourCC, i, &levels);
+			}
 			ReleasePpo(&pddsSrcFaceTop);
 			ReleasePpo(&pddsDestFaceTop);
 		}
 	}
+	if (SUCCEEDED(hr))
+		hr = CompressLevels(&levels);
+	ReleaseLevels(&levels);
+	if (FAILED(hr))
+		return hr;
 
 	SetModifiedFlag();
 	m_bTitleModsChanged = TRUE; // force title bar update
@@ -620,29 +847,19 @@ void CDxtexDoc::OnGenerateMipMaps()
 
 void CDxtexDoc::GenerateMipMaps() 
 {
-	LONG lwTempH;
-	LONG lwTempW;
 	LPDIRECTDRAWSURFACE7 pddsNew = NULL;
+	LPDIRECTDRAWSURFACE7 pddsDestFaceTops[6];
+	DWORD dwFaces = 0;
+	DWORD i;
 	DDSURFACEDESC2 ddsd;
 	HRESULT hr;
 
+	if (FAILED(hr = LoadAllLevels()))
+		goto LFail;
 	ddsd.dwSize = sizeof(ddsd);
 	if (FAILED(hr = m_pddsOrig->GetSurfaceDesc(&ddsd)))
 		goto LFail;
 
-	// Ensure that source image is power of 2
-	lwTempW = ddsd.dwWidth;
-	lwTempH = ddsd.dwHeight;
-	while ((lwTempW & 1) == 0)
-		lwTempW = lwTempW >> 1;
-	while ((lwTempH & 1) == 0)
-		lwTempH = lwTempH >> 1;
-	if (lwTempW != 1 || lwTempH != 1)
-	{
-		AfxMessageBox(ID_ERROR_NOTPOW2);
-		return;
-	}
-
 	// Create destination mipmap surface - same format as source
 	ddsd.dwFlags = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT | DDSD_PIXELFORMAT;
 	ddsd.ddsCaps.dwCaps = DDSCAPS_SYSTEMMEMORY | DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX;
@@ -655,103 +872,40 @@ void CDxtexDoc::GenerateMipMaps()
 	if (m_dwCubeMapFlags == 0)
 	{
 		// Copy top mip level - no filtering
-		if (FAILED(hr = pddsNew->Blt(NULL, m_pddsOrig, NULL, DDBLT_WAIT, NULL)))
+		if (FAILED(hr = DXTSurfaceBlt(pddsNew, NULL, m_pddsOrig, NULL, DDBLT_WAIT, NULL)))
 			goto LFail;
-		if (FAILED(hr = GenerateMipMapsFromTop(pddsNew)))
+		if (FAILED(hr = GenerateMipMapsFromTops(&pddsNew, 1)))
 			goto LFail;
 	}
 	else
 	{
-		LPDIRECTDRAWSURFACE7 pddsSrcFaceTop = NULL;
-		LPDIRECTDRAWSURFACE7 pddsDestFaceTop = NULL;
-		if (m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_NEGATIVEX)
-		{
-			if (FAILED(hr = GetTopCubeFace(m_pddsOrig, DDSCAPS2_CUBEMAP_NEGATIVEX, &pddsSrcFaceTop)))
-				return;
-			if (FAILED(hr = GetTopCubeFace(pddsNew, DDSCAPS2_CUBEMAP_NEGATIVEX, &pddsDestFaceTop)))
-				return;
-			if (FAILED(hr = pddsDestFaceTop->Blt(NULL, pddsSrcFaceTop, NULL, DDBLT_WAIT, NULL)))
-				return;
-			if (FAILED(hr = GenerateMipMapsFromTop(pddsDestFaceTop)))
-				return;
-			ReleasePpo(&pddsSrcFaceTop);
-			ReleasePpo(&pddsDestFaceTop);
-		}
-		if (m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_POSITIVEX)
-		{
-			if (FAILED(hr = GetTopCubeFace(m_pddsOrig, DDSCAPS2_CUBEMAP_POSITIVEX, &pddsSrcFaceTop)))
-				return;
-			if (FAILED(hr = GetTopCubeFace(pddsNew, DDSCAPS2_CUBEMAP_POSITIVEX, &pddsDestFaceTop)))
-				return;
-			if (FAILED(hr = pddsDestFaceTop->Blt(NULL, pddsSrcFaceTop, NULL, DDBLT_WAIT, NULL)))
-				return;
-			if (FAILED(hr = GenerateMipMapsFromTop(pddsDestFaceTop)))
-				return;
-			ReleasePpo(&pddsSrcFaceTop);
-			ReleasePpo(&pddsDestFaceTop);
-		}
-		if (m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_NEGATIVEY)
-		{
-			if (FAILED(hr = GetTopCubeFace(m_pddsOrig, DDSCAPS2_CUBEMAP_NEGATIVEY, &pddsSrcFaceTop)))
-				return;
-			if (FAILED(hr = GetTopCubeFace(pddsNew, DDSCAPS2_CUBEMAP_NEGATIVEY, &pddsDestFaceTop)))
-				return;
-			if (FAILED(hr = pddsDestFaceTop->Blt(NULL, pddsSrcFaceTop, NULL, DDBLT_WAIT, NULL)))
-				return;
-			if (FAILED(hr = GenerateMipMapsFromTop(pddsDestFaceTop)))
-				return;
-			ReleasePpo(&pddsSrcFaceTop);
-			ReleasePpo(&pddsDestFaceTop);
-		}
-		if (m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_POSITIVEY)
-		{
-			if (FAILED(hr = GetTopCubeFace(m_pddsOrig, DDSCAPS2_CUBEMAP_POSITIVEY, &pddsSrcFaceTop)))
-				return;
-			if (FAILED(hr = GetTopCubeFace(pddsNew, DDSCAPS2_CUBEMAP_POSITIVEY, &pddsDestFaceTop)))
-				return;
-			if (FAILED(hr = pddsDestFaceTop->Blt(NULL, pddsSrcFaceTop, NULL, DDBLT_WAIT, NULL)))
-				return;
-			if (FAILED(hr = GenerateMipMapsFromTop(pddsDestFaceTop)))
-				return;
-			ReleasePpo(&pddsSrcFaceTop);
-			ReleasePpo(&pddsDestFaceTop);
-		}
-		if (m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_NEGATIVEZ)
-		{
-			if (FAILED(hr = GetTopCubeFace(m_pddsOrig, DDSCAPS2_CUBEMAP_NEGATIVEZ, &pddsSrcFaceTop)))
-				return;
-			if (FAILED(hr = GetTopCubeFace(pddsNew, DDSCAPS2_CUBEMAP_NEGATIVEZ, &pddsDestFaceTop)))
-				return;
-			if (FAILED(hr = pddsDestFaceTop->Blt(NULL, pddsSrcFaceTop, NULL, DDBLT_WAIT, NULL)))
-				return;
-			if (FAILED(hr = GenerateMipMapsFromTop(pddsDestFaceTop)))
-				return;
-			ReleasePpo(&pddsSrcFaceTop);
-			ReleasePpo(&pddsDestFaceTop);
-		}
-		if (m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_POSITIVEZ)
+		// Copy every face's top level, then filter all the faces at once
+		for (i = 0; i < 6; i++)
 		{
-			if (FAILED(hr = GetTopCubeFace(m_pddsOrig, DDSCAPS2_CUBEMAP_POSITIVEZ, &pddsSrcFaceTop)))
-				return;
-			if (FAILED(hr = GetTopCubeFace(pddsNew, DDSCAPS2_CUBEMAP_POSITIVEZ, &pddsDestFaceTop)))
-				return;
-			if (FAILED(hr = pddsDestFaceTop->Blt(NULL, pddsSrcFaceTop, NULL, DDBLT_WAIT, NULL)))
-				return;
-			if (FAILED(hr = GenerateMipMapsFromTop(pddsDestFaceTop)))
-				return;
+			LPDIRECTDRAWSURFACE7 pddsSrcFaceTop = NULL;
+			if ((m_dwCubeMapFlags & s_dwCubeMapFaces[i]) == 0)
+				continue;
+			if (SUCCEEDED(hr = GetTopCubeFace(m_pddsOrig, s_dwCubeMapFaces[i], &pddsSrcFaceTop)) &&
+				SUCCEEDED(hr = GetTopCubeFace(pddsNew, s_dwCubeMapFaces[i], &pddsDestFaceTops[dwFaces])))
+			{
+				hr = DXTSurfaceBlt(pddsDestFaceTops[dwFaces], NULL, pddsSrcFaceTop, NULL, DDBLT_WAIT, NULL);
+				dwFaces++;
+			}
 			ReleasePpo(&pddsSrcFaceTop);
-			ReleasePpo(&pddsDestFaceTop);
+			if (FAILED(hr))
+				goto LFail;
 		}
+		if (FAILED(hr = GenerateMipMapsFromTops(pddsDestFaceTops, dwFaces)))
+			goto LFail;
+		for (i = 0; i < dwFaces; i++)
+			ReleasePpo(&pddsDestFaceTops[i]);
 	}
 
 	ReleasePpo(&m_pddsOrig);
 	m_pddsOrig = pddsNew;
 
 	if (m_pddsNew != NULL)
-	{
-		m_pddsNew->GetSurfaceDesc(&ddsd);
-		Compress(ddsd.ddpfPixelFormat.dwFourCC, FALSE);
-	}
+		Compress(NewFourCC(), FALSE);
 
 	m_bTitleModsChanged = TRUE; // Generate title bar update
 	UpdateAllViews(NULL, 1); // tell CView to pick up new surface pointers
@@ -759,31 +913,81 @@ void CDxtexDoc::GenerateMipMaps()
 	return;
 
 LFail:
+	for (i = 0; i < dwFaces; i++)
+		ReleasePpo(&pddsDestFaceTops[i]);
 	ReleasePpo(&pddsNew);
 }
 
 
-// Generate lower mip levels by filtering down top level
-HRESULT CDxtexDoc::GenerateMipMapsFromTop(LPDIRECTDRAWSURFACE7 pddsSrcTop)
+// Generate lower mip levels of dwFaces faces by filtering down their top
+// levels.  All the faces go to texlib as one batch, so they're filtered side
+// by side and each level starts on the rows of the level above as soon as
+// they're done.
+HRESULT CDxtexDoc::GenerateMipMapsFromTops(LPDIRECTDRAWSURFACE7* ppddsTops, DWORD dwFaces)
 {
 	HRESULT hr;
 	DDSURFACEDESC2 ddsd;
-	LPDIRECTDRAWSURFACE7 pddsTempSrc = NULL;
-	LPDIRECTDRAWSURFACE7 pddsTempDest = NULL;
-	LPDIRECTDRAWSURFACE7 pddsCurMip = NULL;
-	LPDIRECTDRAWSURFACE7 pddsPrevMip = NULL;
-	LPDIRECTDRAWSURFACE7 pddsT = NULL;
+	DDSURFACEDESC2 ddsdLock;
+	LPDIRECTDRAWSURFACE7 pddsLevels[6][TEX_MAX_LEVELS];
+	LPDIRECTDRAWSURFACE7 pddsTemp = NULL;
+	TEXIMAGE images[6][TEX_MAX_LEVELS];
+	TEXMIPCHAIN chains[6];
 	DDSCAPS2 ddsCaps;
-	RECT rcDest;
-
+	BOOL bConvert;
+	DWORD dwFace;
+	DWORD dwLevel;
+	RECT rc;
+
+	ZeroMemory(pddsLevels, sizeof(pddsLevels));
+	ZeroMemory(images, sizeof(images));
+	ZeroMemory(chains, sizeof(chains));
+	ZeroMemory(&ddsd, sizeof(ddsd));
 	ddsd.dwSize = sizeof(ddsd);
-	if (FAILED(hr = pddsSrcTop->GetSurfaceDesc(&ddsd)))
-		goto LFail;
-	SetRect(&rcDest, 0, 0, ddsd.dwWidth, ddsd.dwHeight);
+	if (FAILED(hr = ppddsTops[0]->GetSurfaceDesc(&ddsd)))
+		return hr;
+	bConvert = (ddsd.ddpfPixelFormat.dwRGBBitCount != 32);
+
+	// Gather every level of every face
+	ZeroMemory(&ddsCaps, sizeof(ddsCaps));
+	ddsCaps.dwCaps = DDSCAPS_TEXTURE;
+	ddsCaps.dwCaps2 = DDSCAPS2_MIPMAPSUBLEVEL;
+	for (dwFace = 0; dwFace < dwFaces; dwFace++)
+	{
+		TEXMIPCHAIN* pChain = &chains[dwFace];
+		pChain->dwWidth = ddsd.dwWidth;
+		pChain->dwHeight = ddsd.dwHeight;
+		pChain->dwLevels = 1;
+		pddsLevels[dwFace][0] = ppddsTops[dwFace];
+		pddsLevels[dwFace][0]->AddRef();
+		while (pChain->dwLevels < TEX_MAX_LEVELS &&
+			SUCCEEDED(pddsLevels[dwFace][pChain->dwLevels - 1]->GetAttachedSurface(&ddsCaps,
+				&pddsLevels[dwFace][pChain->dwLevels])))
+		{
+			pChain->dwLevels++;
+		}
+	}
+	m_numMips = chains[0].dwLevels;
 
-	// Generate temporary ARGB-8888 surfaces if source is not ARGB-8888
-	if (ddsd.ddpfPixelFormat.dwRGBBitCount != 32)
+	if (!bConvert)
+	{
+		// ARGB-8888 levels are filtered in place, all locked at once
+		for (dwFace = 0; dwFace < dwFaces; dwFace++)
+		{
+			for (dwLevel = 0; dwLevel < chains[dwFace].dwLevels; dwLevel++)
+			{
+				ZeroMemory(&ddsdLock, sizeof(ddsdLock));
+				ddsdLock.dwSize = sizeof(ddsdLock);
+				if (FAILED(hr = pddsLevels[dwFace][dwLevel]->Lock(NULL, &ddsdLock, DDLOCK_WAIT, NULL)))
+					goto LEnd;
+				chains[dwFace].pLevels[dwLevel] = ddsdLock.lpSurface;
+				chains[dwFace].lPitch[dwLevel] = ddsdLock.lPitch;
+			}
+		}
+	}
+	else
 	{
+		// Other formats are converted through one ARGB-8888 surface into
+		// images of their own, one per level of each face
 		ddsd.dwFlags = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT | DDSD_PIXELFORMAT;
 		ddsd.ddsCaps.dwCaps = DDSCAPS_OFFSCREENPLAIN;
 		ddsd.ddsCaps.dwCaps2 = 0;
@@ -794,130 +998,73 @@ HRESULT CDxtexDoc::GenerateMipMapsFromTop(LPDIRECTDRAWSURFACE7 pddsSrcTop)
 		ddsd.ddpfPixelFormat.dwGBitMask = 0x0000ff00;
 		ddsd.ddpfPixelFormat.dwBBitMask = 0x000000ff;
 		ddsd.ddpfPixelFormat.dwRGBAlphaBitMask = 0xff000000;
-		if (FAILED(hr = PDxtexApp()->Pdd()->CreateSurface(&ddsd, &pddsTempSrc, NULL)))
-			goto LFail;
-		if (FAILED(hr = PDxtexApp()->Pdd()->CreateSurface(&ddsd, &pddsTempDest, NULL)))
-			goto LFail;
-		if (FAILED(hr = pddsTempSrc->Blt(NULL, pddsSrcTop, NULL, DDBLT_WAIT, NULL)))
-			goto LFail;
+		if (FAILED(hr = PDxtexApp()->Pdd()->CreateSurface(&ddsd, &pddsTemp, NULL)))
+			goto LEnd;
+		for (dwFace = 0; dwFace < dwFaces; dwFace++)
+		{
+			TEXMIPCHAIN* pChain = &chains[dwFace];
+			for (dwLevel = 0; dwLevel < pChain->dwLevels; dwLevel++)
+			{
+				DWORD dwWidth = max(ddsd.dwWidth >> dwLevel, 1);
+				DWORD dwHeight = max(ddsd.dwHeight >> dwLevel, 1);
+				if (FAILED(hr = TEXCreateImage(dwWidth, dwHeight, &images[dwFace][dwLevel])))
+					goto LEnd;
+				pChain->pLevels[dwLevel] = images[dwFace][dwLevel].pdwPixels;
+				pChain->lPitch[dwLevel] = dwWidth * 4;
+			}
+			if (FAILED(hr = pddsTemp->Blt(NULL, ppddsTops[dwFace], NULL, DDBLT_WAIT, NULL)))
+				goto LEnd;
+			ZeroMemory(&ddsdLock, sizeof(ddsdLock));
+			ddsdLock.dwSize = sizeof(ddsdLock);
+			if (FAILED(hr = pddsTemp->Lock(NULL, &ddsdLock, DDLOCK_WAIT | DDLOCK_READONLY, NULL)))
+				goto LEnd;
+			CopyRows(ddsdLock.lpSurface, ddsdLock.lPitch, pChain->pLevels[0],
+				pChain->lPitch[0], ddsd.dwWidth * 4, ddsd.dwHeight);
+			pddsTemp->Unlock(NULL);
+		}
 	}
 
-	pddsCurMip = NULL;
-	pddsPrevMip = pddsSrcTop;
-	pddsPrevMip->AddRef();
-	ZeroMemory(&ddsCaps, sizeof(ddsCaps));
-	ddsCaps.dwCaps = DDSCAPS_TEXTURE;
-	ddsCaps.dwCaps2 = DDSCAPS2_MIPMAPSUBLEVEL;
+	// The filters live in texlib, so batch tools build the same mips
+	if (FAILED(hr = TEXBuildMipChains(chains, dwFaces, PDxtexApp()->DwMipFilter(),
+		PDxtexApp()->DwMipFlags(), PDxtexApp()->Ppool())))
+	{
+		goto LEnd;
+	}
 
-	m_numMips = 1;
-	while (TRUE)
+	// Converted levels go back through the ARGB-8888 surface
+	for (dwFace = 0; bConvert && dwFace < dwFaces; dwFace++)
 	{
-		if (FAILED(pddsPrevMip->GetAttachedSurface(&ddsCaps, &pddsCurMip)))
-			break;
-		m_numMips++;
-		rcDest.right /= 2;
-		rcDest.bottom /= 2;
-		if (pddsTempSrc == NULL)
-		{
-			GenerateMip(pddsPrevMip, pddsCurMip, &rcDest);
-		}
-		else
+		for (dwLevel = 1; dwLevel < chains[dwFace].dwLevels; dwLevel++)
 		{
-			GenerateMip(pddsTempSrc, pddsTempDest, &rcDest);
-			if (FAILED(hr = pddsCurMip->Blt(&rcDest, pddsTempDest, &rcDest, DDBLT_WAIT, NULL)))
+			const TEXIMAGE* pImage = &images[dwFace][dwLevel];
+			ZeroMemory(&ddsdLock, sizeof(ddsdLock));
+			ddsdLock.dwSize = sizeof(ddsdLock);
+			if (FAILED(hr = pddsTemp->Lock(NULL, &ddsdLock, DDLOCK_WAIT, NULL)))
+				goto LEnd;
+			CopyRows(pImage->pdwPixels, pImage->dwWidth * 4, ddsdLock.lpSurface,
+				ddsdLock.lPitch, pImage->dwWidth * 4, pImage->dwHeight);
+			pddsTemp->Unlock(NULL);
+			SetRect(&rc, 0, 0, pImage->dwWidth, pImage->dwHeight);
+			if (FAILED(hr = pddsLevels[dwFace][dwLevel]->Blt(&rc, pddsTemp, &rc, DDBLT_WAIT, NULL)))
 				goto LEnd;
-			// swap pointers so pddsTempDest's reduced image is used as source next time
-			pddsT = pddsTempSrc;
-			pddsTempSrc = pddsTempDest;
-			pddsTempDest = pddsT;
 		}
-		ReleasePpo(&pddsPrevMip);
-		pddsPrevMip = pddsCurMip;
 	}
-	ReleasePpo(&pddsCurMip);
-LEnd:
-	return S_OK;
-LFail:
-	ReleasePpo(&pddsTempSrc);
-	ReleasePpo(&pddsTempDest);
-	ReleasePpo(&pddsCurMip);
-	ReleasePpo(&pddsPrevMip);
-	return hr;
-}
-
-
-// Turn off optimizer to work around a VC compiler bug
-//#pragma optimize("", off)
-//#pragma optimize("q", off)
-
-HRESULT CDxtexDoc::GenerateMip(LPDIRECTDRAWSURFACE7 pddsSrc, LPDIRECTDRAWSURFACE7 pddsDest, RECT * prcDest)
-{
-	HRESULT hr;
-	LONG xpSrc;
-	LONG ypSrc;
-	DDSURFACEDESC2 ddsdSrc;
-	BYTE* pbRowSrc;
-	DWORD* pdwPixelSrc;
-	DDSURFACEDESC2 ddsdDest;
-	BYTE* pbRowDest;
-	DWORD* pdwPixelDest;
-	
-	DWORD dwPixel1;
-	DWORD dwPixel2;
-	DWORD dwPixel3;
-	DWORD dwPixel4;
-	
-	BYTE bRed;
-	BYTE bGreen;
-	BYTE bBlue;
-	BYTE bAlpha;
-
-	ZeroMemory(&ddsdSrc, sizeof(ddsdSrc));
-	ddsdSrc.dwSize = sizeof(ddsdSrc);
-	ZeroMemory(&ddsdDest, sizeof(ddsdDest));
-	ddsdDest.dwSize = sizeof(ddsdDest);
-	if (FAILED(hr = pddsSrc->Lock(NULL, &ddsdSrc, DDLOCK_WAIT, NULL)))
-		return hr;
-	if (FAILED(hr = pddsDest->Lock(NULL, &ddsdDest, DDLOCK_WAIT, NULL)))
-		return hr;
-	pbRowSrc = (BYTE*)ddsdSrc.lpSurface;
-	pdwPixelSrc = (DWORD*)pbRowSrc;
-	pbRowDest = (BYTE*)ddsdDest.lpSurface;
-	pdwPixelDest = (DWORD*)pbRowDest;
 
-	for (ypSrc = 0; ypSrc < prcDest->bottom * 2; ypSrc += 2)
+LEnd:
+	for (dwFace = 0; dwFace < dwFaces; dwFace++)
 	{
-		for (xpSrc = 0; xpSrc < prcDest->right * 2; xpSrc += 2)
+		for (dwLevel = 0; dwLevel < TEX_MAX_LEVELS; dwLevel++)
 		{
-			dwPixel1 = *(pdwPixelSrc);
-			dwPixel2 = *(pdwPixelSrc + 1);
-			dwPixel3 = *(pdwPixelSrc + ddsdSrc.lPitch / 4);
-			dwPixel4 = *(pdwPixelSrc + ddsdSrc.lPitch / 4 + 1);
-			bRed = (BYTE)((RGBA_GETRED(dwPixel1) + RGBA_GETRED(dwPixel2) +
-				           RGBA_GETRED(dwPixel3) + RGBA_GETRED(dwPixel4)) / 4);
-			bGreen = (BYTE)((RGBA_GETGREEN(dwPixel1) + RGBA_GETGREEN(dwPixel2) +
-						     RGBA_GETGREEN(dwPixel3) + RGBA_GETGREEN(dwPixel4)) / 4);
-			bBlue = (BYTE)((RGBA_GETBLUE(dwPixel1) + RGBA_GETBLUE(dwPixel2) +
-						    RGBA_GETBLUE(dwPixel3) + RGBA_GETBLUE(dwPixel4)) / 4);
-			bAlpha = (BYTE)((RGBA_GETALPHA(dwPixel1) + RGBA_GETALPHA(dwPixel2) +
-						     RGBA_GETALPHA(dwPixel3) + RGBA_GETALPHA(dwPixel4)) / 4);
-			*pdwPixelDest = RGBA_MAKE(bRed, bGreen, bBlue, bAlpha);
-			pdwPixelSrc += 2;
-			pdwPixelDest++;
+			if (!bConvert && chains[dwFace].pLevels[dwLevel] != NULL)
+				pddsLevels[dwFace][dwLevel]->Unlock(NULL);
+			TEXFreeImage(&images[dwFace][dwLevel]);
+			ReleasePpo(&pddsLevels[dwFace][dwLevel]);
 		}
-		pbRowSrc += 2 * ddsdSrc.lPitch;
-		pdwPixelSrc = (DWORD*)pbRowSrc;
-		pbRowDest += ddsdDest.lPitch;
-		pdwPixelDest = (DWORD*)pbRowDest;
 	}
-	pddsSrc->Unlock(NULL);
-	pddsDest->Unlock(NULL);
-	return S_OK;
+	ReleasePpo(&pddsTemp);
+	return hr;
 }
 
-//#pragma optimize("", on)
-//#pragma optimize("q", on)
-
 
 void CDxtexDoc::SetPathName(LPCTSTR lpszPathName, BOOL bAddToMRU) 
 {
@@ -966,6 +1113,38 @@ void CDxtexDoc::OnFormatDxt5()
 }
 
 
+void CDxtexDoc::OnFormatAti1() 
+{
+	Compress(FOURCC_ATI1, TRUE);	
+}
+
+
+void CDxtexDoc::OnFormatAti2() 
+{
+	Compress(FOURCC_ATI2, TRUE);	
+}
+
+
+void CDxtexDoc::OnFormatBc7() 
+{
+	Compress(FOURCC_BC7, TRUE);	
+}
+
+
+// The format of m_pddsNew, seeing through ATI1, ATI2 and BC7 carriers
+DWORD CDxtexDoc::NewFourCC(VOID)
+{
+	DDSURFACEDESC2 ddsd;
+
+	if (m_dwCarrierFourCC != 0)
+		return m_dwCarrierFourCC;
+	ZeroMemory(&ddsd, sizeof(ddsd));
+	ddsd.dwSize = sizeof(ddsd);
+	m_pddsNew->GetSurfaceDesc(&ddsd);
+	return ddsd.ddpfPixelFormat.dwFourCC;
+}
+
+
 void CDxtexDoc::OnFileOpenAlpha() 
 {
 	HRESULT hr;
@@ -994,12 +1173,7 @@ void CDxtexDoc::OnFileOpenAlpha()
 	if (m_numMips > 1)
 		OnGenerateMipMaps();
 	else if (m_pddsNew != NULL)
-	{
-		DDSURFACEDESC2 ddsdx;
-		ddsdx.dwSize = sizeof(ddsdx);
-		m_pddsNew->GetSurfaceDesc(&ddsdx);
-		Compress(ddsdx.ddpfPixelFormat.dwFourCC, FALSE);
-	}
+		Compress(NewFourCC(), FALSE);
 	UpdateAllViews(NULL, 1);
 }
 
@@ -1184,12 +1358,6 @@ HRESULT CDxtexDoc::LoadAlphaIntoSurface(CString& strPath, LPDIRECTDRAWSURFACE7 p
 	}
 
 	// Fill pdds's (or pddsTemp)'s alpha channel from pddsAlpha
-	DWORD xp;
-	DWORD yp;
-	BYTE* pbRowSrc;
-	DWORD* pdwPixelSrc;
-	BYTE* pbRowDest;
-	DWORD* pdwPixelDest;
 	DDSURFACEDESC2 ddsdSrc;
 	ZeroMemory(&ddsdSrc, sizeof(ddsdSrc));
 	ddsdSrc.dwSize = sizeof(ddsdSrc);
@@ -1208,24 +1376,8 @@ HRESULT CDxtexDoc::LoadAlphaIntoSurface(CString& strPath, LPDIRECTDRAWSURFACE7 p
 		if (FAILED(hr = pddsTemp->Lock(NULL, &ddsdDest, DDLOCK_WAIT, NULL)))
 			return hr;
 	}
-	pbRowSrc = (BYTE*)ddsdSrc.lpSurface;
-	pdwPixelSrc = (DWORD*)pbRowSrc;
-	pbRowDest = (BYTE*)ddsdDest.lpSurface;
-	pdwPixelDest = (DWORD*)pbRowDest;
-	for (yp = 0; yp < ddsdSrc.dwHeight; yp++)
-	{
-		for (xp = 0; xp < ddsdSrc.dwWidth; xp++)
-		{
-			*pdwPixelDest &= 0x00ffffff;
-			*pdwPixelDest |= (*pdwPixelSrc & 0x000000ff) << 24;
-			pdwPixelSrc++;
-			pdwPixelDest++;
-		}
-		pbRowSrc += ddsdSrc.lPitch;
-		pdwPixelSrc = (DWORD*)pbRowSrc;
-		pbRowDest += ddsdDest.lPitch;
-		pdwPixelDest = (DWORD*)pbRowDest;
-	}
+	TEXCopyAlpha(ddsdSrc.lpSurface, ddsdSrc.lPitch, ddsdDest.lpSurface,
+		ddsdDest.lPitch, ddsdSrc.dwWidth, ddsdSrc.dwHeight);
 	if (pddsTemp == NULL)
 		pdds->Unlock(NULL);
 	else
@@ -1242,13 +1394,73 @@ HRESULT CDxtexDoc::LoadAlphaIntoSurface(CString& strPath, LPDIRECTDRAWSURFACE7 p
 }
 
 
+// Face and level table of m_pddsOrig or m_pddsNew, built the first time
+// it's asked for and again once the surface has been replaced.  NULL for
+// any other surface.
+const DXTSURFACECHAIN* CDxtexDoc::PChain(LPDIRECTDRAWSURFACE7 pdds)
+{
+	DXTSURFACECHAIN** ppChain;
+
+	// A table holds its surfaces, so let go of any the document has dropped
+	if (m_pchainOrig != NULL && m_pchainOrig->pddsTop != m_pddsOrig)
+	{
+		DXTChainDestroy(m_pchainOrig);
+		m_pchainOrig = NULL;
+	}
+	if (m_pchainNew != NULL && m_pchainNew->pddsTop != m_pddsNew)
+	{
+		DXTChainDestroy(m_pchainNew);
+		m_pchainNew = NULL;
+	}
+
+	if (pdds == NULL)
+		return NULL;
+	if (pdds == m_pddsOrig)
+		ppChain = &m_pchainOrig;
+	else if (pdds == m_pddsNew)
+		ppChain = &m_pchainNew;
+	else
+		return NULL;
+	if (*ppChain == NULL && FAILED(DXTChainCreate(pdds, ppChain)))
+		return NULL;
+	return *ppChain;
+}
+
+
+// Bytes in every face and mip level of the original or new surface
+DWORD CDxtexDoc::NumBytes(LPDIRECTDRAWSURFACE7 pdds)
+{
+	const DXTSURFACECHAIN* pChain = PChain(pdds);
+	if (pChain == NULL)
+		return 0;
+	return pChain->dwTotalBytes;
+}
+
+
 HRESULT CDxtexDoc::GetNthMipMap(LPDIRECTDRAWSURFACE7 pddsTop, LONG lwMip,
 							   LPDIRECTDRAWSURFACE7* ppdds)
 {
 	HRESULT hr;
 	LPDIRECTDRAWSURFACE7 pdds = pddsTop;
 	LPDIRECTDRAWSURFACE7 pdds2 = NULL;
+	const DXTSURFACECHAIN* pChain;
 	DDSCAPS2 ddsCaps;
+
+	// Faces of the document's own surfaces are looked up in their tables
+	for (INT i = 0; i < 2; i++)
+	{
+		pChain = PChain(i == 0 ? m_pddsOrig : m_pddsNew);
+		if (pChain != NULL && lwMip >= 0 &&
+			(pdds = DXTChainFindLevel(pChain, pddsTop, lwMip)) != NULL)
+		{
+			pdds->AddRef();
+			*ppdds = pdds;
+			return S_OK;
+		}
+	}
+
+	// Anything else is walked a level at a time
+	pdds = pddsTop;
 	ZeroMemory(&ddsCaps, sizeof(ddsCaps));
 	ddsCaps.dwCaps = DDSCAPS_TEXTURE | DDSCAPS_MIPMAP;
 
@@ -1316,13 +1528,17 @@ void CDxtexDoc::OpenSubsurface(DWORD dwCubeMapFlags, LONG lwMip)
 	LPDIRECTDRAWSURFACE7 pddsNewSubSurface = NULL;
 	LPDIRECTDRAWSURFACE7 pddsLoad = NULL;
 
+	if (FAILED(hr = LoadAllLevels()))
+		return;
 	if (FAILED(hr = GetTopCubeFace(m_pddsOrig, dwCubeMapFlags, &pddsOrigTopFace)))
 		return;
 	if (FAILED(hr = GetNthMipMap(pddsOrigTopFace, lwMip, &pddsOrigSubSurface)))
 		return;
 	ReleasePpo(&pddsOrigTopFace);
 
-	if (m_pddsNew != NULL)
+	// A Blt would write DXTn into an ATI1, ATI2 or BC7 carrier, those are
+	// compressed again at the end instead
+	if (m_pddsNew != NULL && m_dwCarrierFourCC == 0)
 	{
 		if (FAILED(hr = GetTopCubeFace(m_pddsNew, dwCubeMapFlags, &pddsNewTopFace)))
 			return;
@@ -1333,6 +1549,7 @@ void CDxtexDoc::OpenSubsurface(DWORD dwCubeMapFlags, LONG lwMip)
 
 	if (!PromptForBmp(&fileName))
 		return;
+	ForgetCompressError();
 
 	if (FAILED(hr = CreateSurfaceFromBmp(fileName, &pddsLoad)))
 	{
@@ -1379,6 +1596,9 @@ void CDxtexDoc::OpenSubsurface(DWORD dwCubeMapFlags, LONG lwMip)
 	ReleasePpo(&pddsOrigSubSurface);
 	ReleasePpo(&pddsNewSubSurface);
 
+	if (m_dwCarrierFourCC != 0)
+		Compress(m_dwCarrierFourCC, FALSE);
+
 	SetModifiedFlag(TRUE);
 	UpdateAllViews(NULL, 1);
 }
@@ -1394,13 +1614,17 @@ void CDxtexDoc::OpenAlphaSubsurface(DWORD dwCubeMapFlags, LONG lwMip)
 	LPDIRECTDRAWSURFACE7 pddsNewSubSurface = NULL;
 	LPDIRECTDRAWSURFACE7 pddsLoad = NULL;
 
+	if (FAILED(hr = LoadAllLevels()))
+		return;
 	if (FAILED(hr = GetTopCubeFace(m_pddsOrig, dwCubeMapFlags, &pddsOrigTopFace)))
 		return;
 	if (FAILED(hr = GetNthMipMap(pddsOrigTopFace, lwMip, &pddsOrigSubSurface)))
 		return;
 	ReleasePpo(&pddsOrigTopFace);
 	
-	if (m_pddsNew != NULL)
+	// A Blt would write DXTn into an ATI1, ATI2 or BC7 carrier, those are
+	// compressed again at the end instead
+	if (m_pddsNew != NULL && m_dwCarrierFourCC == 0)
 	{
 		if (FAILED(hr = GetTopCubeFace(m_pddsNew, dwCubeMapFlags, &pddsNewTopFace)))
 			return;
@@ -1440,6 +1664,7 @@ void CDxtexDoc::OpenAlphaSubsurface(DWORD dwCubeMapFlags, LONG lwMip)
 	}
 	if (!PromptForBmp(&fileName))
 		return;
+	ForgetCompressError();
 
 	if (FAILED(hr = LoadAlphaIntoSurface(fileName, pddsOrigSubSurface)))
 		return;
@@ -1453,6 +1678,9 @@ void CDxtexDoc::OpenAlphaSubsurface(DWORD dwCubeMapFlags, LONG lwMip)
 	ReleasePpo(&pddsOrigSubSurface);
 	ReleasePpo(&pddsNewSubSurface);
 
+	if (m_dwCarrierFourCC != 0)
+		Compress(m_dwCarrierFourCC, FALSE);
+
 	SetModifiedFlag(TRUE);
 	UpdateAllViews(NULL, 1);
 }
@@ -1463,6 +1691,8 @@ void CDxtexDoc::OnFormatChangeCubeMapFaces()
 	DWORD dwCubeMapFlagsNew = 0;
 	HRESULT hr;
 
+	if (FAILED(hr = LoadAllLevels()))
+		return;
 	CCubeMapDlg cubeMapDlg;
 	if (m_dwCubeMapFlags & DDSCAPS2_CUBEMAP_NEGATIVEX)
 		cubeMapDlg.m_bNegX = TRUE;
@@ -1492,6 +1722,7 @@ void CDxtexDoc::OnFormatChangeCubeMapFaces()
 
 	if (dwCubeMapFlagsNew != m_dwCubeMapFlags)
 	{
+		ForgetCompressError();
 		if (FAILED(hr = ChangeCubeMapFlags(&m_pddsOrig, dwCubeMapFlagsNew)))
 		{
 		}
@@ -1644,6 +1875,14 @@ HRESULT CDxtexDoc::GetTopCubeFace(LPDIRECTDRAWSURFACE7 pdds, DWORD dwCubeMapFlag
 {
 	HRESULT hr;
 	DDSURFACEDESC2 ddsd;
+	const DXTSURFACECHAIN* pChain = PChain(pdds);
+	if (pChain != NULL)
+	{
+		if ((*ppddsFaceTop = DXTChainGetLevel(pChain, dwCubeMapFlags, 0)) == NULL)
+			return DDERR_NOTFOUND;
+		(*ppddsFaceTop)->AddRef();
+		return S_OK;
+	}
 	ZeroMemory(&ddsd, sizeof(ddsd));
 	ddsd.dwSize = sizeof(ddsd);
 	if (FAILED(hr = pdds->GetSurfaceDesc(&ddsd)))
@@ -1682,7 +1921,8 @@ HRESULT CDxtexDoc::BltAllLevels(LPDIRECTDRAWSURFACE7 pddsSrcTop, LPDIRECTDRAWSUR
 	pddsDest->AddRef();
 	while (TRUE)
 	{
-		if (FAILED(hr = pddsDest->Blt(NULL, pddsSrc, NULL, DDBLT_WAIT, NULL)))
+		// Same format levels are copied block for block
+		if (FAILED(hr = DXTSurfaceBlt(pddsDest, NULL, pddsSrc, NULL, DDBLT_WAIT, NULL)))
 		{
 			ReleasePpo(&pddsDest);
 			ReleasePpo(&pddsSrc);
@@ -1706,6 +1946,389 @@ HRESULT CDxtexDoc::BltAllLevels(LPDIRECTDRAWSURFACE7 pddsSrcTop, LPDIRECTDRAWSUR
 }
 
 
+// Decode every mip level of an ATI1, ATI2 or BC7 carrier surface into the
+// matching levels of a 32-bit ARGB surface.
+HRESULT CDxtexDoc::DecodeAllLevels(LPDIRECTDRAWSURFACE7 pddsSrcTop, LPDIRECTDRAWSURFACE7 pddsDestTop, DWORD dwFourCC)
+{
+	HRESULT hr;
+	LPDIRECTDRAWSURFACE7 pddsSrc;
+	LPDIRECTDRAWSURFACE7 pddsDest;
+	LPDIRECTDRAWSURFACE7 pddsSrc2;
+	LPDIRECTDRAWSURFACE7 pddsDest2;
+	DDSCAPS2 ddsCaps;
+
+	ZeroMemory(&ddsCaps, sizeof(ddsCaps));
+	ddsCaps.dwCaps = DDSCAPS_TEXTURE;
+	ddsCaps.dwCaps2 = DDSCAPS2_MIPMAPSUBLEVEL;
+
+	pddsSrc = pddsSrcTop;
+	pddsSrc->AddRef();
+	pddsDest = pddsDestTop;
+	pddsDest->AddRef();
+	while (TRUE)
+	{
+		if (FAILED(hr = DecodeLevel(pddsSrc, pddsDest, dwFourCC)))
+		{
+			ReleasePpo(&pddsDest);
+			ReleasePpo(&pddsSrc);
+			return hr;
+		}
+
+		if (FAILED(hr = pddsSrc->GetAttachedSurface(&ddsCaps, &pddsSrc2)))
+		{
+			ReleasePpo(&pddsDest);
+			ReleasePpo(&pddsSrc);
+			break;
+		}
+		if (FAILED(hr = pddsDest->GetAttachedSurface(&ddsCaps, &pddsDest2)))
+		{
+			ReleasePpo(&pddsSrc2);
+			ReleasePpo(&pddsDest);
+			ReleasePpo(&pddsSrc);
+			break;
+		}
+		ReleasePpo(&pddsDest);
+		pddsDest = pddsDest2;
+		ReleasePpo(&pddsSrc);
+		pddsSrc = pddsSrc2;
+	}
+
+	return S_OK;
+}
+
+
+// Make a 32-bit ARGB surface with the faces and mip levels of an ATI1,
+// ATI2 or BC7 carrier and decode all of them into it.
+HRESULT CDxtexDoc::DecodeCarrier(LPDIRECTDRAWSURFACE7 pddsCarrier, DWORD dwFourCC, LPDIRECTDRAWSURFACE7* ppdds)
+{
+	HRESULT hr;
+	DDSURFACEDESC2 ddsd;
+	LPDIRECTDRAWSURFACE7 pdds = NULL;
+	INT i;
+
+	ZeroMemory(&ddsd, sizeof(ddsd));
+	ddsd.dwSize = sizeof(ddsd);
+	if (FAILED(hr = pddsCarrier->GetSurfaceDesc(&ddsd)))
+		return hr;
+	ddsd.dwFlags = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT | DDSD_PIXELFORMAT;
+	if (m_dwCubeMapFlags != 0)
+		ddsd.ddsCaps.dwCaps2 = DDSCAPS2_CUBEMAP | m_dwCubeMapFlags;
+	ZeroMemory(&ddsd.ddpfPixelFormat, sizeof(ddsd.ddpfPixelFormat));
+	ddsd.ddpfPixelFormat.dwSize = sizeof(DDPIXELFORMAT);
+	ddsd.ddpfPixelFormat.dwFlags = DDPF_RGB | DDPF_ALPHAPIXELS;
+	ddsd.ddpfPixelFormat.dwRGBBitCount = 32;
+	ddsd.ddpfPixelFormat.dwRBitMask = 0x00ff0000;
+	ddsd.ddpfPixelFormat.dwGBitMask = 0x0000ff00;
+	ddsd.ddpfPixelFormat.dwBBitMask = 0x000000ff;
+	ddsd.ddpfPixelFormat.dwRGBAlphaBitMask = 0xff000000;
+	if (FAILED(hr = PDxtexApp()->Pdd()->CreateSurface(&ddsd, &pdds, NULL)))
+		return hr;
+
+	if (m_dwCubeMapFlags == 0)
+	{
+		hr = DecodeAllLevels(pddsCarrier, pdds, dwFourCC);
+	}
+	else
+	{
+		LPDIRECTDRAWSURFACE7 pddsSrcFaceTop = NULL;
+		LPDIRECTDRAWSURFACE7 pddsDestFaceTop = NULL;
+		for (i = 0; i < 6 && SUCCEEDED(hr); i++)
+		{
+			if ((m_dwCubeMapFlags & s_dwCubeMapFaces[i]) == 0)
+				continue;
+			if (SUCCEEDED(hr = GetTopCubeFace(pddsCarrier, s_dwCubeMapFaces[i], &pddsSrcFaceTop)) &&
+				SUCCEEDED(hr = GetTopCubeFace(pdds, s_dwCubeMapFaces[i], &pddsDestFaceTop)))
+			{
+				hr = DecodeAllLevels(pddsSrcFaceTop, pddsDestFaceTop, dwFourCC);
+			}
+			ReleasePpo(&pddsSrcFaceTop);
+			ReleasePpo(&pddsDestFaceTop);
+		}
+	}
+	if (FAILED(hr))
+	{
+		ReleasePpo(&pdds);
+		return hr;
+	}
+
+	*ppdds = pdds;
+	return S_OK;
+}
+
+
+// Queue every mip level of pddsSrcTop for the built-in DXTn encoder, so the
+// result doesn't depend on the installed driver.  The levels are compressed
+// later by CompressLevels.  A format the encoder can't write, or a source
+// that's already in dwFourCC, goes through BltAllLevels right away.  dwFace
+// is the cube map face, 0 if the texture isn't a cube map.
+HRESULT CDxtexDoc::CompressAllLevels(LPDIRECTDRAWSURFACE7 pddsSrcTop, LPDIRECTDRAWSURFACE7 pddsDestTop, DWORD dwFourCC, DWORD dwFace, CPtrArray* pLevels)
+{
+	HRESULT hr;
+	LONG lwMip = 0;
+	LPDIRECTDRAWSURFACE7 pddsSrc;
+	LPDIRECTDRAWSURFACE7 pddsDest;
+	LPDIRECTDRAWSURFACE7 pddsSrc2;
+	LPDIRECTDRAWSURFACE7 pddsDest2;
+	DDSURFACEDESC2 ddsd;
+	DDSCAPS2 ddsCaps;
+
+	if (DXTGetBlockBytes(dwFourCC) == 0)
+		return BltAllLevels(pddsSrcTop, pddsDestTop);
+
+	// The same format is copied block for block instead of losing more
+	// detail to a second encode.  A carrier's FourCC never matches, since
+	// dwFourCC is then ATI1, ATI2 or BC7.
+	ZeroMemory(&ddsd, sizeof(ddsd));
+	ddsd.dwSize = sizeof(ddsd);
+	if (FAILED(hr = pddsSrcTop->GetSurfaceDesc(&ddsd)))
+		return hr;
+	if ((ddsd.ddpfPixelFormat.dwFlags & DDPF_FOURCC) &&
+		ddsd.ddpfPixelFormat.dwFourCC == dwFourCC)
+	{
+		return BltAllLevels(pddsSrcTop, pddsDestTop);
+	}
+
+	ZeroMemory(&ddsCaps, sizeof(ddsCaps));
+	ddsCaps.dwCaps = DDSCAPS_TEXTURE;
+	ddsCaps.dwCaps2 = DDSCAPS2_MIPMAPSUBLEVEL;
+
+	pddsSrc = pddsSrcTop;
+	pddsSrc->AddRef();
+	pddsDest = pddsDestTop;
+	pddsDest->AddRef();
+	while (TRUE)
+	{
+		if (FAILED(hr = QueueLevel(pddsSrc, pddsDest, dwFourCC, dwFace, lwMip, pLevels)))
+		{
+			ReleasePpo(&pddsDest);
+			ReleasePpo(&pddsSrc);
+			return hr;
+		}
+
+		if (FAILED(hr = pddsSrc->GetAttachedSurface(&ddsCaps, &pddsSrc2)))
+		{
+			ReleasePpo(&pddsDest);
+			ReleasePpo(&pddsSrc);
+			break;
+		}
+		if (FAILED(hr = pddsDest->GetAttachedSurface(&ddsCaps, &pddsDest2)))
+		{
+			ReleasePpo(&pddsSrc2);
+			ReleasePpo(&pddsDest);
+			ReleasePpo(&pddsSrc);
+			break;
+		}
+		ReleasePpo(&pddsDest);
+		pddsDest = pddsDest2;
+		ReleasePpo(&pddsSrc);
+		pddsSrc = pddsSrc2;
+		lwMip++;
+	}
+
+	return S_OK;
+}
+
+
+// Lock one surface and the DXTn surface of the same size it will be
+// compressed into, and add them to pLevels.  Sources that aren't 32-bit ARGB
+// are converted to a temporary surface first, block compressed ones with the
+// built-in decoder and the rest with a Blt.
+HRESULT CDxtexDoc::QueueLevel(LPDIRECTDRAWSURFACE7 pddsSrc, LPDIRECTDRAWSURFACE7 pddsDest, DWORD dwFourCC, DWORD dwFace, LONG lwMip, CPtrArray* pLevels)
+{
+	HRESULT hr;
+	DDSURFACEDESC2 ddsdSrc;
+	DDSURFACEDESC2 ddsdDest;
+	LPDIRECTDRAWSURFACE7 pddsTemp = NULL;
+	COMPRESSLEVEL* pLevel;
+	DWORD dwSrcFourCC;
+	// The view shows the error of every level
+	DWORD dwFlags = PDxtexApp()->DwQuality() | DXTC_MEASURE_ERROR;
+
+	ZeroMemory(&ddsdSrc, sizeof(ddsdSrc));
+	ddsdSrc.dwSize = sizeof(ddsdSrc);
+	if (FAILED(hr = pddsSrc->GetSurfaceDesc(&ddsdSrc)))
+		return hr;
+
+	// Keep DXT1's one bit of alpha if the source has any alpha at all
+	if (ddsdSrc.ddpfPixelFormat.dwFlags & (DDPF_ALPHAPIXELS | DDPF_FOURCC))
+		dwFlags |= DXTC_BC1_ALPHA;
+	dwSrcFourCC = 0;
+	if (ddsdSrc.ddpfPixelFormat.dwFlags & DDPF_FOURCC)
+		dwSrcFourCC = ddsdSrc.ddpfPixelFormat.dwFourCC;
+
+	if ((ddsdSrc.ddpfPixelFormat.dwFlags & DDPF_FOURCC) ||
+		ddsdSrc.ddpfPixelFormat.dwRGBBitCount != 32 ||
+		ddsdSrc.ddpfPixelFormat.dwRBitMask != 0x00ff0000 ||
+		ddsdSrc.ddpfPixelFormat.dwGBitMask != 0x0000ff00 ||
+		ddsdSrc.ddpfPixelFormat.dwBBitMask != 0x000000ff)
+	{
+		ddsdSrc.dwFlags = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT | DDSD_PIXELFORMAT;
+		ddsdSrc.ddsCaps.dwCaps = DDSCAPS_OFFSCREENPLAIN | DDSCAPS_SYSTEMMEMORY;
+		ddsdSrc.ddsCaps.dwCaps2 = 0;
+		ddsdSrc.ddpfPixelFormat.dwFlags = DDPF_RGB | DDPF_ALPHAPIXELS;
+		ddsdSrc.ddpfPixelFormat.dwFourCC = 0;
+		ddsdSrc.ddpfPixelFormat.dwRGBBitCount = 32;
+		ddsdSrc.ddpfPixelFormat.dwRBitMask = 0x00ff0000;
+		ddsdSrc.ddpfPixelFormat.dwGBitMask = 0x0000ff00;
+		ddsdSrc.ddpfPixelFormat.dwBBitMask = 0x000000ff;
+		ddsdSrc.ddpfPixelFormat.dwRGBAlphaBitMask = 0xff000000;
+		if (FAILED(hr = PDxtexApp()->Pdd()->CreateSurface(&ddsdSrc, &pddsTemp, NULL)))
+			return hr;
+		// DirectDraw can't unpack DXT2 and DXT4's premultiplied alpha
+		if (DXTGetBlockBytes(dwSrcFourCC) != 0)
+			hr = DecodeLevel(pddsSrc, pddsTemp, dwSrcFourCC);
+		else
+			hr = pddsTemp->Blt(NULL, pddsSrc, NULL, DDBLT_WAIT, NULL);
+		if (FAILED(hr))
+		{
+			ReleasePpo(&pddsTemp);
+			return hr;
+		}
+		pddsSrc = pddsTemp;
+	}
+
+	ZeroMemory(&ddsdSrc, sizeof(ddsdSrc));
+	ddsdSrc.dwSize = sizeof(ddsdSrc);
+	ZeroMemory(&ddsdDest, sizeof(ddsdDest));
+	ddsdDest.dwSize = sizeof(ddsdDest);
+	if (FAILED(hr = pddsSrc->Lock(NULL, &ddsdSrc, DDLOCK_WAIT | DDLOCK_READONLY, NULL)))
+	{
+		ReleasePpo(&pddsTemp);
+		return hr;
+	}
+	if (FAILED(hr = pddsDest->Lock(NULL, &ddsdDest, DDLOCK_WAIT | DDLOCK_WRITEONLY, NULL)))
+	{
+		pddsSrc->Unlock(NULL);
+		ReleasePpo(&pddsTemp);
+		return hr;
+	}
+
+	pLevel = new COMPRESSLEVEL;
+	pLevel->pddsSrc = pddsSrc;
+	pLevel->pddsSrc->AddRef();
+	pLevel->pddsDest = pddsDest;
+	pLevel->pddsDest->AddRef();
+	pLevel->dwFace = dwFace;
+	pLevel->lwMip = lwMip;
+	ZeroMemory(&pLevel->job, sizeof(pLevel->job));
+	pLevel->job.dwFourCC = dwFourCC;
+	pLevel->job.pSrc = ddsdSrc.lpSurface;
+	pLevel->job.lSrcPitch = ddsdSrc.lPitch;
+	pLevel->job.dwWidth = ddsdSrc.dwWidth;
+	pLevel->job.dwHeight = ddsdSrc.dwHeight;
+	pLevel->job.pDest = ddsdDest.lpSurface;
+	pLevel->job.lDestPitch = DXTSurfaceGetPitch(&ddsdDest, dwFourCC);
+	pLevel->job.dwFlags = dwFlags;
+	pLevels->Add(pLevel);
+	ReleasePpo(&pddsTemp);
+	return S_OK;
+}
+
+
+// Compress all queued levels at once on the application's thread pool.  The
+// work is cut into bands of block rows, so a single large level is spread
+// over every processor too.  The whole texture shares the application's
+// time budget.  The error of each level is kept for the view and sent to
+// the debugger.
+HRESULT CDxtexDoc::CompressLevels(CPtrArray* pLevels)
+{
+	HRESULT hr;
+	DXTCOMPRESSJOB* pJobs;
+	CString strReport;
+	INT i;
+
+	if (pLevels->GetSize() == 0)
+		return S_OK;
+	pJobs = new DXTCOMPRESSJOB[pLevels->GetSize()];
+	for (i = 0; i < pLevels->GetSize(); i++)
+		pJobs[i] = ((COMPRESSLEVEL*)pLevels->GetAt(i))->job;
+	hr = DXTCompressImages(PDxtexApp()->Ppool(), pJobs, pLevels->GetSize(),
+		PDxtexApp()->DwTimeBudget());
+	if (SUCCEEDED(hr))
+	{
+		for (i = 0; i < pLevels->GetSize(); i++)
+		{
+			COMPRESSLEVEL* pLevel = (COMPRESSLEVEL*)pLevels->GetAt(i);
+			if (pLevel->lwMip < MAX_RMSE_MIPS)
+			{
+				m_fColorRMSE[pLevel->dwFace][pLevel->lwMip] = pJobs[i].fColorRMSE;
+				m_fAlphaRMSE[pLevel->dwFace][pLevel->lwMip] = pJobs[i].fAlphaRMSE;
+			}
+			strReport.Format("dxtex: face %d mip %d, %d x %d, RMSE %.3f color, %.3f alpha",
+				pLevel->dwFace, pLevel->lwMip, pJobs[i].dwWidth, pJobs[i].dwHeight,
+				pJobs[i].fColorRMSE, pJobs[i].fAlphaRMSE);
+			if (pJobs[i].dwLateRows != 0)
+			{
+				CString strLate;
+				strLate.Format(", %d block rows over budget", pJobs[i].dwLateRows);
+				strReport += strLate;
+			}
+			strReport += "\n";
+			OutputDebugString(strReport);
+		}
+	}
+	delete[] pJobs;
+	return hr;
+}
+
+
+// Root mean square error of one compressed mip level, as measured by
+// CompressLevels.  Returns FALSE if the level wasn't compressed by the
+// built-in encoder since the document last changed.
+BOOL CDxtexDoc::GetCompressError(DWORD dwCubeMapFace, LONG lwMip, FLOAT* pfColorRMSE, FLOAT* pfAlphaRMSE)
+{
+	DWORD dwFace = 0;
+
+	if (dwCubeMapFace != 0)
+	{
+		while (dwFace < 6 && s_dwCubeMapFaces[dwFace] != dwCubeMapFace)
+			dwFace++;
+		if (dwFace == 6)
+			return FALSE;
+	}
+	if (lwMip < 0 || lwMip >= MAX_RMSE_MIPS || m_fColorRMSE[dwFace][lwMip] < 0.0f)
+		return FALSE;
+	*pfColorRMSE = m_fColorRMSE[dwFace][lwMip];
+	*pfAlphaRMSE = m_fAlphaRMSE[dwFace][lwMip];
+	return TRUE;
+}
+
+
+// Drop the measured errors, the compressed surfaces no longer match them
+VOID CDxtexDoc::ForgetCompressError(VOID)
+{
+	INT i;
+	INT j;
+
+	for (i = 0; i < 6; i++)
+	{
+		for (j = 0; j < MAX_RMSE_MIPS; j++)
+		{
+			m_fColorRMSE[i][j] = -1.0f;
+			m_fAlphaRMSE[i][j] = -1.0f;
+		}
+	}
+}
+
+
+// Unlock and release everything QueueLevel added to pLevels
+VOID CDxtexDoc::ReleaseLevels(CPtrArray* pLevels)
+{
+	INT i;
+
+	for (i = 0; i < pLevels->GetSize(); i++)
+	{
+		COMPRESSLEVEL* pLevel = (COMPRESSLEVEL*)pLevels->GetAt(i);
+		pLevel->pddsDest->Unlock(NULL);
+		pLevel->pddsSrc->Unlock(NULL);
+		ReleasePpo(&pLevel->pddsDest);
+		ReleasePpo(&pLevel->pddsSrc);
+		delete pLevel;
+	}
+	pLevels->RemoveAll();
+}
+
+
 void CDxtexDoc::OpenCubeFace(DWORD dwCubeMapFlags)
 {
 	HRESULT hr;
@@ -1714,10 +2337,14 @@ void CDxtexDoc::OpenCubeFace(DWORD dwCubeMapFlags)
 	LPDIRECTDRAWSURFACE7 pddsNewFaceTop = NULL;
 	LPDIRECTDRAWSURFACE7 pddsLoad = NULL;
 
+	if (FAILED(hr = LoadAllLevels()))
+		return;
 	if (FAILED(hr = GetTopCubeFace(m_pddsOrig, dwCubeMapFlags, &pddsOrigFaceTop)))
 		return;
 
-	if (m_pddsNew != NULL)
+	// A Blt would write DXTn into an ATI1, ATI2 or BC7 carrier, those are
+	// compressed again at the end instead
+	if (m_pddsNew != NULL && m_dwCarrierFourCC == 0)
 	{
 		if (FAILED(hr = GetTopCubeFace(m_pddsNew, dwCubeMapFlags, &pddsNewFaceTop)))
 			return;
@@ -1725,6 +2352,7 @@ void CDxtexDoc::OpenCubeFace(DWORD dwCubeMapFlags)
 
 	if (!PromptForBmp(&fileName))
 		return;
+	ForgetCompressError();
 
 	if (FAILED(hr = CreateSurfaceFromBmp(fileName, &pddsLoad)))
 	{
@@ -1762,7 +2390,7 @@ void CDxtexDoc::OpenCubeFace(DWORD dwCubeMapFlags)
 		return;
 	if (m_numMips > 0)
 	{
-		if (FAILED(hr = GenerateMipMapsFromTop(pddsOrigFaceTop)))
+		if (FAILED(hr = GenerateMipMapsFromTops(&pddsOrigFaceTop, 1)))
 			return;
 	}
 
@@ -1773,7 +2401,7 @@ void CDxtexDoc::OpenCubeFace(DWORD dwCubeMapFlags)
 			return;
 		if (m_numMips > 0)
 		{
-			if (FAILED(hr = GenerateMipMapsFromTop(pddsNewFaceTop)))
+			if (FAILED(hr = GenerateMipMapsFromTops(&pddsNewFaceTop, 1)))
 				return;
 		}
 	}
@@ -1782,6 +2410,9 @@ void CDxtexDoc::OpenCubeFace(DWORD dwCubeMapFlags)
 	ReleasePpo(&pddsOrigFaceTop);
 	ReleasePpo(&pddsNewFaceTop);
 
+	if (m_dwCarrierFourCC != 0)
+		Compress(m_dwCarrierFourCC, FALSE);
+
 	SetModifiedFlag(TRUE);
 	UpdateAllViews(NULL, 1);
 }
@@ -1794,6 +2425,8 @@ void CDxtexDoc::OpenAlphaCubeFace(DWORD dwCubeMapFlags)
 	LPDIRECTDRAWSURFACE7 pddsOrigFaceTop = NULL;
 	LPDIRECTDRAWSURFACE7 pddsNewFaceTop = NULL;
 
+	if (FAILED(hr = LoadAllLevels()))
+		return;
 	// Premultiplied-alpha files don't support this feature:
 	DDSURFACEDESC2 ddsd;
 	ZeroMemory(&ddsd, sizeof(ddsd));
@@ -1827,7 +2460,9 @@ void CDxtexDoc::OpenAlphaCubeFace(DWORD dwCubeMapFlags)
 	if (FAILED(hr = GetTopCubeFace(m_pddsOrig, dwCubeMapFlags, &pddsOrigFaceTop)))
 		return;
 
-	if (m_pddsNew != NULL)
+	// A Blt would write DXTn into an ATI1, ATI2 or BC7 carrier, those are
+	// compressed again at the end instead
+	if (m_pddsNew != NULL && m_dwCarrierFourCC == 0)
 	{
 		if (FAILED(hr = GetTopCubeFace(m_pddsNew, dwCubeMapFlags, &pddsNewFaceTop)))
 			return;
@@ -1835,6 +2470,7 @@ void CDxtexDoc::OpenAlphaCubeFace(DWORD dwCubeMapFlags)
 
 	if (!PromptForBmp(&fileName))
 		return;
+	ForgetCompressError();
 
 	if (FAILED(hr = LoadAlphaIntoSurface(fileName, pddsOrigFaceTop)))
 		return;
@@ -1846,11 +2482,11 @@ void CDxtexDoc::OpenAlphaCubeFace(DWORD dwCubeMapFlags)
 
 	if (m_numMips > 0)
 	{
-		if (FAILED(hr = GenerateMipMapsFromTop(pddsOrigFaceTop)))
+		if (FAILED(hr = GenerateMipMapsFromTops(&pddsOrigFaceTop, 1)))
 			return;
 		if (pddsNewFaceTop != NULL)
 		{
-			if (FAILED(hr = GenerateMipMapsFromTop(pddsNewFaceTop)))
+			if (FAILED(hr = GenerateMipMapsFromTops(&pddsNewFaceTop, 1)))
 				return;
 		}
 	}
@@ -1858,6 +2494,9 @@ void CDxtexDoc::OpenAlphaCubeFace(DWORD dwCubeMapFlags)
 	ReleasePpo(&pddsOrigFaceTop);
 	ReleasePpo(&pddsNewFaceTop);
 
+	if (m_dwCarrierFourCC != 0)
+		Compress(m_dwCarrierFourCC, FALSE);
+
 	SetModifiedFlag(TRUE);
 	UpdateAllViews(NULL, 1);
 }
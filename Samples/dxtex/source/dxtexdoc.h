@@ -9,6 +9,12 @@
 #pragma once
 #endif // _MSC_VER > 1000
 
+#include "ddsmap.h"
+#include "dxtchain.h"
+
+// Mip levels whose compression error is remembered
+#define MAX_RMSE_MIPS 16
+
 
 class CDxtexDoc : public CDocument
 {
@@ -24,13 +30,14 @@ public:
 	virtual BOOL OnNewDocument();
 	virtual void Serialize(CArchive& ar);
 	virtual void SetPathName(LPCTSTR lpszPathName, BOOL bAddToMRU = TRUE);
+	virtual BOOL OnSaveDocument(LPCTSTR lpszPathName);
 	//}}AFX_VIRTUAL
 
 // Implementation
 public:
 	HRESULT LoadAlphaBmp(CString& strPath);
 	VOID GenerateMipMaps(VOID);
-	HRESULT GenerateMipMapsFromTop(LPDIRECTDRAWSURFACE7 pddsSrcTop);
+	HRESULT GenerateMipMapsFromTops(LPDIRECTDRAWSURFACE7* ppddsTops, DWORD dwFaces);
 	HRESULT Compress(DWORD dwFourCC, BOOL bSwitchView);
 	DWORD NumMips(VOID);
 	LPDIRECTDRAWSURFACE7 PddsOrig(VOID) { return m_pddsOrig; }
@@ -38,6 +45,9 @@ public:
 	DWORD DwWidth(VOID) { return m_dwWidth; }
 	DWORD DwHeight(VOID) { return m_dwHeight; }
 	HRESULT GetTopCubeFace(LPDIRECTDRAWSURFACE7 pdds, DWORD dwCubeMapFlags, LPDIRECTDRAWSURFACE7* ppddsFaceTop);
+	HRESULT GetNthMipMap(LPDIRECTDRAWSURFACE7 pddsTop, LONG lwMip,
+		LPDIRECTDRAWSURFACE7* ppDDS);
+	DWORD NumBytes(LPDIRECTDRAWSURFACE7 pdds);
 	BOOL TitleModsChanged(VOID) { return m_bTitleModsChanged; }
 	VOID ClearTitleModsChanged(VOID) { m_bTitleModsChanged = FALSE; }
 	virtual ~CDxtexDoc();
@@ -46,6 +56,9 @@ public:
 	void OpenCubeFace(DWORD dwCubeMapFlags);
 	void OpenAlphaCubeFace(DWORD dwCubeMapFlags);
 	DWORD DwCubeMapFlags(VOID) { return m_dwCubeMapFlags; }
+	DWORD DwCarrierFourCC(VOID) { return m_dwCarrierFourCC; }
+	BOOL GetCompressError(DWORD dwCubeMapFace, LONG lwMip, FLOAT* pfColorRMSE, FLOAT* pfAlphaRMSE);
+	HRESULT LoadLevel(DWORD dwCubeMapFace, LONG lwMip);
 #ifdef _DEBUG
 	virtual void AssertValid() const;
 	virtual void Dump(CDumpContext& dc) const;
@@ -61,6 +74,9 @@ protected:
 	afx_msg void OnFormatDxt3();
 	afx_msg void OnFormatDxt4();
 	afx_msg void OnFormatDxt5();
+	afx_msg void OnFormatAti1();
+	afx_msg void OnFormatAti2();
+	afx_msg void OnFormatBc7();
 	afx_msg void OnFormatChangeCubeMapFaces();
 	afx_msg void OnUpdateFileOpenAlpha(CCmdUI* pCmdUI);
 	afx_msg void OnUpdateFormatGenerateMipmaps(CCmdUI* pCmdUI);
@@ -75,21 +91,38 @@ private:
 	DWORD m_numMips;
 	DWORD m_dwCubeMapFlags;
 	BOOL m_bTitleModsChanged;
+	DWORD m_dwCarrierFourCC; // ATI1, ATI2 or BC7 if m_pddsNew holds them in a DXTn surface, else 0
+	FLOAT m_fColorRMSE[6][MAX_RMSE_MIPS]; // Per face and mip, negative if unknown
+	FLOAT m_fAlphaRMSE[6][MAX_RMSE_MIPS];
+	DDSMAPPING m_mapping; // DDS file the original's levels are still copied from
+	LPDIRECTDRAWSURFACE7 m_pddsMapped; // Surface filled from m_mapping, NULL once it's all in
+	DWORD m_dwLevelsLoaded[6]; // Per face, a bit for each mip level copied in
+	DXTSURFACECHAIN* m_pchainOrig; // Faces and levels of m_pddsOrig, built when first needed
+	DXTSURFACECHAIN* m_pchainNew; // Same for m_pddsNew
 
 	HRESULT LoadBmp(CString& strPath);
 	CDxtexApp* PDxtexApp(VOID) { return (CDxtexApp*)AfxGetApp(); }
-	HRESULT GetNthMipMap(LPDIRECTDRAWSURFACE7 pddsTop, LONG lwMip,
-		LPDIRECTDRAWSURFACE7* ppDDS);
+	const DXTSURFACECHAIN* PChain(LPDIRECTDRAWSURFACE7 pdds);
 	HRESULT CreateSurfaceFromBmp(CString& strPath, LPDIRECTDRAWSURFACE7* ppdds);
 	HRESULT LoadAlphaIntoSurface(CString& strPath, LPDIRECTDRAWSURFACE7 pdds);
 	HRESULT ChangeCubeMapFlags(LPDIRECTDRAWSURFACE7* ppddsSrc, DWORD dwCubeMapFlagsNew);
 	HRESULT BltAllLevels(LPDIRECTDRAWSURFACE7 pddsSrcTop, LPDIRECTDRAWSURFACE7 pddsDestTop);
+	HRESULT DecodeAllLevels(LPDIRECTDRAWSURFACE7 pddsSrcTop, LPDIRECTDRAWSURFACE7 pddsDestTop, DWORD dwFourCC);
+	HRESULT DecodeCarrier(LPDIRECTDRAWSURFACE7 pddsCarrier, DWORD dwFourCC, LPDIRECTDRAWSURFACE7* ppdds);
+	DWORD NewFourCC(VOID);
+	HRESULT CompressAllLevels(LPDIRECTDRAWSURFACE7 pddsSrcTop, LPDIRECTDRAWSURFACE7 pddsDestTop, DWORD dwFourCC, DWORD dwFace, CPtrArray* pLevels);
+	HRESULT QueueLevel(LPDIRECTDRAWSURFACE7 pddsSrc, LPDIRECTDRAWSURFACE7 pddsDest, DWORD dwFourCC, DWORD dwFace, LONG lwMip, CPtrArray* pLevels);
+	HRESULT CompressLevels(CPtrArray* pLevels);
+	VOID ReleaseLevels(CPtrArray* pLevels);
+	VOID ForgetCompressError(VOID);
 	BOOL PromptForBmp(CString* pstrPath);
-	HRESULT SaveDDS(LPDIRECTDRAWSURFACE7 pdds, CArchive& ar);
-	HRESULT SaveAllMipSurfaces(LPDIRECTDRAWSURFACE7 pddsTop, CArchive& ar);
+	HRESULT SaveDDS(LPDIRECTDRAWSURFACE7 pdds, LPCTSTR lpszPathName);
+	HRESULT SaveAllMipSurfaces(LPDIRECTDRAWSURFACE7 pddsTop, DDSMAPPING* pMapping, DWORD dwFace);
 	HRESULT LoadDDS(LPDIRECTDRAWSURFACE7* ppdds, CArchive& ar);
 	HRESULT LoadAllMipSurfaces(LPDIRECTDRAWSURFACE7 pddsTop, CArchive& ar);
-	HRESULT GenerateMip(LPDIRECTDRAWSURFACE7 pddsSrc, LPDIRECTDRAWSURFACE7 pddsDest, RECT* prcDest);
+	HRESULT LoadMappedDDS(LPDIRECTDRAWSURFACE7* ppdds);
+	HRESULT LoadAllLevels(VOID);
+	VOID UnmapDDS(VOID);
 };
 
 /////////////////////////////////////////////////////////////////////////////
@@ -5,6 +5,8 @@
 #include "dxtex.h"
 #include "dxtexDoc.h"
 #include "dxtexView.h"
+#include "dxtcodec.h"
+#include "dxtsurf.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -66,6 +68,7 @@ CDxtexView::CDxtexView()
 	m_fZoom = 1.0f;
 	m_bViewOrig = TRUE;
 	m_bViewAlpha = FALSE;
+	m_bViewPremult = FALSE;
 }
 
 
@@ -154,8 +157,6 @@ VOID CDxtexView::GetImageInfo(CString& strInfo)
 	DWORD dwBytes = 0;
 	DWORD dwWidth;
 	DWORD dwHeight;
-	DWORD dwTopCubeFace;
-	DWORD dwCubeMapFlags = GetDocument()->DwCubeMapFlags();
 
 	if (m_bViewOrig)
 		pdds = GetDocument()->PddsOrig();
@@ -170,8 +171,9 @@ VOID CDxtexView::GetImageInfo(CString& strInfo)
 		return;
 	dwWidth = ddsd.dwWidth;
 	dwHeight = ddsd.dwHeight;
-	dwTopCubeFace = (ddsd.ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP_ALLFACES);
 	pddpf = &ddsd.ddpfPixelFormat;
+	if (!m_bViewOrig && GetDocument()->DwCarrierFourCC() != 0)
+		pddpf->dwFourCC = GetDocument()->DwCarrierFourCC();
 	if (pddpf->dwFlags & DDPF_FOURCC)
 	{
 		wsprintf(szFormat, "%c%c%c%c", 
@@ -189,105 +191,22 @@ VOID CDxtexView::GetImageInfo(CString& strInfo)
 		lstrcpy(szFormat, "");
 	}
 
-	// Count bytes in main surface chain
-	dwBytes += NumBytesInSurfaces(pdds);
-
-	// Count bytes in other cubemap faces, if any
-	if (GetDocument()->DwCubeMapFlags() != dwTopCubeFace)
-	{
-		LPDIRECTDRAWSURFACE7 pddsFaceTop = NULL;
-
-		if ((dwCubeMapFlags & DDSCAPS2_CUBEMAP_POSITIVEX) && !(dwTopCubeFace & DDSCAPS2_CUBEMAP_POSITIVEX))
-		{
-			if (SUCCEEDED(GetDocument()->GetTopCubeFace(pdds, DDSCAPS2_CUBEMAP_POSITIVEX, &pddsFaceTop)))
-			{
-				dwBytes += NumBytesInSurfaces(pddsFaceTop);
-				ReleasePpo(&pddsFaceTop);
-			}
-		}
-		if ((dwCubeMapFlags & DDSCAPS2_CUBEMAP_NEGATIVEX) && !(dwTopCubeFace & DDSCAPS2_CUBEMAP_NEGATIVEX))
-		{
-			if (SUCCEEDED(GetDocument()->GetTopCubeFace(pdds, DDSCAPS2_CUBEMAP_NEGATIVEX, &pddsFaceTop)))
-			{
-				dwBytes += NumBytesInSurfaces(pddsFaceTop);
-				ReleasePpo(&pddsFaceTop);
-			}
-		}
-		if ((dwCubeMapFlags & DDSCAPS2_CUBEMAP_POSITIVEY) && !(dwTopCubeFace & DDSCAPS2_CUBEMAP_POSITIVEY))
-		{
-			if (SUCCEEDED(GetDocument()->GetTopCubeFace(pdds, DDSCAPS2_CUBEMAP_POSITIVEY, &pddsFaceTop)))
-			{
-				dwBytes += NumBytesInSurfaces(pddsFaceTop);
-				ReleasePpo(&pddsFaceTop);
-			}
-		}
-		if ((dwCubeMapFlags & DDSCAPS2_CUBEMAP_NEGATIVEY) && !(dwTopCubeFace & DDSCAPS2_CUBEMAP_NEGATIVEY))
-		{
-			if (SUCCEEDED(GetDocument()->GetTopCubeFace(pdds, DDSCAPS2_CUBEMAP_NEGATIVEY, &pddsFaceTop)))
-			{
-				dwBytes += NumBytesInSurfaces(pddsFaceTop);
-				ReleasePpo(&pddsFaceTop);
-			}
-		}
-		if ((dwCubeMapFlags & DDSCAPS2_CUBEMAP_POSITIVEZ) && !(dwTopCubeFace & DDSCAPS2_CUBEMAP_POSITIVEZ))
-		{
-			if (SUCCEEDED(GetDocument()->GetTopCubeFace(pdds, DDSCAPS2_CUBEMAP_POSITIVEZ, &pddsFaceTop)))
-			{
-				dwBytes += NumBytesInSurfaces(pddsFaceTop);
-				ReleasePpo(&pddsFaceTop);
-			}
-		}
-		if ((dwCubeMapFlags & DDSCAPS2_CUBEMAP_NEGATIVEZ) && !(dwTopCubeFace & DDSCAPS2_CUBEMAP_NEGATIVEZ))
-		{
-			if (SUCCEEDED(GetDocument()->GetTopCubeFace(pdds, DDSCAPS2_CUBEMAP_NEGATIVEZ, &pddsFaceTop)))
-			{
-				dwBytes += NumBytesInSurfaces(pddsFaceTop);
-				ReleasePpo(&pddsFaceTop);
-			}
-		}
-	}
+	// Every face and mip level, from the document's table
+	dwBytes = GetDocument()->NumBytes(pdds);
 
 	wsprintf(sz, "%d x %d, %s, %d bytes", dwWidth, dwHeight, szFormat, dwBytes);
 	strInfo = sz;
-}
-
-
-DWORD CDxtexView::NumBytesInSurfaces(LPDIRECTDRAWSURFACE7 pddsTopMip)
-{
-	DWORD dwBytes = 0;
-	LPDIRECTDRAWSURFACE7 pdds = NULL;
-	LPDIRECTDRAWSURFACE7 pddsNext = NULL;
-	DDSCAPS2 ddsCaps;
-	DDSURFACEDESC2 ddsd;
 
-	ZeroMemory(&ddsd, sizeof(ddsd));
-	ddsd.dwSize = sizeof(ddsd);
-	if (FAILED(pddsTopMip->GetSurfaceDesc(&ddsd)))
-		return 0;
-
-	ZeroMemory(&ddsCaps, sizeof(ddsCaps));
-	ddsCaps.dwCaps = DDSCAPS_TEXTURE;
-	ddsCaps.dwCaps2 = DDSCAPS2_MIPMAPSUBLEVEL;
-
-	pdds = pddsTopMip;
-	pdds->AddRef();
-	while (TRUE)
+	// How far the mip level being viewed is from the original
+	FLOAT fColorRMSE;
+	FLOAT fAlphaRMSE;
+	if (!m_bViewOrig && GetDocument()->GetCompressError(m_dwCubeMapCur,
+		m_lwMipCur, &fColorRMSE, &fAlphaRMSE))
 	{
-		if (ddsd.dwFlags & DDSD_LINEARSIZE)
-			dwBytes += ddsd.dwLinearSize;
-		else
-			dwBytes += ddsd.dwWidth * ddsd.dwHeight * (ddsd.ddpfPixelFormat.dwRGBBitCount / 8);
-		if (FAILED(pdds->GetAttachedSurface(&ddsCaps, &pddsNext)))
-		{
-			ReleasePpo(&pdds);
-			break;
-		}
-		ReleasePpo(&pdds);
-		pdds = pddsNext;
-		pddsNext = NULL;
-		pdds->GetSurfaceDesc(&ddsd);
+		CString strError;
+		strError.Format(", RMSE %.2f color, %.2f alpha", fColorRMSE, fAlphaRMSE);
+		strInfo += strError;
 	}
-	return dwBytes;
 }
 
 
@@ -372,15 +291,9 @@ HRESULT CDxtexView::RenderScene(VOID)
 
 	// If the texture uses premultiplied alpha, the source blend should be D3DBLEND_ONE
 	// since RGB is already at the level we want.  With nonpremultiplied alpha, the
-	// source blend should be D3DBLEND_SRCALPHA.
-	DDSURFACEDESC2 ddsd;
-	ZeroMemory(&ddsd, sizeof(ddsd));
-	ddsd.dwSize = sizeof(ddsd);
-	if (FAILED(m_pddsCur->GetSurfaceDesc(&ddsd)))
-		return hr;
-	if (!m_bViewAlpha && (ddsd.ddpfPixelFormat.dwFlags & DDPF_FOURCC) != 0 &&
-		(ddsd.ddpfPixelFormat.dwFourCC == FOURCC_DXT2 ||
-		 ddsd.ddpfPixelFormat.dwFourCC == FOURCC_DXT4))
+	// source blend should be D3DBLEND_SRCALPHA.  DXT2 and DXT4 levels are decoded
+	// to plain ARGB with the color left premultiplied.
+	if (m_bViewPremult)
 	{
 		if (FAILED(hr = m_pd3ddev->SetRenderState(D3DRENDERSTATE_SRCBLEND, D3DBLEND_ONE)))
 			return hr;
@@ -543,7 +456,7 @@ void CDxtexView::OnUpdateViewAlphaChannel(CCmdUI* pCmdUI)
 }
 
 
-HRESULT CDxtexView::GenerateAlphaImage(LPDIRECTDRAWSURFACE7 pddsSrc, LPDIRECTDRAWSURFACE7* ppddsDest)
+HRESULT CDxtexView::GenerateAlphaImage(LPDIRECTDRAWSURFACE7 pddsSrc, DWORD dwFourCC, LPDIRECTDRAWSURFACE7* ppddsDest)
 {
 	HRESULT hr;
 	DDSURFACEDESC2 ddsd;
@@ -556,6 +469,11 @@ HRESULT CDxtexView::GenerateAlphaImage(LPDIRECTDRAWSURFACE7 pddsSrc, LPDIRECTDRA
 	DWORD* pdwPixel2 = NULL;
 	DWORD dwAlpha;
 	LPDIRECTDRAWSURFACE7 pddsTemp = NULL;
+
+	// DXTn alpha is read straight out of the blocks
+	hr = DecodeSurface(pddsSrc, dwFourCC, DXTD_ALPHAONLY, ppddsDest);
+	if (hr != DDERR_UNSUPPORTEDFORMAT)
+		return hr;
 		
 	ddsd.dwSize = sizeof(ddsd);
 	pddsSrc->GetSurfaceDesc(&ddsd);
@@ -656,6 +574,67 @@ HRESULT CDxtexView::GenerateAlphaImage(LPDIRECTDRAWSURFACE7 pddsSrc, LPDIRECTDRA
 }
 
 
+// Decode a DXTn surface into a new ARGB8888 system memory texture without
+// going through Blt, so the view doesn't depend on the driver's decoder.
+// A nonzero dwFourCC overrides the surface's own, for ATI1, ATI2 and BC7
+// carriers.  Returns DDERR_UNSUPPORTEDFORMAT if pddsSrc isn't DXTn.
+HRESULT CDxtexView::DecodeSurface(LPDIRECTDRAWSURFACE7 pddsSrc, DWORD dwFourCC, DWORD dwFlags, LPDIRECTDRAWSURFACE7* ppddsDest)
+{
+	HRESULT hr;
+	DDSURFACEDESC2 ddsdSrc;
+	DDSURFACEDESC2 ddsdDest;
+
+	ZeroMemory(&ddsdSrc, sizeof(ddsdSrc));
+	ddsdSrc.dwSize = sizeof(ddsdSrc);
+	if (FAILED(hr = pddsSrc->GetSurfaceDesc(&ddsdSrc)))
+		return hr;
+	if ((ddsdSrc.ddpfPixelFormat.dwFlags & DDPF_FOURCC) == 0)
+		return DDERR_UNSUPPORTEDFORMAT;
+	if (dwFourCC == 0)
+		dwFourCC = ddsdSrc.ddpfPixelFormat.dwFourCC;
+	if (DXTGetBlockBytes(dwFourCC) == 0)
+		return DDERR_UNSUPPORTEDFORMAT;
+
+	ZeroMemory(&ddsdDest, sizeof(ddsdDest));
+	ddsdDest.dwSize = sizeof(ddsdDest);
+	ddsdDest.dwFlags = DDSD_CAPS | DDSD_WIDTH | DDSD_HEIGHT | DDSD_PIXELFORMAT;
+	ddsdDest.dwWidth = ddsdSrc.dwWidth;
+	ddsdDest.dwHeight = ddsdSrc.dwHeight;
+	ddsdDest.ddsCaps.dwCaps = DDSCAPS_TEXTURE | DDSCAPS_SYSTEMMEMORY;
+	ddsdDest.ddpfPixelFormat.dwSize = sizeof(DDPIXELFORMAT);
+	ddsdDest.ddpfPixelFormat.dwFlags = DDPF_RGB | DDPF_ALPHAPIXELS;
+	ddsdDest.ddpfPixelFormat.dwRGBBitCount = 32;
+	ddsdDest.ddpfPixelFormat.dwRBitMask = 0x00ff0000;
+	ddsdDest.ddpfPixelFormat.dwGBitMask = 0x0000ff00;
+	ddsdDest.ddpfPixelFormat.dwBBitMask = 0x000000ff;
+	ddsdDest.ddpfPixelFormat.dwRGBAlphaBitMask = 0xff000000;
+	if (FAILED(hr = PDxtexApp()->Pdd()->CreateSurface(&ddsdDest, ppddsDest, NULL)))
+		return hr;
+
+	if (FAILED(hr = pddsSrc->Lock(NULL, &ddsdSrc, DDLOCK_WAIT | DDLOCK_READONLY, NULL)))
+	{
+		ReleasePpo(ppddsDest);
+		return hr;
+	}
+	if (FAILED(hr = (*ppddsDest)->Lock(NULL, &ddsdDest, DDLOCK_WAIT | DDLOCK_WRITEONLY, NULL)))
+	{
+		pddsSrc->Unlock(NULL);
+		ReleasePpo(ppddsDest);
+		return hr;
+	}
+
+	hr = DXTDecompressImage(dwFourCC, ddsdSrc.lpSurface,
+		DXTSurfaceGetPitch(&ddsdSrc, dwFourCC), ddsdSrc.dwWidth, ddsdSrc.dwHeight,
+		NULL, ddsdDest.lpSurface, ddsdDest.lPitch, dwFlags);
+
+	(*ppddsDest)->Unlock(NULL);
+	pddsSrc->Unlock(NULL);
+	if (FAILED(hr))
+		ReleasePpo(ppddsDest);
+	return hr;
+}
+
+
 void CDxtexView::OnUpdateViewLargerMipLevel(CCmdUI* pCmdUI) 
 {
 	if (m_lwMipCur > 0)
@@ -736,6 +715,8 @@ CString CDxtexView::GetStrTitleMods(VOID)
 	if (SUCCEEDED(pdds->GetSurfaceDesc(&ddsd)))
 	{
 		pddpf = &ddsd.ddpfPixelFormat;
+		if (!m_bViewOrig && GetDocument()->DwCarrierFourCC() != 0)
+			pddpf->dwFourCC = GetDocument()->DwCarrierFourCC();
 		if (pddpf->dwFlags & DDPF_FOURCC)
 		{
 			strFormat.Format("%c%c%c%c", 
@@ -869,12 +850,17 @@ HRESULT CDxtexView::BuildViewSurface(BOOL bOrig, DWORD dwCubeMapFace, LONG lwMip
 	LPDIRECTDRAWSURFACE7 pddsLevel = NULL; // mip level we want
 	LPDIRECTDRAWSURFACE7 pddsCur = NULL; // new texture we will use
 	DDSURFACEDESC2 ddsd;
+	BOOL bPremult;
+	DWORD dwCarrierFourCC = 0;
 
 	// Get top of original or new surface
 	if (bOrig)
 		pddsTop = GetDocument()->PddsOrig();
 	else
+	{
 		pddsTop = GetDocument()->PddsNew();
+		dwCarrierFourCC = GetDocument()->DwCarrierFourCC();
+	}
 	pddsTop->AddRef();
 
 	// Adjust dwCubeMapFace if necessary
@@ -892,63 +878,29 @@ HRESULT CDxtexView::BuildViewSurface(BOOL bOrig, DWORD dwCubeMapFace, LONG lwMip
 	if (dwCubeMapFace == 0 && (ddsd.ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP) != 0)
 		dwCubeMapFace = ddsd.ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP_ALLFACES;
 
-	// Get top of the correct face
-	if (dwCubeMapFace == 0)
-	{
-		pddsTopFace = pddsTop;
-		pddsTopFace->AddRef();
-	}
-	else
-	{
-		ZeroMemory(&ddsd, sizeof(ddsd));
-		ddsd.dwSize = sizeof(ddsd);
-		if (FAILED(hr = pddsTop->GetSurfaceDesc(&ddsd)))
-			goto LFail;
-		if ((ddsd.ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP_ALLFACES) == dwCubeMapFace)
-		{
-			pddsTopFace = pddsTop;
-			pddsTopFace->AddRef();
-		}
-		else
-		{
-			DDSCAPS2 ddsCaps;
-			ZeroMemory(&ddsCaps, sizeof(ddsCaps));
-			ddsCaps.dwCaps2 = dwCubeMapFace;
+	// Levels of a mapped DDS file are only read once they're shown
+	if (bOrig && FAILED(hr = GetDocument()->LoadLevel(dwCubeMapFace, lwMip)))
+		goto LFail;
 
-			if (FAILED(hr = pddsTop->GetAttachedSurface(&ddsCaps, &pddsTopFace)))
-				return hr;
-		}
-	}
+	// Get top of the correct face, then the mip level, both looked up in
+	// the document's table
+	if (FAILED(hr = GetDocument()->GetTopCubeFace(pddsTop, dwCubeMapFace, &pddsTopFace)))
+		goto LFail;
 	ReleasePpo(&pddsTop);
-
-	// Get correct mip level
-	{
-		LPDIRECTDRAWSURFACE7 pdds;
-		LPDIRECTDRAWSURFACE7 pdds2;
-		DDSCAPS2 ddsCaps;
-		INT i;
-		HRESULT hr2;
-
-		ZeroMemory(&ddsCaps, sizeof(ddsCaps));
-		ddsCaps.dwCaps = DDSCAPS_TEXTURE;
-		ddsCaps.dwCaps2 = DDSCAPS2_MIPMAPSUBLEVEL;
-		pdds = pddsTopFace;
-		pdds->AddRef();
-		for (i = 0; i < lwMip; i++)
-		{
-			if (FAILED(hr2 = pdds->GetAttachedSurface(&ddsCaps, &pdds2)))
-				return hr2;
-			ReleasePpo(&pdds);
-			pdds = pdds2;
-		}
-		pddsLevel = pdds;
-	}
+	hr = GetDocument()->GetNthMipMap(pddsTopFace, lwMip, &pddsLevel);
 	ReleasePpo(&pddsTopFace);
+	if (FAILED(hr))
+		goto LFail;
 
 	// make surface that will be used as texture for current view
 	if (bViewAlpha)
 	{
-		if (FAILED(hr = GenerateAlphaImage(pddsLevel, &pddsCur)))
+		if (FAILED(hr = GenerateAlphaImage(pddsLevel, dwCarrierFourCC, &pddsCur)))
+			goto LFail;
+	}
+	else if ((hr = DecodeSurface(pddsLevel, dwCarrierFourCC, 0, &pddsCur)) != DDERR_UNSUPPORTEDFORMAT)
+	{
+		if (FAILED(hr))
 			goto LFail;
 	}
 	else
@@ -962,9 +914,17 @@ HRESULT CDxtexView::BuildViewSurface(BOOL bOrig, DWORD dwCubeMapFace, LONG lwMip
 		ddsd.dwFlags = DDSD_WIDTH | DDSD_HEIGHT | DDSD_CAPS | DDSD_PIXELFORMAT;
 		if (FAILED(hr = PDxtexApp()->Pdd()->CreateSurface(&ddsd, &pddsCur, NULL)))
 			goto LFail;
-		if (FAILED(hr = pddsCur->Blt(NULL, pddsLevel, NULL, DDBLT_WAIT, NULL)))
+		if (FAILED(hr = DXTSurfaceBlt(pddsCur, NULL, pddsLevel, NULL, DDBLT_WAIT, NULL)))
 			goto LFail;
 	}
+
+	ZeroMemory(&ddsd, sizeof(ddsd));
+	ddsd.dwSize = sizeof(ddsd);
+	if (FAILED(hr = pddsLevel->GetSurfaceDesc(&ddsd)))
+		goto LFail;
+	bPremult = !bViewAlpha && (ddsd.ddpfPixelFormat.dwFlags & DDPF_FOURCC) != 0 &&
+		(ddsd.ddpfPixelFormat.dwFourCC == FOURCC_DXT2 ||
+		 ddsd.ddpfPixelFormat.dwFourCC == FOURCC_DXT4);
 	ReleasePpo(&pddsLevel);
 
 	ZeroMemory(&ddsd, sizeof(ddsd));
@@ -978,6 +938,7 @@ HRESULT CDxtexView::BuildViewSurface(BOOL bOrig, DWORD dwCubeMapFace, LONG lwMip
 	m_pddsCur = pddsCur;
 	m_bViewOrig = bOrig;
 	m_bViewAlpha = bViewAlpha;
+	m_bViewPremult = bPremult;
 	m_dwCubeMapCur = dwCubeMapFace;
 	m_lwMipCur = lwMip;
 	return S_OK;
@@ -85,13 +85,13 @@ protected:
 	DECLARE_MESSAGE_MAP()
 
 private:
-	HRESULT GenerateAlphaImage(LPDIRECTDRAWSURFACE7 pddsSrc, LPDIRECTDRAWSURFACE7* ppddsDest);
+	HRESULT GenerateAlphaImage(LPDIRECTDRAWSURFACE7 pddsSrc, DWORD dwFourCC, LPDIRECTDRAWSURFACE7* ppddsDest);
+	HRESULT DecodeSurface(LPDIRECTDRAWSURFACE7 pddsSrc, DWORD dwFourCC, DWORD dwFlags, LPDIRECTDRAWSURFACE7* ppddsDest);
 	HRESULT UpdateDevice(VOID);
 	HRESULT RenderScene(VOID);
 	CDxtexApp* PDxtexApp(VOID) { return (CDxtexApp*)AfxGetApp(); }
 	DWORD DwCubeMapCur(LPDIRECTDRAWSURFACE7 pdds);
 	HRESULT BuildViewSurface(BOOL bOrig, DWORD dwCubeMapFace, LONG lwMip, BOOL bViewAlpha);
-	DWORD NumBytesInSurfaces(LPDIRECTDRAWSURFACE7 pddsTopMip);
 
 	LPDIRECTDRAWSURFACE7 m_pddsCur; // Currently-viewed texture surface
 	LPDIRECTDRAWSURFACE7 m_pddsBack; // The render target surface
@@ -101,6 +101,7 @@ private:
 	FLOAT m_fZoom; // Zoom factor
 	BOOL m_bViewOrig; // View "original" vs. "new" surface
 	BOOL m_bViewAlpha; // View alpha channel alone vs. normal image
+	BOOL m_bViewPremult; // m_pddsCur holds premultiplied color (DXT2/DXT4)
 	BOOL m_bTitleModsChanged; // Whether title bar text modifiers need to be updated
 	LONG m_lwMipCur; // Currently-viewed mip.  0 = top, 1 = next one down, etc.
 	DWORD m_dwCubeMapCur; // 0 = no cube map, or DDSCAPS2_CUBEMAP_NEGATIVEX, etc.
@@ -40,13 +40,24 @@
 #define ID_VIEW_NEGZ                    32802
 #define ID_FILE_OPENFACE                32803
 #define ID_FILE_OPENALPHAFACE           32804
+#define ID_FORMAT_QUALITYFAST           32806
+#define ID_FORMAT_QUALITYNORMAL         32807
+#define ID_FORMAT_QUALITYBEST           32808
+#define ID_FORMAT_ATI1                  32809
+#define ID_FORMAT_ATI2                  32810
+#define ID_FORMAT_BC7                   32811
+#define ID_FORMAT_SRGBMIPMAPS           32812
+#define ID_FORMAT_FILTERBOX             32813
+#define ID_FORMAT_FILTERKAISER          32814
+#define ID_FORMAT_FILTERLANCZOS         32815
+#define ID_FORMAT_FILTERMITCHELL        32816
 #define ID_INDICATOR_IMAGEINFO          61216
 #define ID_ERROR_ODDDIMENSIONS          61217
-#define ID_ERROR_NOTPOW2                61218
 #define ID_ERROR_WRONGDIMENSIONS        61219
 #define ID_ERROR_GENERATEALPHAFAILED    61220
 #define ID_ERROR_PREMULTALPHA           61221
 #define ID_ERROR_PREMULTTODXT1          61222
+#define ID_ERROR_VOLUME                 61223
 
 // Next default values for new objects
 // 
@@ -54,7 +65,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_3D_CONTROLS                     1
 #define _APS_NEXT_RESOURCE_VALUE        132
-#define _APS_NEXT_COMMAND_VALUE         32806
+#define _APS_NEXT_COMMAND_VALUE         32817
 #define _APS_NEXT_CONTROL_VALUE         1007
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
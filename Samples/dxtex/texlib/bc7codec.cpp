@@ -0,0 +1,1293 @@
+//-----------------------------------------------------------------------------
+// File: bc7codec.cpp
+//
+// Desc: BC7 block encoder and decoder.
+//
+//       Every block tries mode 6, one subset with seven bit RGBA endpoints.
+//       Opaque blocks also try the two subset modes 1 and 3, blocks with
+//       alpha try the two subset mode 7 and mode 5, which keeps alpha on
+//       its own indices and can swap it with any color channel. The 64 two
+//       subset partitions are ranked by how tightly each subset gathers
+//       around its mean and only the best few are fitted for real. On x86
+//       and x64 the ranking runs on SSE2 registers four channels at a time
+//       and the index search four texels at a time.
+//
+//       A subset is fitted along its principal axis, quantized with every
+//       choice of p-bits, then solved again by least squares from the
+//       indices it got. Modes 0, 2 and 4 are decoded but never written.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include "bc7codec.h"
+#include "dxtcodec.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define BC7_SSE2
+#include <emmintrin.h>
+#endif
+
+//-----------------------------------------------------------------------------
+// Larger than any block error
+//-----------------------------------------------------------------------------
+#define BC7_MAX_ERROR 3.4e38f
+
+//-----------------------------------------------------------------------------
+// Luminance weights used by DXTC_PERCEPTUAL, the same as the DXTn encoder
+//-----------------------------------------------------------------------------
+#define BC7_LUMA_RED 0.2126f
+#define BC7_LUMA_GREEN 0.7152f
+#define BC7_LUMA_BLUE 0.0722f
+
+//-----------------------------------------------------------------------------
+// Most two subset partitions the best tier fits in full
+//-----------------------------------------------------------------------------
+#define BC7_MAX_PARTITIONS 16
+
+//-----------------------------------------------------------------------------
+// How the endpoints of a subset carry p-bits
+//-----------------------------------------------------------------------------
+#define BC7_PBIT_NONE 0
+#define BC7_PBIT_SHARED 1   // One for both endpoints
+#define BC7_PBIT_ENDPOINT 2 // One for each endpoint
+
+//-----------------------------------------------------------------------------
+// Layout of one mode
+//-----------------------------------------------------------------------------
+struct BC7Mode {
+	UINT uSubsets;
+	UINT uPartitionBits;
+	UINT uRotationBits;
+	UINT uSelectorBits;  // Mode 4 picks which index set is the color one
+	UINT uColorBits;     // Per channel of each endpoint, without the p-bit
+	UINT uAlphaBits;     // 0 if alpha is always 255
+	UINT uEndpointPBits; // 1 if each endpoint has a p-bit
+	UINT uSharedPBits;   // 1 if both endpoints of a subset share one
+	UINT uIndexBits;
+	UINT uIndexBits2;    // Second index set of modes 4 and 5
+};
+
+static const BC7Mode s_Modes[8] = {
+	{3, 4, 0, 0, 4, 0, 1, 0, 3, 0},
+	{2, 6, 0, 0, 6, 0, 0, 1, 3, 0},
+	{3, 6, 0, 0, 5, 0, 0, 0, 2, 0},
+	{2, 6, 0, 0, 7, 0, 1, 0, 2, 0},
+	{1, 0, 2, 1, 5, 6, 0, 0, 2, 3},
+	{1, 0, 2, 0, 7, 8, 0, 0, 2, 2},
+	{1, 0, 0, 0, 7, 7, 1, 0, 4, 0},
+	{2, 6, 0, 0, 5, 5, 1, 0, 2, 0}};
+
+//-----------------------------------------------------------------------------
+// Interpolation weights out of 64 for 2, 3 and 4 bit indices
+//-----------------------------------------------------------------------------
+static const UINT s_Weights2[4] = {0, 21, 43, 64};
+static const UINT s_Weights3[8] = {0, 9, 18, 27, 37, 46, 55, 64};
+static const UINT s_Weights4[16] = {
+	0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+//-----------------------------------------------------------------------------
+// Two subset partitions, bit n set if texel n is in the second subset
+//-----------------------------------------------------------------------------
+static const WORD s_Partitions2[64] = {
+	0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+	0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+	0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+	0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+	0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+	0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+	0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+	0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22,
+};
+
+//-----------------------------------------------------------------------------
+// Anchor texel of the second subset of each two subset partition
+//-----------------------------------------------------------------------------
+static const BYTE s_Anchors2[64] = {
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+	15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+	6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15,
+};
+
+//-----------------------------------------------------------------------------
+// Three subset partitions, the subset of each texel
+//-----------------------------------------------------------------------------
+static const BYTE s_Partitions3[64][16] = {
+	{0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 1, 2, 2, 2, 2},
+	{0, 0, 0, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 2, 1},
+	{0, 0, 0, 0, 2, 0, 0, 1, 2, 2, 1, 1, 2, 2, 1, 1},
+	{0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 0, 1, 1, 1},
+	{0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2},
+	{0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 2, 2},
+	{0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1},
+	{0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1},
+	{0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2},
+	{0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2},
+	{0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2},
+	{0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2},
+	{0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2},
+	{0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2},
+	{0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2, 1, 2, 2, 2},
+	{0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0, 2, 2, 2, 0},
+	{0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2},
+	{0, 1, 1, 1, 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0},
+	{0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2},
+	{0, 0, 2, 2, 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1},
+	{0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2, 0, 2, 2, 2},
+	{0, 0, 0, 1, 0, 0, 0, 1, 2, 2, 2, 1, 2, 2, 2, 1},
+	{0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2},
+	{0, 0, 0, 0, 1, 1, 0, 0, 2, 2, 1, 0, 2, 2, 1, 0},
+	{0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1, 0, 0, 0, 0},
+	{0, 0, 1, 2, 0, 0, 1, 2, 1, 1, 2, 2, 2, 2, 2, 2},
+	{0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1, 0, 1, 1, 0},
+	{0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1},
+	{0, 0, 2, 2, 1, 1, 0, 2, 1, 1, 0, 2, 0, 0, 2, 2},
+	{0, 1, 1, 0, 0, 1, 1, 0, 2, 0, 0, 2, 2, 2, 2, 2},
+	{0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1},
+	{0, 0, 0, 0, 2, 0, 0, 0, 2, 2, 1, 1, 2, 2, 2, 1},
+	{0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 2, 2, 2},
+	{0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 2, 0, 0, 1, 1},
+	{0, 0, 1, 1, 0, 0, 1, 2, 0, 0, 2, 2, 0, 2, 2, 2},
+	{0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0},
+	{0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0},
+	{0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0},
+	{0, 1, 2, 0, 2, 0, 1, 2, 1, 2, 0, 1, 0, 1, 2, 0},
+	{0, 0, 1, 1, 2, 2, 0, 0, 1, 1, 2, 2, 0, 0, 1, 1},
+	{0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0, 1, 1},
+	{0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2},
+	{0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1},
+	{0, 0, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2, 1, 1, 2, 2},
+	{0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 1, 1},
+	{0, 2, 2, 0, 1, 2, 2, 1, 0, 2, 2, 0, 1, 2, 2, 1},
+	{0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 0, 1, 0, 1},
+	{0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1},
+	{0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2},
+	{0, 2, 2, 2, 0, 1, 1, 1, 0, 2, 2, 2, 0, 1, 1, 1},
+	{0, 0, 0, 2, 1, 1, 1, 2, 0, 0, 0, 2, 1, 1, 1, 2},
+	{0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2},
+	{0, 2, 2, 2, 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2},
+	{0, 0, 0, 2, 1, 1, 1, 2, 1, 1, 1, 2, 0, 0, 0, 2},
+	{0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2},
+	{0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2},
+	{0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2, 2, 2, 2, 2},
+	{0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2},
+	{0, 0, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2},
+	{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2},
+	{0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 1},
+	{0, 2, 2, 2, 1, 2, 2, 2, 0, 2, 2, 2, 1, 2, 2, 2},
+	{0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2},
+	{0, 1, 1, 1, 2, 0, 1, 1, 2, 2, 0, 1, 2, 2, 2, 0},
+};
+
+//-----------------------------------------------------------------------------
+// Anchor texels of the second and third subsets of each three subset
+// partition
+//-----------------------------------------------------------------------------
+static const BYTE s_Anchors3Second[64] = {
+	3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+	3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+	8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+	3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3,
+};
+
+static const BYTE s_Anchors3Third[64] = {
+	15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+	15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+	15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+	15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8,
+};
+
+//-----------------------------------------------------------------------------
+// One block being encoded. The channels are kept apart so four texels fit
+// in one SSE2 register. They are red, green, blue and alpha, except that
+// mode 5's rotations swap alpha with one of the others.
+//-----------------------------------------------------------------------------
+struct BC7Block {
+	float fChannels[4][16];
+	float fWeights[4]; // Error weight of each channel
+	UINT Members[16];  // Texels inside the image
+	UINT uMembers;
+	BOOL bOpaque;      // Every texel inside the image has alpha 255
+};
+
+//-----------------------------------------------------------------------------
+// How the endpoints of one subset are stored
+//-----------------------------------------------------------------------------
+struct BC7Format {
+	UINT uFirst;    // First channel fitted
+	UINT uChannels; // Channels fitted together
+	UINT uBits;     // Bits per channel without the p-bit
+	UINT uPBits;    // BC7_PBIT_ value
+	UINT uIndexBits;
+};
+
+//-----------------------------------------------------------------------------
+// Best quantized endpoints found for one subset
+//-----------------------------------------------------------------------------
+struct BC7SubsetFit {
+	UINT Endpoints[2][4]; // Without the p-bits
+	UINT PBits[2];
+	BYTE Indices[16];     // Only the subset's texels are set
+	float fError;
+};
+
+//-----------------------------------------------------------------------------
+// A whole block in one mode, ready to write
+//-----------------------------------------------------------------------------
+struct BC7Encoding {
+	UINT uMode;
+	UINT uPartition;
+	UINT uRotation;
+	UINT Endpoints[3][2][4];
+	UINT PBits[3][2];
+	BYTE Indices[16];
+	BYTE Indices2[16]; // Mode 5 alpha
+	float fError;
+};
+
+//-----------------------------------------------------------------------------
+// Name: GetWeights()
+// Desc: Interpolation weights for indices of uBits bits
+//-----------------------------------------------------------------------------
+static const UINT* GetWeights(UINT uBits)
+{
+	return uBits == 2 ? s_Weights2 : (uBits == 3 ? s_Weights3 : s_Weights4);
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetSubset()
+// Desc: Which subset of a partition a texel is in
+//-----------------------------------------------------------------------------
+static UINT GetSubset(UINT uSubsets, UINT uPartition, UINT uTexel)
+{
+	if (uSubsets == 2) {
+		return (s_Partitions2[uPartition] >> uTexel) & 1;
+	}
+	if (uSubsets == 3) {
+		return s_Partitions3[uPartition][uTexel];
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetAnchor()
+// Desc: Texel whose index is stored one bit short in a subset
+//-----------------------------------------------------------------------------
+static UINT GetAnchor(UINT uSubsets, UINT uPartition, UINT uSubset)
+{
+	if (!uSubset) {
+		return 0;
+	}
+	if (uSubsets == 2) {
+		return s_Anchors2[uPartition];
+	}
+	return uSubset == 1 ? s_Anchors3Second[uPartition] :
+						  s_Anchors3Third[uPartition];
+}
+
+//-----------------------------------------------------------------------------
+// Name: IsAnchor()
+// Desc: 1 if the texel is the anchor of any subset, else 0
+//-----------------------------------------------------------------------------
+static UINT IsAnchor(UINT uSubsets, UINT uPartition, UINT uTexel)
+{
+	UINT s;
+
+	for (s = 0; s < uSubsets; ++s) {
+		if (GetAnchor(uSubsets, uPartition, s) == uTexel) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Name: WriteBits()
+// Desc: Append uCount bits of uValue, lowest first. The block must start
+//       cleared.
+//-----------------------------------------------------------------------------
+static void WriteBits(BYTE* pBlock, UINT* puPos, UINT uValue, UINT uCount)
+{
+	UINT uPos = *puPos;
+	UINT i;
+
+	for (i = 0; i < uCount; ++i, ++uPos) {
+		if ((uValue >> i) & 1) {
+			pBlock[uPos >> 3] |= (BYTE)(1U << (uPos & 7));
+		}
+	}
+	*puPos = uPos;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ReadBits()
+// Desc: Read uCount bits, lowest first
+//-----------------------------------------------------------------------------
+static UINT ReadBits(const BYTE* pBlock, UINT* puPos, UINT uCount)
+{
+	UINT uPos = *puPos;
+	UINT uValue = 0;
+	UINT i;
+
+	for (i = 0; i < uCount; ++i, ++uPos) {
+		uValue |= ((pBlock[uPos >> 3] >> (uPos & 7)) & 1U) << i;
+	}
+	*puPos = uPos;
+	return uValue;
+}
+
+//-----------------------------------------------------------------------------
+// Name: Expand()
+// Desc: Widen a uBits bit endpoint channel, p-bit included, to 8 bits by
+//       repeating its top bits
+//-----------------------------------------------------------------------------
+static UINT Expand(UINT uValue, UINT uBits)
+{
+	uValue <<= 8 - uBits;
+	return uValue | (uValue >> uBits);
+}
+
+//-----------------------------------------------------------------------------
+// Name: Interpolate()
+// Desc: Blend two 8 bit endpoints by a weight out of 64
+//-----------------------------------------------------------------------------
+static UINT Interpolate(UINT uLow, UINT uHigh, UINT uWeight)
+{
+	return ((uLow * (64 - uWeight)) + (uHigh * uWeight) + 32) >> 6;
+}
+
+//-----------------------------------------------------------------------------
+// Name: InitBlock()
+// Desc: Split the texels into channels and list the ones inside the image.
+//       Returns TRUE if any of them isn't opaque.
+//-----------------------------------------------------------------------------
+static BOOL InitBlock(
+	BC7Block* pBlock, const DWORD* pdwTexels, DWORD dwMask, DWORD dwFlags)
+{
+	BOOL bAlpha = FALSE;
+	UINT i;
+
+	if (dwFlags & DXTC_PERCEPTUAL) {
+		pBlock->fWeights[0] = BC7_LUMA_RED * BC7_LUMA_RED;
+		pBlock->fWeights[1] = BC7_LUMA_GREEN * BC7_LUMA_GREEN;
+		pBlock->fWeights[2] = BC7_LUMA_BLUE * BC7_LUMA_BLUE;
+	} else {
+		pBlock->fWeights[0] = 1.0f;
+		pBlock->fWeights[1] = 1.0f;
+		pBlock->fWeights[2] = 1.0f;
+	}
+	pBlock->fWeights[3] = 1.0f;
+
+	pBlock->uMembers = 0;
+	for (i = 0; i < 16; ++i) {
+		DWORD dwTexel = pdwTexels[i];
+
+		pBlock->fChannels[0][i] = (float)((dwTexel >> 16) & 0xFF);
+		pBlock->fChannels[1][i] = (float)((dwTexel >> 8) & 0xFF);
+		pBlock->fChannels[2][i] = (float)(dwTexel & 0xFF);
+		pBlock->fChannels[3][i] = (float)(dwTexel >> 24);
+		if (dwMask & (1U << i)) {
+			pBlock->Members[pBlock->uMembers++] = i;
+			if ((dwTexel >> 24) != 0xFF) {
+				bAlpha = TRUE;
+			}
+		}
+	}
+	pBlock->bOpaque = !bAlpha;
+	return bAlpha;
+}
+
+//-----------------------------------------------------------------------------
+// Name: RotateBlock()
+// Desc: Copy of a block with alpha swapped with red (1), green (2) or blue
+//       (3), the way mode 5 stores it
+//-----------------------------------------------------------------------------
+static void RotateBlock(
+	const BC7Block* pBlock, UINT uRotation, BC7Block* pRotated)
+{
+	UINT uOther = uRotation - 1;
+
+	*pRotated = *pBlock;
+	memcpy(pRotated->fChannels[uOther], pBlock->fChannels[3],
+		sizeof(pBlock->fChannels[3]));
+	memcpy(pRotated->fChannels[3], pBlock->fChannels[uOther],
+		sizeof(pBlock->fChannels[3]));
+	pRotated->fWeights[uOther] = pBlock->fWeights[3];
+	pRotated->fWeights[3] = pBlock->fWeights[uOther];
+}
+
+//-----------------------------------------------------------------------------
+// Name: RankPartitions()
+// Desc: Find the uCount two subset partitions that leave the least squared
+//       error around each subset's mean over the first uChannels channels.
+//       That error is the total spread minus sum^2 / count of each subset,
+//       so the best partitions have the largest sum^2 / count. Returns how
+//       many were stored in pBest, best first.
+//-----------------------------------------------------------------------------
+static UINT RankPartitions(
+	const BC7Block* pBlock, UINT uChannels, UINT* pBest, UINT uCount)
+{
+	float fScores[BC7_MAX_PARTITIONS];
+	DWORD dwMembers = 0;
+	UINT uFound = 0;
+	UINT uPartition;
+	UINT i;
+
+#if defined(BC7_SSE2)
+	__m128 Texels[16];
+	__m128 Total = _mm_setzero_ps();
+	__m128 Weights = _mm_setr_ps(pBlock->fWeights[0], pBlock->fWeights[1],
+		pBlock->fWeights[2], uChannels > 3 ? pBlock->fWeights[3] : 0.0f);
+
+	for (i = 0; i < 16; ++i) {
+		Texels[i] = _mm_setzero_ps();
+	}
+	for (i = 0; i < pBlock->uMembers; ++i) {
+		UINT uTexel = pBlock->Members[i];
+		Texels[uTexel] = _mm_setr_ps(pBlock->fChannels[0][uTexel],
+			pBlock->fChannels[1][uTexel], pBlock->fChannels[2][uTexel],
+			pBlock->fChannels[3][uTexel]);
+		Total = _mm_add_ps(Total, Texels[uTexel]);
+		dwMembers |= 1U << uTexel;
+	}
+#else
+	float fTotal[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	UINT c;
+
+	for (i = 0; i < pBlock->uMembers; ++i) {
+		UINT uTexel = pBlock->Members[i];
+		for (c = 0; c < uChannels; ++c) {
+			fTotal[c] += pBlock->fChannels[c][uTexel];
+		}
+		dwMembers |= 1U << uTexel;
+	}
+#endif
+
+	for (uPartition = 0; uPartition < 64; ++uPartition) {
+		DWORD dwSecond = s_Partitions2[uPartition] & dwMembers;
+		UINT uSecond = 0;
+		UINT uFirst;
+		float fScore = 0.0f;
+		float fSums[2][4];
+
+		for (i = 0; i < 16; ++i) {
+			uSecond += (dwSecond >> i) & 1;
+		}
+		uFirst = pBlock->uMembers - uSecond;
+
+#if defined(BC7_SSE2)
+		{
+			__m128 Sum = _mm_setzero_ps();
+			__m128 Ones = _mm_cmpeq_ps(Sum, Sum);
+			for (i = 0; i < 16; ++i) {
+				__m128 Select = ((dwSecond >> i) & 1) ? Ones : _mm_setzero_ps();
+				Sum = _mm_add_ps(Sum, _mm_and_ps(Texels[i], Select));
+			}
+			_mm_storeu_ps(fSums[1], _mm_mul_ps(_mm_mul_ps(Sum, Sum), Weights));
+			Sum = _mm_sub_ps(Total, Sum);
+			_mm_storeu_ps(fSums[0], _mm_mul_ps(_mm_mul_ps(Sum, Sum), Weights));
+		}
+		if (uFirst) {
+			fScore += (fSums[0][0] + fSums[0][1] + fSums[0][2] + fSums[0][3]) /
+				(float)uFirst;
+		}
+		if (uSecond) {
+			fScore += (fSums[1][0] + fSums[1][1] + fSums[1][2] + fSums[1][3]) /
+				(float)uSecond;
+		}
+#else
+		for (c = 0; c < uChannels; ++c) {
+			fSums[1][c] = 0.0f;
+		}
+		for (i = 0; i < 16; ++i) {
+			if ((dwSecond >> i) & 1) {
+				for (c = 0; c < uChannels; ++c) {
+					fSums[1][c] += pBlock->fChannels[c][i];
+				}
+			}
+		}
+		for (c = 0; c < uChannels; ++c) {
+			float fFirst = fTotal[c] - fSums[1][c];
+			if (uFirst) {
+				fScore += pBlock->fWeights[c] * fFirst * fFirst / (float)uFirst;
+			}
+			if (uSecond) {
+				fScore += pBlock->fWeights[c] * fSums[1][c] * fSums[1][c] /
+					(float)uSecond;
+			}
+		}
+#endif
+
+		// Insert into the sorted list of the best ones
+		for (i = uFound; i && fScores[i - 1] < fScore; --i) {
+			if (i < uCount) {
+				fScores[i] = fScores[i - 1];
+				pBest[i] = pBest[i - 1];
+			}
+		}
+		if (i < uCount) {
+			fScores[i] = fScore;
+			pBest[i] = uPartition;
+			if (uFound < uCount) {
+				++uFound;
+			}
+		}
+	}
+	return uFound;
+}
+
+//-----------------------------------------------------------------------------
+// Name: FitIndices()
+// Desc: Nearest palette entry of all 16 texels over the given channels and
+//       its weighted squared error
+//-----------------------------------------------------------------------------
+static void FitIndices(const BC7Block* pBlock, const BC7Format* pFormat,
+	const float (*pPalette)[4], UINT uEntries, BYTE* pIndices, float* pErrors)
+{
+	UINT uLast = pFormat->uFirst + pFormat->uChannels;
+	UINT i;
+	UINT k;
+	UINT c;
+
+#if defined(BC7_SSE2)
+	for (i = 0; i < 16; i += 4) {
+		__m128 Best = _mm_set1_ps(BC7_MAX_ERROR);
+		__m128 BestIndex = _mm_setzero_ps();
+		int Indices[4];
+
+		for (k = 0; k < uEntries; ++k) {
+			__m128 Error = _mm_setzero_ps();
+			__m128 Less;
+			for (c = pFormat->uFirst; c < uLast; ++c) {
+				__m128 Delta = _mm_sub_ps(_mm_loadu_ps(&pBlock->fChannels[c][i]),
+					_mm_set1_ps(pPalette[k][c]));
+				Error = _mm_add_ps(Error, _mm_mul_ps(_mm_mul_ps(Delta, Delta),
+											  _mm_set1_ps(pBlock->fWeights[c])));
+			}
+			Less = _mm_cmplt_ps(Error, Best);
+			Best = _mm_min_ps(Error, Best);
+			BestIndex = _mm_or_ps(_mm_andnot_ps(Less, BestIndex),
+				_mm_and_ps(Less, _mm_set1_ps((float)k)));
+		}
+		_mm_storeu_ps(&pErrors[i], Best);
+		_mm_storeu_si128((__m128i*)Indices, _mm_cvttps_epi32(BestIndex));
+		pIndices[i] = (BYTE)Indices[0];
+		pIndices[i + 1] = (BYTE)Indices[1];
+		pIndices[i + 2] = (BYTE)Indices[2];
+		pIndices[i + 3] = (BYTE)Indices[3];
+	}
+#else
+	for (i = 0; i < 16; ++i) {
+		float fBest = BC7_MAX_ERROR;
+		UINT uBest = 0;
+
+		for (k = 0; k < uEntries; ++k) {
+			float fError = 0.0f;
+			for (c = pFormat->uFirst; c < uLast; ++c) {
+				float fDelta = pBlock->fChannels[c][i] - pPalette[k][c];
+				fError += fDelta * fDelta * pBlock->fWeights[c];
+			}
+			if (fError < fBest) {
+				fBest = fError;
+				uBest = k;
+			}
+		}
+		pIndices[i] = (BYTE)uBest;
+		pErrors[i] = fBest;
+	}
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Name: EvaluateSubset()
+// Desc: Build the palette a decoder would from quantized endpoints, pick
+//       the indices of the subset's texels and return their error
+//-----------------------------------------------------------------------------
+static float EvaluateSubset(const BC7Block* pBlock, const BC7Format* pFormat,
+	const UINT* pMembers, UINT uCount, const UINT (*pEndpoints)[4],
+	const UINT* pPBits, BYTE* pIndices)
+{
+	float fPalette[16][4];
+	BYTE Indices[16];
+	float fErrors[16];
+	UINT Expanded[2][4];
+	const UINT* pWeights = GetWeights(pFormat->uIndexBits);
+	UINT uEntries = 1U << pFormat->uIndexBits;
+	UINT uLast = pFormat->uFirst + pFormat->uChannels;
+	UINT uBits = pFormat->uBits;
+	float fError = 0.0f;
+	UINT e;
+	UINT c;
+	UINT k;
+	UINT i;
+
+	for (e = 0; e < 2; ++e) {
+		for (c = pFormat->uFirst; c < uLast; ++c) {
+			if (pFormat->uPBits == BC7_PBIT_NONE) {
+				Expanded[e][c] = Expand(pEndpoints[e][c], uBits);
+			} else {
+				Expanded[e][c] =
+					Expand((pEndpoints[e][c] << 1) | pPBits[e], uBits + 1);
+			}
+		}
+	}
+	for (k = 0; k < uEntries; ++k) {
+		for (c = pFormat->uFirst; c < uLast; ++c) {
+			fPalette[k][c] = (float)Interpolate(
+				Expanded[0][c], Expanded[1][c], pWeights[k]);
+		}
+	}
+
+	FitIndices(pBlock, pFormat, fPalette, uEntries, Indices, fErrors);
+	for (i = 0; i < uCount; ++i) {
+		UINT uTexel = pMembers[i];
+		pIndices[uTexel] = Indices[uTexel];
+		fError += fErrors[uTexel];
+	}
+	return fError;
+}
+
+//-----------------------------------------------------------------------------
+// Name: QuantizeChannel()
+// Desc: Nearest stored value of an endpoint channel, keeping to the given
+//       p-bit if there is one
+//-----------------------------------------------------------------------------
+static UINT QuantizeChannel(float fValue, UINT uBits, UINT uPBit, BOOL bPBit)
+{
+	int iMax = (1 << uBits) - 1;
+	int iValue;
+
+	if (bPBit) {
+		float fScaled = fValue * (float)((2 << uBits) - 1) / 255.0f;
+		iValue = (int)floorf(((fScaled - (float)uPBit) * 0.5f) + 0.5f);
+	} else {
+		iValue = (int)((fValue * (float)iMax / 255.0f) + 0.5f);
+	}
+	return (UINT)(iValue < 0 ? 0 : (iValue > iMax ? iMax : iValue));
+}
+
+//-----------------------------------------------------------------------------
+// Name: QuantizeSubset()
+// Desc: Quantize a pair of endpoints with every p-bit choice the format
+//       has. Returns TRUE if one of them beat pFit, which is updated.
+//-----------------------------------------------------------------------------
+static BOOL QuantizeSubset(const BC7Block* pBlock, const BC7Format* pFormat,
+	const UINT* pMembers, UINT uCount, const float* pLow, const float* pHigh,
+	BC7SubsetFit* pFit)
+{
+	UINT Endpoints[2][4];
+	UINT PBits[2];
+	BYTE Indices[16];
+	UINT uLast = pFormat->uFirst + pFormat->uChannels;
+	BOOL bPBit = pFormat->uPBits != BC7_PBIT_NONE;
+	UINT uChoices = pFormat->uPBits == BC7_PBIT_ENDPOINT ?
+		4 :
+		(pFormat->uPBits == BC7_PBIT_SHARED ? 2 : 1);
+	BOOL bBetter = FALSE;
+	UINT uChoice = 0;
+	UINT c;
+	UINT i;
+
+	// Alpha is only 255 with p-bits of 1, and an opaque block has to stay
+	// opaque even where another choice would fit the color better
+	if (pBlock->bOpaque && bPBit && (uLast == 4)) {
+		uChoice = uChoices - 1;
+	}
+	for (; uChoice < uChoices; ++uChoice) {
+		float fError;
+
+		PBits[0] = uChoice & 1;
+		PBits[1] = pFormat->uPBits == BC7_PBIT_ENDPOINT ? uChoice >> 1 : uChoice;
+		for (c = pFormat->uFirst; c < uLast; ++c) {
+			Endpoints[0][c] =
+				QuantizeChannel(pLow[c], pFormat->uBits, PBits[0], bPBit);
+			Endpoints[1][c] =
+				QuantizeChannel(pHigh[c], pFormat->uBits, PBits[1], bPBit);
+		}
+		fError = EvaluateSubset(
+			pBlock, pFormat, pMembers, uCount, Endpoints, PBits, Indices);
+		if (fError < pFit->fError) {
+			pFit->fError = fError;
+			for (c = pFormat->uFirst; c < uLast; ++c) {
+				pFit->Endpoints[0][c] = Endpoints[0][c];
+				pFit->Endpoints[1][c] = Endpoints[1][c];
+			}
+			pFit->PBits[0] = PBits[0];
+			pFit->PBits[1] = PBits[1];
+			for (i = 0; i < uCount; ++i) {
+				pFit->Indices[pMembers[i]] = Indices[pMembers[i]];
+			}
+			bBetter = TRUE;
+		}
+	}
+	return bBetter;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ComputeAxis()
+// Desc: Mean and unit principal axis of a subset's texels, by power
+//       iteration on their covariance
+//-----------------------------------------------------------------------------
+static void ComputeAxis(const BC7Block* pBlock, const BC7Format* pFormat,
+	const UINT* pMembers, UINT uCount, float* pMean, float* pAxis)
+{
+	float fCovariance[4][4];
+	float fLength = 0.0f;
+	UINT uFirst = pFormat->uFirst;
+	UINT uLast = uFirst + pFormat->uChannels;
+	UINT uPass;
+	UINT i;
+	UINT c;
+	UINT d;
+
+	for (c = uFirst; c < uLast; ++c) {
+		float fSum = 0.0f;
+		for (i = 0; i < uCount; ++i) {
+			fSum += pBlock->fChannels[c][pMembers[i]];
+		}
+		pMean[c] = fSum / (float)uCount;
+	}
+	for (c = uFirst; c < uLast; ++c) {
+		for (d = c; d < uLast; ++d) {
+			float fSum = 0.0f;
+			for (i = 0; i < uCount; ++i) {
+				UINT uTexel = pMembers[i];
+				fSum += (pBlock->fChannels[c][uTexel] - pMean[c]) *
+					(pBlock->fChannels[d][uTexel] - pMean[d]);
+			}
+			fCovariance[c][d] = fSum;
+			fCovariance[d][c] = fSum;
+		}
+	}
+
+	// Start from the channel that varies most
+	d = uFirst;
+	for (c = uFirst; c < uLast; ++c) {
+		pAxis[c] = 0.0f;
+		if (fCovariance[c][c] > fCovariance[d][d]) {
+			d = c;
+		}
+	}
+	pAxis[d] = 1.0f;
+	for (uPass = 0; uPass < 8; ++uPass) {
+		float fNext[4];
+		float fLargest = 0.0f;
+		for (c = uFirst; c < uLast; ++c) {
+			fNext[c] = 0.0f;
+			for (d = uFirst; d < uLast; ++d) {
+				fNext[c] += fCovariance[c][d] * pAxis[d];
+			}
+			if (fabsf(fNext[c]) > fLargest) {
+				fLargest = fabsf(fNext[c]);
+			}
+		}
+		if (fLargest <= 0.0f) {
+			break;
+		}
+		for (c = uFirst; c < uLast; ++c) {
+			pAxis[c] = fNext[c] / fLargest;
+		}
+	}
+
+	for (c = uFirst; c < uLast; ++c) {
+		fLength += pAxis[c] * pAxis[c];
+	}
+	fLength = fLength > 0.0f ? 1.0f / sqrtf(fLength) : 0.0f;
+	for (c = uFirst; c < uLast; ++c) {
+		pAxis[c] *= fLength;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: SolveEndpoints()
+// Desc: Least squares endpoints for the indices in pFit. Returns FALSE if
+//       every texel has the same weight and there's nothing to solve.
+//-----------------------------------------------------------------------------
+static BOOL SolveEndpoints(const BC7Block* pBlock, const BC7Format* pFormat,
+	const UINT* pMembers, UINT uCount, const BC7SubsetFit* pFit, float* pLow,
+	float* pHigh)
+{
+	float fLowX[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	float fHighX[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	float fLowLow = 0.0f;
+	float fLowHigh = 0.0f;
+	float fHighHigh = 0.0f;
+	const UINT* pWeights = GetWeights(pFormat->uIndexBits);
+	UINT uLast = pFormat->uFirst + pFormat->uChannels;
+	float fDeterminant;
+	UINT i;
+	UINT c;
+
+	for (i = 0; i < uCount; ++i) {
+		UINT uTexel = pMembers[i];
+		float fHigh = (float)pWeights[pFit->Indices[uTexel]] / 64.0f;
+		float fLow = 1.0f - fHigh;
+
+		fLowLow += fLow * fLow;
+		fLowHigh += fLow * fHigh;
+		fHighHigh += fHigh * fHigh;
+		for (c = pFormat->uFirst; c < uLast; ++c) {
+			fLowX[c] += fLow * pBlock->fChannels[c][uTexel];
+			fHighX[c] += fHigh * pBlock->fChannels[c][uTexel];
+		}
+	}
+
+	fDeterminant = (fLowLow * fHighHigh) - (fLowHigh * fLowHigh);
+	if (fabsf(fDeterminant) < 1e-6f) {
+		return FALSE;
+	}
+	fDeterminant = 1.0f / fDeterminant;
+	for (c = pFormat->uFirst; c < uLast; ++c) {
+		float fLow = ((fLowX[c] * fHighHigh) - (fHighX[c] * fLowHigh)) *
+			fDeterminant;
+		float fHigh = ((fHighX[c] * fLowLow) - (fLowX[c] * fLowHigh)) *
+			fDeterminant;
+		pLow[c] = fLow < 0.0f ? 0.0f : (fLow > 255.0f ? 255.0f : fLow);
+		pHigh[c] = fHigh < 0.0f ? 0.0f : (fHigh > 255.0f ? 255.0f : fHigh);
+	}
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: FitSubset()
+// Desc: Endpoints for one subset from the extremes along its principal
+//       axis, then uRefines rounds of least squares on the indices found
+//-----------------------------------------------------------------------------
+static void FitSubset(const BC7Block* pBlock, const BC7Format* pFormat,
+	const UINT* pMembers, UINT uCount, UINT uRefines, BC7SubsetFit* pFit)
+{
+	float fMean[4];
+	float fAxis[4];
+	float fLow[4];
+	float fHigh[4];
+	float fMin = 0.0f;
+	float fMax = 0.0f;
+	UINT uLast = pFormat->uFirst + pFormat->uChannels;
+	UINT i;
+	UINT c;
+
+	memset(pFit, 0, sizeof(*pFit));
+	if (!uCount) {
+		return;
+	}
+	pFit->fError = BC7_MAX_ERROR;
+
+	ComputeAxis(pBlock, pFormat, pMembers, uCount, fMean, fAxis);
+	for (i = 0; i < uCount; ++i) {
+		float fDot = 0.0f;
+		for (c = pFormat->uFirst; c < uLast; ++c) {
+			fDot += (pBlock->fChannels[c][pMembers[i]] - fMean[c]) * fAxis[c];
+		}
+		if (!i || fDot < fMin) {
+			fMin = fDot;
+		}
+		if (!i || fDot > fMax) {
+			fMax = fDot;
+		}
+	}
+	for (c = pFormat->uFirst; c < uLast; ++c) {
+		float fValue = fMean[c] + (fAxis[c] * fMin);
+		fLow[c] = fValue < 0.0f ? 0.0f : (fValue > 255.0f ? 255.0f : fValue);
+		fValue = fMean[c] + (fAxis[c] * fMax);
+		fHigh[c] = fValue < 0.0f ? 0.0f : (fValue > 255.0f ? 255.0f : fValue);
+	}
+	QuantizeSubset(pBlock, pFormat, pMembers, uCount, fLow, fHigh, pFit);
+
+	for (i = 0; i < uRefines && pFit->fError > 0.0f; ++i) {
+		if (!SolveEndpoints(
+				pBlock, pFormat, pMembers, uCount, pFit, fLow, fHigh) ||
+			!QuantizeSubset(
+				pBlock, pFormat, pMembers, uCount, fLow, fHigh, pFit)) {
+			break;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: TryMode()
+// Desc: Encode the block in mode 1, 3, 5, 6 or 7 and keep it in pBest if
+//       it has less error. Modes 1 and 3 ignore alpha, so they are only
+//       for opaque blocks.
+//-----------------------------------------------------------------------------
+static void TryMode(const BC7Block* pBlock, UINT uMode, UINT uPartition,
+	UINT uRotation, UINT uRefines, BC7Encoding* pBest)
+{
+	const BC7Mode* pMode = &s_Modes[uMode];
+	BC7Encoding Encoding;
+	BC7Format Format;
+	BC7SubsetFit Fit;
+	UINT Members[16];
+	float fError = 0.0f;
+	UINT s;
+	UINT e;
+	UINT c;
+	UINT i;
+
+	memset(&Encoding, 0, sizeof(Encoding));
+	Encoding.uMode = uMode;
+	Encoding.uPartition = uPartition;
+	Encoding.uRotation = uRotation;
+
+	// Alpha goes with the color unless it has indices of its own
+	Format.uFirst = 0;
+	Format.uChannels = (pMode->uAlphaBits && !pMode->uIndexBits2) ? 4 : 3;
+	Format.uBits = pMode->uColorBits;
+	Format.uPBits = pMode->uEndpointPBits ?
+		BC7_PBIT_ENDPOINT :
+		(pMode->uSharedPBits ? BC7_PBIT_SHARED : BC7_PBIT_NONE);
+	Format.uIndexBits = pMode->uIndexBits;
+
+	for (s = 0; s < pMode->uSubsets; ++s) {
+		UINT uCount = 0;
+		for (i = 0; i < pBlock->uMembers; ++i) {
+			UINT uTexel = pBlock->Members[i];
+			if (GetSubset(pMode->uSubsets, uPartition, uTexel) == s) {
+				Members[uCount++] = uTexel;
+			}
+		}
+		FitSubset(pBlock, &Format, Members, uCount, uRefines, &Fit);
+		fError += Fit.fError;
+		if (fError >= pBest->fError) {
+			return;
+		}
+		for (e = 0; e < 2; ++e) {
+			for (c = 0; c < Format.uChannels; ++c) {
+				Encoding.Endpoints[s][e][c] = Fit.Endpoints[e][c];
+			}
+			Encoding.PBits[s][e] = Fit.PBits[e];
+		}
+		for (i = 0; i < uCount; ++i) {
+			Encoding.Indices[Members[i]] = Fit.Indices[Members[i]];
+		}
+	}
+
+	if (pMode->uIndexBits2) {
+		Format.uFirst = 3;
+		Format.uChannels = 1;
+		Format.uBits = pMode->uAlphaBits;
+		Format.uPBits = BC7_PBIT_NONE;
+		Format.uIndexBits = pMode->uIndexBits2;
+		FitSubset(pBlock, &Format, pBlock->Members, pBlock->uMembers,
+			uRefines, &Fit);
+		fError += Fit.fError;
+		if (fError >= pBest->fError) {
+			return;
+		}
+		Encoding.Endpoints[0][0][3] = Fit.Endpoints[0][3];
+		Encoding.Endpoints[0][1][3] = Fit.Endpoints[1][3];
+		for (i = 0; i < pBlock->uMembers; ++i) {
+			Encoding.Indices2[pBlock->Members[i]] =
+				Fit.Indices[pBlock->Members[i]];
+		}
+	}
+
+	Encoding.fError = fError;
+	*pBest = Encoding;
+}
+
+//-----------------------------------------------------------------------------
+// Name: WriteBlock()
+// Desc: Pack an encoding into 16 bytes. The anchor index of each subset
+//       must have its top bit clear, subsets where it doesn't get their
+//       endpoints swapped and their indices flipped first.
+//-----------------------------------------------------------------------------
+static void WriteBlock(BC7Encoding* pEncoding, BYTE* pOutput)
+{
+	const BC7Mode* pMode = &s_Modes[pEncoding->uMode];
+	UINT uSubsets = pMode->uSubsets;
+	UINT uPartition = pEncoding->uPartition;
+	UINT uMax = (1U << pMode->uIndexBits) - 1;
+	UINT uPos = 0;
+	UINT s;
+	UINT e;
+	UINT c;
+	UINT i;
+
+	for (s = 0; s < uSubsets; ++s) {
+		UINT uAnchor = GetAnchor(uSubsets, uPartition, s);
+		if (pEncoding->Indices[uAnchor] <= (uMax >> 1)) {
+			continue;
+		}
+		// Mode 5's alpha has its own indices and is checked below
+		for (c = 0; c < (pMode->uIndexBits2 ? 3U : 4U); ++c) {
+			UINT uTemp = pEncoding->Endpoints[s][0][c];
+			pEncoding->Endpoints[s][0][c] = pEncoding->Endpoints[s][1][c];
+			pEncoding->Endpoints[s][1][c] = uTemp;
+		}
+		e = pEncoding->PBits[s][0];
+		pEncoding->PBits[s][0] = pEncoding->PBits[s][1];
+		pEncoding->PBits[s][1] = e;
+		for (i = 0; i < 16; ++i) {
+			if (GetSubset(uSubsets, uPartition, i) == s) {
+				pEncoding->Indices[i] = (BYTE)(uMax - pEncoding->Indices[i]);
+			}
+		}
+	}
+	if (pMode->uIndexBits2) {
+		UINT uMax2 = (1U << pMode->uIndexBits2) - 1;
+		if (pEncoding->Indices2[0] > (uMax2 >> 1)) {
+			UINT uTemp = pEncoding->Endpoints[0][0][3];
+			pEncoding->Endpoints[0][0][3] = pEncoding->Endpoints[0][1][3];
+			pEncoding->Endpoints[0][1][3] = uTemp;
+			for (i = 0; i < 16; ++i) {
+				pEncoding->Indices2[i] = (BYTE)(uMax2 - pEncoding->Indices2[i]);
+			}
+		}
+	}
+
+	memset(pOutput, 0, 16);
+	WriteBits(pOutput, &uPos, 1U << pEncoding->uMode, pEncoding->uMode + 1);
+	WriteBits(pOutput, &uPos, uPartition, pMode->uPartitionBits);
+	WriteBits(pOutput, &uPos, pEncoding->uRotation, pMode->uRotationBits);
+	WriteBits(pOutput, &uPos, 0, pMode->uSelectorBits);
+	for (c = 0; c < 3; ++c) {
+		for (s = 0; s < uSubsets; ++s) {
+			for (e = 0; e < 2; ++e) {
+				WriteBits(pOutput, &uPos, pEncoding->Endpoints[s][e][c],
+					pMode->uColorBits);
+			}
+		}
+	}
+	for (s = 0; s < uSubsets; ++s) {
+		for (e = 0; e < 2; ++e) {
+			WriteBits(pOutput, &uPos, pEncoding->Endpoints[s][e][3],
+				pMode->uAlphaBits);
+		}
+	}
+	for (s = 0; s < uSubsets; ++s) {
+		for (e = 0; e < 2; ++e) {
+			WriteBits(pOutput, &uPos, pEncoding->PBits[s][e],
+				pMode->uEndpointPBits);
+		}
+		WriteBits(pOutput, &uPos, pEncoding->PBits[s][0], pMode->uSharedPBits);
+	}
+	for (i = 0; i < 16; ++i) {
+		WriteBits(pOutput, &uPos, pEncoding->Indices[i],
+			pMode->uIndexBits - IsAnchor(uSubsets, uPartition, i));
+	}
+	if (pMode->uIndexBits2) {
+		for (i = 0; i < 16; ++i) {
+			WriteBits(pOutput, &uPos, pEncoding->Indices2[i],
+				pMode->uIndexBits2 - (i ? 0 : 1));
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: BC7CompressBlock()
+// Desc: Encode 16 ARGB texels, in rows of four, as one BC7 block. Texels
+//       whose bit in dwMask is clear lie outside the image and are ignored.
+//       dwFit is the one DXTC_FIT_ flag in effect, the box fit only tries
+//       mode 6 and the slower fits try more partitions, rotations and least
+//       squares rounds. DXTC_PERCEPTUAL is the only other flag used.
+//-----------------------------------------------------------------------------
+void BC7CompressBlock(const DWORD* pdwTexels, DWORD dwMask, DWORD dwFit,
+	DWORD dwFlags, void* pBlock)
+{
+	BC7Block Block;
+	BC7Block Rotated;
+	BC7Encoding Best;
+	UINT Partitions[BC7_MAX_PARTITIONS];
+	UINT uPartitions;
+	UINT uRefines;
+	UINT uRotations;
+	UINT uFound;
+	BOOL bAlpha;
+	UINT i;
+
+	switch (dwFit) {
+	case DXTC_FIT_BOX:
+		uPartitions = 0;
+		uRefines = 0;
+		uRotations = 0;
+		break;
+	case DXTC_FIT_RANGE:
+		uPartitions = 1;
+		uRefines = 1;
+		uRotations = 0;
+		break;
+	case DXTC_FIT_REFINE:
+		uPartitions = BC7_MAX_PARTITIONS;
+		uRefines = 4;
+		uRotations = 3;
+		break;
+	default:
+		uPartitions = 4;
+		uRefines = 2;
+		uRotations = 3;
+		break;
+	}
+
+	bAlpha = InitBlock(&Block, pdwTexels, dwMask, dwFlags);
+	Best.fError = BC7_MAX_ERROR;
+	TryMode(&Block, 6, 0, 0, uRefines, &Best);
+
+	if (uPartitions && Best.fError > 0.0f) {
+		uFound = RankPartitions(&Block, bAlpha ? 4 : 3, Partitions, uPartitions);
+		for (i = 0; i < uFound && Best.fError > 0.0f; ++i) {
+			if (bAlpha) {
+				TryMode(&Block, 7, Partitions[i], 0, uRefines, &Best);
+			} else {
+				TryMode(&Block, 1, Partitions[i], 0, uRefines, &Best);
+				TryMode(&Block, 3, Partitions[i], 0, uRefines, &Best);
+			}
+		}
+		if (bAlpha) {
+			TryMode(&Block, 5, 0, 0, uRefines, &Best);
+			for (i = 1; i <= uRotations && Best.fError > 0.0f; ++i) {
+				RotateBlock(&Block, i, &Rotated);
+				TryMode(&Rotated, 5, 0, i, uRefines, &Best);
+			}
+		}
+	}
+	WriteBlock(&Best, (BYTE*)pBlock);
+
+#ifdef _DEBUG
+	if (!bAlpha) {
+		DWORD Decoded[16];
+		BC7DecompressBlock(pBlock, Decoded);
+		for (i = 0; i < 16; ++i) {
+			if ((dwMask & (1U << i)) && ((Decoded[i] >> 24) != 0xFF)) {
+				OutputDebugStringA(
+					"BC7CompressBlock: opaque block lost alpha\n");
+				break;
+			}
+		}
+	}
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Name: BC7DecompressBlock()
+// Desc: Decode one block of any mode to 16 ARGB texels. The reserved mode
+//       decodes to transparent black.
+//-----------------------------------------------------------------------------
+void BC7DecompressBlock(const void* pBlock, DWORD* pdwTexels)
+{
+	const BYTE* pBytes = (const BYTE*)pBlock;
+	const BC7Mode* pMode;
+	UINT Endpoints[3][2][4];
+	BYTE Indices[16];
+	BYTE Indices2[16];
+	const BYTE* pColorIndices = Indices;
+	const BYTE* pAlphaIndices = Indices;
+	const UINT* pColorWeights;
+	const UINT* pAlphaWeights;
+	UINT uMode = 0;
+	UINT uPos;
+	UINT uPartition;
+	UINT uRotation;
+	UINT uSelector;
+	UINT uColorBits;
+	UINT uAlphaBits;
+	UINT s;
+	UINT e;
+	UINT c;
+	UINT i;
+
+	memset(Endpoints, 0, sizeof(Endpoints));
+	while (uMode < 8 && !((pBytes[0] >> uMode) & 1)) {
+		++uMode;
+	}
+	if (uMode == 8) {
+		for (i = 0; i < 16; ++i) {
+			pdwTexels[i] = 0;
+		}
+		return;
+	}
+	pMode = &s_Modes[uMode];
+	uPos = uMode + 1;
+	uPartition = ReadBits(pBytes, &uPos, pMode->uPartitionBits);
+	uRotation = ReadBits(pBytes, &uPos, pMode->uRotationBits);
+	uSelector = ReadBits(pBytes, &uPos, pMode->uSelectorBits);
+
+	for (c = 0; c < 3; ++c) {
+		for (s = 0; s < pMode->uSubsets; ++s) {
+			for (e = 0; e < 2; ++e) {
+				Endpoints[s][e][c] = ReadBits(pBytes, &uPos, pMode->uColorBits);
+			}
+		}
+	}
+	for (s = 0; s < pMode->uSubsets; ++s) {
+		for (e = 0; e < 2; ++e) {
+			Endpoints[s][e][3] = ReadBits(pBytes, &uPos, pMode->uAlphaBits);
+		}
+	}
+
+	// P-bits become the lowest bit of every channel of their endpoints
+	uColorBits = pMode->uColorBits;
+	uAlphaBits = pMode->uAlphaBits;
+	if (pMode->uEndpointPBits || pMode->uSharedPBits) {
+		for (s = 0; s < pMode->uSubsets; ++s) {
+			UINT PBits[2];
+			PBits[0] = ReadBits(pBytes, &uPos, 1);
+			PBits[1] = pMode->uEndpointPBits ? ReadBits(pBytes, &uPos, 1) :
+											   PBits[0];
+			for (e = 0; e < 2; ++e) {
+				for (c = 0; c < 4; ++c) {
+					Endpoints[s][e][c] = (Endpoints[s][e][c] << 1) | PBits[e];
+				}
+			}
+		}
+		++uColorBits;
+		if (uAlphaBits) {
+			++uAlphaBits;
+		}
+	}
+	for (s = 0; s < pMode->uSubsets; ++s) {
+		for (e = 0; e < 2; ++e) {
+			for (c = 0; c < 3; ++c) {
+				Endpoints[s][e][c] = Expand(Endpoints[s][e][c], uColorBits);
+			}
+			Endpoints[s][e][3] =
+				uAlphaBits ? Expand(Endpoints[s][e][3], uAlphaBits) : 255;
+		}
+	}
+
+	for (i = 0; i < 16; ++i) {
+		Indices[i] = (BYTE)ReadBits(pBytes, &uPos,
+			pMode->uIndexBits - IsAnchor(pMode->uSubsets, uPartition, i));
+	}
+	pColorWeights = GetWeights(pMode->uIndexBits);
+	pAlphaWeights = pColorWeights;
+	if (pMode->uIndexBits2) {
+		for (i = 0; i < 16; ++i) {
+			Indices2[i] = (BYTE)ReadBits(
+				pBytes, &uPos, pMode->uIndexBits2 - (i ? 0 : 1));
+		}
+		if (uSelector) {
+			pColorIndices = Indices2;
+			pColorWeights = GetWeights(pMode->uIndexBits2);
+		} else {
+			pAlphaIndices = Indices2;
+			pAlphaWeights = GetWeights(pMode->uIndexBits2);
+		}
+	}
+
+	for (i = 0; i < 16; ++i) {
+		UINT Texel[4];
+		UINT uColorWeight = pColorWeights[pColorIndices[i]];
+
+		s = GetSubset(pMode->uSubsets, uPartition, i);
+		for (c = 0; c < 3; ++c) {
+			Texel[c] = Interpolate(
+				Endpoints[s][0][c], Endpoints[s][1][c], uColorWeight);
+		}
+		Texel[3] = Interpolate(Endpoints[s][0][3], Endpoints[s][1][3],
+			pAlphaWeights[pAlphaIndices[i]]);
+		if (uRotation) {
+			UINT uTemp = Texel[3];
+			Texel[3] = Texel[uRotation - 1];
+			Texel[uRotation - 1] = uTemp;
+		}
+		pdwTexels[i] = ((DWORD)Texel[3] << 24) | ((DWORD)Texel[0] << 16) |
+			((DWORD)Texel[1] << 8) | (DWORD)Texel[2];
+	}
+}
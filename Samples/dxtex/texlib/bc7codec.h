@@ -0,0 +1,34 @@
+/***************************************
+
+	BC7 block compression
+
+	Encodes ARGB8888 texels into BC7 blocks and decodes any BC7 block back.
+	dxtcodec.h routes FOURCC_BC7 here, so images, bands and thread pools
+	work the same as for DXTn. The quality tier comes from the DXTC_FIT_
+	flags.
+
+***************************************/
+
+#ifndef __BC7CODEC_H__
+#define __BC7CODEC_H__
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+/* Assume C declarations for C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern void BC7CompressBlock(const DWORD* pdwTexels, DWORD dwMask,
+	DWORD dwFit, DWORD dwFlags, void* pBlock);
+extern void BC7DecompressBlock(const void* pBlock, DWORD* pdwTexels);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -0,0 +1,562 @@
+//-----------------------------------------------------------------------------
+// File: ddsfile.cpp
+//
+// Desc: DDS headers and a DDS writer for textures in plain memory.
+//
+//       The writer takes one packed buffer per mip level, either blocks in
+//       the format the FourCC names or 32-bit ARGB pixels, and saves them
+//       with stdio. BC7 has no FourCC of its own and is written with a DX10
+//       header, which the reader side turns back into a legacy pixel format
+//       for everything else.
+//
+//       A second writer takes the levels a band of rows at a time, in any
+//       order, for textures too large to hold in memory. It creates the
+//       file at its full size and writes each band at its offset. Volume
+//       textures are written the same way, a level being its slices one
+//       after the other, and the matching reader hands back the slices of
+//       the top level one at a time.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include "ddsfile.h"
+#include "dxtcodec.h"
+#include <stdio.h>
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// DXGI formats DX10 headers are read in and how they load. sRGB formats load
+// as their linear twin, the texture library doesn't convert color spaces.
+//-----------------------------------------------------------------------------
+struct DXGIFormatMap {
+	DWORD dwDxgiFormat;
+	DWORD dwFourCC; // 0 for 32-bit RGB with the masks below
+	DWORD dwRBitMask;
+	DWORD dwBBitMask;
+};
+
+static const DXGIFormatMap s_DxgiFormats[] = {
+	{28, 0, 0x000000FF, 0x00FF0000}, // R8G8B8A8_UNORM
+	{29, 0, 0x000000FF, 0x00FF0000}, // R8G8B8A8_UNORM_SRGB
+	{71, FOURCC_DXT1, 0, 0},         // BC1_UNORM
+	{72, FOURCC_DXT1, 0, 0},         // BC1_UNORM_SRGB
+	{74, FOURCC_DXT3, 0, 0},         // BC2_UNORM
+	{75, FOURCC_DXT3, 0, 0},         // BC2_UNORM_SRGB
+	{77, FOURCC_DXT5, 0, 0},         // BC3_UNORM
+	{78, FOURCC_DXT5, 0, 0},         // BC3_UNORM_SRGB
+	{80, FOURCC_ATI1, 0, 0},         // BC4_UNORM
+	{83, FOURCC_ATI2, 0, 0},         // BC5_UNORM
+	{87, 0, 0x00FF0000, 0x000000FF}, // B8G8R8A8_UNORM
+	{91, 0, 0x00FF0000, 0x000000FF}, // B8G8R8A8_UNORM_SRGB
+	{DXGI_BC7_UNORM, FOURCC_BC7, 0, 0},
+	{99, FOURCC_BC7, 0, 0} // BC7_UNORM_SRGB
+};
+
+//-----------------------------------------------------------------------------
+// Name: DDSNeedsDX10Header()
+// Desc: TRUE for formats the legacy header can't name
+//-----------------------------------------------------------------------------
+BOOL DDSNeedsDX10Header(DWORD dwFourCC)
+{
+	return dwFourCC == FOURCC_BC7;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSInitDX10Header()
+// Desc: Fill in the DX10 header for a single texture or cube map
+//-----------------------------------------------------------------------------
+void DDSInitDX10Header(DWORD dwFourCC, BOOL bCubeMap, DDSHEADERDX10* pHeader)
+{
+	DWORD i;
+	pHeader->dwDxgiFormat = 0;
+	for (i = 0; i < sizeof(s_DxgiFormats) / sizeof(s_DxgiFormats[0]); ++i) {
+		if (s_DxgiFormats[i].dwFourCC == dwFourCC && dwFourCC != 0) {
+			pHeader->dwDxgiFormat = s_DxgiFormats[i].dwDxgiFormat;
+			break;
+		}
+	}
+	pHeader->dwResourceDimension = DX10_DIMENSION_TEXTURE2D;
+	pHeader->dwMiscFlag = bCubeMap ? DX10_MISC_TEXTURECUBE : 0;
+	pHeader->dwArraySize = 1;
+	pHeader->dwMiscFlags2 = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSReadDX10Header()
+// Desc: Put the format a DX10 header names into pddpf, so the rest of a load
+//       can go the legacy way. Cube map caps are added to pddsCaps if the
+//       writer left them out, and so are volume caps. Texture arrays and
+//       formats with no legacy match fail.
+//-----------------------------------------------------------------------------
+HRESULT DDSReadDX10Header(
+	const DDSHEADERDX10* pHeader, DDPIXELFORMAT* pddpf, DDSCAPS2* pddsCaps)
+{
+	DWORD i;
+	if ((pHeader->dwResourceDimension != DX10_DIMENSION_TEXTURE2D &&
+			pHeader->dwResourceDimension != DX10_DIMENSION_TEXTURE3D) ||
+		pHeader->dwArraySize > 1) {
+		return DDERR_INVALIDPIXELFORMAT;
+	}
+	for (i = 0; i < sizeof(s_DxgiFormats) / sizeof(s_DxgiFormats[0]); ++i) {
+		if (s_DxgiFormats[i].dwDxgiFormat == pHeader->dwDxgiFormat) {
+			break;
+		}
+	}
+	if (i == sizeof(s_DxgiFormats) / sizeof(s_DxgiFormats[0])) {
+		return DDERR_INVALIDPIXELFORMAT;
+	}
+
+	memset(pddpf, 0, sizeof(*pddpf));
+	pddpf->dwSize = sizeof(*pddpf);
+	if (s_DxgiFormats[i].dwFourCC != 0) {
+		pddpf->dwFlags = DDPF_FOURCC;
+		pddpf->dwFourCC = s_DxgiFormats[i].dwFourCC;
+	} else {
+		pddpf->dwFlags = DDPF_RGB | DDPF_ALPHAPIXELS;
+		pddpf->dwRGBBitCount = 32;
+		pddpf->dwRBitMask = s_DxgiFormats[i].dwRBitMask;
+		pddpf->dwGBitMask = 0x0000FF00;
+		pddpf->dwBBitMask = s_DxgiFormats[i].dwBBitMask;
+		pddpf->dwRGBAlphaBitMask = 0xFF000000;
+	}
+
+	// Writers are meant to set the cube map caps too, but not all do
+	if ((pHeader->dwMiscFlag & DX10_MISC_TEXTURECUBE) &&
+		!(pddsCaps->dwCaps2 & DDSCAPS2_CUBEMAP)) {
+		pddsCaps->dwCaps |= DDSCAPS_COMPLEX;
+		pddsCaps->dwCaps2 |= DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_ALLFACES;
+	}
+	if (pHeader->dwResourceDimension == DX10_DIMENSION_TEXTURE3D) {
+		pddsCaps->dwCaps |= DDSCAPS_COMPLEX;
+		pddsCaps->dwCaps2 |= DDSCAPS2_VOLUME;
+	}
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSGetLevelBytes()
+// Desc: Size of one packed mip level, 32-bit ARGB if dwFourCC is 0
+//-----------------------------------------------------------------------------
+DWORD DDSGetLevelBytes(DWORD dwFourCC, DWORD dwWidth, DWORD dwHeight)
+{
+	if (dwFourCC == 0) {
+		return dwWidth * dwHeight * 4;
+	}
+	return DXTGetImageBytes(dwFourCC, dwWidth, dwHeight);
+}
+
+//-----------------------------------------------------------------------------
+// Name: InitFileHeader()
+// Desc: Fill in the header DDSWriteFile() and DDSCreateWriter() save, a
+//       volume texture if dwDepth is over 1
+//-----------------------------------------------------------------------------
+static void InitFileHeader(DWORD dwFourCC, DWORD dwWidth, DWORD dwHeight,
+	DWORD dwDepth, DWORD dwMipCount, DDSFILEHEADER* pHeader)
+{
+	memset(pHeader, 0, sizeof(DDSFILEHEADER));
+	pHeader->dwSize = sizeof(DDSFILEHEADER);
+	pHeader->dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT;
+	pHeader->dwHeight = dwHeight;
+	pHeader->dwWidth = dwWidth;
+	pHeader->ddpfPixelFormat.dwSize = sizeof(DDPIXELFORMAT);
+	pHeader->ddsCaps.dwCaps = DDSCAPS_TEXTURE;
+	if (dwFourCC != 0) {
+		pHeader->dwFlags |= DDSD_LINEARSIZE;
+		pHeader->dwPitchOrLinearSize =
+			DXTGetImageBytes(dwFourCC, dwWidth, dwHeight);
+		pHeader->ddpfPixelFormat.dwFlags = DDPF_FOURCC;
+		pHeader->ddpfPixelFormat.dwFourCC =
+			DDSNeedsDX10Header(dwFourCC) ? FOURCC_DX10 : dwFourCC;
+	} else {
+		pHeader->dwFlags |= DDSD_PITCH;
+		pHeader->dwPitchOrLinearSize = dwWidth * 4;
+		pHeader->ddpfPixelFormat.dwFlags = DDPF_RGB | DDPF_ALPHAPIXELS;
+		pHeader->ddpfPixelFormat.dwRGBBitCount = 32;
+		pHeader->ddpfPixelFormat.dwRBitMask = 0x00FF0000;
+		pHeader->ddpfPixelFormat.dwGBitMask = 0x0000FF00;
+		pHeader->ddpfPixelFormat.dwBBitMask = 0x000000FF;
+		pHeader->ddpfPixelFormat.dwRGBAlphaBitMask = 0xFF000000;
+	}
+	if (dwMipCount > 1) {
+		pHeader->dwFlags |= DDSD_MIPMAPCOUNT;
+		pHeader->dwMipMapCount = dwMipCount;
+		pHeader->ddsCaps.dwCaps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+	}
+	if (dwDepth > 1) {
+		pHeader->dwFlags |= DDSD_DEPTH;
+		pHeader->dwDepth = dwDepth;
+		pHeader->ddsCaps.dwCaps |= DDSCAPS_COMPLEX;
+		pHeader->ddsCaps.dwCaps2 |= DDSCAPS2_VOLUME;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: InitVolumeDX10Header()
+// Desc: Fill in the DX10 header for a texture, 3D if dwDepth is over 1
+//-----------------------------------------------------------------------------
+static void InitVolumeDX10Header(
+	DWORD dwFourCC, DWORD dwDepth, DDSHEADERDX10* pHeader)
+{
+	DDSInitDX10Header(dwFourCC, FALSE, pHeader);
+	if (dwDepth > 1) {
+		pHeader->dwResourceDimension = DX10_DIMENSION_TEXTURE3D;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSWriteFile()
+// Desc: Save a texture to a DDS file. ppLevels holds dwMipCount packed
+//       levels, each half the size of the one before down to 1. A dwFourCC
+//       of 0 writes 32-bit ARGB pixels.
+//-----------------------------------------------------------------------------
+HRESULT DDSWriteFile(const char* pFileName, DWORD dwFourCC, DWORD dwWidth,
+	DWORD dwHeight, DWORD dwMipCount, const void* const* ppLevels)
+{
+	DDSFILEHEADER Header;
+	DDSHEADERDX10 HeaderDX10;
+	DWORD dwMagic = FOURCC_DDS;
+	BOOL bDX10 = DDSNeedsDX10Header(dwFourCC);
+	BOOL bOk;
+	DWORD i;
+
+	if (!dwWidth || !dwHeight || !dwMipCount) {
+		return DDERR_INVALIDPARAMS;
+	}
+	InitFileHeader(dwFourCC, dwWidth, dwHeight, 1, dwMipCount, &Header);
+
+	FILE* fp = fopen(pFileName, "wb");
+	if (!fp) {
+		return DDERR_GENERIC;
+	}
+	bOk = fwrite(&dwMagic, sizeof(dwMagic), 1, fp) == 1 &&
+		fwrite(&Header, sizeof(Header), 1, fp) == 1;
+	if (bOk && bDX10) {
+		DDSInitDX10Header(dwFourCC, FALSE, &HeaderDX10);
+		bOk = fwrite(&HeaderDX10, sizeof(HeaderDX10), 1, fp) == 1;
+	}
+	for (i = 0; bOk && i < dwMipCount; ++i) {
+		DWORD dwBytes = DDSGetLevelBytes(dwFourCC, dwWidth, dwHeight);
+		bOk = fwrite(ppLevels[i], 1, dwBytes, fp) == dwBytes;
+		dwWidth = dwWidth > 1 ? dwWidth >> 1 : 1;
+		dwHeight = dwHeight > 1 ? dwHeight >> 1 : 1;
+	}
+	if (fclose(fp) != 0) {
+		bOk = FALSE;
+	}
+	return bOk ? DD_OK : DDERR_GENERIC;
+}
+
+//-----------------------------------------------------------------------------
+// A DDS file being written a band of rows at a time
+//-----------------------------------------------------------------------------
+struct DDSWriter {
+	HANDLE hFile;
+	DWORD dwFourCC;
+	DWORD dwWidth;
+	DWORD dwHeight;
+	DWORD dwDepth;
+	DWORD dwMipCount;
+	ULONGLONG uLevelOffset[DDS_MAX_LEVELS]; // From the start of the file
+};
+
+//-----------------------------------------------------------------------------
+// Name: DDSCreateWriter()
+// Desc: Create a DDS file at its full size and write its header. The
+//       levels are then written in bands with DDSWriteRows(), in any order,
+//       so a texture never has to be in memory all at once. Offsets are 64
+//       bit, an uncompressed file can be larger than 4 GB. A dwDepth over 1
+//       makes a volume texture, whose slices halve along with the rest.
+//-----------------------------------------------------------------------------
+HRESULT DDSCreateWriter(const char* pFileName, DWORD dwFourCC,
+	DWORD dwWidth, DWORD dwHeight, DWORD dwDepth, DWORD dwMipCount,
+	DDSWriter** ppWriter)
+{
+	DDSFILEHEADER Header;
+	DDSHEADERDX10 HeaderDX10;
+	DWORD dwMagic = FOURCC_DDS;
+	DWORD dwWritten;
+	DWORD i;
+
+	*ppWriter = NULL;
+	if (!dwWidth || !dwHeight || !dwDepth || !dwMipCount ||
+		dwMipCount > DDS_MAX_LEVELS) {
+		return DDERR_INVALIDPARAMS;
+	}
+	DDSWriter* pWriter = new DDSWriter;
+	if (!pWriter) {
+		return DDERR_OUTOFMEMORY;
+	}
+	memset(pWriter, 0, sizeof(DDSWriter));
+	pWriter->dwFourCC = dwFourCC;
+	pWriter->dwWidth = dwWidth;
+	pWriter->dwHeight = dwHeight;
+	pWriter->dwDepth = dwDepth;
+	pWriter->dwMipCount = dwMipCount;
+
+	InitFileHeader(dwFourCC, dwWidth, dwHeight, dwDepth, dwMipCount, &Header);
+	BOOL bDX10 = DDSNeedsDX10Header(dwFourCC);
+	ULONGLONG uOffset = sizeof(dwMagic) + sizeof(Header);
+	if (bDX10) {
+		uOffset += sizeof(HeaderDX10);
+	}
+	for (i = 0; i < dwMipCount; ++i) {
+		pWriter->uLevelOffset[i] = uOffset;
+		// Worked out wide, 32768 by 32768 ARGB doesn't fit a DWORD
+		uOffset += (dwFourCC ?
+			(ULONGLONG)DXTGetImageBytes(dwFourCC, dwWidth, dwHeight) :
+			(ULONGLONG)dwWidth * dwHeight * 4) * dwDepth;
+		dwWidth = dwWidth > 1 ? dwWidth >> 1 : 1;
+		dwHeight = dwHeight > 1 ? dwHeight >> 1 : 1;
+		dwDepth = dwDepth > 1 ? dwDepth >> 1 : 1;
+	}
+
+	pWriter->hFile = CreateFileA(pFileName, GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (pWriter->hFile == INVALID_HANDLE_VALUE) {
+		delete pWriter;
+		return DDERR_GENERIC;
+	}
+	// Setting the size first keeps the file in one piece on disk
+	LONG lHigh = (LONG)(uOffset >> 32);
+	DWORD dwLow = SetFilePointer(
+		pWriter->hFile, (LONG)(DWORD)uOffset, &lHigh, FILE_BEGIN);
+	BOOL bOk = (dwLow != INVALID_SET_FILE_POINTER ||
+				   GetLastError() == NO_ERROR) &&
+		SetEndOfFile(pWriter->hFile) &&
+		SetFilePointer(pWriter->hFile, 0, NULL, FILE_BEGIN) == 0 &&
+		WriteFile(pWriter->hFile, &dwMagic, sizeof(dwMagic), &dwWritten,
+			NULL) &&
+		WriteFile(pWriter->hFile, &Header, sizeof(Header), &dwWritten, NULL);
+	if (bOk && bDX10) {
+		InitVolumeDX10Header(dwFourCC, pWriter->dwDepth, &HeaderDX10);
+		bOk = WriteFile(pWriter->hFile, &HeaderDX10, sizeof(HeaderDX10),
+			&dwWritten, NULL);
+	}
+	if (!bOk) {
+		DDSCloseWriter(pWriter);
+		DeleteFileA(pFileName);
+		return DDERR_GENERIC;
+	}
+	*ppWriter = pWriter;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSWriteRows()
+// Desc: Write dwRows rows of one slice of a mip level, starting at
+//       dwFirstRow, from one packed buffer, blocks or 32-bit ARGB pixels.
+//       For a compressed format dwFirstRow has to start a row of blocks.
+//       dwSlice is 0 unless the texture is a volume.
+//-----------------------------------------------------------------------------
+HRESULT DDSWriteRows(DDSWriter* pWriter, DWORD dwLevel, DWORD dwSlice,
+	DWORD dwFirstRow, DWORD dwRows, const void* pData)
+{
+	if (dwLevel >= pWriter->dwMipCount) {
+		return DDERR_INVALIDPARAMS;
+	}
+	DWORD dwWidth = pWriter->dwWidth >> dwLevel;
+	DWORD dwHeight = pWriter->dwHeight >> dwLevel;
+	DWORD dwDepth = pWriter->dwDepth >> dwLevel;
+	dwWidth = dwWidth ? dwWidth : 1;
+	dwHeight = dwHeight ? dwHeight : 1;
+	dwDepth = dwDepth ? dwDepth : 1;
+	if (dwSlice >= dwDepth || dwFirstRow > dwHeight ||
+		dwRows > dwHeight - dwFirstRow ||
+		(pWriter->dwFourCC && (dwFirstRow & 3))) {
+		return DDERR_INVALIDPARAMS;
+	}
+	if (!dwRows) {
+		return DD_OK;
+	}
+
+	ULONGLONG uOffset = pWriter->uLevelOffset[dwLevel] + (ULONGLONG)dwSlice *
+		DDSGetLevelBytes(pWriter->dwFourCC, dwWidth, dwHeight);
+	if (pWriter->dwFourCC) {
+		uOffset += (ULONGLONG)DXTGetPitch(pWriter->dwFourCC, dwWidth) *
+			(dwFirstRow >> 2);
+	} else {
+		uOffset += (ULONGLONG)dwWidth * dwFirstRow * 4;
+	}
+	DWORD dwBytes = DDSGetLevelBytes(pWriter->dwFourCC, dwWidth, dwRows);
+	DWORD dwWritten = 0;
+	LONG lHigh = (LONG)(uOffset >> 32);
+	if ((SetFilePointer(pWriter->hFile, (LONG)(DWORD)uOffset, &lHigh,
+			 FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+			GetLastError() != NO_ERROR) ||
+		!WriteFile(pWriter->hFile, pData, dwBytes, &dwWritten, NULL) ||
+		dwWritten != dwBytes) {
+		return DDERR_GENERIC;
+	}
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSCloseWriter()
+// Desc: Close a file from DDSCreateWriter(), NULL is ignored
+//-----------------------------------------------------------------------------
+HRESULT DDSCloseWriter(DDSWriter* pWriter)
+{
+	HRESULT hr = DD_OK;
+	if (pWriter) {
+		if (!CloseHandle(pWriter->hFile)) {
+			hr = DDERR_GENERIC;
+		}
+		delete pWriter;
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// A DDS file being read a slice at a time
+//-----------------------------------------------------------------------------
+struct DDSReader {
+	HANDLE hFile;
+	DDSFILEHEADER Header;      // DX10 header folded in, dwDepth at least 1
+	DWORD dwSliceBytes;        // One packed slice of the top level
+	ULONGLONG uFirstOffset;    // Where the top level starts
+};
+
+//-----------------------------------------------------------------------------
+// Name: DDSOpenReader()
+// Desc: Open a DDS file and check that it holds the whole top level, 2D or
+//       volume, in a block format or 32-bit RGB. Only the header is read,
+//       the slices are read with DDSReadSlice().
+//-----------------------------------------------------------------------------
+HRESULT DDSOpenReader(const char* pFileName, DDSReader** ppReader)
+{
+	DDSFILEHEADER* pHeader;
+	DWORD dwMagic;
+	DWORD dwRead;
+
+	*ppReader = NULL;
+	DDSReader* pReader = new DDSReader;
+	if (!pReader) {
+		return DDERR_OUTOFMEMORY;
+	}
+	memset(pReader, 0, sizeof(DDSReader));
+	pReader->hFile = CreateFileA(pFileName, GENERIC_READ, FILE_SHARE_READ,
+		NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (pReader->hFile == INVALID_HANDLE_VALUE) {
+		delete pReader;
+		return DDERR_NOTFOUND;
+	}
+
+	HRESULT hr = DDERR_INVALIDPARAMS;
+	pHeader = &pReader->Header;
+	pReader->uFirstOffset = sizeof(dwMagic) + sizeof(DDSFILEHEADER);
+	if (ReadFile(pReader->hFile, &dwMagic, sizeof(dwMagic), &dwRead, NULL) &&
+		dwRead == sizeof(dwMagic) && dwMagic == FOURCC_DDS &&
+		ReadFile(pReader->hFile, pHeader, sizeof(DDSFILEHEADER), &dwRead,
+			NULL) &&
+		dwRead == sizeof(DDSFILEHEADER) &&
+		pHeader->dwSize == sizeof(DDSFILEHEADER)) {
+		hr = DD_OK;
+	}
+	if (SUCCEEDED(hr) && (pHeader->ddpfPixelFormat.dwFlags & DDPF_FOURCC) &&
+		pHeader->ddpfPixelFormat.dwFourCC == FOURCC_DX10) {
+		DDSHEADERDX10 Dx10;
+		hr = DDERR_INVALIDPARAMS;
+		if (ReadFile(pReader->hFile, &Dx10, sizeof(Dx10), &dwRead, NULL) &&
+			dwRead == sizeof(Dx10)) {
+			hr = DDSReadDX10Header(
+				&Dx10, &pHeader->ddpfPixelFormat, &pHeader->ddsCaps);
+		}
+		pReader->uFirstOffset += sizeof(Dx10);
+	}
+
+	// Same limits as a mapped file, but the depth only counts for volumes
+	if (SUCCEEDED(hr)) {
+		if (!(pHeader->ddsCaps.dwCaps2 & DDSCAPS2_VOLUME) ||
+			!pHeader->dwDepth) {
+			pHeader->dwDepth = 1;
+		}
+		if (!pHeader->dwWidth || !pHeader->dwHeight ||
+			pHeader->dwWidth > 32768 || pHeader->dwHeight > 32768 ||
+			pHeader->dwDepth > 32768) {
+			hr = DDERR_INVALIDPARAMS;
+		} else if (pHeader->ddpfPixelFormat.dwFlags & DDPF_FOURCC) {
+			DWORD dwFourCC = pHeader->ddpfPixelFormat.dwFourCC;
+			if (!DXTGetBlockBytes(dwFourCC)) {
+				hr = DDERR_INVALIDPIXELFORMAT;
+			} else {
+				pReader->dwSliceBytes = DXTGetImageBytes(
+					dwFourCC, pHeader->dwWidth, pHeader->dwHeight);
+			}
+		} else if ((pHeader->ddpfPixelFormat.dwFlags & DDPF_RGB) &&
+			pHeader->ddpfPixelFormat.dwRGBBitCount == 32 &&
+			(ULONGLONG)pHeader->dwWidth * pHeader->dwHeight < 0x40000000) {
+			pReader->dwSliceBytes = pHeader->dwWidth * pHeader->dwHeight * 4;
+		} else {
+			hr = DDERR_INVALIDPIXELFORMAT;
+		}
+	}
+	if (SUCCEEDED(hr)) {
+		DWORD dwHigh = 0;
+		DWORD dwLow = GetFileSize(pReader->hFile, &dwHigh);
+		if (dwLow == INVALID_FILE_SIZE && GetLastError() != NO_ERROR) {
+			hr = DDERR_GENERIC;
+		} else if (pReader->uFirstOffset +
+				(ULONGLONG)pReader->dwSliceBytes * pHeader->dwDepth >
+			(((ULONGLONG)dwHigh << 32) | dwLow)) {
+			hr = DDERR_INVALIDPARAMS;
+		}
+	}
+	if (FAILED(hr)) {
+		DDSCloseReader(pReader);
+		return hr;
+	}
+	*ppReader = pReader;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSGetReaderHeader()
+// Desc: Header of a file from DDSOpenReader(), with any DX10 header folded
+//       into its pixel format and caps and dwDepth 1 unless it's a volume
+//-----------------------------------------------------------------------------
+const DDSFILEHEADER* DDSGetReaderHeader(const DDSReader* pReader)
+{
+	return &pReader->Header;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSReadSlice()
+// Desc: Read one slice of the top level into a packed buffer, in the
+//       file's own format. Slice 0 is the whole level of a 2D texture.
+//-----------------------------------------------------------------------------
+HRESULT DDSReadSlice(DDSReader* pReader, DWORD dwSlice, void* pData)
+{
+	if (dwSlice >= pReader->Header.dwDepth) {
+		return DDERR_INVALIDPARAMS;
+	}
+	ULONGLONG uOffset =
+		pReader->uFirstOffset + (ULONGLONG)dwSlice * pReader->dwSliceBytes;
+	DWORD dwRead = 0;
+	LONG lHigh = (LONG)(uOffset >> 32);
+	if ((SetFilePointer(pReader->hFile, (LONG)(DWORD)uOffset, &lHigh,
+			 FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+			GetLastError() != NO_ERROR) ||
+		!ReadFile(pReader->hFile, pData, pReader->dwSliceBytes, &dwRead,
+			NULL) ||
+		dwRead != pReader->dwSliceBytes) {
+		return DDERR_GENERIC;
+	}
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSCloseReader()
+// Desc: Close a file from DDSOpenReader(), NULL is ignored
+//-----------------------------------------------------------------------------
+void DDSCloseReader(DDSReader* pReader)
+{
+	if (pReader) {
+		CloseHandle(pReader->hFile);
+		delete pReader;
+	}
+}
@@ -0,0 +1,116 @@
+/***************************************
+
+	DDS file headers and writer
+
+	The DDS header spelled out in DWORDs, so it's the same 124 bytes in
+	every build instead of depending on how DDSURFACEDESC2 is packed, plus
+	the DX10 extension header used for formats with no legacy FourCC.
+	DDSWriteFile() saves a texture held in plain memory, with no DirectDraw
+	surfaces involved, and DDSCreateWriter() one too large to hold, a band
+	of rows at a time. DDSOpenReader() reads the top level of a texture,
+	2D or volume, a slice at a time.
+
+***************************************/
+
+#ifndef __DDSFILE_H__
+#define __DDSFILE_H__
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include <ddraw.h>
+
+/***************************************
+
+	Magic numbers
+
+***************************************/
+
+#define FOURCC_DDS MAKEFOURCC('D', 'D', 'S', ' ')
+#define FOURCC_DX10 MAKEFOURCC('D', 'X', '1', '0')
+
+#define DX10_DIMENSION_TEXTURE2D 3
+#define DX10_DIMENSION_TEXTURE3D 4
+#define DX10_MISC_TEXTURECUBE 0x4
+
+#define DXGI_BC7_UNORM 98
+
+/***************************************
+
+	The header after the magic number, laid out like DDSURFACEDESC2
+
+***************************************/
+
+typedef struct _DDSFILEHEADER {
+	DWORD dwSize; // sizeof(DDSFILEHEADER), 124
+	DWORD dwFlags; // DDSD_ flags
+	DWORD dwHeight;
+	DWORD dwWidth;
+	DWORD dwPitchOrLinearSize; // Bytes per row, or of the top level if compressed
+	DWORD dwDepth; // Slices of a DDSCAPS2_VOLUME texture
+	DWORD dwMipMapCount;
+	DWORD dwReserved1[11];
+	DDPIXELFORMAT ddpfPixelFormat;
+	DDSCAPS2 ddsCaps;
+	DWORD dwReserved2;
+} DDSFILEHEADER, *LPDDSFILEHEADER;
+
+/***************************************
+
+	Follows DDSFILEHEADER when its FourCC is FOURCC_DX10
+
+***************************************/
+
+typedef struct _DDSHEADERDX10 {
+	DWORD dwDxgiFormat; // DXGI_FORMAT value
+	DWORD dwResourceDimension;
+	DWORD dwMiscFlag;
+	DWORD dwArraySize; // Textures, or cube maps, in the array
+	DWORD dwMiscFlags2;
+} DDSHEADERDX10, *LPDDSHEADERDX10;
+
+/***************************************
+
+	Opaque DDS band writer and slice reader
+
+***************************************/
+
+typedef struct DDSWriter DDSWriter;
+typedef struct DDSReader DDSReader;
+
+#define DDS_MAX_LEVELS 16 // Most mip levels DDSCreateWriter() takes
+
+/* Assume C declarations for C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern BOOL DDSNeedsDX10Header(DWORD dwFourCC);
+extern void DDSInitDX10Header(
+	DWORD dwFourCC, BOOL bCubeMap, DDSHEADERDX10* pHeader);
+extern HRESULT DDSReadDX10Header(
+	const DDSHEADERDX10* pHeader, DDPIXELFORMAT* pddpf, DDSCAPS2* pddsCaps);
+extern DWORD DDSGetLevelBytes(DWORD dwFourCC, DWORD dwWidth, DWORD dwHeight);
+extern HRESULT DDSWriteFile(const char* pFileName, DWORD dwFourCC,
+	DWORD dwWidth, DWORD dwHeight, DWORD dwMipCount,
+	const void* const* ppLevels);
+extern HRESULT DDSCreateWriter(const char* pFileName, DWORD dwFourCC,
+	DWORD dwWidth, DWORD dwHeight, DWORD dwDepth, DWORD dwMipCount,
+	DDSWriter** ppWriter);
+extern HRESULT DDSWriteRows(DDSWriter* pWriter, DWORD dwLevel, DWORD dwSlice,
+	DWORD dwFirstRow, DWORD dwRows, const void* pData);
+extern HRESULT DDSCloseWriter(DDSWriter* pWriter);
+extern HRESULT DDSOpenReader(const char* pFileName, DDSReader** ppReader);
+extern const DDSFILEHEADER* DDSGetReaderHeader(const DDSReader* pReader);
+extern HRESULT DDSReadSlice(
+	DDSReader* pReader, DWORD dwSlice, void* pData);
+extern void DDSCloseReader(DDSReader* pReader);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -0,0 +1,823 @@
+//-----------------------------------------------------------------------------
+// File: ddsindex.cpp
+//
+// Desc: DDS catalog index.
+//
+//       Every entry is a fixed size record with the offset of its path in
+//       one block of NUL terminated paths, and the index file is just the
+//       record array and the path block written out whole, so it loads
+//       with two reads. Paths are found through an open addressed hash
+//       table of record numbers, built when the index is loaded.
+//
+//       A refresh walks the directory with FindFirstFile(), which hands
+//       back the size and write time of every file for free, so a file
+//       whose record still matches is never opened. The others have their
+//       first 148 bytes read, the magic number, the header and a DX10
+//       header if there is one, across the work pool if there is one,
+//       since a cold scan spends its time waiting on the disk. Records of
+//       files under the directory that weren't found are dropped and the
+//       paths packed again.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include "ddsindex.h"
+#include "ddsfile.h"
+#include "dxtcodec.h"
+#include <stdio.h>
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// File layout, bump the version when DDSINDEXENTRY or its meaning changes
+//-----------------------------------------------------------------------------
+#define DDSINDEX_MAGIC MAKEFOURCC('D', 'D', 'S', 'X')
+#define DDSINDEX_VERSION 1
+
+//-----------------------------------------------------------------------------
+// Everything a header can be, the magic number, the header and the DX10
+// header
+//-----------------------------------------------------------------------------
+#define DDSINDEX_HEADER_BYTES \
+	(sizeof(DWORD) + sizeof(DDSFILEHEADER) + sizeof(DDSHEADERDX10))
+
+//-----------------------------------------------------------------------------
+// An empty hash table slot
+//-----------------------------------------------------------------------------
+#define DDSINDEX_EMPTY 0xFFFFFFFF
+
+//-----------------------------------------------------------------------------
+// One file, as stored in the index file
+//-----------------------------------------------------------------------------
+struct DDSIndexRecord {
+	DDSINDEXENTRY Entry;
+	DWORD dwPath;      // Offset of the path in the path block
+	DWORD dwPathBytes; // Length of the path, without the NUL
+};
+
+//-----------------------------------------------------------------------------
+// The index
+//-----------------------------------------------------------------------------
+struct DDSIndex {
+	char szFile[MAX_PATH];
+	DDSIndexRecord* pRecords;
+	DWORD dwCount;
+	DWORD dwMaxCount;
+	char* pPaths;
+	DWORD dwPathBytes;
+	DWORD dwMaxPathBytes;
+	DWORD* pdwTable;   // Record numbers, dwCapacity is a power of 2
+	DWORD dwCapacity;
+	BOOL bChanged;     // Differs from the index file
+};
+
+//-----------------------------------------------------------------------------
+// State of one refresh
+//-----------------------------------------------------------------------------
+struct DDSIndexScan {
+	DDSIndex* pIndex;
+	BYTE* pbSeen;      // Per record from before, 1 if found, 2 if dropped
+	DWORD dwOldCount;
+	DWORD* pdwRead;    // Records whose header has to be read
+	DWORD dwReadCount;
+	DWORD dwMaxRead;
+	DDSINDEXSTATS* pStats;
+};
+
+//-----------------------------------------------------------------------------
+// Name: HashPath()
+// Desc: FNV-1a of a path, ignoring ASCII case like the file system does
+//-----------------------------------------------------------------------------
+static DWORD HashPath(const char* pPath)
+{
+	DWORD dwHash = 0x811C9DC5;
+	while (*pPath) {
+		BYTE bChar = (BYTE)*pPath++;
+		if (bChar >= 'A' && bChar <= 'Z') {
+			bChar += 'a' - 'A';
+		}
+		dwHash = (dwHash ^ bChar) * 0x01000193;
+	}
+	return dwHash;
+}
+
+//-----------------------------------------------------------------------------
+// Name: SamePath()
+// Desc: TRUE if the first dwBytes of two paths only differ in ASCII case
+//-----------------------------------------------------------------------------
+static BOOL SamePath(const char* pPath1, const char* pPath2, DWORD dwBytes)
+{
+	for (DWORD i = 0; i < dwBytes; ++i) {
+		BYTE bChar1 = (BYTE)pPath1[i];
+		BYTE bChar2 = (BYTE)pPath2[i];
+		if (bChar1 >= 'A' && bChar1 <= 'Z') {
+			bChar1 += 'a' - 'A';
+		}
+		if (bChar2 >= 'A' && bChar2 <= 'Z') {
+			bChar2 += 'a' - 'A';
+		}
+		if (bChar1 != bChar2) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: FindSlot()
+// Desc: Table slot holding the record of pPath, or the empty slot that
+//       ends its probe
+//-----------------------------------------------------------------------------
+static DWORD* FindSlot(
+	const DDSIndex* pIndex, const char* pPath, DWORD dwPathBytes)
+{
+	DWORD dwMask = pIndex->dwCapacity - 1;
+	DWORD i = HashPath(pPath) & dwMask;
+	for (;;) {
+		DWORD* pdwSlot = &pIndex->pdwTable[i];
+		if (*pdwSlot == DDSINDEX_EMPTY) {
+			return pdwSlot;
+		}
+		const DDSIndexRecord* pRecord = &pIndex->pRecords[*pdwSlot];
+		if (pRecord->dwPathBytes == dwPathBytes &&
+			SamePath(pIndex->pPaths + pRecord->dwPath, pPath, dwPathBytes)) {
+			return pdwSlot;
+		}
+		i = (i + 1) & dwMask;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: Rehash()
+// Desc: Build a table of at least twice as many slots as records. The old
+//       table is kept if there's no memory.
+//-----------------------------------------------------------------------------
+static BOOL Rehash(DDSIndex* pIndex)
+{
+	DWORD dwCapacity = 1024;
+	while (dwCapacity < pIndex->dwMaxCount * 2) {
+		dwCapacity <<= 1;
+	}
+	DWORD* pdwTable = new DWORD[dwCapacity];
+	if (!pdwTable) {
+		return FALSE;
+	}
+	memset(pdwTable, 0xFF, sizeof(DWORD) * dwCapacity);
+	delete[] pIndex->pdwTable;
+	pIndex->pdwTable = pdwTable;
+	pIndex->dwCapacity = dwCapacity;
+	for (DWORD i = 0; i < pIndex->dwCount; ++i) {
+		const DDSIndexRecord* pRecord = &pIndex->pRecords[i];
+		*FindSlot(pIndex, pIndex->pPaths + pRecord->dwPath,
+			pRecord->dwPathBytes) = i;
+	}
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: AddRecord()
+// Desc: Append an empty record for pPath, growing the records, the paths
+//       and the table as needed. Returns the record number or
+//       DDSINDEX_EMPTY if there's no memory.
+//-----------------------------------------------------------------------------
+static DWORD AddRecord(DDSIndex* pIndex, const char* pPath, DWORD dwPathBytes)
+{
+	if (pIndex->dwPathBytes + dwPathBytes + 1 > pIndex->dwMaxPathBytes) {
+		DWORD dwMax = pIndex->dwMaxPathBytes * 2;
+		while (pIndex->dwPathBytes + dwPathBytes + 1 > dwMax) {
+			dwMax *= 2;
+		}
+		char* pPaths = new char[dwMax];
+		if (!pPaths) {
+			return DDSINDEX_EMPTY;
+		}
+		memcpy(pPaths, pIndex->pPaths, pIndex->dwPathBytes);
+		delete[] pIndex->pPaths;
+		pIndex->pPaths = pPaths;
+		pIndex->dwMaxPathBytes = dwMax;
+	}
+	if (pIndex->dwCount == pIndex->dwMaxCount) {
+		DDSIndexRecord* pRecords = new DDSIndexRecord[pIndex->dwMaxCount * 2];
+		if (!pRecords) {
+			return DDSINDEX_EMPTY;
+		}
+		memcpy(pRecords, pIndex->pRecords,
+			sizeof(DDSIndexRecord) * pIndex->dwCount);
+		delete[] pIndex->pRecords;
+		pIndex->pRecords = pRecords;
+		pIndex->dwMaxCount *= 2;
+		if (pIndex->dwMaxCount * 2 > pIndex->dwCapacity && !Rehash(pIndex)) {
+			pIndex->dwMaxCount /= 2;
+			return DDSINDEX_EMPTY;
+		}
+	}
+
+	DWORD dwRecord = pIndex->dwCount++;
+	DDSIndexRecord* pRecord = &pIndex->pRecords[dwRecord];
+	memset(pRecord, 0, sizeof(DDSIndexRecord));
+	pRecord->dwPath = pIndex->dwPathBytes;
+	pRecord->dwPathBytes = dwPathBytes;
+	memcpy(pIndex->pPaths + pIndex->dwPathBytes, pPath, dwPathBytes + 1);
+	pIndex->dwPathBytes += dwPathBytes + 1;
+	*FindSlot(pIndex, pPath, dwPathBytes) = dwRecord;
+	return dwRecord;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ParseHeader()
+// Desc: Fill in an entry from the first dwBytes of a file, uFileBytes and
+//       ftLastWrite are already set
+//-----------------------------------------------------------------------------
+static void ParseHeader(
+	const BYTE* pData, DWORD dwBytes, DDSINDEXENTRY* pEntry)
+{
+	DDSFILEHEADER Header;
+	DWORD dwMagic;
+	ULONGLONG uOffset = sizeof(DWORD) + sizeof(DDSFILEHEADER);
+
+	if (dwBytes < uOffset) {
+		pEntry->dwFlags = DDSINDEX_INVALID;
+		return;
+	}
+	memcpy(&dwMagic, pData, sizeof(DWORD));
+	memcpy(&Header, pData + sizeof(DWORD), sizeof(DDSFILEHEADER));
+	if (dwMagic != FOURCC_DDS || Header.dwSize != sizeof(DDSFILEHEADER) ||
+		!Header.dwWidth || !Header.dwHeight) {
+		pEntry->dwFlags = DDSINDEX_INVALID;
+		return;
+	}
+
+	// Fold the DX10 header into the legacy one. An array still folds as
+	// one texture, formats texlib doesn't know only keep their shape and
+	// their DXGI format.
+	pEntry->dwArraySize = 1;
+	if ((Header.ddpfPixelFormat.dwFlags & DDPF_FOURCC) &&
+		Header.ddpfPixelFormat.dwFourCC == FOURCC_DX10) {
+		DDSHEADERDX10 Dx10;
+		if (dwBytes < uOffset + sizeof(DDSHEADERDX10)) {
+			pEntry->dwFlags = DDSINDEX_INVALID;
+			return;
+		}
+		memcpy(&Dx10, pData + uOffset, sizeof(DDSHEADERDX10));
+		uOffset += sizeof(DDSHEADERDX10);
+		pEntry->dwFlags |= DDSINDEX_DX10;
+		pEntry->dwDxgiFormat = Dx10.dwDxgiFormat;
+		if (Dx10.dwArraySize > 1) {
+			pEntry->dwArraySize = Dx10.dwArraySize;
+			Dx10.dwArraySize = 1;
+		}
+		if (FAILED(DDSReadDX10Header(
+				&Dx10, &Header.ddpfPixelFormat, &Header.ddsCaps))) {
+			Header.ddpfPixelFormat.dwFlags = 0;
+			Header.ddpfPixelFormat.dwRGBBitCount = 0;
+			if (Dx10.dwMiscFlag & DX10_MISC_TEXTURECUBE) {
+				Header.ddsCaps.dwCaps2 |=
+					DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_ALLFACES;
+			}
+			if (Dx10.dwResourceDimension == DX10_DIMENSION_TEXTURE3D) {
+				Header.ddsCaps.dwCaps2 |= DDSCAPS2_VOLUME;
+			}
+		}
+	}
+
+	pEntry->dwWidth = Header.dwWidth;
+	pEntry->dwHeight = Header.dwHeight;
+	pEntry->dwDepth = 1;
+	if (Header.ddsCaps.dwCaps2 & DDSCAPS2_VOLUME) {
+		pEntry->dwFlags |= DDSINDEX_VOLUME;
+		if (Header.dwDepth) {
+			pEntry->dwDepth = Header.dwDepth;
+		}
+	}
+	pEntry->dwFaces = 1;
+	if (Header.ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP) {
+		DWORD dwFaceBits = Header.ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP_ALLFACES;
+		pEntry->dwFlags |= DDSINDEX_CUBEMAP;
+		pEntry->dwFaces = 0;
+		while (dwFaceBits) {
+			dwFaceBits &= dwFaceBits - 1;
+			++pEntry->dwFaces;
+		}
+		if (!pEntry->dwFaces) {
+			pEntry->dwFaces = 1;
+		}
+	}
+
+	// Trust the count if there is one, it can't be more than the chain
+	DWORD dwWidth = pEntry->dwWidth;
+	DWORD dwHeight = pEntry->dwHeight;
+	DWORD dwDepth = pEntry->dwDepth;
+	DWORD dwChain = 1;
+	while (dwWidth > 1 || dwHeight > 1 || dwDepth > 1) {
+		dwWidth = dwWidth > 1 ? dwWidth >> 1 : 1;
+		dwHeight = dwHeight > 1 ? dwHeight >> 1 : 1;
+		dwDepth = dwDepth > 1 ? dwDepth >> 1 : 1;
+		++dwChain;
+	}
+	pEntry->dwMipCount = 1;
+	if ((Header.dwFlags & DDSD_MIPMAPCOUNT) ||
+		(Header.ddsCaps.dwCaps & DDSCAPS_MIPMAP)) {
+		pEntry->dwMipCount = Header.dwMipMapCount ? Header.dwMipMapCount :
+			(Header.ddsCaps.dwCaps & DDSCAPS_MIPMAP) ? dwChain : 1;
+		if (pEntry->dwMipCount > dwChain) {
+			pEntry->dwMipCount = dwChain;
+		}
+	}
+
+	DWORD dwBlockBytes = 0;
+	if (Header.ddpfPixelFormat.dwFlags & DDPF_FOURCC) {
+		pEntry->dwFourCC = Header.ddpfPixelFormat.dwFourCC;
+		dwBlockBytes = DXTGetBlockBytes(pEntry->dwFourCC);
+		if (dwBlockBytes) {
+			pEntry->dwFlags |= DDSINDEX_COMPRESSED;
+		} else {
+			pEntry->dwFlags |= DDSINDEX_UNKNOWN;
+		}
+	} else {
+		pEntry->dwBitCount = Header.ddpfPixelFormat.dwRGBBitCount;
+		if (!pEntry->dwBitCount || (pEntry->dwBitCount & 7) ||
+			pEntry->dwBitCount > 128) {
+			pEntry->dwFlags |= DDSINDEX_UNKNOWN;
+		}
+	}
+	if (pEntry->dwFlags & DDSINDEX_UNKNOWN) {
+		return;
+	}
+
+	// Faces and array textures are each a whole chain of levels, a level
+	// of a volume is all of its slices
+	ULONGLONG uChainBytes = 0;
+	dwWidth = pEntry->dwWidth;
+	dwHeight = pEntry->dwHeight;
+	dwDepth = pEntry->dwDepth;
+	for (DWORD i = 0; i < pEntry->dwMipCount; ++i) {
+		if (dwBlockBytes) {
+			uChainBytes += (ULONGLONG)dwDepth * dwBlockBytes *
+				(((ULONGLONG)dwWidth + 3) >> 2) *
+				(((ULONGLONG)dwHeight + 3) >> 2);
+		} else {
+			uChainBytes += (ULONGLONG)dwDepth * dwHeight *
+				((((ULONGLONG)dwWidth * pEntry->dwBitCount) + 7) >> 3);
+		}
+		dwWidth = dwWidth > 1 ? dwWidth >> 1 : 1;
+		dwHeight = dwHeight > 1 ? dwHeight >> 1 : 1;
+		dwDepth = dwDepth > 1 ? dwDepth >> 1 : 1;
+	}
+	pEntry->uPayloadBytes =
+		uChainBytes * pEntry->dwFaces * pEntry->dwArraySize;
+	if (uOffset + pEntry->uPayloadBytes > pEntry->uFileBytes) {
+		pEntry->dwFlags |= DDSINDEX_TRUNCATED;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: ReadHeaderTask()
+// Desc: Pool task, read the header of one new or changed file
+//-----------------------------------------------------------------------------
+static void ReadHeaderTask(void* pContext, DWORD dwTask)
+{
+	DDSIndexScan* pScan = static_cast<DDSIndexScan*>(pContext);
+	DDSIndex* pIndex = pScan->pIndex;
+	DDSIndexRecord* pRecord = &pIndex->pRecords[pScan->pdwRead[dwTask]];
+	DDSINDEXENTRY* pEntry = &pRecord->Entry;
+
+	// Keep the size and time, clear what the last header said
+	ULONGLONG uFileBytes = pEntry->uFileBytes;
+	FILETIME ftLastWrite = pEntry->ftLastWrite;
+	memset(pEntry, 0, sizeof(DDSINDEXENTRY));
+	pEntry->uFileBytes = uFileBytes;
+	pEntry->ftLastWrite = ftLastWrite;
+
+	HANDLE hFile = CreateFileA(pIndex->pPaths + pRecord->dwPath, GENERIC_READ,
+		FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		// Forget the time too, so the next refresh tries again
+		pEntry->ftLastWrite.dwLowDateTime = 0;
+		pEntry->ftLastWrite.dwHighDateTime = 0;
+		pEntry->dwFlags = DDSINDEX_INVALID;
+		return;
+	}
+	BYTE Data[DDSINDEX_HEADER_BYTES];
+	DWORD dwRead = 0;
+	if (!ReadFile(hFile, Data, sizeof(Data), &dwRead, NULL)) {
+		dwRead = 0;
+	}
+	CloseHandle(hFile);
+	ParseHeader(Data, dwRead, pEntry);
+}
+
+//-----------------------------------------------------------------------------
+// Name: ScanDirectory()
+// Desc: Find every .dds file under pDirectory, marking the records that
+//       are still current and adding the rest to the list to read
+//-----------------------------------------------------------------------------
+static HRESULT ScanDirectory(DDSIndexScan* pScan, const char* pDirectory)
+{
+	DDSIndex* pIndex = pScan->pIndex;
+	WIN32_FIND_DATAA FindData;
+	char szPath[MAX_PATH];
+
+	sprintf(szPath, "%s\\*", pDirectory);
+	HANDLE hFind = FindFirstFileA(szPath, &FindData);
+	if (hFind == INVALID_HANDLE_VALUE) {
+		return DD_OK;
+	}
+	HRESULT hr = DD_OK;
+	do {
+		const char* pName = FindData.cFileName;
+		size_t uLength = strlen(pDirectory) + strlen(pName) + 1;
+		if (uLength + 2 >= MAX_PATH) {
+			continue;
+		}
+		sprintf(szPath, "%s\\%s", pDirectory, pName);
+		if (FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			if (strcmp(pName, ".") && strcmp(pName, "..")) {
+				hr = ScanDirectory(pScan, szPath);
+			}
+			continue;
+		}
+		if (uLength < 4 || !SamePath(szPath + uLength - 4, ".dds", 4)) {
+			continue;
+		}
+		++pScan->pStats->dwFiles;
+
+		ULONGLONG uFileBytes =
+			((ULONGLONG)FindData.nFileSizeHigh << 32) | FindData.nFileSizeLow;
+		DWORD dwRecord = *FindSlot(pIndex, szPath, (DWORD)uLength);
+		if (dwRecord != DDSINDEX_EMPTY) {
+			DDSINDEXENTRY* pEntry = &pIndex->pRecords[dwRecord].Entry;
+			if (dwRecord < pScan->dwOldCount) {
+				pScan->pbSeen[dwRecord] = 1;
+			}
+			if (pEntry->uFileBytes == uFileBytes &&
+				!CompareFileTime(
+					&pEntry->ftLastWrite, &FindData.ftLastWriteTime)) {
+				++pScan->pStats->dwUnchanged;
+				continue;
+			}
+		} else {
+			dwRecord = AddRecord(pIndex, szPath, (DWORD)uLength);
+			if (dwRecord == DDSINDEX_EMPTY) {
+				hr = DDERR_OUTOFMEMORY;
+				break;
+			}
+		}
+		DDSINDEXENTRY* pEntry = &pIndex->pRecords[dwRecord].Entry;
+		pEntry->uFileBytes = uFileBytes;
+		pEntry->ftLastWrite = FindData.ftLastWriteTime;
+
+		if (pScan->dwReadCount == pScan->dwMaxRead) {
+			DWORD dwMax = pScan->dwMaxRead ? pScan->dwMaxRead * 2 : 256;
+			DWORD* pdwRead = new DWORD[dwMax];
+			if (!pdwRead) {
+				hr = DDERR_OUTOFMEMORY;
+				break;
+			}
+			if (pScan->pdwRead) {
+				memcpy(pdwRead, pScan->pdwRead,
+					sizeof(DWORD) * pScan->dwReadCount);
+				delete[] pScan->pdwRead;
+			}
+			pScan->pdwRead = pdwRead;
+			pScan->dwMaxRead = dwMax;
+		}
+		pScan->pdwRead[pScan->dwReadCount++] = dwRecord;
+	} while (SUCCEEDED(hr) && FindNextFileA(hFind, &FindData));
+	FindClose(hFind);
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DropMissing()
+// Desc: Remove the records of files under pDirectory the scan didn't find
+//       and pack the paths of the rest
+//-----------------------------------------------------------------------------
+static HRESULT DropMissing(DDSIndexScan* pScan, const char* pDirectory)
+{
+	DDSIndex* pIndex = pScan->pIndex;
+	DWORD dwPrefix = (DWORD)strlen(pDirectory);
+	DWORD i;
+
+	DWORD dwRemoved = 0;
+	for (i = 0; i < pScan->dwOldCount; ++i) {
+		const DDSIndexRecord* pRecord = &pIndex->pRecords[i];
+		const char* pPath = pIndex->pPaths + pRecord->dwPath;
+		if (!pScan->pbSeen[i] && pRecord->dwPathBytes > dwPrefix &&
+			pPath[dwPrefix] == '\\' && SamePath(pPath, pDirectory, dwPrefix)) {
+			pScan->pbSeen[i] = 2;
+			++dwRemoved;
+		}
+	}
+	if (!dwRemoved) {
+		return DD_OK;
+	}
+
+	char* pPaths = new char[pIndex->dwMaxPathBytes];
+	if (!pPaths) {
+		return DDERR_OUTOFMEMORY;
+	}
+	DWORD dwCount = 0;
+	DWORD dwPathBytes = 0;
+	for (i = 0; i < pIndex->dwCount; ++i) {
+		if (i < pScan->dwOldCount && pScan->pbSeen[i] == 2) {
+			continue;
+		}
+		DDSIndexRecord* pRecord = &pIndex->pRecords[dwCount++];
+		*pRecord = pIndex->pRecords[i];
+		memcpy(pPaths + dwPathBytes, pIndex->pPaths + pRecord->dwPath,
+			pRecord->dwPathBytes + 1);
+		pRecord->dwPath = dwPathBytes;
+		dwPathBytes += pRecord->dwPathBytes + 1;
+	}
+	delete[] pIndex->pPaths;
+	pIndex->pPaths = pPaths;
+	pIndex->dwPathBytes = dwPathBytes;
+	pIndex->dwCount = dwCount;
+	pScan->pStats->dwRemoved = dwRemoved;
+	// Same size as before, so there's always room to rebuild the table
+	memset(pIndex->pdwTable, 0xFF, sizeof(DWORD) * pIndex->dwCapacity);
+	for (i = 0; i < dwCount; ++i) {
+		const DDSIndexRecord* pRecord = &pIndex->pRecords[i];
+		*FindSlot(pIndex, pIndex->pPaths + pRecord->dwPath,
+			pRecord->dwPathBytes) = i;
+	}
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ReadIndex()
+// Desc: Load the index file, if there is one that's whole and current.
+//       Anything else leaves the index empty, to be filled by a refresh.
+//-----------------------------------------------------------------------------
+static void ReadIndex(DDSIndex* pIndex)
+{
+	FILE* fp = fopen(pIndex->szFile, "rb");
+	if (!fp) {
+		return;
+	}
+	DWORD Header[4];
+	if ((fread(Header, sizeof(Header), 1, fp) != 1) ||
+		(Header[0] != DDSINDEX_MAGIC) || (Header[1] != DDSINDEX_VERSION) ||
+		!Header[2] || !Header[3] || (Header[2] > 0x01000000) ||
+		(Header[3] > 0x40000000)) {
+		fclose(fp);
+		return;
+	}
+	DWORD dwMaxCount = pIndex->dwMaxCount;
+	while (dwMaxCount < Header[2]) {
+		dwMaxCount *= 2;
+	}
+	DWORD dwMaxPathBytes = pIndex->dwMaxPathBytes;
+	while (dwMaxPathBytes < Header[3]) {
+		dwMaxPathBytes *= 2;
+	}
+	DDSIndexRecord* pRecords = new DDSIndexRecord[dwMaxCount];
+	char* pPaths = new char[dwMaxPathBytes];
+	BOOL bOk = pRecords && pPaths &&
+		(fread(pRecords, sizeof(DDSIndexRecord), Header[2], fp) ==
+			Header[2]) &&
+		(fread(pPaths, 1, Header[3], fp) == Header[3]);
+	fclose(fp);
+
+	// Every path has to be inside the block and end in a NUL
+	for (DWORD i = 0; bOk && i < Header[2]; ++i) {
+		const DDSIndexRecord* pRecord = &pRecords[i];
+		bOk = pRecord->dwPath < Header[3] &&
+			pRecord->dwPathBytes < Header[3] - pRecord->dwPath &&
+			!pPaths[pRecord->dwPath + pRecord->dwPathBytes];
+	}
+	if (bOk) {
+		delete[] pIndex->pRecords;
+		delete[] pIndex->pPaths;
+		pIndex->pRecords = pRecords;
+		pIndex->pPaths = pPaths;
+		pIndex->dwCount = Header[2];
+		pIndex->dwMaxCount = dwMaxCount;
+		pIndex->dwPathBytes = Header[3];
+		pIndex->dwMaxPathBytes = dwMaxPathBytes;
+		if (Rehash(pIndex)) {
+			return;
+		}
+		// No room for the table, start again empty
+		pIndex->dwCount = 0;
+		pIndex->dwPathBytes = 0;
+		return;
+	}
+	delete[] pRecords;
+	delete[] pPaths;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSIndexOpen()
+// Desc: Load an index file, or start an empty index that will be saved
+//       there if the file is missing or out of date
+//-----------------------------------------------------------------------------
+HRESULT DDSIndexOpen(const char* pIndexFile, DDSIndex** ppIndex)
+{
+	*ppIndex = NULL;
+	if (strlen(pIndexFile) + 8 > MAX_PATH) {
+		return DDERR_INVALIDPARAMS;
+	}
+	DDSIndex* pIndex = new DDSIndex;
+	if (!pIndex) {
+		return DDERR_OUTOFMEMORY;
+	}
+	memset(pIndex, 0, sizeof(DDSIndex));
+	strcpy(pIndex->szFile, pIndexFile);
+	pIndex->dwMaxCount = 256;
+	pIndex->dwMaxPathBytes = 16384;
+	pIndex->pRecords = new DDSIndexRecord[pIndex->dwMaxCount];
+	pIndex->pPaths = new char[pIndex->dwMaxPathBytes];
+	if (!pIndex->pRecords || !pIndex->pPaths || !Rehash(pIndex)) {
+		DDSIndexClose(pIndex);
+		return DDERR_OUTOFMEMORY;
+	}
+	ReadIndex(pIndex);
+	*ppIndex = pIndex;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSIndexClose()
+// Desc: Release the index without saving it
+//-----------------------------------------------------------------------------
+void DDSIndexClose(DDSIndex* pIndex)
+{
+	if (pIndex) {
+		delete[] pIndex->pRecords;
+		delete[] pIndex->pPaths;
+		delete[] pIndex->pdwTable;
+		delete pIndex;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSIndexRefresh()
+// Desc: Bring the entries for every .dds file under pDirectory up to date.
+//       Only new files and files whose size or write time changed are
+//       opened, their headers are read across pPool, which may be NULL.
+//       Entries for files that are gone are dropped. Other directories in
+//       the index are left alone.
+//-----------------------------------------------------------------------------
+HRESULT DDSIndexRefresh(DDSIndex* pIndex, const char* pDirectory,
+	DXTWorkPool* pPool, DDSINDEXSTATS* pStats)
+{
+	DDSIndexScan Scan;
+	DDSINDEXSTATS Stats;
+	char szDirectory[MAX_PATH];
+	WIN32_FIND_DATAA FindData;
+
+	// Paths are kept the way they're spelled, without a trailing separator
+	size_t uLength = strlen(pDirectory);
+	if (uLength + 8 > MAX_PATH) {
+		return DDERR_INVALIDPARAMS;
+	}
+	strcpy(szDirectory, pDirectory);
+	while (uLength > 1 && (szDirectory[uLength - 1] == '\\' ||
+							  szDirectory[uLength - 1] == '/')) {
+		szDirectory[--uLength] = 0;
+	}
+
+	// A missing directory would drop everything under it, make sure
+	HANDLE hFind = FindFirstFileA(szDirectory, &FindData);
+	if (hFind == INVALID_HANDLE_VALUE) {
+		return DDERR_NOTFOUND;
+	}
+	FindClose(hFind);
+	if (!(FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+		return DDERR_INVALIDPARAMS;
+	}
+
+	memset(&Stats, 0, sizeof(Stats));
+	memset(&Scan, 0, sizeof(Scan));
+	Scan.pIndex = pIndex;
+	Scan.pStats = &Stats;
+	Scan.dwOldCount = pIndex->dwCount;
+	Scan.pbSeen = new BYTE[Scan.dwOldCount + 1];
+	if (!Scan.pbSeen) {
+		return DDERR_OUTOFMEMORY;
+	}
+	memset(Scan.pbSeen, 0, Scan.dwOldCount + 1);
+
+	HRESULT hr = ScanDirectory(&Scan, szDirectory);
+	if (SUCCEEDED(hr)) {
+		DXTPoolRun(pPool, ReadHeaderTask, &Scan, Scan.dwReadCount);
+		Stats.dwRead = Scan.dwReadCount;
+		for (DWORD i = 0; i < Scan.dwReadCount; ++i) {
+			if (pIndex->pRecords[Scan.pdwRead[i]].Entry.dwFlags &
+				DDSINDEX_INVALID) {
+				++Stats.dwInvalid;
+			}
+		}
+		hr = DropMissing(&Scan, szDirectory);
+	}
+	if (Stats.dwRead || Stats.dwRemoved) {
+		pIndex->bChanged = TRUE;
+	}
+	delete[] Scan.pbSeen;
+	delete[] Scan.pdwRead;
+	if (pStats) {
+		*pStats = Stats;
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSIndexSave()
+// Desc: Write the index file if anything changed since it was read. It's
+//       written beside the old one and moved over it in one step with
+//       MoveFileEx(), so a failed save leaves the old index.
+//-----------------------------------------------------------------------------
+HRESULT DDSIndexSave(DDSIndex* pIndex)
+{
+	if (!pIndex->bChanged) {
+		return DD_OK;
+	}
+	char szTemp[MAX_PATH + 4];
+	sprintf(szTemp, "%s.tmp", pIndex->szFile);
+	FILE* fp = fopen(szTemp, "wb");
+	if (!fp) {
+		return DDERR_GENERIC;
+	}
+	DWORD Header[4];
+	Header[0] = DDSINDEX_MAGIC;
+	Header[1] = DDSINDEX_VERSION;
+	Header[2] = pIndex->dwCount;
+	Header[3] = pIndex->dwPathBytes;
+	BOOL bOk = (fwrite(Header, sizeof(Header), 1, fp) == 1) &&
+		(fwrite(pIndex->pRecords, sizeof(DDSIndexRecord), pIndex->dwCount,
+			 fp) == pIndex->dwCount) &&
+		(fwrite(pIndex->pPaths, 1, pIndex->dwPathBytes, fp) ==
+			pIndex->dwPathBytes);
+	if ((fclose(fp) != 0) || !bOk ||
+		!MoveFileExA(szTemp, pIndex->szFile, MOVEFILE_REPLACE_EXISTING)) {
+		DeleteFileA(szTemp);
+		return DDERR_GENERIC;
+	}
+	pIndex->bChanged = FALSE;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSIndexGetCount()
+// Desc: Number of entries, DDSINDEX_INVALID ones included
+//-----------------------------------------------------------------------------
+DWORD DDSIndexGetCount(const DDSIndex* pIndex)
+{
+	return pIndex->dwCount;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSIndexGetEntry()
+// Desc: What the index knows about one file, valid until the next refresh
+//-----------------------------------------------------------------------------
+const DDSINDEXENTRY* DDSIndexGetEntry(const DDSIndex* pIndex, DWORD dwEntry)
+{
+	return &pIndex->pRecords[dwEntry].Entry;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSIndexGetPath()
+// Desc: Path of one file as it was found, valid until the next refresh
+//-----------------------------------------------------------------------------
+const char* DDSIndexGetPath(const DDSIndex* pIndex, DWORD dwEntry)
+{
+	return pIndex->pPaths + pIndex->pRecords[dwEntry].dwPath;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSIndexFind()
+// Desc: First entry from dwStart on that matches pQuery, or DDSINDEX_END.
+//       Files that aren't DDS files only match if dwRequire asks for
+//       DDSINDEX_INVALID.
+//-----------------------------------------------------------------------------
+DWORD DDSIndexFind(
+	const DDSIndex* pIndex, const DDSINDEXQUERY* pQuery, DWORD dwStart)
+{
+	DWORD dwExclude = pQuery->dwExclude;
+	if (!(pQuery->dwRequire & DDSINDEX_INVALID)) {
+		dwExclude |= DDSINDEX_INVALID;
+	}
+	DWORD dwMaxWidth = pQuery->dwMaxWidth ? pQuery->dwMaxWidth : 0xFFFFFFFF;
+	DWORD dwMaxHeight = pQuery->dwMaxHeight ? pQuery->dwMaxHeight : 0xFFFFFFFF;
+	DWORD dwMaxMips = pQuery->dwMaxMips ? pQuery->dwMaxMips : 0xFFFFFFFF;
+	for (DWORD i = dwStart; i < pIndex->dwCount; ++i) {
+		const DDSINDEXENTRY* pEntry = &pIndex->pRecords[i].Entry;
+		if ((pEntry->dwFlags & pQuery->dwRequire) == pQuery->dwRequire &&
+			!(pEntry->dwFlags & dwExclude) &&
+			pEntry->dwWidth >= pQuery->dwMinWidth &&
+			pEntry->dwWidth <= dwMaxWidth &&
+			pEntry->dwHeight >= pQuery->dwMinHeight &&
+			pEntry->dwHeight <= dwMaxHeight &&
+			pEntry->dwMipCount >= pQuery->dwMinMips &&
+			pEntry->dwMipCount <= dwMaxMips &&
+			(!pQuery->dwFourCC || pEntry->dwFourCC == pQuery->dwFourCC)) {
+			return i;
+		}
+	}
+	return DDSINDEX_END;
+}
@@ -0,0 +1,127 @@
+/***************************************
+
+	DDS catalog index
+
+	Remembers what the header of every DDS file under one or more
+	directories says, its size, format, mip count, faces and how many
+	bytes of pixels it holds, in an index file. Refreshing walks the
+	directories and only reads the header of a file whose size or write
+	time changed, and queries only look at the index, so finding textures
+	in a library of tens of thousands never opens one of them.
+
+***************************************/
+
+#ifndef __DDSINDEX_H__
+#define __DDSINDEX_H__
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include "dxtpool.h"
+#include <ddraw.h>
+
+/***************************************
+
+	Opaque index object
+
+***************************************/
+
+typedef struct DDSIndex DDSIndex;
+
+/***************************************
+
+	DDSINDEXENTRY dwFlags
+
+***************************************/
+
+#define DDSINDEX_CUBEMAP 0x01    // Cube map, dwFaces says how many faces
+#define DDSINDEX_VOLUME 0x02     // Volume, dwDepth says how many slices
+#define DDSINDEX_COMPRESSED 0x04 // Block format, dwFourCC says which
+#define DDSINDEX_DX10 0x08       // Has the DX10 header
+#define DDSINDEX_UNKNOWN 0x10    // Format texlib can't size, no payload
+#define DDSINDEX_TRUNCATED 0x20  // File is shorter than its payload
+#define DDSINDEX_INVALID 0x40    // Not a DDS file, only the path is valid
+
+#define DDSINDEX_END 0xFFFFFFFF // No more matches from DDSIndexFind()
+
+/***************************************
+
+	What the index knows about one file
+
+***************************************/
+
+typedef struct _DDSINDEXENTRY {
+	ULONGLONG uFileBytes;
+	ULONGLONG uPayloadBytes; // Every face, slice and level after the headers
+	FILETIME ftLastWrite;
+	DWORD dwWidth;
+	DWORD dwHeight;
+	DWORD dwDepth;      // 1 unless a volume
+	DWORD dwMipCount;   // Levels in each face, at least 1
+	DWORD dwFaces;      // 1, or the cube map faces in the file
+	DWORD dwArraySize;  // Textures in a DX10 array, 1 otherwise
+	DWORD dwFourCC;     // Block format, 0 if uncompressed
+	DWORD dwBitCount;   // Bits per pixel if uncompressed
+	DWORD dwDxgiFormat; // From the DX10 header, 0 without one
+	DWORD dwFlags;      // DDSINDEX_ flags
+} DDSINDEXENTRY, *LPDDSINDEXENTRY;
+
+/***************************************
+
+	What to look for, zero matches every DDS file. A zero maximum has no
+	limit, dwRequire and dwExclude are DDSINDEX_ flags that must be set
+	or clear.
+
+***************************************/
+
+typedef struct _DDSINDEXQUERY {
+	DWORD dwMinWidth;
+	DWORD dwMaxWidth;
+	DWORD dwMinHeight;
+	DWORD dwMaxHeight;
+	DWORD dwMinMips;
+	DWORD dwMaxMips;
+	DWORD dwFourCC; // 0 for any format
+	DWORD dwRequire;
+	DWORD dwExclude;
+} DDSINDEXQUERY, *LPDDSINDEXQUERY;
+
+/***************************************
+
+	What the last refresh did
+
+***************************************/
+
+typedef struct _DDSINDEXSTATS {
+	DWORD dwFiles;     // DDS files found under the directory
+	DWORD dwUnchanged; // Files whose size and write time still matched
+	DWORD dwRead;      // Headers read, new or changed files
+	DWORD dwInvalid;   // Files read that weren't DDS files
+	DWORD dwRemoved;   // Entries for files that are gone
+} DDSINDEXSTATS, *LPDDSINDEXSTATS;
+
+/* Assume C declarations for C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern HRESULT DDSIndexOpen(const char* pIndexFile, DDSIndex** ppIndex);
+extern void DDSIndexClose(DDSIndex* pIndex);
+extern HRESULT DDSIndexRefresh(DDSIndex* pIndex, const char* pDirectory,
+	DXTWorkPool* pPool, DDSINDEXSTATS* pStats);
+extern HRESULT DDSIndexSave(DDSIndex* pIndex);
+extern DWORD DDSIndexGetCount(const DDSIndex* pIndex);
+extern const DDSINDEXENTRY* DDSIndexGetEntry(
+	const DDSIndex* pIndex, DWORD dwEntry);
+extern const char* DDSIndexGetPath(const DDSIndex* pIndex, DWORD dwEntry);
+extern DWORD DDSIndexFind(
+	const DDSIndex* pIndex, const DDSINDEXQUERY* pQuery, DWORD dwStart);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
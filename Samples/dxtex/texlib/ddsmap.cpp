@@ -0,0 +1,497 @@
+//-----------------------------------------------------------------------------
+// File: ddsmap.cpp
+//
+// Desc: Memory mapped DDS reader and writer.
+//
+//       The level sizes only depend on the header, so the offset of every
+//       level within a face and the size of a face are worked out once
+//       when the file is mapped. Finding a level is then one multiply and
+//       one add, and nothing but the header is touched until a level is
+//       asked for. The whole layout is checked against the file size up
+//       front, so a truncated file fails to map instead of faulting later.
+//       Volume textures lay out the same way, with every slice of a level
+//       counted into its size.
+//
+//       Writing works the same way backwards. The file is created at its
+//       final size and each level is copied straight into the view, rows
+//       packed together, so a whole texture goes out without a write call
+//       per row or per level. It's written under a temporary name and
+//       only replaces the target once it's flushed, so a failed save
+//       leaves the old file alone.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include "ddsmap.h"
+#include "dxtcodec.h"
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// Largest width or height accepted, same as TEXCreateImage()
+//-----------------------------------------------------------------------------
+#define DDSMAP_MAXSIZE 32768
+
+//-----------------------------------------------------------------------------
+// Name: GetMappedRowBytes()
+// Desc: Bytes in one row of pixels, or of blocks, of a level in the file
+//-----------------------------------------------------------------------------
+static DWORD GetMappedRowBytes(const DDSMAPPING* pMapping, DWORD dwWidth)
+{
+	if (pMapping->dwFourCC) {
+		return DXTGetPitch(pMapping->dwFourCC, dwWidth);
+	}
+	return dwWidth * (pMapping->dwBitCount >> 3);
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetMappedRows()
+// Desc: Rows of pixels, or of blocks, in a level in the file
+//-----------------------------------------------------------------------------
+static DWORD GetMappedRows(const DDSMAPPING* pMapping, DWORD dwHeight)
+{
+	if (pMapping->dwFourCC) {
+		return (dwHeight + 3) >> 2;
+	}
+	return dwHeight;
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetLevelShape()
+// Desc: Bytes per row and rows of one mip level in the file
+//-----------------------------------------------------------------------------
+static void GetLevelShape(const DDSMAPPING* pMapping, DWORD dwLevel,
+	DWORD* pRowBytes, DWORD* pRows)
+{
+	DWORD dwWidth = pMapping->Header.dwWidth >> dwLevel;
+	DWORD dwHeight = pMapping->Header.dwHeight >> dwLevel;
+	*pRowBytes = GetMappedRowBytes(pMapping, dwWidth ? dwWidth : 1);
+	*pRows = GetMappedRows(pMapping, dwHeight ? dwHeight : 1);
+}
+
+//-----------------------------------------------------------------------------
+// Name: CopyRows()
+// Desc: Copy rows of pixels or blocks between two pitches, in one go when
+//       neither side has padding
+//-----------------------------------------------------------------------------
+static void CopyRows(void* pDest, LONG lDestPitch, const void* pSrc,
+	LONG lSrcPitch, DWORD dwRowBytes, DWORD dwRows)
+{
+	if ((LONG)dwRowBytes == lDestPitch && (LONG)dwRowBytes == lSrcPitch) {
+		memcpy(pDest, pSrc, dwRowBytes * dwRows);
+		return;
+	}
+	DWORD i;
+	for (i = 0; i < dwRows; ++i) {
+		memcpy((BYTE*)pDest + (LONG)i * lDestPitch,
+			(const BYTE*)pSrc + (LONG)i * lSrcPitch, dwRowBytes);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: LayoutLevels()
+// Desc: Work out the faces and levels behind Header, whose DX10 header, if
+//       any, has already been folded in. dwFirstOffset must be set.
+//-----------------------------------------------------------------------------
+static HRESULT LayoutLevels(DDSMAPPING* pMapping)
+{
+	DDSFILEHEADER* pHeader = &pMapping->Header;
+
+	if (pHeader->ddpfPixelFormat.dwFlags & DDPF_FOURCC) {
+		pMapping->dwFourCC = pHeader->ddpfPixelFormat.dwFourCC;
+		if (!DXTGetBlockBytes(pMapping->dwFourCC)) {
+			return DDERR_INVALIDPIXELFORMAT;
+		}
+	} else {
+		pMapping->dwBitCount = pHeader->ddpfPixelFormat.dwRGBBitCount;
+		if (!pMapping->dwBitCount || (pMapping->dwBitCount & 7) ||
+			pMapping->dwBitCount > 32) {
+			return DDERR_INVALIDPIXELFORMAT;
+		}
+	}
+	pMapping->dwDepth = 1;
+	if (pHeader->ddsCaps.dwCaps2 & DDSCAPS2_VOLUME) {
+		pMapping->dwDepth = pHeader->dwDepth ? pHeader->dwDepth : 1;
+	}
+	if (!pHeader->dwWidth || !pHeader->dwHeight ||
+		pHeader->dwWidth > DDSMAP_MAXSIZE ||
+		pHeader->dwHeight > DDSMAP_MAXSIZE ||
+		pMapping->dwDepth > DDSMAP_MAXSIZE) {
+		return DDERR_INVALIDPARAMS;
+	}
+
+	// Mip mapped surfaces are created with the full chain, so that's what
+	// the file has to hold whatever dwMipMapCount says
+	DWORD dwWidth = pHeader->dwWidth;
+	DWORD dwHeight = pHeader->dwHeight;
+	DWORD dwDepth = pMapping->dwDepth;
+	pMapping->dwLevels = 1;
+	if (pHeader->ddsCaps.dwCaps & DDSCAPS_MIPMAP) {
+		while (dwWidth > 1 || dwHeight > 1 || dwDepth > 1) {
+			dwWidth = dwWidth > 1 ? dwWidth >> 1 : 1;
+			dwHeight = dwHeight > 1 ? dwHeight >> 1 : 1;
+			dwDepth = dwDepth > 1 ? dwDepth >> 1 : 1;
+			++pMapping->dwLevels;
+		}
+	}
+	pMapping->dwFaces = 1;
+	if (pMapping->dwDepth > 1 &&
+		(pHeader->ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP)) {
+		return DDERR_INVALIDCAPS;
+	}
+	if (pHeader->ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP) {
+		// Counting the faces before one past the last face counts them all
+		pMapping->dwFaces =
+			DDSGetMappedFace(pMapping, DDSCAPS2_CUBEMAP_NEGATIVEZ << 1);
+		if (!pMapping->dwFaces) {
+			return DDERR_INVALIDCAPS;
+		}
+	}
+
+	// Every slice fits in 32 bits, a level of a volume and the total are
+	// checked in 64
+	ULONGLONG uFaceBytes = 0;
+	DWORD i;
+	dwWidth = pHeader->dwWidth;
+	dwHeight = pHeader->dwHeight;
+	dwDepth = pMapping->dwDepth;
+	for (i = 0; i < pMapping->dwLevels; ++i) {
+		ULONGLONG uLevelBytes = (ULONGLONG)dwDepth *
+			GetMappedRowBytes(pMapping, dwWidth) *
+			GetMappedRows(pMapping, dwHeight);
+		if (uFaceBytes + uLevelBytes > 0xFFFFFFFFU) {
+			return DDERR_INVALIDPARAMS;
+		}
+		pMapping->dwLevelOffset[i] = (DWORD)uFaceBytes;
+		pMapping->dwLevelBytes[i] = (DWORD)uLevelBytes;
+		uFaceBytes += uLevelBytes;
+		dwWidth = dwWidth > 1 ? dwWidth >> 1 : 1;
+		dwHeight = dwHeight > 1 ? dwHeight >> 1 : 1;
+		dwDepth = dwDepth > 1 ? dwDepth >> 1 : 1;
+	}
+	if (pMapping->dwFirstOffset + uFaceBytes * pMapping->dwFaces >
+		0xFFFFFFFFU) {
+		return DDERR_INVALIDPARAMS;
+	}
+	pMapping->dwFaceBytes = (DWORD)uFaceBytes;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ParseHeader()
+// Desc: Check the header of a mapped file and that it holds every level
+//-----------------------------------------------------------------------------
+static HRESULT ParseHeader(DDSMAPPING* pMapping)
+{
+	const BYTE* pView = pMapping->pView;
+	DWORD dwOffset = 4 + sizeof(DDSFILEHEADER);
+	DDSFILEHEADER* pHeader = &pMapping->Header;
+	HRESULT hr;
+
+	if (pMapping->dwFileBytes < dwOffset ||
+		*(const DWORD*)pView != FOURCC_DDS) {
+		return DDERR_INVALIDPARAMS;
+	}
+	memcpy(pHeader, pView + 4, sizeof(DDSFILEHEADER));
+	if (pHeader->dwSize != sizeof(DDSFILEHEADER)) {
+		return DDERR_INVALIDPARAMS;
+	}
+	if ((pHeader->ddpfPixelFormat.dwFlags & DDPF_FOURCC) &&
+		(pHeader->ddpfPixelFormat.dwFourCC == FOURCC_DX10)) {
+		DDSHEADERDX10 Dx10;
+		if (pMapping->dwFileBytes < dwOffset + sizeof(Dx10)) {
+			return DDERR_INVALIDPARAMS;
+		}
+		memcpy(&Dx10, pView + dwOffset, sizeof(Dx10));
+		dwOffset += sizeof(Dx10);
+		if (FAILED(hr = DDSReadDX10Header(
+					   &Dx10, &pHeader->ddpfPixelFormat, &pHeader->ddsCaps))) {
+			return hr;
+		}
+	}
+	pMapping->dwFirstOffset = dwOffset;
+	if (FAILED(hr = LayoutLevels(pMapping))) {
+		return hr;
+	}
+	if (dwOffset + (ULONGLONG)pMapping->dwFaceBytes * pMapping->dwFaces >
+		pMapping->dwFileBytes) {
+		return DDERR_INVALIDPARAMS;
+	}
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSMapFile()
+// Desc: Open and map a DDS file. Other readers may keep it open, writers
+//       can't open it until DDSUnmapFile().
+//-----------------------------------------------------------------------------
+HRESULT DDSMapFile(const char* pFileName, DDSMAPPING* pMapping)
+{
+	HRESULT hr;
+
+	if (!pFileName || !pMapping) {
+		return DDERR_INVALIDPARAMS;
+	}
+	memset(pMapping, 0, sizeof(DDSMAPPING));
+	pMapping->hFile = CreateFileA(pFileName, GENERIC_READ, FILE_SHARE_READ,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (pMapping->hFile == INVALID_HANDLE_VALUE) {
+		pMapping->hFile = NULL;
+		return DDERR_NOTFOUND;
+	}
+
+	DWORD dwHigh = 0;
+	pMapping->dwFileBytes = GetFileSize(pMapping->hFile, &dwHigh);
+	hr = DDERR_GENERIC;
+	if (!dwHigh && pMapping->dwFileBytes != INVALID_FILE_SIZE &&
+		pMapping->dwFileBytes) {
+		pMapping->hMapping = CreateFileMappingA(
+			pMapping->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (pMapping->hMapping) {
+			pMapping->pView = (const BYTE*)MapViewOfFile(
+				pMapping->hMapping, FILE_MAP_READ, 0, 0, 0);
+			if (pMapping->pView) {
+				hr = ParseHeader(pMapping);
+			}
+		}
+	}
+	if (FAILED(hr)) {
+		DDSUnmapFile(pMapping);
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSUnmapFile()
+// Desc: Unmap and close the file, pointers from DDSGetMappedLevel() die. A
+//       file from DDSCreateMappedFile() that wasn't committed is deleted.
+//-----------------------------------------------------------------------------
+void DDSUnmapFile(DDSMAPPING* pMapping)
+{
+	if (pMapping->pView) {
+		UnmapViewOfFile(pMapping->pView);
+	}
+	if (pMapping->hMapping) {
+		CloseHandle(pMapping->hMapping);
+	}
+	if (pMapping->hFile) {
+		CloseHandle(pMapping->hFile);
+	}
+	if (pMapping->szTemp[0]) {
+		DeleteFileA(pMapping->szTemp);
+	}
+	memset(pMapping, 0, sizeof(DDSMAPPING));
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSGetMappedFace()
+// Desc: Index of a DDSCAPS2_CUBEMAP_ face in the file, which is the number
+//       of faces stored before it. 0 for textures that aren't cube maps.
+//-----------------------------------------------------------------------------
+DWORD DDSGetMappedFace(const DDSMAPPING* pMapping, DWORD dwCubeMapFace)
+{
+	DWORD dwBefore = pMapping->Header.ddsCaps.dwCaps2 &
+		DDSCAPS2_CUBEMAP_ALLFACES & (dwCubeMapFace - 1);
+	DWORD dwFace = 0;
+	while (dwBefore) {
+		dwBefore &= dwBefore - 1;
+		++dwFace;
+	}
+	return dwFace;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSGetMappedLevel()
+// Desc: Start of one level of one face in the mapped file, packed rows of
+//       pixels or blocks. NULL if there's no such level.
+//-----------------------------------------------------------------------------
+const void* DDSGetMappedLevel(
+	const DDSMAPPING* pMapping, DWORD dwFace, DWORD dwLevel)
+{
+	if (!pMapping->pView || dwFace >= pMapping->dwFaces ||
+		dwLevel >= pMapping->dwLevels) {
+		return NULL;
+	}
+	return pMapping->pView + pMapping->dwFirstOffset +
+		dwFace * pMapping->dwFaceBytes + pMapping->dwLevelOffset[dwLevel];
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSGetMappedSlice()
+// Desc: Start of one slice of one level of a mapped volume texture, which
+//       is the whole level for slice 0 of a 2D one. NULL if there's no such
+//       slice.
+//-----------------------------------------------------------------------------
+const void* DDSGetMappedSlice(
+	const DDSMAPPING* pMapping, DWORD dwLevel, DWORD dwSlice)
+{
+	const BYTE* pLevel =
+		(const BYTE*)DDSGetMappedLevel(pMapping, 0, dwLevel);
+	DWORD dwDepth = pMapping->dwDepth >> dwLevel;
+	if (!pLevel || dwSlice >= (dwDepth ? dwDepth : 1)) {
+		return NULL;
+	}
+	DWORD dwRowBytes;
+	DWORD dwRows;
+	GetLevelShape(pMapping, dwLevel, &dwRowBytes, &dwRows);
+	return pLevel + dwSlice * dwRowBytes * dwRows;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSCopyMappedLevel()
+// Desc: Copy one level into locked memory whose rows, of pixels or of
+//       blocks, are lDestPitch bytes apart. Only the pages of that level
+//       are read from the file. Only the first slice of a volume is copied.
+//-----------------------------------------------------------------------------
+void DDSCopyMappedLevel(const DDSMAPPING* pMapping, DWORD dwFace,
+	DWORD dwLevel, void* pDest, LONG lDestPitch)
+{
+	const BYTE* pSrc =
+		(const BYTE*)DDSGetMappedLevel(pMapping, dwFace, dwLevel);
+	if (!pSrc) {
+		return;
+	}
+	DWORD dwRowBytes;
+	DWORD dwRows;
+	GetLevelShape(pMapping, dwLevel, &dwRowBytes, &dwRows);
+	CopyRows(pDest, lDestPitch, pSrc, (LONG)dwRowBytes, dwRowBytes, dwRows);
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSCreateMappedFile()
+// Desc: Create a DDS file sized for every face and level pHeader describes
+//       and map it for writing. pHeaderDX10 is written after pHeader when
+//       its FourCC is FOURCC_DX10 and ignored otherwise. The levels are
+//       then filled in with DDSFillMappedLevel(). The file is written as
+//       pFileName with .tmp added, and DDSCommitMappedFile() moves it over
+//       pFileName. DDSUnmapFile() throws it away instead.
+//-----------------------------------------------------------------------------
+HRESULT DDSCreateMappedFile(const char* pFileName,
+	const DDSFILEHEADER* pHeader, const DDSHEADERDX10* pHeaderDX10,
+	DDSMAPPING* pMapping)
+{
+	DWORD dwMagic = FOURCC_DDS;
+	BOOL bDX10;
+	HRESULT hr;
+
+	if (!pFileName || !pHeader || !pMapping ||
+		pHeader->dwSize != sizeof(DDSFILEHEADER) ||
+		strlen(pFileName) >= MAX_PATH) {
+		return DDERR_INVALIDPARAMS;
+	}
+	memset(pMapping, 0, sizeof(DDSMAPPING));
+	memcpy(&pMapping->Header, pHeader, sizeof(DDSFILEHEADER));
+	pMapping->dwFirstOffset = 4 + sizeof(DDSFILEHEADER);
+	bDX10 = (pHeader->ddpfPixelFormat.dwFlags & DDPF_FOURCC) &&
+		(pHeader->ddpfPixelFormat.dwFourCC == FOURCC_DX10);
+	if (bDX10) {
+		if (!pHeaderDX10) {
+			return DDERR_INVALIDPARAMS;
+		}
+		pMapping->dwFirstOffset += sizeof(DDSHEADERDX10);
+		if (FAILED(hr = DDSReadDX10Header(pHeaderDX10,
+					   &pMapping->Header.ddpfPixelFormat,
+					   &pMapping->Header.ddsCaps))) {
+			return hr;
+		}
+	}
+	if (FAILED(hr = LayoutLevels(pMapping))) {
+		return hr;
+	}
+	pMapping->dwFileBytes =
+		pMapping->dwFirstOffset + pMapping->dwFaceBytes * pMapping->dwFaces;
+
+	strcpy(pMapping->szFile, pFileName);
+	strcpy(pMapping->szTemp, pFileName);
+	strcat(pMapping->szTemp, ".tmp");
+	pMapping->hFile = CreateFileA(pMapping->szTemp,
+		GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (pMapping->hFile == INVALID_HANDLE_VALUE) {
+		memset(pMapping, 0, sizeof(DDSMAPPING));
+		return DDERR_GENERIC;
+	}
+
+	// Mapping past the end grows the file to its final size in one step, so
+	// a full disk fails here and not halfway through the levels
+	hr = DDERR_GENERIC;
+	pMapping->hMapping = CreateFileMappingA(pMapping->hFile, NULL,
+		PAGE_READWRITE, 0, pMapping->dwFileBytes, NULL);
+	if (pMapping->hMapping) {
+		pMapping->pView = (const BYTE*)MapViewOfFile(
+			pMapping->hMapping, FILE_MAP_WRITE, 0, 0, 0);
+		if (pMapping->pView) {
+			BYTE* pView = (BYTE*)pMapping->pView;
+			memcpy(pView, &dwMagic, sizeof(dwMagic));
+			memcpy(pView + 4, pHeader, sizeof(DDSFILEHEADER));
+			if (bDX10) {
+				memcpy(pView + 4 + sizeof(DDSFILEHEADER), pHeaderDX10,
+					sizeof(DDSHEADERDX10));
+			}
+			hr = DD_OK;
+		}
+	}
+	if (FAILED(hr)) {
+		DDSUnmapFile(pMapping);
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSCommitMappedFile()
+// Desc: Flush a file from DDSCreateMappedFile() to disk, unmap it and move
+//       it over the target in one step. On failure the temporary file is
+//       deleted and the target is untouched. The mapping is closed either
+//       way.
+//-----------------------------------------------------------------------------
+HRESULT DDSCommitMappedFile(DDSMAPPING* pMapping)
+{
+	if (!pMapping || !pMapping->pView || !pMapping->szTemp[0]) {
+		return DDERR_INVALIDPARAMS;
+	}
+
+	// The new file has to be on disk before it replaces the old one
+	BOOL bOk = FlushViewOfFile(pMapping->pView, 0);
+	UnmapViewOfFile(pMapping->pView);
+	pMapping->pView = NULL;
+	CloseHandle(pMapping->hMapping);
+	pMapping->hMapping = NULL;
+	if (!FlushFileBuffers(pMapping->hFile)) {
+		bOk = FALSE;
+	}
+	CloseHandle(pMapping->hFile);
+	pMapping->hFile = NULL;
+
+	if (bOk && MoveFileExA(pMapping->szTemp, pMapping->szFile,
+				   MOVEFILE_REPLACE_EXISTING)) {
+		pMapping->szTemp[0] = 0;
+	} else {
+		bOk = FALSE;
+	}
+	DDSUnmapFile(pMapping);
+	return bOk ? DD_OK : DDERR_GENERIC;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DDSFillMappedLevel()
+// Desc: Copy one level into a file from DDSCreateMappedFile(), from locked
+//       memory whose rows, of pixels or of blocks, are lSrcPitch bytes
+//       apart. The padding is dropped on the way. Slices of a volume past
+//       the first are filled through DDSGetMappedSlice().
+//-----------------------------------------------------------------------------
+void DDSFillMappedLevel(DDSMAPPING* pMapping, DWORD dwFace, DWORD dwLevel,
+	const void* pSrc, LONG lSrcPitch)
+{
+	BYTE* pDest = (BYTE*)DDSGetMappedLevel(pMapping, dwFace, dwLevel);
+	if (!pDest) {
+		return;
+	}
+	DWORD dwRowBytes;
+	DWORD dwRows;
+	GetLevelShape(pMapping, dwLevel, &dwRowBytes, &dwRows);
+	CopyRows(pDest, (LONG)dwRowBytes, pSrc, lSrcPitch, dwRowBytes, dwRows);
+}
@@ -0,0 +1,90 @@
+/***************************************
+
+	Memory mapped DDS reader and writer
+
+	Maps a DDS file read only and works out where every face and mip level
+	starts from the header alone, so opening a texture costs a header parse
+	and a level is only paged in when something reads it. The file stays
+	open, and can't be written, until it's unmapped. Files are written
+	the same way, created at full size beside the target and filled in
+	level by level, then moved over the target once they're on disk.
+
+***************************************/
+
+#ifndef __DDSMAP_H__
+#define __DDSMAP_H__
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include "ddsfile.h"
+#include <ddraw.h>
+
+/***************************************
+
+	Most mip levels per face, enough for 32768 by 32768
+
+***************************************/
+
+#define DDSMAP_MAXLEVELS 16
+
+/***************************************
+
+	A mapped DDS file
+
+	Header holds the legacy header, with a DX10 header already folded
+	into its pixel format and caps. Faces are stored in the order of their
+	DDSCAPS2_CUBEMAP_ bits, each one a full chain of dwLevels levels. A
+	level of a volume texture is its slices one after the other, each
+	half as many as the level above down to 1.
+
+***************************************/
+
+typedef struct _DDSMAPPING {
+	HANDLE hFile;
+	HANDLE hMapping;
+	const BYTE* pView;     // Whole file, writable if DDSCreateMappedFile()
+	DWORD dwFileBytes;
+	DDSFILEHEADER Header;
+	DWORD dwFourCC;        // Block format, 0 if uncompressed
+	DWORD dwBitCount;      // Bits per pixel if uncompressed
+	DWORD dwFaces;         // 1, or the number of cube map faces
+	DWORD dwDepth;         // Slices in the top level, 1 unless a volume
+	DWORD dwLevels;        // Mip levels per face
+	DWORD dwFirstOffset;   // Where the first face starts
+	DWORD dwFaceBytes;     // Bytes from one face to the next
+	DWORD dwLevelOffset[DDSMAP_MAXLEVELS]; // From the start of a face
+	DWORD dwLevelBytes[DDSMAP_MAXLEVELS];
+	char szFile[MAX_PATH];     // Target of DDSCreateMappedFile()
+	char szTemp[MAX_PATH + 4]; // File being written, empty once it's moved
+} DDSMAPPING, *LPDDSMAPPING;
+
+/* Assume C declarations for C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern HRESULT DDSMapFile(const char* pFileName, DDSMAPPING* pMapping);
+extern void DDSUnmapFile(DDSMAPPING* pMapping);
+extern DWORD DDSGetMappedFace(const DDSMAPPING* pMapping, DWORD dwCubeMapFace);
+extern const void* DDSGetMappedLevel(
+	const DDSMAPPING* pMapping, DWORD dwFace, DWORD dwLevel);
+extern const void* DDSGetMappedSlice(
+	const DDSMAPPING* pMapping, DWORD dwLevel, DWORD dwSlice);
+extern void DDSCopyMappedLevel(const DDSMAPPING* pMapping, DWORD dwFace,
+	DWORD dwLevel, void* pDest, LONG lDestPitch);
+extern HRESULT DDSCreateMappedFile(const char* pFileName,
+	const DDSFILEHEADER* pHeader, const DDSHEADERDX10* pHeaderDX10,
+	DDSMAPPING* pMapping);
+extern HRESULT DDSCommitMappedFile(DDSMAPPING* pMapping);
+extern void DDSFillMappedLevel(DDSMAPPING* pMapping, DWORD dwFace,
+	DWORD dwLevel, const void* pSrc, LONG lSrcPitch);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
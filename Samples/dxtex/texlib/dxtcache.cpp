@@ -0,0 +1,562 @@
+//-----------------------------------------------------------------------------
+// File: dxtcache.cpp
+//
+// Desc: Compressed block cache.
+//
+//       Every entry is one file in the cache directory, named after its
+//       key, holding the blocks of one image with a short header that
+//       repeats the key, size and format so a stale or damaged file is
+//       never used. The index file lists the entries with their sizes and
+//       a use stamp, it's read when the cache is opened and written when
+//       it's closed or pruned. In between the entries live in an open
+//       addressed hash table guarded by a critical section, files are read
+//       and written outside of it.
+//
+//       An image is only stored once another thread isn't already storing
+//       it, and images compressed over their time budget aren't stored at
+//       all, so the cache never hands back a worse result than a fresh
+//       compression. Entry files the index doesn't know about, left by a
+//       process that didn't close the cache, are never pruned.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include "dxtcache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// Bump when the encoders change their output, so old entries stop matching
+//-----------------------------------------------------------------------------
+#define DXTCACHE_VERSION 1
+
+//-----------------------------------------------------------------------------
+// File layout
+//-----------------------------------------------------------------------------
+#define DXTCACHE_INDEX_MAGIC MAKEFOURCC('D', 'X', 'C', 'I')
+#define DXTCACHE_ENTRY_MAGIC MAKEFOURCC('D', 'X', 'C', 'E')
+#define DXTCACHE_INDEX_NAME "dxtcache.idx"
+
+//-----------------------------------------------------------------------------
+// Pruning goes down to this percentage of the limit, so it doesn't run again
+// on the very next store
+//-----------------------------------------------------------------------------
+#define DXTCACHE_PRUNE_PERCENT 90
+
+//-----------------------------------------------------------------------------
+// Encoder flags that change the blocks written
+//-----------------------------------------------------------------------------
+#define DXTCACHE_FLAG_MASK (DXTC_FIT_MASK | DXTC_BC1_ALPHA | DXTC_PERCEPTUAL)
+
+//-----------------------------------------------------------------------------
+// 64 bit constants built from halves, for compilers without LL suffixes
+//-----------------------------------------------------------------------------
+#define DXTCACHE_U64(hi, lo) (((ULONGLONG)(hi) << 32) | (ULONGLONG)(lo))
+
+//-----------------------------------------------------------------------------
+// State of a hash table slot
+//-----------------------------------------------------------------------------
+#define DXTCACHE_EMPTY 0   // Never used, ends a probe
+#define DXTCACHE_READY 1   // Entry file is complete
+#define DXTCACHE_PENDING 2 // Entry file is being written
+#define DXTCACHE_DEAD 3    // Removed, skipped until the table is rebuilt
+
+//-----------------------------------------------------------------------------
+// Header of every entry file, followed by the blocks, row after row
+//-----------------------------------------------------------------------------
+struct DXTCacheFileHeader {
+	DWORD dwMagic;
+	DWORD dwVersion;
+	DXTCACHEKEY Key;
+	DWORD dwFourCC;
+	DWORD dwWidth;
+	DWORD dwHeight;
+	DWORD dwBlockBytes;
+	float fColorRMSE;
+	float fAlphaRMSE;
+};
+
+//-----------------------------------------------------------------------------
+// One entry, as stored in the index file and the hash table
+//-----------------------------------------------------------------------------
+struct DXTCacheEntry {
+	DXTCACHEKEY Key;
+	DWORD dwBytes; // Size of the entry file
+	DWORD dwStamp; // Higher was used more recently
+	DWORD dwState; // DXTCACHE_ state, always READY in the index file
+};
+
+//-----------------------------------------------------------------------------
+// The cache
+//-----------------------------------------------------------------------------
+struct DXTCache {
+	CRITICAL_SECTION csLock; // Guards everything below
+	char szDirectory[MAX_PATH];
+	ULONGLONG uMaxBytes;
+	DXTCacheEntry* pTable;   // Open addressed, dwCapacity is a power of 2
+	DWORD dwCapacity;
+	DWORD dwUsed;            // Slots that aren't DXTCACHE_EMPTY
+	DWORD dwStamp;           // Next use stamp
+	DXTCACHESTATS Stats;
+};
+
+//-----------------------------------------------------------------------------
+// Name: Mix64()
+// Desc: Spread every input bit over the whole result
+//-----------------------------------------------------------------------------
+static ULONGLONG Mix64(ULONGLONG uValue)
+{
+	uValue ^= uValue >> 33;
+	uValue *= DXTCACHE_U64(0xFF51AFD7, 0xED558CCD);
+	uValue ^= uValue >> 33;
+	uValue *= DXTCACHE_U64(0xC4CEB9FE, 0x1A85EC53);
+	uValue ^= uValue >> 33;
+	return uValue;
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetEntryPath()
+// Desc: Name of the file holding an entry
+//-----------------------------------------------------------------------------
+static void GetEntryPath(
+	const DXTCache* pCache, const DXTCACHEKEY* pKey, char* pPath)
+{
+	sprintf(pPath, "%s\\%08lX%08lX%08lX%08lX.dxc", pCache->szDirectory,
+		(unsigned long)pKey->dwHash[0], (unsigned long)pKey->dwHash[1],
+		(unsigned long)pKey->dwHash[2], (unsigned long)pKey->dwHash[3]);
+}
+
+//-----------------------------------------------------------------------------
+// Name: FindSlot()
+// Desc: Slot holding pKey, or the empty slot that ends its probe
+//-----------------------------------------------------------------------------
+static DXTCacheEntry* FindSlot(const DXTCache* pCache, const DXTCACHEKEY* pKey)
+{
+	DWORD dwMask = pCache->dwCapacity - 1;
+	DWORD i = pKey->dwHash[0] & dwMask;
+	for (;;) {
+		DXTCacheEntry* pEntry = &pCache->pTable[i];
+		if (pEntry->dwState == DXTCACHE_EMPTY) {
+			return pEntry;
+		}
+		if (pEntry->dwState != DXTCACHE_DEAD &&
+			!memcmp(&pEntry->Key, pKey, sizeof(DXTCACHEKEY))) {
+			return pEntry;
+		}
+		i = (i + 1) & dwMask;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: Rehash()
+// Desc: Move the live entries to a table of dwCapacity slots, dropping dead
+//       ones. The old table is kept if there's no memory.
+//-----------------------------------------------------------------------------
+static BOOL Rehash(DXTCache* pCache, DWORD dwCapacity)
+{
+	DXTCacheEntry* pTable = new DXTCacheEntry[dwCapacity];
+	if (!pTable) {
+		return FALSE;
+	}
+	memset(pTable, 0, sizeof(DXTCacheEntry) * dwCapacity);
+	DXTCacheEntry* pOld = pCache->pTable;
+	DWORD dwOldCapacity = pCache->dwCapacity;
+	pCache->pTable = pTable;
+	pCache->dwCapacity = dwCapacity;
+	pCache->dwUsed = 0;
+	for (DWORD i = 0; i < dwOldCapacity; ++i) {
+		if (pOld[i].dwState == DXTCACHE_READY ||
+			pOld[i].dwState == DXTCACHE_PENDING) {
+			*FindSlot(pCache, &pOld[i].Key) = pOld[i];
+			++pCache->dwUsed;
+		}
+	}
+	delete[] pOld;
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: AddEntry()
+// Desc: Claim the empty slot FindSlot() returned, growing the table when
+//       it's half full. Returns the slot, which may have moved, or NULL.
+//-----------------------------------------------------------------------------
+static DXTCacheEntry* AddEntry(DXTCache* pCache, const DXTCACHEKEY* pKey,
+	DWORD dwBytes, DWORD dwStamp, DWORD dwState)
+{
+	if ((pCache->dwUsed + 1) * 2 > pCache->dwCapacity) {
+		if (!Rehash(pCache, pCache->dwCapacity * 2)) {
+			return NULL;
+		}
+	}
+	DXTCacheEntry* pEntry = FindSlot(pCache, pKey);
+	pEntry->Key = *pKey;
+	pEntry->dwBytes = dwBytes;
+	pEntry->dwStamp = dwStamp;
+	pEntry->dwState = dwState;
+	++pCache->dwUsed;
+	return pEntry;
+}
+
+//-----------------------------------------------------------------------------
+// Name: CompareStamps()
+// Desc: qsort() order for entry pointers, least recently used first
+//-----------------------------------------------------------------------------
+static int CompareStamps(const void* p1, const void* p2)
+{
+	DWORD dwStamp1 = (*(DXTCacheEntry* const*)p1)->dwStamp;
+	DWORD dwStamp2 = (*(DXTCacheEntry* const*)p2)->dwStamp;
+	return (dwStamp1 < dwStamp2) ? -1 : (dwStamp1 > dwStamp2) ? 1 : 0;
+}
+
+//-----------------------------------------------------------------------------
+// Name: WriteIndex()
+// Desc: Save the complete entries to the index file
+//-----------------------------------------------------------------------------
+static void WriteIndex(const DXTCache* pCache)
+{
+	char szPath[MAX_PATH + 16];
+	sprintf(szPath, "%s\\%s", pCache->szDirectory, DXTCACHE_INDEX_NAME);
+	FILE* fp = fopen(szPath, "wb");
+	if (!fp) {
+		return;
+	}
+	DWORD Header[4];
+	Header[0] = DXTCACHE_INDEX_MAGIC;
+	Header[1] = DXTCACHE_VERSION;
+	Header[2] = pCache->Stats.dwEntries;
+	Header[3] = pCache->dwStamp;
+	BOOL bOk = fwrite(Header, sizeof(Header), 1, fp) == 1;
+	for (DWORD i = 0; bOk && i < pCache->dwCapacity; ++i) {
+		if (pCache->pTable[i].dwState == DXTCACHE_READY) {
+			bOk =
+				fwrite(&pCache->pTable[i], sizeof(DXTCacheEntry), 1, fp) == 1;
+		}
+	}
+	if ((fclose(fp) != 0) || !bOk) {
+		remove(szPath);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: ReadIndex()
+// Desc: Load the entries listed in the index file, if there is one
+//-----------------------------------------------------------------------------
+static void ReadIndex(DXTCache* pCache)
+{
+	char szPath[MAX_PATH + 16];
+	sprintf(szPath, "%s\\%s", pCache->szDirectory, DXTCACHE_INDEX_NAME);
+	FILE* fp = fopen(szPath, "rb");
+	if (!fp) {
+		return;
+	}
+	DWORD Header[4];
+	if ((fread(Header, sizeof(Header), 1, fp) == 1) &&
+		(Header[0] == DXTCACHE_INDEX_MAGIC) &&
+		(Header[1] == DXTCACHE_VERSION)) {
+		pCache->dwStamp = Header[3];
+		for (DWORD i = 0; i < Header[2]; ++i) {
+			DXTCacheEntry Entry;
+			if (fread(&Entry, sizeof(Entry), 1, fp) != 1) {
+				break;
+			}
+			DXTCacheEntry* pSlot = FindSlot(pCache, &Entry.Key);
+			if (pSlot->dwState != DXTCACHE_EMPTY) {
+				continue;
+			}
+			if (!AddEntry(pCache, &Entry.Key, Entry.dwBytes, Entry.dwStamp,
+					DXTCACHE_READY)) {
+				break;
+			}
+			if (Entry.dwStamp >= pCache->dwStamp) {
+				pCache->dwStamp = Entry.dwStamp + 1;
+			}
+			++pCache->Stats.dwEntries;
+			pCache->Stats.uBytes += Entry.dwBytes;
+		}
+	}
+	fclose(fp);
+}
+
+//-----------------------------------------------------------------------------
+// Name: Prune()
+// Desc: Remove the least recently used entries until the cache is back
+//       under its limit. Entries being written are left alone. Called with
+//       the lock held.
+//-----------------------------------------------------------------------------
+static void Prune(DXTCache* pCache)
+{
+	if (pCache->Stats.uBytes <= pCache->uMaxBytes) {
+		return;
+	}
+	DXTCacheEntry** ppSorted =
+		new DXTCacheEntry*[pCache->Stats.dwEntries + 1];
+	if (!ppSorted) {
+		return;
+	}
+	DWORD dwCount = 0;
+	DWORD i;
+	for (i = 0; i < pCache->dwCapacity; ++i) {
+		if (pCache->pTable[i].dwState == DXTCACHE_READY) {
+			ppSorted[dwCount++] = &pCache->pTable[i];
+		}
+	}
+	qsort(ppSorted, dwCount, sizeof(DXTCacheEntry*), CompareStamps);
+
+	ULONGLONG uTarget = (pCache->uMaxBytes / 100) * DXTCACHE_PRUNE_PERCENT;
+	for (i = 0; (i < dwCount) && (pCache->Stats.uBytes > uTarget); ++i) {
+		char szPath[MAX_PATH + 48];
+		GetEntryPath(pCache, &ppSorted[i]->Key, szPath);
+		remove(szPath);
+		ppSorted[i]->dwState = DXTCACHE_DEAD;
+		pCache->Stats.uBytes -= ppSorted[i]->dwBytes;
+		--pCache->Stats.dwEntries;
+		++pCache->Stats.dwEvictions;
+	}
+	delete[] ppSorted;
+	Rehash(pCache, pCache->dwCapacity);
+	WriteIndex(pCache);
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTCacheOpen()
+// Desc: Open the cache in an existing directory, pruning it to
+//       dwMaxMegabytes if it's over
+//-----------------------------------------------------------------------------
+HRESULT DXTCacheOpen(
+	const char* pDirectory, DWORD dwMaxMegabytes, DXTCache** ppCache)
+{
+	*ppCache = NULL;
+	if (strlen(pDirectory) + 40 > MAX_PATH) {
+		return DDERR_INVALIDPARAMS;
+	}
+	DXTCache* pCache = new DXTCache;
+	if (!pCache) {
+		return DDERR_OUTOFMEMORY;
+	}
+	memset(pCache, 0, sizeof(DXTCache));
+	pCache->dwCapacity = 1024;
+	pCache->pTable = new DXTCacheEntry[pCache->dwCapacity];
+	if (!pCache->pTable) {
+		delete pCache;
+		return DDERR_OUTOFMEMORY;
+	}
+	memset(pCache->pTable, 0, sizeof(DXTCacheEntry) * pCache->dwCapacity);
+	strcpy(pCache->szDirectory, pDirectory);
+	pCache->uMaxBytes = (ULONGLONG)dwMaxMegabytes << 20;
+	InitializeCriticalSection(&pCache->csLock);
+
+	ReadIndex(pCache);
+	Prune(pCache);
+	pCache->Stats.dwEvictions = 0;
+	*ppCache = pCache;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTCacheClose()
+// Desc: Save the index and release the cache. Every load and store must
+//       have returned.
+//-----------------------------------------------------------------------------
+void DXTCacheClose(DXTCache* pCache)
+{
+	if (pCache) {
+		Prune(pCache);
+		WriteIndex(pCache);
+		DeleteCriticalSection(&pCache->csLock);
+		delete[] pCache->pTable;
+		delete pCache;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTCacheGetKey()
+// Desc: Hash the source pixels of a job with everything else that decides
+//       the blocks it makes
+//-----------------------------------------------------------------------------
+void DXTCacheGetKey(const DXTCOMPRESSJOB* pJob, DXTCACHEKEY* pKey)
+{
+	// FNV-1a on whole pixels in one lane, multiply and shift in the other
+	ULONGLONG uHash1 = DXTCACHE_U64(0xCBF29CE4, 0x84222325);
+	ULONGLONG uHash2 = DXTCACHE_U64(0x9E3779B9, 0x7F4A7C15);
+	const ULONGLONG uPrime1 = DXTCACHE_U64(0x00000100, 0x000001B3);
+	const ULONGLONG uPrime2 = DXTCACHE_U64(0x9E3779B9, 0x7F4A7C15);
+	const BYTE* pRow = static_cast<const BYTE*>(pJob->pSrc);
+	for (DWORD y = 0; y < pJob->dwHeight; ++y) {
+		const DWORD* pdwPixels = reinterpret_cast<const DWORD*>(pRow);
+		for (DWORD x = 0; x < pJob->dwWidth; ++x) {
+			uHash1 = (uHash1 ^ pdwPixels[x]) * uPrime1;
+			uHash2 = (uHash2 + pdwPixels[x]) * uPrime2;
+			uHash2 ^= uHash2 >> 29;
+		}
+		pRow += pJob->lSrcPitch;
+	}
+
+	ULONGLONG uShape = ((ULONGLONG)pJob->dwWidth << 32) | pJob->dwHeight;
+	ULONGLONG uFormat = ((ULONGLONG)pJob->dwFourCC << 32) |
+		(pJob->dwFlags & DXTCACHE_FLAG_MASK) | (DXTCACHE_VERSION << 24);
+	ULONGLONG uKey1 = Mix64(uHash1 ^ Mix64(uShape));
+	ULONGLONG uKey2 = Mix64(uHash2 ^ Mix64(uFormat + uKey1));
+	uKey1 = Mix64(uKey1 ^ uFormat);
+	pKey->dwHash[0] = (DWORD)uKey1;
+	pKey->dwHash[1] = (DWORD)(uKey1 >> 32);
+	pKey->dwHash[2] = (DWORD)uKey2;
+	pKey->dwHash[3] = (DWORD)(uKey2 >> 32);
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTCacheLoad()
+// Desc: Copy the blocks for pKey to the destination of pJob and fill in its
+//       error. FALSE on a miss, pJob then still needs compressing.
+//-----------------------------------------------------------------------------
+BOOL DXTCacheLoad(
+	DXTCache* pCache, const DXTCACHEKEY* pKey, DXTCOMPRESSJOB* pJob)
+{
+	EnterCriticalSection(&pCache->csLock);
+	DXTCacheEntry* pEntry = FindSlot(pCache, pKey);
+	BOOL bFound = (pEntry->dwState == DXTCACHE_READY);
+	if (bFound) {
+		pEntry->dwStamp = pCache->dwStamp++;
+	} else {
+		++pCache->Stats.dwMisses;
+	}
+	LeaveCriticalSection(&pCache->csLock);
+	if (!bFound) {
+		return FALSE;
+	}
+
+	// Check the file is what the index says before using it
+	char szPath[MAX_PATH + 48];
+	DXTCacheFileHeader Header;
+	DWORD dwPitch = DXTGetPitch(pJob->dwFourCC, pJob->dwWidth);
+	DWORD dwRows = (pJob->dwHeight + 3) >> 2;
+	BOOL bOk = FALSE;
+	GetEntryPath(pCache, pKey, szPath);
+	FILE* fp = fopen(szPath, "rb");
+	if (fp) {
+		bOk = (fread(&Header, sizeof(Header), 1, fp) == 1) &&
+			(Header.dwMagic == DXTCACHE_ENTRY_MAGIC) &&
+			(Header.dwVersion == DXTCACHE_VERSION) &&
+			!memcmp(&Header.Key, pKey, sizeof(DXTCACHEKEY)) &&
+			(Header.dwFourCC == pJob->dwFourCC) &&
+			(Header.dwWidth == pJob->dwWidth) &&
+			(Header.dwHeight == pJob->dwHeight) &&
+			(Header.dwBlockBytes == dwPitch * dwRows);
+		BYTE* pDest = static_cast<BYTE*>(pJob->pDest);
+		for (DWORD y = 0; bOk && (y < dwRows); ++y) {
+			bOk = fread(pDest, 1, dwPitch, fp) == dwPitch;
+			pDest += pJob->lDestPitch;
+		}
+		fclose(fp);
+	}
+
+	// A missing or damaged file is dropped, so the next store replaces it
+	EnterCriticalSection(&pCache->csLock);
+	if (bOk) {
+		++pCache->Stats.dwHits;
+		pCache->Stats.uHitBytes += dwPitch * dwRows;
+	} else {
+		++pCache->Stats.dwMisses;
+		pEntry = FindSlot(pCache, pKey);
+		if (pEntry->dwState == DXTCACHE_READY) {
+			pEntry->dwState = DXTCACHE_DEAD;
+			--pCache->Stats.dwEntries;
+			pCache->Stats.uBytes -= pEntry->dwBytes;
+		}
+	}
+	LeaveCriticalSection(&pCache->csLock);
+	if (bOk) {
+		pJob->fColorRMSE = Header.fColorRMSE;
+		pJob->fAlphaRMSE = Header.fAlphaRMSE;
+		pJob->dwLateRows = 0;
+	}
+	return bOk;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTCacheStore()
+// Desc: Add the blocks of a compressed job. S_FALSE if the key is already
+//       there or being stored by another thread, or if the job ran over its
+//       time budget.
+//-----------------------------------------------------------------------------
+HRESULT DXTCacheStore(
+	DXTCache* pCache, const DXTCACHEKEY* pKey, const DXTCOMPRESSJOB* pJob)
+{
+	if (pJob->dwLateRows) {
+		return S_FALSE;
+	}
+	EnterCriticalSection(&pCache->csLock);
+	DXTCacheEntry* pEntry = FindSlot(pCache, pKey);
+	if (pEntry->dwState != DXTCACHE_EMPTY) {
+		LeaveCriticalSection(&pCache->csLock);
+		return S_FALSE;
+	}
+	pEntry = AddEntry(pCache, pKey, 0, pCache->dwStamp++, DXTCACHE_PENDING);
+	LeaveCriticalSection(&pCache->csLock);
+	if (!pEntry) {
+		return DDERR_OUTOFMEMORY;
+	}
+
+	char szPath[MAX_PATH + 48];
+	DXTCacheFileHeader Header;
+	DWORD dwPitch = DXTGetPitch(pJob->dwFourCC, pJob->dwWidth);
+	DWORD dwRows = (pJob->dwHeight + 3) >> 2;
+	Header.dwMagic = DXTCACHE_ENTRY_MAGIC;
+	Header.dwVersion = DXTCACHE_VERSION;
+	Header.Key = *pKey;
+	Header.dwFourCC = pJob->dwFourCC;
+	Header.dwWidth = pJob->dwWidth;
+	Header.dwHeight = pJob->dwHeight;
+	Header.dwBlockBytes = dwPitch * dwRows;
+	Header.fColorRMSE = pJob->fColorRMSE;
+	Header.fAlphaRMSE = pJob->fAlphaRMSE;
+	GetEntryPath(pCache, pKey, szPath);
+	FILE* fp = fopen(szPath, "wb");
+	BOOL bOk = FALSE;
+	if (fp) {
+		bOk = fwrite(&Header, sizeof(Header), 1, fp) == 1;
+		const BYTE* pSrc = static_cast<const BYTE*>(pJob->pDest);
+		for (DWORD y = 0; bOk && (y < dwRows); ++y) {
+			bOk = fwrite(pSrc, 1, dwPitch, fp) == dwPitch;
+			pSrc += pJob->lDestPitch;
+		}
+		if (fclose(fp) != 0) {
+			bOk = FALSE;
+		}
+		if (!bOk) {
+			remove(szPath);
+		}
+	}
+
+	// The table may have been rebuilt while the file was written
+	EnterCriticalSection(&pCache->csLock);
+	pEntry = FindSlot(pCache, pKey);
+	if (bOk) {
+		pEntry->dwState = DXTCACHE_READY;
+		pEntry->dwBytes = sizeof(Header) + Header.dwBlockBytes;
+		++pCache->Stats.dwStores;
+		++pCache->Stats.dwEntries;
+		pCache->Stats.uBytes += pEntry->dwBytes;
+		Prune(pCache);
+	} else {
+		pEntry->dwState = DXTCACHE_DEAD;
+	}
+	LeaveCriticalSection(&pCache->csLock);
+	return bOk ? DD_OK : DDERR_GENERIC;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTCacheGetStats()
+// Desc: Copy the counters
+//-----------------------------------------------------------------------------
+void DXTCacheGetStats(DXTCache* pCache, DXTCACHESTATS* pStats)
+{
+	EnterCriticalSection(&pCache->csLock);
+	*pStats = pCache->Stats;
+	LeaveCriticalSection(&pCache->csLock);
+}
@@ -0,0 +1,78 @@
+/***************************************
+
+	Compressed block cache
+
+	Keeps the blocks of compressed images in a directory, keyed by a hash
+	of the source pixels, the size, the format and the encoder flags, so a
+	rebuild only compresses the mip levels and faces that changed. The
+	cache is kept under a size limit by removing the least recently used
+	entries. All calls may be made from several threads at once.
+
+***************************************/
+
+#ifndef __DXTCACHE_H__
+#define __DXTCACHE_H__
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include "dxtcodec.h"
+#include <ddraw.h>
+
+/***************************************
+
+	Opaque cache object
+
+***************************************/
+
+typedef struct DXTCache DXTCache;
+
+/***************************************
+
+	128 bit key of one compressed image
+
+***************************************/
+
+typedef struct _DXTCACHEKEY {
+	DWORD dwHash[4];
+} DXTCACHEKEY, *LPDXTCACHEKEY;
+
+/***************************************
+
+	Counters since the cache was opened
+
+***************************************/
+
+typedef struct _DXTCACHESTATS {
+	DWORD dwHits;        // Images copied from the cache
+	DWORD dwMisses;      // Images that had to be compressed
+	DWORD dwStores;      // Images added to the cache
+	DWORD dwEvictions;   // Entries removed to stay under the limit
+	DWORD dwEntries;     // Entries in the cache now
+	ULONGLONG uBytes;    // Size of those entries
+	ULONGLONG uHitBytes; // Block bytes copied instead of compressed
+} DXTCACHESTATS, *LPDXTCACHESTATS;
+
+/* Assume C declarations for C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern HRESULT DXTCacheOpen(
+	const char* pDirectory, DWORD dwMaxMegabytes, DXTCache** ppCache);
+extern void DXTCacheClose(DXTCache* pCache);
+extern void DXTCacheGetKey(const DXTCOMPRESSJOB* pJob, DXTCACHEKEY* pKey);
+extern BOOL DXTCacheLoad(
+	DXTCache* pCache, const DXTCACHEKEY* pKey, DXTCOMPRESSJOB* pJob);
+extern HRESULT DXTCacheStore(
+	DXTCache* pCache, const DXTCACHEKEY* pKey, const DXTCOMPRESSJOB* pJob);
+extern void DXTCacheGetStats(DXTCache* pCache, DXTCACHESTATS* pStats);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
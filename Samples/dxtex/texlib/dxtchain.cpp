@@ -0,0 +1,224 @@
+//-----------------------------------------------------------------------------
+// File: dxtchain.cpp
+//
+// Desc: Face and mip level table of a DirectDraw texture.
+//
+//       The table and the surface pointers after it are one allocation.
+//       Cube map faces are six bits in a row of dwCaps2, so a face's slot
+//       is found by counting the faces below its bit, and its levels are
+//       dwLevels pointers on from there.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include "dxtchain.h"
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// Name: GetFaceSlot()
+// Desc: Which face of the table holds dwCubeMapFace, a single
+//       DDSCAPS2_CUBEMAP_ bit, or 0 for the top face. Returns dwFaces if the
+//       texture doesn't have it.
+//-----------------------------------------------------------------------------
+static DWORD GetFaceSlot(const DXTSURFACECHAIN* pChain, DWORD dwCubeMapFace)
+{
+	if (dwCubeMapFace == 0) {
+		return 0;
+	}
+	if ((dwCubeMapFace & (dwCubeMapFace - 1)) ||
+		!(dwCubeMapFace & pChain->dwCubeMapFlags)) {
+		return pChain->dwFaces;
+	}
+	DWORD dwBelow = pChain->dwCubeMapFlags & (dwCubeMapFace - 1);
+	DWORD dwSlot = 0;
+	while (dwBelow) {
+		dwBelow &= dwBelow - 1;
+		++dwSlot;
+	}
+	return dwSlot;
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetLevelBytes()
+// Desc: Bytes in one level, counted the way DirectDraw describes it
+//-----------------------------------------------------------------------------
+static DWORD GetLevelBytes(const DDSURFACEDESC2* pddsd)
+{
+	if (pddsd->dwFlags & DDSD_LINEARSIZE) {
+		return pddsd->dwLinearSize;
+	}
+	return pddsd->dwWidth * pddsd->dwHeight *
+		(pddsd->ddpfPixelFormat.dwRGBBitCount / 8);
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTChainCreate()
+// Desc: Walk every face and mip level of pddsTop once and build its table.
+//       Every face must have the same number of levels.
+//-----------------------------------------------------------------------------
+HRESULT DXTChainCreate(IDirectDrawSurface7* pddsTop, DXTSURFACECHAIN** ppChain)
+{
+	IDirectDrawSurface7* pddsLevels[6][DXTCHAIN_MAXLEVELS];
+	DXTSURFACECHAIN Chain;
+	DDSURFACEDESC2 ddsd;
+	DDSCAPS2 ddsCaps;
+	DWORD dwFace;
+	DWORD dwLevel;
+	DWORD dwCount;
+	HRESULT hr;
+
+	*ppChain = NULL;
+	memset(&Chain, 0, sizeof(Chain));
+	memset(pddsLevels, 0, sizeof(pddsLevels));
+	memset(&ddsd, 0, sizeof(ddsd));
+	ddsd.dwSize = sizeof(ddsd);
+	hr = pddsTop->GetSurfaceDesc(&ddsd);
+	if (FAILED(hr)) {
+		return hr;
+	}
+	Chain.pddsTop = pddsTop;
+
+	// The top of each face. The texture is the first face and only has
+	// its own bit, the others are found by asking for each one.
+	if (!(ddsd.ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP)) {
+		pddsLevels[0][0] = pddsTop;
+		pddsTop->AddRef();
+		Chain.dwFaces = 1;
+	}
+	for (DWORD dwBit = DDSCAPS2_CUBEMAP_POSITIVEX;
+		(ddsd.ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP) &&
+		dwBit <= DDSCAPS2_CUBEMAP_NEGATIVEZ; dwBit <<= 1) {
+		IDirectDrawSurface7** ppddsFace = &pddsLevels[Chain.dwFaces][0];
+		if (ddsd.ddsCaps.dwCaps2 & dwBit) {
+			*ppddsFace = pddsTop;
+			pddsTop->AddRef();
+		} else {
+			memset(&ddsCaps, 0, sizeof(ddsCaps));
+			ddsCaps.dwCaps2 = dwBit;
+			if (FAILED(pddsTop->GetAttachedSurface(&ddsCaps, ppddsFace))) {
+				*ppddsFace = NULL;
+				continue;
+			}
+		}
+		Chain.dwCubeMapFlags |= dwBit;
+		++Chain.dwFaces;
+	}
+	if (!Chain.dwFaces) {
+		hr = DDERR_INVALIDOBJECT;
+	}
+
+	// Each face's mip levels, and the size of each from the first face
+	memset(&ddsCaps, 0, sizeof(ddsCaps));
+	ddsCaps.dwCaps = DDSCAPS_TEXTURE;
+	ddsCaps.dwCaps2 = DDSCAPS2_MIPMAPSUBLEVEL;
+	for (dwFace = 0; dwFace < Chain.dwFaces && SUCCEEDED(hr); ++dwFace) {
+		dwCount = 1;
+		while (dwCount < DXTCHAIN_MAXLEVELS &&
+			SUCCEEDED(pddsLevels[dwFace][dwCount - 1]->GetAttachedSurface(
+				&ddsCaps, &pddsLevels[dwFace][dwCount]))) {
+			++dwCount;
+		}
+		if (!dwFace) {
+			Chain.dwLevels = dwCount;
+		} else if (dwCount != Chain.dwLevels) {
+			hr = DDERR_INVALIDOBJECT;
+		}
+	}
+	for (dwLevel = 0; dwLevel < Chain.dwLevels && SUCCEEDED(hr); ++dwLevel) {
+		memset(&ddsd, 0, sizeof(ddsd));
+		ddsd.dwSize = sizeof(ddsd);
+		hr = pddsLevels[0][dwLevel]->GetSurfaceDesc(&ddsd);
+		Chain.dwLevelOffset[dwLevel] = Chain.dwFaceBytes;
+		Chain.dwLevelBytes[dwLevel] = GetLevelBytes(&ddsd);
+		Chain.dwFaceBytes += Chain.dwLevelBytes[dwLevel];
+	}
+	Chain.dwTotalBytes = Chain.dwFaceBytes * Chain.dwFaces;
+
+	// The table with the surfaces right behind it
+	BYTE* pbBlock = NULL;
+	if (SUCCEEDED(hr)) {
+		pbBlock = new BYTE[sizeof(DXTSURFACECHAIN) +
+			sizeof(IDirectDrawSurface7*) * Chain.dwFaces * Chain.dwLevels];
+		if (!pbBlock) {
+			hr = DDERR_OUTOFMEMORY;
+		}
+	}
+	if (SUCCEEDED(hr)) {
+		DXTSURFACECHAIN* pChain = reinterpret_cast<DXTSURFACECHAIN*>(pbBlock);
+		*pChain = Chain;
+		pChain->ppddsLevels = reinterpret_cast<IDirectDrawSurface7**>(
+			pbBlock + sizeof(DXTSURFACECHAIN));
+		for (dwFace = 0; dwFace < Chain.dwFaces; ++dwFace) {
+			memcpy(pChain->ppddsLevels + dwFace * Chain.dwLevels,
+				pddsLevels[dwFace],
+				sizeof(IDirectDrawSurface7*) * Chain.dwLevels);
+		}
+		pddsTop->AddRef();
+		*ppChain = pChain;
+		return DD_OK;
+	}
+	for (dwFace = 0; dwFace < 6; ++dwFace) {
+		for (dwLevel = 0; dwLevel < DXTCHAIN_MAXLEVELS; ++dwLevel) {
+			if (pddsLevels[dwFace][dwLevel]) {
+				pddsLevels[dwFace][dwLevel]->Release();
+			}
+		}
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTChainDestroy()
+// Desc: Let go of every surface in the table and the table itself
+//-----------------------------------------------------------------------------
+void DXTChainDestroy(DXTSURFACECHAIN* pChain)
+{
+	if (pChain) {
+		DWORD dwCount = pChain->dwFaces * pChain->dwLevels;
+		for (DWORD i = 0; i < dwCount; ++i) {
+			pChain->ppddsLevels[i]->Release();
+		}
+		pChain->pddsTop->Release();
+		delete[] reinterpret_cast<BYTE*>(pChain);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTChainGetLevel()
+// Desc: Level dwLevel of face dwCubeMapFace, a DDSCAPS2_CUBEMAP_ bit or 0
+//       for the top face. NULL if there's no such face or level. No
+//       reference is added, the table keeps it alive.
+//-----------------------------------------------------------------------------
+IDirectDrawSurface7* DXTChainGetLevel(
+	const DXTSURFACECHAIN* pChain, DWORD dwCubeMapFace, DWORD dwLevel)
+{
+	DWORD dwSlot = GetFaceSlot(pChain, dwCubeMapFace);
+	if (dwSlot >= pChain->dwFaces || dwLevel >= pChain->dwLevels) {
+		return NULL;
+	}
+	return pChain->ppddsLevels[dwSlot * pChain->dwLevels + dwLevel];
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTChainFindLevel()
+// Desc: Level dwLevel of the face whose top level is pddsFaceTop, NULL if
+//       pddsFaceTop isn't the top of one of the table's faces
+//-----------------------------------------------------------------------------
+IDirectDrawSurface7* DXTChainFindLevel(const DXTSURFACECHAIN* pChain,
+	IDirectDrawSurface7* pddsFaceTop, DWORD dwLevel)
+{
+	if (dwLevel >= pChain->dwLevels) {
+		return NULL;
+	}
+	for (DWORD dwFace = 0; dwFace < pChain->dwFaces; ++dwFace) {
+		if (pChain->ppddsLevels[dwFace * pChain->dwLevels] == pddsFaceTop) {
+			return pChain->ppddsLevels[dwFace * pChain->dwLevels + dwLevel];
+		}
+	}
+	return NULL;
+}
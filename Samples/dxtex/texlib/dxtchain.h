@@ -0,0 +1,74 @@
+/***************************************
+
+	Face and mip level table of a DirectDraw texture
+
+	A complex surface only hands out its faces and mip levels one
+	GetAttachedSurface() at a time, so finding level N of a face means N
+	calls, each with its own AddRef() and Release(). This walks the
+	texture once and keeps every face and level in a single allocation,
+	with the size of each level and where it sits in DDS file order, so
+	finding a level or adding up the whole texture is a table lookup. The
+	surfaces in it are the texture's own, so each one is still a normal
+	IDirectDrawSurface7 to lock or Blt().
+
+***************************************/
+
+#ifndef __DXTCHAIN_H__
+#define __DXTCHAIN_H__
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include <ddraw.h>
+
+/***************************************
+
+	Most mip levels per face, enough for 32768 by 32768
+
+***************************************/
+
+#define DXTCHAIN_MAXLEVELS 16
+
+/***************************************
+
+	A texture's faces and levels
+
+	Faces are in the order of their DDSCAPS2_CUBEMAP_ bits, the order a DDS
+	file stores them in, each one a full chain of dwLevels levels. The
+	chain holds a reference on every surface in it.
+
+***************************************/
+
+typedef struct _DXTSURFACECHAIN {
+	IDirectDrawSurface7* pddsTop; // The texture the table was built from
+	DWORD dwCubeMapFlags;  // DDSCAPS2_CUBEMAP_ faces, 0 if not a cube map
+	DWORD dwFaces;         // 1, or the number of cube map faces
+	DWORD dwLevels;        // Mip levels per face
+	DWORD dwFaceBytes;     // Bytes from one face to the next
+	DWORD dwTotalBytes;    // Bytes in every face and level
+	DWORD dwLevelOffset[DXTCHAIN_MAXLEVELS]; // From the start of a face
+	DWORD dwLevelBytes[DXTCHAIN_MAXLEVELS];
+	IDirectDrawSurface7** ppddsLevels; // dwLevels per face, face by face
+} DXTSURFACECHAIN, *LPDXTSURFACECHAIN;
+
+/* Assume C declarations for C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern HRESULT DXTChainCreate(
+	IDirectDrawSurface7* pddsTop, DXTSURFACECHAIN** ppChain);
+extern void DXTChainDestroy(DXTSURFACECHAIN* pChain);
+extern IDirectDrawSurface7* DXTChainGetLevel(
+	const DXTSURFACECHAIN* pChain, DWORD dwCubeMapFace, DWORD dwLevel);
+extern IDirectDrawSurface7* DXTChainFindLevel(const DXTSURFACECHAIN* pChain,
+	IDirectDrawSurface7* pddsFaceTop, DWORD dwLevel);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
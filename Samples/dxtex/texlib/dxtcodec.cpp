@@ -0,0 +1,1995 @@
+//-----------------------------------------------------------------------------
+// File: dxtcodec.cpp
+//
+// Desc: DXTn block encoder and decoder.
+//
+//       Each 4x4 block is reduced to its distinct colors, which are fitted
+//       with the corners of their bounding box (box fit), the extremes
+//       along their principal axis (range fit) or by trying every ordered
+//       split of the colors across the palette entries and solving each
+//       split for its best endpoints by least squares (cluster fit). The
+//       refined cluster fit sorts again along the axis of the endpoints it
+//       found until that stops helping. Candidates are scored against the
+//       palette exactly as a decoder rebuilds it. On x86 and x64 the fits
+//       run on SSE2 registers, four channels or four texels at a time.
+//
+//       Decoding rebuilds the palettes of eight blocks at once, one block
+//       per 16 bit SSE2 lane, then expands the indices.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include "dxtcodec.h"
+#include "bc7codec.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define DXTC_SSE2
+#include <emmintrin.h>
+#endif
+
+//-----------------------------------------------------------------------------
+// Larger than any block error
+//-----------------------------------------------------------------------------
+#define DXTC_MAX_ERROR 3.4e38f
+
+//-----------------------------------------------------------------------------
+// Luminance weights used by DXTC_PERCEPTUAL
+//-----------------------------------------------------------------------------
+#define DXTC_LUMA_RED 0.2126f
+#define DXTC_LUMA_GREEN 0.7152f
+#define DXTC_LUMA_BLUE 0.0722f
+
+//-----------------------------------------------------------------------------
+// Most passes of the refined cluster fit
+//-----------------------------------------------------------------------------
+#define DXTC_REFINE_PASSES 8
+
+//-----------------------------------------------------------------------------
+// Four floats, held in one SSE2 register when available. The fits keep red,
+// green and blue in x, y and z and a weight in w.
+//-----------------------------------------------------------------------------
+#if defined(DXTC_SSE2)
+class Vec4 {
+public:
+	Vec4() {}
+	explicit Vec4(__m128 v) : m_v(v) {}
+	explicit Vec4(float f) : m_v(_mm_set1_ps(f)) {}
+	Vec4(float x, float y, float z, float w) : m_v(_mm_setr_ps(x, y, z, w)) {}
+
+	void Store(float* pf) const { _mm_storeu_ps(pf, m_v); }
+	float X() const { float f; _mm_store_ss(&f, m_v); return f; }
+	Vec4 SplatW() const { return Vec4(_mm_shuffle_ps(m_v, m_v, 0xFF)); }
+
+	Vec4& operator+=(const Vec4& v) { m_v = _mm_add_ps(m_v, v.m_v); return *this; }
+	friend Vec4 operator+(const Vec4& a, const Vec4& b) { return Vec4(_mm_add_ps(a.m_v, b.m_v)); }
+	friend Vec4 operator-(const Vec4& a, const Vec4& b) { return Vec4(_mm_sub_ps(a.m_v, b.m_v)); }
+	friend Vec4 operator*(const Vec4& a, const Vec4& b) { return Vec4(_mm_mul_ps(a.m_v, b.m_v)); }
+	friend Vec4 Reciprocal(const Vec4& v) { return Vec4(_mm_div_ps(_mm_set1_ps(1.0f), v.m_v)); }
+	friend Vec4 Min(const Vec4& a, const Vec4& b) { return Vec4(_mm_min_ps(a.m_v, b.m_v)); }
+	friend Vec4 Max(const Vec4& a, const Vec4& b) { return Vec4(_mm_max_ps(a.m_v, b.m_v)); }
+	friend Vec4 Truncate(const Vec4& v) { return Vec4(_mm_cvtepi32_ps(_mm_cvttps_epi32(v.m_v))); }
+	friend float Dot3(const Vec4& a, const Vec4& b)
+	{
+		float f[4];
+		_mm_storeu_ps(f, _mm_mul_ps(a.m_v, b.m_v));
+		return f[0] + f[1] + f[2];
+	}
+
+private:
+	__m128 m_v;
+};
+#else
+class Vec4 {
+public:
+	Vec4() {}
+	explicit Vec4(float f) : m_x(f), m_y(f), m_z(f), m_w(f) {}
+	Vec4(float x, float y, float z, float w) : m_x(x), m_y(y), m_z(z), m_w(w) {}
+
+	void Store(float* pf) const { pf[0] = m_x; pf[1] = m_y; pf[2] = m_z; pf[3] = m_w; }
+	float X() const { return m_x; }
+	Vec4 SplatW() const { return Vec4(m_w); }
+
+	Vec4& operator+=(const Vec4& v) { m_x += v.m_x; m_y += v.m_y; m_z += v.m_z; m_w += v.m_w; return *this; }
+	friend Vec4 operator+(const Vec4& a, const Vec4& b) { return Vec4(a.m_x + b.m_x, a.m_y + b.m_y, a.m_z + b.m_z, a.m_w + b.m_w); }
+	friend Vec4 operator-(const Vec4& a, const Vec4& b) { return Vec4(a.m_x - b.m_x, a.m_y - b.m_y, a.m_z - b.m_z, a.m_w - b.m_w); }
+	friend Vec4 operator*(const Vec4& a, const Vec4& b) { return Vec4(a.m_x * b.m_x, a.m_y * b.m_y, a.m_z * b.m_z, a.m_w * b.m_w); }
+	friend Vec4 Reciprocal(const Vec4& v) { return Vec4(1.0f / v.m_x, 1.0f / v.m_y, 1.0f / v.m_z, 1.0f / v.m_w); }
+	friend Vec4 Min(const Vec4& a, const Vec4& b)
+	{
+		return Vec4(a.m_x < b.m_x ? a.m_x : b.m_x, a.m_y < b.m_y ? a.m_y : b.m_y,
+			a.m_z < b.m_z ? a.m_z : b.m_z, a.m_w < b.m_w ? a.m_w : b.m_w);
+	}
+	friend Vec4 Max(const Vec4& a, const Vec4& b)
+	{
+		return Vec4(a.m_x > b.m_x ? a.m_x : b.m_x, a.m_y > b.m_y ? a.m_y : b.m_y,
+			a.m_z > b.m_z ? a.m_z : b.m_z, a.m_w > b.m_w ? a.m_w : b.m_w);
+	}
+	friend Vec4 Truncate(const Vec4& v) { return Vec4((float)(int)v.m_x, (float)(int)v.m_y, (float)(int)v.m_z, (float)(int)v.m_w); }
+	friend float Dot3(const Vec4& a, const Vec4& b) { return a.m_x * b.m_x + a.m_y * b.m_y + a.m_z * b.m_z; }
+
+private:
+	float m_x;
+	float m_y;
+	float m_z;
+	float m_w;
+};
+#endif
+
+//-----------------------------------------------------------------------------
+// One block being encoded
+//-----------------------------------------------------------------------------
+struct DXTBlock {
+	UINT uCount;           // Number of distinct opaque colors
+	Vec4 Points[16];       // Those colors, 0.0 to 1.0, w is unused
+	float fWeights[16];    // Texels sharing each color
+	float fRed[16];        // Texel colors, 0 to 255, for scoring
+	float fGreen[16];
+	float fBlue[16];
+	float fTexelWeights[16]; // 0 for absent or transparent texels
+	float fMetric[3];      // Squared channel weights of the error
+	DWORD dwTransparent;   // Bit per texel that must decode as transparent
+};
+
+//-----------------------------------------------------------------------------
+// Best color endpoints found so far
+//-----------------------------------------------------------------------------
+struct DXTColorFit {
+	UINT uColor0;        // RGB 565 endpoints
+	UINT uColor1;
+	BOOL bFourColor;     // Four color palette, else three plus transparent
+	BYTE Indices[16];    // Palette entry per texel
+	float fError;        // Weighted squared error, 0 to 255 scale
+};
+
+//-----------------------------------------------------------------------------
+// Name: Expand5() / Expand6()
+// Desc: Widen a 5 or 6 bit channel to 8 bits the way decoders do
+//-----------------------------------------------------------------------------
+static UINT Expand5(UINT uValue)
+{
+	return (uValue << 3) | (uValue >> 2);
+}
+
+static UINT Expand6(UINT uValue)
+{
+	return (uValue << 2) | (uValue >> 4);
+}
+
+//-----------------------------------------------------------------------------
+// Name: BuildPalette()
+// Desc: Rebuild the ARGB palette of a color block from its endpoints
+//-----------------------------------------------------------------------------
+static void BuildPalette(
+	UINT uColor0, UINT uColor1, BOOL bFourColor, DWORD* pPalette)
+{
+	UINT Red[4];
+	UINT Green[4];
+	UINT Blue[4];
+	UINT i;
+
+	Red[0] = Expand5((uColor0 >> 11) & 31);
+	Green[0] = Expand6((uColor0 >> 5) & 63);
+	Blue[0] = Expand5(uColor0 & 31);
+	Red[1] = Expand5((uColor1 >> 11) & 31);
+	Green[1] = Expand6((uColor1 >> 5) & 63);
+	Blue[1] = Expand5(uColor1 & 31);
+	if (bFourColor) {
+		Red[2] = (2 * Red[0] + Red[1] + 1) / 3;
+		Green[2] = (2 * Green[0] + Green[1] + 1) / 3;
+		Blue[2] = (2 * Blue[0] + Blue[1] + 1) / 3;
+		Red[3] = (Red[0] + 2 * Red[1] + 1) / 3;
+		Green[3] = (Green[0] + 2 * Green[1] + 1) / 3;
+		Blue[3] = (Blue[0] + 2 * Blue[1] + 1) / 3;
+	} else {
+		Red[2] = (Red[0] + Red[1] + 1) >> 1;
+		Green[2] = (Green[0] + Green[1] + 1) >> 1;
+		Blue[2] = (Blue[0] + Blue[1] + 1) >> 1;
+		Red[3] = 0;
+		Green[3] = 0;
+		Blue[3] = 0;
+	}
+	for (i = 0; i < 4; ++i) {
+		pPalette[i] = (Red[i] << 16) | (Green[i] << 8) | Blue[i];
+		if (bFourColor || i < 3) {
+			pPalette[i] |= 0xFF000000UL;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: FitIndices()
+// Desc: Give every texel its nearest entry among the first uColors of the
+//       palette and return the weighted squared error. Transparent texels
+//       always get entry 3.
+//-----------------------------------------------------------------------------
+static float FitIndices(const DXTBlock* pBlock, const DWORD* pPalette,
+	UINT uColors, BYTE* pIndices)
+{
+	float fPalette[4][3];
+	float fError;
+	UINT i;
+	UINT j;
+
+	for (j = 0; j < uColors; ++j) {
+		fPalette[j][0] = (float)((pPalette[j] >> 16) & 0xFF);
+		fPalette[j][1] = (float)((pPalette[j] >> 8) & 0xFF);
+		fPalette[j][2] = (float)(pPalette[j] & 0xFF);
+	}
+
+#if defined(DXTC_SSE2)
+	{
+		__m128 vMetricRed = _mm_set1_ps(pBlock->fMetric[0]);
+		__m128 vMetricGreen = _mm_set1_ps(pBlock->fMetric[1]);
+		__m128 vMetricBlue = _mm_set1_ps(pBlock->fMetric[2]);
+		__m128 vError = _mm_setzero_ps();
+		float fIndices[4];
+		float fSums[4];
+
+		for (i = 0; i < 16; i += 4) {
+			__m128 vRed = _mm_loadu_ps(&pBlock->fRed[i]);
+			__m128 vGreen = _mm_loadu_ps(&pBlock->fGreen[i]);
+			__m128 vBlue = _mm_loadu_ps(&pBlock->fBlue[i]);
+			__m128 vBest = _mm_set1_ps(DXTC_MAX_ERROR);
+			__m128 vIndex = _mm_setzero_ps();
+			for (j = 0; j < uColors; ++j) {
+				__m128 vDeltaRed = _mm_sub_ps(vRed, _mm_set1_ps(fPalette[j][0]));
+				__m128 vDeltaGreen = _mm_sub_ps(vGreen, _mm_set1_ps(fPalette[j][1]));
+				__m128 vDeltaBlue = _mm_sub_ps(vBlue, _mm_set1_ps(fPalette[j][2]));
+				__m128 vDistance = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(_mm_mul_ps(vDeltaRed, vDeltaRed), vMetricRed),
+						_mm_mul_ps(_mm_mul_ps(vDeltaGreen, vDeltaGreen), vMetricGreen)),
+					_mm_mul_ps(_mm_mul_ps(vDeltaBlue, vDeltaBlue), vMetricBlue));
+				__m128 vCloser = _mm_cmplt_ps(vDistance, vBest);
+				vBest = _mm_min_ps(vDistance, vBest);
+				vIndex = _mm_or_ps(_mm_and_ps(vCloser, _mm_set1_ps((float)j)),
+					_mm_andnot_ps(vCloser, vIndex));
+			}
+			vError = _mm_add_ps(vError,
+				_mm_mul_ps(vBest, _mm_loadu_ps(&pBlock->fTexelWeights[i])));
+			_mm_storeu_ps(fIndices, vIndex);
+			for (j = 0; j < 4; ++j) {
+				pIndices[i + j] = (BYTE)(int)fIndices[j];
+			}
+		}
+		_mm_storeu_ps(fSums, vError);
+		fError = (fSums[0] + fSums[1]) + (fSums[2] + fSums[3]);
+	}
+#else
+	fError = 0.0f;
+	for (i = 0; i < 16; ++i) {
+		float fBest = DXTC_MAX_ERROR;
+		BYTE bIndex = 0;
+		for (j = 0; j < uColors; ++j) {
+			float fDeltaRed = pBlock->fRed[i] - fPalette[j][0];
+			float fDeltaGreen = pBlock->fGreen[i] - fPalette[j][1];
+			float fDeltaBlue = pBlock->fBlue[i] - fPalette[j][2];
+			float fDistance = fDeltaRed * fDeltaRed * pBlock->fMetric[0] +
+				fDeltaGreen * fDeltaGreen * pBlock->fMetric[1] +
+				fDeltaBlue * fDeltaBlue * pBlock->fMetric[2];
+			if (fDistance < fBest) {
+				fBest = fDistance;
+				bIndex = (BYTE)j;
+			}
+		}
+		fError += fBest * pBlock->fTexelWeights[i];
+		pIndices[i] = bIndex;
+	}
+#endif
+
+	if (pBlock->dwTransparent) {
+		for (i = 0; i < 16; ++i) {
+			if (pBlock->dwTransparent & (1U << i)) {
+				pIndices[i] = 3;
+			}
+		}
+	}
+	return fError;
+}
+
+//-----------------------------------------------------------------------------
+// Name: TryEndpoints()
+// Desc: Score a pair of endpoints and keep them if they beat the best fit
+//-----------------------------------------------------------------------------
+static void TryEndpoints(const DXTBlock* pBlock, UINT uColor0, UINT uColor1,
+	BOOL bFourColor, DXTColorFit* pBest)
+{
+	DWORD Palette[4];
+	BYTE Indices[16];
+	float fError;
+
+	BuildPalette(uColor0, uColor1, bFourColor, Palette);
+	fError = FitIndices(pBlock, Palette, bFourColor ? 4 : 3, Indices);
+	if (fError < pBest->fError) {
+		pBest->uColor0 = uColor0;
+		pBest->uColor1 = uColor1;
+		pBest->bFourColor = bFourColor;
+		memcpy(pBest->Indices, Indices, sizeof(Indices));
+		pBest->fError = fError;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: QuantizeColor()
+// Desc: Round a 0.0 to 1.0 color to RGB 565
+//-----------------------------------------------------------------------------
+static UINT QuantizeColor(const Vec4& Color)
+{
+	float fColor[4];
+	int iRed;
+	int iGreen;
+	int iBlue;
+
+	Color.Store(fColor);
+	iRed = (int)(fColor[0] * 31.0f + 0.5f);
+	iGreen = (int)(fColor[1] * 63.0f + 0.5f);
+	iBlue = (int)(fColor[2] * 31.0f + 0.5f);
+	iRed = iRed < 0 ? 0 : (iRed > 31 ? 31 : iRed);
+	iGreen = iGreen < 0 ? 0 : (iGreen > 63 ? 63 : iGreen);
+	iBlue = iBlue < 0 ? 0 : (iBlue > 31 ? 31 : iBlue);
+	return ((UINT)iRed << 11) | ((UINT)iGreen << 5) | (UINT)iBlue;
+}
+
+//-----------------------------------------------------------------------------
+// Name: InitBlock()
+// Desc: Collect the distinct colors of a block and its texels for scoring
+//-----------------------------------------------------------------------------
+static void InitBlock(
+	DXTBlock* pBlock, const DWORD* pdwTexels, DWORD dwMask, DWORD dwFlags)
+{
+	DWORD Colors[16];
+	UINT i;
+	UINT j;
+
+	pBlock->uCount = 0;
+	pBlock->dwTransparent = 0;
+	if (dwFlags & DXTC_PERCEPTUAL) {
+		pBlock->fMetric[0] = DXTC_LUMA_RED * DXTC_LUMA_RED;
+		pBlock->fMetric[1] = DXTC_LUMA_GREEN * DXTC_LUMA_GREEN;
+		pBlock->fMetric[2] = DXTC_LUMA_BLUE * DXTC_LUMA_BLUE;
+	} else {
+		pBlock->fMetric[0] = 1.0f;
+		pBlock->fMetric[1] = 1.0f;
+		pBlock->fMetric[2] = 1.0f;
+	}
+
+	for (i = 0; i < 16; ++i) {
+		DWORD dwTexel = pdwTexels[i];
+		DWORD dwColor = dwTexel & 0x00FFFFFFUL;
+
+		pBlock->fRed[i] = (float)((dwTexel >> 16) & 0xFF);
+		pBlock->fGreen[i] = (float)((dwTexel >> 8) & 0xFF);
+		pBlock->fBlue[i] = (float)(dwTexel & 0xFF);
+		pBlock->fTexelWeights[i] = 0.0f;
+		if (!(dwMask & (1U << i))) {
+			continue;
+		}
+		if ((dwFlags & DXTC_BC1_ALPHA) && (dwTexel >> 24) < 128) {
+			pBlock->dwTransparent |= 1U << i;
+			continue;
+		}
+		pBlock->fTexelWeights[i] = 1.0f;
+
+		for (j = 0; j < pBlock->uCount; ++j) {
+			if (Colors[j] == dwColor) {
+				pBlock->fWeights[j] += 1.0f;
+				break;
+			}
+		}
+		if (j == pBlock->uCount) {
+			Colors[j] = dwColor;
+			pBlock->Points[j] = Vec4(pBlock->fRed[i] / 255.0f,
+				pBlock->fGreen[i] / 255.0f, pBlock->fBlue[i] / 255.0f, 0.0f);
+			pBlock->fWeights[j] = 1.0f;
+			pBlock->uCount++;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: ComputePrincipalAxis()
+// Desc: Direction of greatest spread of the block's colors, found by power
+//       iteration on their weighted covariance
+//-----------------------------------------------------------------------------
+static Vec4 ComputePrincipalAxis(const DXTBlock* pBlock)
+{
+	float fCentroid[3];
+	float fCovariance[6];
+	float fTotal;
+	float fAxis[3];
+	UINT i;
+	UINT uIteration;
+
+	fCentroid[0] = fCentroid[1] = fCentroid[2] = 0.0f;
+	fTotal = 0.0f;
+	for (i = 0; i < pBlock->uCount; ++i) {
+		float fPoint[4];
+		pBlock->Points[i].Store(fPoint);
+		fCentroid[0] += fPoint[0] * pBlock->fWeights[i];
+		fCentroid[1] += fPoint[1] * pBlock->fWeights[i];
+		fCentroid[2] += fPoint[2] * pBlock->fWeights[i];
+		fTotal += pBlock->fWeights[i];
+	}
+	if (fTotal > 0.0f) {
+		fCentroid[0] /= fTotal;
+		fCentroid[1] /= fTotal;
+		fCentroid[2] /= fTotal;
+	}
+
+	for (i = 0; i < 6; ++i) {
+		fCovariance[i] = 0.0f;
+	}
+	for (i = 0; i < pBlock->uCount; ++i) {
+		float fPoint[4];
+		float fRed;
+		float fGreen;
+		float fBlue;
+		float fWeight = pBlock->fWeights[i];
+
+		pBlock->Points[i].Store(fPoint);
+		fRed = fPoint[0] - fCentroid[0];
+		fGreen = fPoint[1] - fCentroid[1];
+		fBlue = fPoint[2] - fCentroid[2];
+		fCovariance[0] += fRed * fRed * fWeight;
+		fCovariance[1] += fRed * fGreen * fWeight;
+		fCovariance[2] += fRed * fBlue * fWeight;
+		fCovariance[3] += fGreen * fGreen * fWeight;
+		fCovariance[4] += fGreen * fBlue * fWeight;
+		fCovariance[5] += fBlue * fBlue * fWeight;
+	}
+
+	fAxis[0] = fAxis[1] = fAxis[2] = 1.0f;
+	for (uIteration = 0; uIteration < 8; ++uIteration) {
+		float fNext[3];
+		float fLargest;
+
+		fNext[0] = fAxis[0] * fCovariance[0] + fAxis[1] * fCovariance[1] +
+			fAxis[2] * fCovariance[2];
+		fNext[1] = fAxis[0] * fCovariance[1] + fAxis[1] * fCovariance[3] +
+			fAxis[2] * fCovariance[4];
+		fNext[2] = fAxis[0] * fCovariance[2] + fAxis[1] * fCovariance[4] +
+			fAxis[2] * fCovariance[5];
+		fLargest = fNext[0] < 0.0f ? -fNext[0] : fNext[0];
+		for (i = 1; i < 3; ++i) {
+			float fMagnitude = fNext[i] < 0.0f ? -fNext[i] : fNext[i];
+			if (fMagnitude > fLargest) {
+				fLargest = fMagnitude;
+			}
+		}
+		if (fLargest <= 0.0f) {
+			break;
+		}
+		fAxis[0] = fNext[0] / fLargest;
+		fAxis[1] = fNext[1] / fLargest;
+		fAxis[2] = fNext[2] / fLargest;
+	}
+	return Vec4(fAxis[0], fAxis[1], fAxis[2], 0.0f);
+}
+
+//-----------------------------------------------------------------------------
+// Name: BoxFit()
+// Desc: Use the corners of the colors' bounding box, pulled in by a
+//       sixteenth of its size, as the endpoints. No axis is needed.
+//-----------------------------------------------------------------------------
+static void BoxFit(const DXTBlock* pBlock, BOOL bFourColor, DXTColorFit* pBest)
+{
+	Vec4 Low(1.0f);
+	Vec4 High(0.0f);
+	Vec4 Inset;
+	UINT i;
+
+	for (i = 0; i < pBlock->uCount; ++i) {
+		Low = Min(Low, pBlock->Points[i]);
+		High = Max(High, pBlock->Points[i]);
+	}
+	Inset = (High - Low) * Vec4(1.0f / 16.0f);
+	TryEndpoints(pBlock, QuantizeColor(High - Inset),
+		QuantizeColor(Low + Inset), bFourColor, pBest);
+}
+
+//-----------------------------------------------------------------------------
+// Name: RangeFit()
+// Desc: Use the colors furthest apart along the axis as the endpoints
+//-----------------------------------------------------------------------------
+static void RangeFit(const DXTBlock* pBlock, const Vec4& Axis,
+	BOOL bFourColor, DXTColorFit* pBest)
+{
+	UINT uStart = 0;
+	UINT uEnd = 0;
+	float fMin = DXTC_MAX_ERROR;
+	float fMax = -DXTC_MAX_ERROR;
+	UINT i;
+
+	for (i = 0; i < pBlock->uCount; ++i) {
+		float fDot = Dot3(pBlock->Points[i], Axis);
+		if (fDot < fMin) {
+			fMin = fDot;
+			uStart = i;
+		}
+		if (fDot > fMax) {
+			fMax = fDot;
+			uEnd = i;
+		}
+	}
+	TryEndpoints(pBlock, QuantizeColor(pBlock->Points[uStart]),
+		QuantizeColor(pBlock->Points[uEnd]), bFourColor, pBest);
+}
+
+//-----------------------------------------------------------------------------
+// Name: FitSingleChannel()
+// Desc: Endpoints for one channel whose first blend (2/3 and 1/3, or 1/2
+//       and 1/2 for three color blocks) lands closest to uValue
+//-----------------------------------------------------------------------------
+static void FitSingleChannel(UINT uValue, UINT uBits, BOOL bFourColor,
+	UINT* puEnd0, UINT* puEnd1)
+{
+	UINT uMax = (1U << uBits) - 1;
+	UINT uBestError = 0xFFFFFFFFU;
+	UINT uEnd0;
+
+	*puEnd0 = 0;
+	*puEnd1 = 0;
+	for (uEnd0 = 0; uEnd0 <= uMax; ++uEnd0) {
+		int iExpanded0 = (int)(uBits == 5 ? Expand5(uEnd0) : Expand6(uEnd0));
+		int iTarget = bFourColor ? 3 * (int)uValue - 2 * iExpanded0 :
+			2 * (int)uValue - iExpanded0;
+		int iGuess;
+		int iEnd1;
+
+		iTarget = iTarget < 0 ? 0 : (iTarget > 255 ? 255 : iTarget);
+		iGuess = (iTarget * (int)uMax + 127) / 255;
+		for (iEnd1 = iGuess - 1; iEnd1 <= iGuess + 1; ++iEnd1) {
+			int iExpanded1;
+			int iBlend;
+			UINT uError;
+
+			if (iEnd1 < 0 || iEnd1 > (int)uMax) {
+				continue;
+			}
+			iExpanded1 = (int)(uBits == 5 ? Expand5(iEnd1) : Expand6(iEnd1));
+			iBlend = bFourColor ? (2 * iExpanded0 + iExpanded1 + 1) / 3 :
+				(iExpanded0 + iExpanded1 + 1) >> 1;
+			uError = (UINT)(iBlend > (int)uValue ? iBlend - (int)uValue :
+				(int)uValue - iBlend);
+			if (uError < uBestError) {
+				uBestError = uError;
+				*puEnd0 = uEnd0;
+				*puEnd1 = (UINT)iEnd1;
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: SingleColorFit()
+// Desc: Endpoints for a block of one color, which has the color land on the
+//       first blended palette entry as closely as 565 allows
+//-----------------------------------------------------------------------------
+static void SingleColorFit(
+	const DXTBlock* pBlock, BOOL bFourColor, DXTColorFit* pBest)
+{
+	float fColor[4];
+	UINT uRed0;
+	UINT uRed1;
+	UINT uGreen0;
+	UINT uGreen1;
+	UINT uBlue0;
+	UINT uBlue1;
+
+	pBlock->Points[0].Store(fColor);
+	FitSingleChannel((UINT)(fColor[0] * 255.0f + 0.5f), 5, bFourColor,
+		&uRed0, &uRed1);
+	FitSingleChannel((UINT)(fColor[1] * 255.0f + 0.5f), 6, bFourColor,
+		&uGreen0, &uGreen1);
+	FitSingleChannel((UINT)(fColor[2] * 255.0f + 0.5f), 5, bFourColor,
+		&uBlue0, &uBlue1);
+	TryEndpoints(pBlock, (uRed0 << 11) | (uGreen0 << 5) | uBlue0,
+		(uRed1 << 11) | (uGreen1 << 5) | uBlue1, bFourColor, pBest);
+}
+
+//-----------------------------------------------------------------------------
+// Name: SortAlongAxis()
+// Desc: Order the block's colors by their projection onto the axis
+//-----------------------------------------------------------------------------
+static void SortAlongAxis(const DXTBlock* pBlock, const Vec4& Axis, UINT* pOrder)
+{
+	float fDots[16];
+	UINT i;
+	UINT j;
+
+	// Insertion sort, there are never more than 16 colors
+	for (i = 0; i < pBlock->uCount; ++i) {
+		float fDot = Dot3(pBlock->Points[i], Axis);
+		for (j = i; j > 0 && fDots[j - 1] > fDot; --j) {
+			fDots[j] = fDots[j - 1];
+			pOrder[j] = pOrder[j - 1];
+		}
+		fDots[j] = fDot;
+		pOrder[j] = i;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: ClusterFit()
+// Desc: Try every way of splitting the sorted colors into consecutive runs,
+//       one run per palette entry. Each split is solved for its least
+//       squares endpoints, which are snapped to the 565 grid before the
+//       split is scored.
+//-----------------------------------------------------------------------------
+static void ClusterFit(const DXTBlock* pBlock, const UINT* pOrder,
+	BOOL bFourColor, DXTColorFit* pBest)
+{
+	Vec4 Weighted[16];
+	UINT uCount = pBlock->uCount;
+	Vec4 Total(0.0f);
+	Vec4 BestStart(0.0f);
+	Vec4 BestEnd(0.0f);
+	float fBestError = DXTC_MAX_ERROR;
+	UINT i;
+	UINT j;
+	UINT k;
+
+	const Vec4 Zero(0.0f);
+	const Vec4 Half(0.5f);
+	const Vec4 One(1.0f);
+	const Vec4 Two(2.0f);
+	const Vec4 Grid(31.0f, 63.0f, 31.0f, 0.0f);
+	const Vec4 GridReciprocal(1.0f / 31.0f, 1.0f / 63.0f, 1.0f / 31.0f, 0.0f);
+	const Vec4 Metric(
+		pBlock->fMetric[0], pBlock->fMetric[1], pBlock->fMetric[2], 0.0f);
+
+	// Colors premultiplied by their weight, with the weight in w
+	for (i = 0; i < uCount; ++i) {
+		float fWeight = pBlock->fWeights[pOrder[i]];
+		Weighted[i] = pBlock->Points[pOrder[i]] * Vec4(fWeight) +
+			Vec4(0.0f, 0.0f, 0.0f, fWeight);
+		Total += Weighted[i];
+	}
+
+	if (bFourColor) {
+		const Vec4 OneThird(1.0f / 3.0f);
+		const Vec4 TwoThirds(2.0f / 3.0f);
+		const Vec4 OneNinth(1.0f / 9.0f);
+		const Vec4 TwoNinths(2.0f / 9.0f);
+		const Vec4 FourNinths(4.0f / 9.0f);
+		Vec4 Part0(0.0f);
+
+		// Runs [0, i) [i, j) [j, k) [k, n) map to palette 0, 2, 3 and 1
+		for (i = 0; i <= uCount; ++i) {
+			Vec4 Part1(0.0f);
+			for (j = i; j <= uCount; ++j) {
+				Vec4 Part2(0.0f);
+				for (k = j; k <= uCount; ++k) {
+					Vec4 Part3 = Total - Part0 - Part1 - Part2;
+					Vec4 AlphaX = Part0 + TwoThirds * Part1 + OneThird * Part2;
+					Vec4 BetaX = Part3 + OneThird * Part1 + TwoThirds * Part2;
+					Vec4 Alpha2 =
+						(Part0 + FourNinths * Part1 + OneNinth * Part2).SplatW();
+					Vec4 Beta2 =
+						(Part3 + OneNinth * Part1 + FourNinths * Part2).SplatW();
+					Vec4 AlphaBeta = (TwoNinths * (Part1 + Part2)).SplatW();
+					Vec4 Determinant = Alpha2 * Beta2 - AlphaBeta * AlphaBeta;
+
+					if (Determinant.X() > 1e-6f) {
+						Vec4 Factor = Reciprocal(Determinant);
+						Vec4 Start =
+							(AlphaX * Beta2 - BetaX * AlphaBeta) * Factor;
+						Vec4 End =
+							(BetaX * Alpha2 - AlphaX * AlphaBeta) * Factor;
+						Vec4 Error;
+						float fError;
+
+						Start = Min(One, Max(Zero, Start));
+						End = Min(One, Max(Zero, End));
+						Start = Truncate(Grid * Start + Half) * GridReciprocal;
+						End = Truncate(Grid * End + Half) * GridReciprocal;
+						Error = Start * Start * Alpha2 + End * End * Beta2 +
+							Two * (Start * End * AlphaBeta - Start * AlphaX -
+								End * BetaX);
+						fError = Dot3(Error, Metric);
+						if (fError < fBestError) {
+							fBestError = fError;
+							BestStart = Start;
+							BestEnd = End;
+						}
+					}
+					if (k < uCount) {
+						Part2 += Weighted[k];
+					}
+				}
+				if (j < uCount) {
+					Part1 += Weighted[j];
+				}
+			}
+			if (i < uCount) {
+				Part0 += Weighted[i];
+			}
+		}
+	} else {
+		const Vec4 Quarter(0.25f);
+		Vec4 Part0(0.0f);
+
+		// Runs [0, i) [i, j) [j, n) map to palette 0, 2 and 1
+		for (i = 0; i <= uCount; ++i) {
+			Vec4 Part1(0.0f);
+			for (j = i; j <= uCount; ++j) {
+				Vec4 Part2 = Total - Part0 - Part1;
+				Vec4 AlphaX = Part0 + Half * Part1;
+				Vec4 BetaX = Part2 + Half * Part1;
+				Vec4 Alpha2 = (Part0 + Quarter * Part1).SplatW();
+				Vec4 Beta2 = (Part2 + Quarter * Part1).SplatW();
+				Vec4 AlphaBeta = (Quarter * Part1).SplatW();
+				Vec4 Determinant = Alpha2 * Beta2 - AlphaBeta * AlphaBeta;
+
+				if (Determinant.X() > 1e-6f) {
+					Vec4 Factor = Reciprocal(Determinant);
+					Vec4 Start = (AlphaX * Beta2 - BetaX * AlphaBeta) * Factor;
+					Vec4 End = (BetaX * Alpha2 - AlphaX * AlphaBeta) * Factor;
+					Vec4 Error;
+					float fError;
+
+					Start = Min(One, Max(Zero, Start));
+					End = Min(One, Max(Zero, End));
+					Start = Truncate(Grid * Start + Half) * GridReciprocal;
+					End = Truncate(Grid * End + Half) * GridReciprocal;
+					Error = Start * Start * Alpha2 + End * End * Beta2 +
+						Two * (Start * End * AlphaBeta - Start * AlphaX -
+							End * BetaX);
+					fError = Dot3(Error, Metric);
+					if (fError < fBestError) {
+						fBestError = fError;
+						BestStart = Start;
+						BestEnd = End;
+					}
+				}
+				if (j < uCount) {
+					Part1 += Weighted[j];
+				}
+			}
+			if (i < uCount) {
+				Part0 += Weighted[i];
+			}
+		}
+	}
+
+	if (fBestError < DXTC_MAX_ERROR) {
+		TryEndpoints(pBlock, QuantizeColor(BestStart), QuantizeColor(BestEnd),
+			bFourColor, pBest);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: EndpointAxis()
+// Desc: Direction from the first to the second endpoint of a fit, all zero
+//       if they decode to the same color
+//-----------------------------------------------------------------------------
+static Vec4 EndpointAxis(const DXTColorFit* pFit)
+{
+	DWORD Palette[4];
+
+	BuildPalette(pFit->uColor0, pFit->uColor1, TRUE, Palette);
+	return Vec4((float)(int)((Palette[1] >> 16) & 0xFF) -
+			(float)(int)((Palette[0] >> 16) & 0xFF),
+		(float)(int)((Palette[1] >> 8) & 0xFF) -
+			(float)(int)((Palette[0] >> 8) & 0xFF),
+		(float)(int)(Palette[1] & 0xFF) - (float)(int)(Palette[0] & 0xFF),
+		0.0f);
+}
+
+//-----------------------------------------------------------------------------
+// Name: WriteColorBlock()
+// Desc: Store endpoints and indices, ordering the endpoints so a decoder
+//       picks the palette mode that was fitted
+//-----------------------------------------------------------------------------
+static void WriteColorBlock(const DXTColorFit* pFit, BYTE* pOutput)
+{
+	UINT uColor0 = pFit->uColor0;
+	UINT uColor1 = pFit->uColor1;
+	DWORD dwIndices = 0;
+	BYTE Indices[16];
+	UINT i;
+
+	memcpy(Indices, pFit->Indices, sizeof(Indices));
+	if (pFit->bFourColor) {
+		// Four color blocks need color0 > color1, entries 2 and 3 trade
+		// places with the endpoints. Equal endpoints only need entry 0.
+		if (uColor0 < uColor1) {
+			uColor0 = pFit->uColor1;
+			uColor1 = pFit->uColor0;
+			for (i = 0; i < 16; ++i) {
+				Indices[i] ^= 1;
+			}
+		} else if (uColor0 == uColor1) {
+			memset(Indices, 0, sizeof(Indices));
+		}
+	} else if (uColor0 > uColor1) {
+		// Three color blocks need color0 <= color1, the blend and the
+		// transparent entry stay put
+		uColor0 = pFit->uColor1;
+		uColor1 = pFit->uColor0;
+		for (i = 0; i < 16; ++i) {
+			if (Indices[i] < 2) {
+				Indices[i] ^= 1;
+			}
+		}
+	}
+
+	for (i = 0; i < 16; ++i) {
+		dwIndices |= (DWORD)Indices[i] << (i * 2);
+	}
+	pOutput[0] = (BYTE)uColor0;
+	pOutput[1] = (BYTE)(uColor0 >> 8);
+	pOutput[2] = (BYTE)uColor1;
+	pOutput[3] = (BYTE)(uColor1 >> 8);
+	pOutput[4] = (BYTE)dwIndices;
+	pOutput[5] = (BYTE)(dwIndices >> 8);
+	pOutput[6] = (BYTE)(dwIndices >> 16);
+	pOutput[7] = (BYTE)(dwIndices >> 24);
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetFit()
+// Desc: The one DXTC_FIT_ flag that applies, the slowest one set or the
+//       cluster fit if there are none
+//-----------------------------------------------------------------------------
+static DWORD GetFit(DWORD dwFlags)
+{
+	if (dwFlags & DXTC_FIT_REFINE) {
+		return DXTC_FIT_REFINE;
+	}
+	if (dwFlags & DXTC_FIT_CLUSTER) {
+		return DXTC_FIT_CLUSTER;
+	}
+	if (dwFlags & DXTC_FIT_RANGE) {
+		return DXTC_FIT_RANGE;
+	}
+	if (dwFlags & DXTC_FIT_BOX) {
+		return DXTC_FIT_BOX;
+	}
+	return DXTC_FIT_CLUSTER;
+}
+
+//-----------------------------------------------------------------------------
+// Name: CompressColor()
+// Desc: Fit and write the 8 byte color part of a block. Three color
+//       palettes are only tried when bAllowThree is set, and are the only
+//       choice if texels have to be transparent.
+//-----------------------------------------------------------------------------
+static void CompressColor(
+	const DXTBlock* pBlock, DWORD dwFlags, BOOL bAllowThree, BYTE* pOutput)
+{
+	DXTColorFit Best;
+	BOOL bTryFour = !pBlock->dwTransparent;
+	BOOL bTryThree = bAllowThree;
+	DWORD dwFit = GetFit(dwFlags);
+	Vec4 Axis;
+	UINT Order[16];
+	UINT uPass;
+
+	Best.uColor0 = 0;
+	Best.uColor1 = 0;
+	Best.bFourColor = FALSE;
+	Best.fError = DXTC_MAX_ERROR;
+
+	// With no palette every texel gets entry 0, or 3 if transparent, which
+	// is all a block without opaque colors needs
+	FitIndices(pBlock, NULL, 0, Best.Indices);
+
+	if (dwFit == DXTC_FIT_BOX) {
+		if (pBlock->uCount) {
+			if (bTryFour) {
+				BoxFit(pBlock, TRUE, &Best);
+			}
+			if (bTryThree) {
+				BoxFit(pBlock, FALSE, &Best);
+			}
+		}
+		WriteColorBlock(&Best, pOutput);
+		return;
+	}
+
+	if (pBlock->uCount == 1) {
+		if (bTryFour) {
+			SingleColorFit(pBlock, TRUE, &Best);
+		}
+		if (bTryThree) {
+			SingleColorFit(pBlock, FALSE, &Best);
+		}
+	}
+	if (pBlock->uCount) {
+		Axis = ComputePrincipalAxis(pBlock);
+		if (bTryFour) {
+			RangeFit(pBlock, Axis, TRUE, &Best);
+		}
+		if (bTryThree) {
+			RangeFit(pBlock, Axis, FALSE, &Best);
+		}
+		if (dwFit != DXTC_FIT_RANGE && pBlock->uCount > 1) {
+			SortAlongAxis(pBlock, Axis, Order);
+			if (bTryFour) {
+				ClusterFit(pBlock, Order, TRUE, &Best);
+			}
+			if (bTryThree) {
+				ClusterFit(pBlock, Order, FALSE, &Best);
+			}
+		}
+
+		// Sort again along the endpoints that were found. Only a new order
+		// can give a different answer, and two colors sort the same along
+		// any axis.
+		if (dwFit == DXTC_FIT_REFINE && pBlock->uCount > 2) {
+			for (uPass = 0; uPass < DXTC_REFINE_PASSES; ++uPass) {
+				UINT NewOrder[16];
+				float fError = Best.fError;
+
+				Axis = EndpointAxis(&Best);
+				if (Dot3(Axis, Axis) <= 0.0f) {
+					break;
+				}
+				SortAlongAxis(pBlock, Axis, NewOrder);
+				if (!memcmp(NewOrder, Order, pBlock->uCount * sizeof(UINT))) {
+					break;
+				}
+				memcpy(Order, NewOrder, pBlock->uCount * sizeof(UINT));
+				if (bTryFour) {
+					ClusterFit(pBlock, Order, TRUE, &Best);
+				}
+				if (bTryThree) {
+					ClusterFit(pBlock, Order, FALSE, &Best);
+				}
+				if (!(Best.fError < fError)) {
+					break;
+				}
+			}
+		}
+	}
+	WriteColorBlock(&Best, pOutput);
+}
+
+//-----------------------------------------------------------------------------
+// Name: BuildAlphaPalette()
+// Desc: Rebuild the eight values of an interpolated alpha block. Blocks
+//       with uAlpha0 > uAlpha1 blend six values between the endpoints, the
+//       others blend four and add 0 and 255.
+//-----------------------------------------------------------------------------
+static void BuildAlphaPalette(UINT uAlpha0, UINT uAlpha1, BYTE* pPalette)
+{
+	UINT i;
+
+	pPalette[0] = (BYTE)uAlpha0;
+	pPalette[1] = (BYTE)uAlpha1;
+	if (uAlpha0 > uAlpha1) {
+		for (i = 1; i < 7; ++i) {
+			pPalette[i + 1] = (BYTE)(((7 - i) * uAlpha0 + i * uAlpha1 + 3) / 7);
+		}
+	} else {
+		for (i = 1; i < 5; ++i) {
+			pPalette[i + 1] = (BYTE)(((5 - i) * uAlpha0 + i * uAlpha1 + 2) / 5);
+		}
+		pPalette[6] = 0;
+		pPalette[7] = 255;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: FitAlphaIndices()
+// Desc: Give each of 16 values its nearest palette entry and return the
+//       squared error of the values whose bit in dwMask is set. The SSE2
+//       path keeps all 16 values in one register.
+//-----------------------------------------------------------------------------
+static UINT FitAlphaIndices(const BYTE* pValues, const BYTE* pMaskBytes,
+	const BYTE* pPalette, BYTE* pIndices)
+{
+#if defined(DXTC_SSE2)
+	__m128i vValues = _mm_loadu_si128((const __m128i*)pValues);
+	__m128i vBest = _mm_set1_epi8((char)0xFF);
+	__m128i vIndex = _mm_setzero_si128();
+	__m128i vZero = _mm_setzero_si128();
+	__m128i vLow;
+	__m128i vHigh;
+	__m128i vSum;
+	UINT Sums[4];
+	UINT j;
+
+	for (j = 0; j < 8; ++j) {
+		__m128i vEntry = _mm_set1_epi8((char)pPalette[j]);
+		__m128i vDelta = _mm_or_si128(_mm_subs_epu8(vValues, vEntry),
+			_mm_subs_epu8(vEntry, vValues));
+		__m128i vNearer = _mm_andnot_si128(_mm_cmpeq_epi8(vDelta, vBest),
+			_mm_cmpeq_epi8(_mm_min_epu8(vDelta, vBest), vDelta));
+		vBest = _mm_min_epu8(vDelta, vBest);
+		vIndex = _mm_or_si128(_mm_and_si128(vNearer, _mm_set1_epi8((char)j)),
+			_mm_andnot_si128(vNearer, vIndex));
+	}
+	_mm_storeu_si128((__m128i*)pIndices, vIndex);
+
+	vBest = _mm_and_si128(
+		vBest, _mm_loadu_si128((const __m128i*)pMaskBytes));
+	vLow = _mm_unpacklo_epi8(vBest, vZero);
+	vHigh = _mm_unpackhi_epi8(vBest, vZero);
+	vSum = _mm_add_epi32(_mm_madd_epi16(vLow, vLow), _mm_madd_epi16(vHigh, vHigh));
+	_mm_storeu_si128((__m128i*)Sums, vSum);
+	return Sums[0] + Sums[1] + Sums[2] + Sums[3];
+#else
+	UINT uError = 0;
+	UINT i;
+	UINT j;
+
+	for (i = 0; i < 16; ++i) {
+		UINT uBest = 256;
+		BYTE bIndex = 0;
+		for (j = 0; j < 8; ++j) {
+			UINT uDelta = pValues[i] > pPalette[j] ?
+				(UINT)(pValues[i] - pPalette[j]) : (UINT)(pPalette[j] - pValues[i]);
+			if (uDelta < uBest) {
+				uBest = uDelta;
+				bIndex = (BYTE)j;
+			}
+		}
+		pIndices[i] = bIndex;
+		if (pMaskBytes[i]) {
+			uError += uBest * uBest;
+		}
+	}
+	return uError;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Name: CompressAlphaInterpolated()
+// Desc: Fit and write an 8 byte interpolated alpha block (DXT4 and DXT5).
+//       Endpoints start at the extremes of the values, with and without 0
+//       and 255, and every pair within uRadius of those is scored.
+//-----------------------------------------------------------------------------
+static void CompressAlphaInterpolated(
+	const BYTE* pValues, DWORD dwMask, UINT uRadius, BYTE* pOutput)
+{
+	BYTE MaskBytes[16];
+	BYTE Palette[8];
+	BYTE Indices[16];
+	BYTE BestIndices[16];
+	UINT uBestError = 0xFFFFFFFFU;
+	UINT uBest0 = 0;
+	UINT uBest1 = 0;
+	int iMin = 255;
+	int iMax = 0;
+	int iInnerMin = 255;
+	int iInnerMax = 0;
+	int iLow;
+	int iHigh;
+	DWORD dwIndices0;
+	DWORD dwIndices1;
+	UINT i;
+
+	for (i = 0; i < 16; ++i) {
+		int iValue = pValues[i];
+		MaskBytes[i] = 0;
+		if (!(dwMask & (1U << i))) {
+			continue;
+		}
+		MaskBytes[i] = 0xFF;
+		iMin = iValue < iMin ? iValue : iMin;
+		iMax = iValue > iMax ? iValue : iMax;
+		if (iValue != 0 && iValue != 255) {
+			iInnerMin = iValue < iInnerMin ? iValue : iInnerMin;
+			iInnerMax = iValue > iInnerMax ? iValue : iInnerMax;
+		}
+	}
+	if (iMin > iMax) {
+		iMin = iMax = 0;
+	}
+	if (iInnerMin > iInnerMax) {
+		iInnerMin = iInnerMax = 0;
+	}
+
+	// Six blended values, alpha0 > alpha1
+	for (iLow = iMin - (int)uRadius; iLow <= iMin + (int)uRadius; ++iLow) {
+		for (iHigh = iMax - (int)uRadius; iHigh <= iMax + (int)uRadius; ++iHigh) {
+			UINT uError;
+			if (iLow < 0 || iHigh > 255 || iLow >= iHigh) {
+				continue;
+			}
+			BuildAlphaPalette((UINT)iHigh, (UINT)iLow, Palette);
+			uError = FitAlphaIndices(pValues, MaskBytes, Palette, Indices);
+			if (uError < uBestError) {
+				uBestError = uError;
+				uBest0 = (UINT)iHigh;
+				uBest1 = (UINT)iLow;
+				memcpy(BestIndices, Indices, sizeof(Indices));
+			}
+		}
+	}
+
+	// Four blended values plus 0 and 255, alpha0 <= alpha1
+	for (iLow = iInnerMin - (int)uRadius; iLow <= iInnerMin + (int)uRadius;
+		 ++iLow) {
+		for (iHigh = iInnerMax - (int)uRadius;
+			 iHigh <= iInnerMax + (int)uRadius; ++iHigh) {
+			UINT uError;
+			if (iLow < 0 || iHigh > 255 || iLow > iHigh) {
+				continue;
+			}
+			BuildAlphaPalette((UINT)iLow, (UINT)iHigh, Palette);
+			uError = FitAlphaIndices(pValues, MaskBytes, Palette, Indices);
+			if (uError < uBestError) {
+				uBestError = uError;
+				uBest0 = (UINT)iLow;
+				uBest1 = (UINT)iHigh;
+				memcpy(BestIndices, Indices, sizeof(Indices));
+			}
+		}
+	}
+
+	dwIndices0 = 0;
+	dwIndices1 = 0;
+	for (i = 0; i < 8; ++i) {
+		dwIndices0 |= (DWORD)BestIndices[i] << (i * 3);
+		dwIndices1 |= (DWORD)BestIndices[i + 8] << (i * 3);
+	}
+	pOutput[0] = (BYTE)uBest0;
+	pOutput[1] = (BYTE)uBest1;
+	pOutput[2] = (BYTE)dwIndices0;
+	pOutput[3] = (BYTE)(dwIndices0 >> 8);
+	pOutput[4] = (BYTE)(dwIndices0 >> 16);
+	pOutput[5] = (BYTE)dwIndices1;
+	pOutput[6] = (BYTE)(dwIndices1 >> 8);
+	pOutput[7] = (BYTE)(dwIndices1 >> 16);
+}
+
+//-----------------------------------------------------------------------------
+// Name: CompressAlphaExplicit()
+// Desc: Write an 8 byte block of 4 bit alpha values (DXT2 and DXT3)
+//-----------------------------------------------------------------------------
+static void CompressAlphaExplicit(const BYTE* pValues, BYTE* pOutput)
+{
+	UINT i;
+
+	for (i = 0; i < 8; ++i) {
+		UINT uLow = ((UINT)pValues[i * 2] + 8) / 17;
+		UINT uHigh = ((UINT)pValues[i * 2 + 1] + 8) / 17;
+		pOutput[i] = (BYTE)(uLow | (uHigh << 4));
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetAlphaRadius()
+// Desc: How far around the extremes the interpolated alpha search looks,
+//       as wide as the color fit works
+//-----------------------------------------------------------------------------
+static UINT GetAlphaRadius(DWORD dwFlags)
+{
+	DWORD dwFit = GetFit(dwFlags);
+	return dwFit == DXTC_FIT_REFINE ? 8 : (dwFit == DXTC_FIT_CLUSTER ? 4 : 0);
+}
+
+//-----------------------------------------------------------------------------
+// Name: CompressChannels()
+// Desc: Write ATI1 or ATI2 blocks, one interpolated alpha block for red and
+//       for ATI2 another for green
+//-----------------------------------------------------------------------------
+static void CompressChannels(DWORD dwFourCC, const DWORD* pdwTexels,
+	DWORD dwMask, DWORD dwFlags, BYTE* pOutput)
+{
+	BYTE Reds[16];
+	BYTE Greens[16];
+	UINT uRadius = GetAlphaRadius(dwFlags);
+	UINT i;
+
+	for (i = 0; i < 16; ++i) {
+		Reds[i] = (BYTE)(pdwTexels[i] >> 16);
+		Greens[i] = (BYTE)(pdwTexels[i] >> 8);
+	}
+	CompressAlphaInterpolated(Reds, dwMask, uRadius, pOutput);
+	if (dwFourCC == FOURCC_ATI2) {
+		CompressAlphaInterpolated(Greens, dwMask, uRadius, pOutput + 8);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTGetBlockBytes()
+// Desc: Bytes per 4x4 block of a DXTn, ATI1, ATI2 or BC7 FourCC, 0 if it
+//       isn't one
+//-----------------------------------------------------------------------------
+DWORD DXTGetBlockBytes(DWORD dwFourCC)
+{
+	switch (dwFourCC) {
+	case FOURCC_DXT1:
+	case FOURCC_ATI1:
+		return 8;
+	case FOURCC_ATI2:
+	case FOURCC_DXT2:
+	case FOURCC_DXT3:
+	case FOURCC_DXT4:
+	case FOURCC_DXT5:
+	case FOURCC_BC7:
+		return 16;
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTGetPitch()
+// Desc: Bytes in one row of blocks
+//-----------------------------------------------------------------------------
+DWORD DXTGetPitch(DWORD dwFourCC, DWORD dwWidth)
+{
+	DWORD dwBlocks = (dwWidth + 3) >> 2;
+	return (dwBlocks ? dwBlocks : 1) * DXTGetBlockBytes(dwFourCC);
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTGetImageBytes()
+// Desc: Bytes in a whole compressed image
+//-----------------------------------------------------------------------------
+DWORD DXTGetImageBytes(DWORD dwFourCC, DWORD dwWidth, DWORD dwHeight)
+{
+	DWORD dwRows = (dwHeight + 3) >> 2;
+	return (dwRows ? dwRows : 1) * DXTGetPitch(dwFourCC, dwWidth);
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTIsBlockRect()
+// Desc: TRUE if prcRect lies inside a dwWidth by dwHeight image and covers
+//       whole blocks, so it can be copied without decoding. The right and
+//       bottom edges may stop short of a block only at the image's edge.
+//-----------------------------------------------------------------------------
+BOOL DXTIsBlockRect(const RECT* prcRect, DWORD dwWidth, DWORD dwHeight)
+{
+	if (prcRect->left < 0 || prcRect->top < 0 ||
+		prcRect->left >= prcRect->right || prcRect->top >= prcRect->bottom ||
+		prcRect->right > (LONG)dwWidth || prcRect->bottom > (LONG)dwHeight) {
+		return FALSE;
+	}
+	return !(prcRect->left & 3) && !(prcRect->top & 3) &&
+		(!(prcRect->right & 3) || prcRect->right == (LONG)dwWidth) &&
+		(!(prcRect->bottom & 3) || prcRect->bottom == (LONG)dwHeight);
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTCopyBlocks()
+// Desc: Copy the blocks covering dwWidth by dwHeight texels, one block row
+//       at a time. pSrc and pDest point at the top left block. The two may
+//       overlap if they share a pitch, as when moving blocks within one
+//       surface.
+//-----------------------------------------------------------------------------
+void DXTCopyBlocks(DWORD dwFourCC, const void* pSrc, LONG lSrcPitch,
+	void* pDest, LONG lDestPitch, DWORD dwWidth, DWORD dwHeight)
+{
+	DWORD dwRowBytes = ((dwWidth + 3) >> 2) * DXTGetBlockBytes(dwFourCC);
+	LONG lRows = (LONG)((dwHeight + 3) >> 2);
+	LONG lRow;
+
+	// Walk up when writing below the source so no row is read after it
+	// was overwritten
+	if ((const BYTE*)pDest > (const BYTE*)pSrc) {
+		for (lRow = lRows - 1; lRow >= 0; --lRow) {
+			memmove((BYTE*)pDest + lRow * lDestPitch,
+				(const BYTE*)pSrc + lRow * lSrcPitch, dwRowBytes);
+		}
+	} else {
+		for (lRow = 0; lRow < lRows; ++lRow) {
+			memmove((BYTE*)pDest + lRow * lDestPitch,
+				(const BYTE*)pSrc + lRow * lSrcPitch, dwRowBytes);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTCompressBlockBC1()
+// Desc: Encode 16 ARGB texels, in rows of four, as one DXT1 block. Texels
+//       whose bit in dwMask is clear lie outside the image and are ignored.
+//-----------------------------------------------------------------------------
+void DXTCompressBlockBC1(
+	const DWORD* pdwTexels, DWORD dwMask, DWORD dwFlags, void* pBlock)
+{
+	DXTBlock Block;
+
+	InitBlock(&Block, pdwTexels, dwMask, dwFlags);
+	CompressColor(&Block, dwFlags, TRUE, (BYTE*)pBlock);
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTCompressBlock()
+// Desc: Encode 16 ARGB texels as one block of any DXTn, ATI1, ATI2 or BC7
+//       format. DXT2 and DXT4 premultiply the color by alpha first.
+//-----------------------------------------------------------------------------
+void DXTCompressBlock(DWORD dwFourCC, const DWORD* pdwTexels, DWORD dwMask,
+	DWORD dwFlags, void* pBlock)
+{
+	DXTBlock Block;
+	DWORD Premultiplied[16];
+	BYTE Alphas[16];
+	BYTE* pOutput = (BYTE*)pBlock;
+	UINT i;
+
+	if (dwFourCC == FOURCC_DXT1) {
+		DXTCompressBlockBC1(pdwTexels, dwMask, dwFlags, pBlock);
+		return;
+	}
+	if (dwFourCC == FOURCC_ATI1 || dwFourCC == FOURCC_ATI2) {
+		CompressChannels(dwFourCC, pdwTexels, dwMask, dwFlags, pOutput);
+		return;
+	}
+	if (dwFourCC == FOURCC_BC7) {
+		BC7CompressBlock(pdwTexels, dwMask, GetFit(dwFlags), dwFlags, pBlock);
+		return;
+	}
+
+	for (i = 0; i < 16; ++i) {
+		Alphas[i] = (BYTE)(pdwTexels[i] >> 24);
+	}
+	if (dwFourCC == FOURCC_DXT2 || dwFourCC == FOURCC_DXT4) {
+		for (i = 0; i < 16; ++i) {
+			DWORD dwTexel = pdwTexels[i];
+			DWORD dwAlpha = dwTexel >> 24;
+			Premultiplied[i] = (dwTexel & 0xFF000000UL) |
+				((((dwTexel >> 16) & 0xFF) * dwAlpha + 127) / 255 << 16) |
+				((((dwTexel >> 8) & 0xFF) * dwAlpha + 127) / 255 << 8) |
+				(((dwTexel & 0xFF) * dwAlpha + 127) / 255);
+		}
+		pdwTexels = Premultiplied;
+	}
+
+	if (dwFourCC == FOURCC_DXT2 || dwFourCC == FOURCC_DXT3) {
+		CompressAlphaExplicit(Alphas, pOutput);
+	} else {
+		CompressAlphaInterpolated(
+			Alphas, dwMask, GetAlphaRadius(dwFlags), pOutput);
+	}
+
+	// The color half of these formats is always decoded with four colors
+	InitBlock(&Block, pdwTexels, dwMask, dwFlags & ~DXTC_BC1_ALPHA);
+	CompressColor(&Block, dwFlags, FALSE, pOutput + 8);
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTCompressImage()
+// Desc: Encode an ARGB8888 image. Images smaller than a block and edges
+//       that don't fill a whole block are handled.
+//-----------------------------------------------------------------------------
+HRESULT DXTCompressImage(DWORD dwFourCC, const void* pSrc, LONG lSrcPitch,
+	DWORD dwWidth, DWORD dwHeight, void* pDest, LONG lDestPitch,
+	DWORD dwFlags)
+{
+	DWORD dwBlockBytes;
+	DWORD x;
+	DWORD y;
+
+	if (!pSrc || !pDest || !dwWidth || !dwHeight) {
+		return DDERR_INVALIDPARAMS;
+	}
+	dwBlockBytes = DXTGetBlockBytes(dwFourCC);
+	if (!dwBlockBytes) {
+		return DDERR_UNSUPPORTEDFORMAT;
+	}
+
+	for (y = 0; y < dwHeight; y += 4) {
+		BYTE* pOutput = (BYTE*)pDest + (LONG)(y >> 2) * lDestPitch;
+		for (x = 0; x < dwWidth; x += 4) {
+			DWORD Texels[16];
+			DWORD dwMask = 0;
+			UINT uRow;
+			UINT uColumn;
+
+			memset(Texels, 0, sizeof(Texels));
+			for (uRow = 0; uRow < 4 && y + uRow < dwHeight; ++uRow) {
+				const DWORD* pRow = (const DWORD*)((const BYTE*)pSrc +
+					(LONG)(y + uRow) * lSrcPitch);
+				for (uColumn = 0; uColumn < 4 && x + uColumn < dwWidth;
+					 ++uColumn) {
+					UINT uTexel = uRow * 4 + uColumn;
+					Texels[uTexel] = pRow[x + uColumn];
+					dwMask |= 1U << uTexel;
+				}
+			}
+			DXTCompressBlock(dwFourCC, Texels, dwMask, dwFlags, pOutput);
+			pOutput += dwBlockBytes;
+		}
+	}
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// What one band of DXTCompressImages() measured
+//-----------------------------------------------------------------------------
+struct DXTBandStats {
+	double dColorError;   // Summed squared RGB error
+	double dAlphaError;   // Summed squared alpha error
+	DWORD dwColorSamples; // Color channels compared
+	DWORD dwAlphaTexels;  // Texels whose alpha counts
+	DWORD dwLateRows;     // Block rows started over budget
+};
+
+//-----------------------------------------------------------------------------
+// Work shared by the tasks of DXTCompressImages()
+//-----------------------------------------------------------------------------
+struct DXTCompressBatch {
+	const DXTCOMPRESSJOB* pJobs; // Images to compress
+	DWORD dwJobs;                // Number of images
+	DWORD* pFirstBands;          // Task number of each job's first band,
+	                             // plus the total at the end
+	DXTBandStats* pStats;        // One per band
+	DWORD dwStartTime;           // GetTickCount() when the batch started
+	DWORD dwTimeBudget;          // Milliseconds, 0 for no limit
+};
+
+//-----------------------------------------------------------------------------
+// Name: MeasureBlockRow()
+// Desc: Decode one freshly written row of blocks and add its error to
+//       pStats, comparing with what the encoder was aiming for
+//-----------------------------------------------------------------------------
+static void MeasureBlockRow(const DXTCOMPRESSJOB* pJob, DWORD dwTop,
+	const BYTE* pBlocks, DXTBandStats* pStats)
+{
+	DWORD Decoded[4 * 32];
+	BOOL bPremultiplied =
+		pJob->dwFourCC == FOURCC_DXT2 || pJob->dwFourCC == FOURCC_DXT4;
+	BOOL bBC1 = pJob->dwFourCC == FOURCC_DXT1;
+	BOOL bRed = pJob->dwFourCC == FOURCC_ATI1;
+	BOOL bRedGreen = pJob->dwFourCC == FOURCC_ATI2;
+	BOOL bAlpha = (!bBC1 || (pJob->dwFlags & DXTC_BC1_ALPHA)) && !bRed &&
+		!bRedGreen;
+	DWORD dwRows = pJob->dwHeight - dwTop;
+	DWORD x;
+	DWORD y;
+
+	dwRows = dwRows > 4 ? 4 : dwRows;
+	// 32 texels across at a time keeps the buffer on the stack
+	for (x = 0; x < pJob->dwWidth; x += 32) {
+		RECT rcRow;
+		DWORD dwColumns = pJob->dwWidth - x;
+
+		dwColumns = dwColumns > 32 ? 32 : dwColumns;
+		rcRow.left = (LONG)x;
+		rcRow.top = 0;
+		rcRow.right = (LONG)(x + dwColumns);
+		rcRow.bottom = (LONG)dwRows;
+		DXTDecompressImage(pJob->dwFourCC, pBlocks, pJob->lDestPitch,
+			pJob->dwWidth, dwRows, &rcRow, Decoded, 32 * sizeof(DWORD), 0);
+
+		for (y = 0; y < dwRows; ++y) {
+			const DWORD* pSource = (const DWORD*)((const BYTE*)pJob->pSrc +
+				(LONG)(dwTop + y) * pJob->lSrcPitch) + x;
+			const DWORD* pResult = &Decoded[y * 32];
+			DWORD i;
+
+			for (i = 0; i < dwColumns; ++i) {
+				DWORD dwSource = pSource[i];
+				DWORD dwResult = pResult[i];
+				int iAlpha = (int)(dwSource >> 24);
+				int iRed = (int)((dwSource >> 16) & 0xFF);
+				int iGreen = (int)((dwSource >> 8) & 0xFF);
+				int iBlue = (int)(dwSource & 0xFF);
+				int iDelta;
+
+				if (bPremultiplied) {
+					iRed = (iRed * iAlpha + 127) / 255;
+					iGreen = (iGreen * iAlpha + 127) / 255;
+					iBlue = (iBlue * iAlpha + 127) / 255;
+				}
+				if (bAlpha) {
+					if (bBC1) {
+						iAlpha = iAlpha < 128 ? 0 : 255;
+					}
+					iDelta = iAlpha - (int)(dwResult >> 24);
+					pStats->dAlphaError += (double)(iDelta * iDelta);
+					pStats->dwAlphaTexels++;
+				}
+				// Transparent DXT1 texels have no color
+				if (bBC1 && !(dwResult >> 24)) {
+					continue;
+				}
+				iDelta = iRed - (int)((dwResult >> 16) & 0xFF);
+				pStats->dColorError += (double)(iDelta * iDelta);
+				pStats->dwColorSamples++;
+				// Only the stored channels of ATI1 and ATI2 count
+				if (bRed) {
+					continue;
+				}
+				iDelta = iGreen - (int)((dwResult >> 8) & 0xFF);
+				pStats->dColorError += (double)(iDelta * iDelta);
+				pStats->dwColorSamples++;
+				if (bRedGreen) {
+					continue;
+				}
+				iDelta = iBlue - (int)(dwResult & 0xFF);
+				pStats->dColorError += (double)(iDelta * iDelta);
+				pStats->dwColorSamples++;
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: CompressBandTask()
+// Desc: Compress one band of block rows of one job, measuring its error if
+//       the job asks for it. Once the batch is over budget the remaining
+//       rows are only range fitted.
+//-----------------------------------------------------------------------------
+static void CompressBandTask(void* pContext, DWORD dwTask)
+{
+	const DXTCompressBatch* pBatch = (const DXTCompressBatch*)pContext;
+	const DXTCOMPRESSJOB* pJob;
+	DXTBandStats* pStats = &pBatch->pStats[dwTask];
+	DWORD dwLow = 0;
+	DWORD dwHigh = pBatch->dwJobs;
+	DWORD dwBand;
+	DWORD dwRow;
+
+	// Find the job holding this band
+	while (dwHigh - dwLow > 1) {
+		DWORD dwMiddle = (dwLow + dwHigh) >> 1;
+		if (pBatch->pFirstBands[dwMiddle] <= dwTask) {
+			dwLow = dwMiddle;
+		} else {
+			dwHigh = dwMiddle;
+		}
+	}
+	pJob = &pBatch->pJobs[dwLow];
+	dwBand = dwTask - pBatch->pFirstBands[dwLow];
+
+	for (dwRow = dwBand * DXTC_BAND_ROWS;
+		 dwRow < (dwBand + 1) * DXTC_BAND_ROWS && dwRow * 4 < pJob->dwHeight;
+		 ++dwRow) {
+		DWORD dwTop = dwRow * 4;
+		DWORD dwRows = pJob->dwHeight - dwTop;
+		DWORD dwFlags = pJob->dwFlags;
+		BYTE* pBlocks = (BYTE*)pJob->pDest + (LONG)dwRow * pJob->lDestPitch;
+
+		if (pBatch->dwTimeBudget &&
+			(GetTickCount() - pBatch->dwStartTime) >= pBatch->dwTimeBudget) {
+			DWORD dwFit = dwFlags & DXTC_FIT_MASK;
+			if (!dwFit || (dwFit & (DXTC_FIT_CLUSTER | DXTC_FIT_REFINE))) {
+				dwFlags = (dwFlags & ~DXTC_FIT_MASK) | DXTC_FIT_RANGE;
+				pStats->dwLateRows++;
+			}
+		}
+		DXTCompressImage(pJob->dwFourCC,
+			(const BYTE*)pJob->pSrc + (LONG)dwTop * pJob->lSrcPitch,
+			pJob->lSrcPitch, pJob->dwWidth, dwRows > 4 ? 4 : dwRows, pBlocks,
+			pJob->lDestPitch, dwFlags);
+		if (dwFlags & DXTC_MEASURE_ERROR) {
+			MeasureBlockRow(pJob, dwTop, pBlocks, pStats);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTCompressImages()
+// Desc: Compress a set of images, such as every face and mip level of a
+//       texture, on a thread pool. Bands are written straight into each
+//       job's destination and the error of jobs with DXTC_MEASURE_ERROR is
+//       filled in. A NULL pool runs everything on this thread.
+//-----------------------------------------------------------------------------
+HRESULT DXTCompressImages(DXTWorkPool* pPool, DXTCOMPRESSJOB* pJobs,
+	DWORD dwJobs, DWORD dwTimeBudget)
+{
+	DXTCompressBatch Batch;
+	DWORD dwBands;
+	DWORD i;
+	DWORD j;
+
+	if (!dwJobs) {
+		return DD_OK;
+	}
+	if (!pJobs) {
+		return DDERR_INVALIDPARAMS;
+	}
+	// Check everything first, the tasks have no way to report errors
+	for (i = 0; i < dwJobs; ++i) {
+		if (!pJobs[i].pSrc || !pJobs[i].pDest || !pJobs[i].dwWidth ||
+			!pJobs[i].dwHeight) {
+			return DDERR_INVALIDPARAMS;
+		}
+		if (!DXTGetBlockBytes(pJobs[i].dwFourCC)) {
+			return DDERR_UNSUPPORTEDFORMAT;
+		}
+	}
+
+	Batch.pJobs = pJobs;
+	Batch.dwJobs = dwJobs;
+	Batch.pFirstBands = new DWORD[dwJobs + 1];
+	if (!Batch.pFirstBands) {
+		return DDERR_OUTOFMEMORY;
+	}
+	Batch.pFirstBands[0] = 0;
+	for (i = 0; i < dwJobs; ++i) {
+		DWORD dwBlockRows = (pJobs[i].dwHeight + 3) >> 2;
+		Batch.pFirstBands[i + 1] = Batch.pFirstBands[i] +
+			(dwBlockRows + DXTC_BAND_ROWS - 1) / DXTC_BAND_ROWS;
+	}
+	dwBands = Batch.pFirstBands[dwJobs];
+	Batch.pStats = new DXTBandStats[dwBands];
+	if (!Batch.pStats) {
+		delete[] Batch.pFirstBands;
+		return DDERR_OUTOFMEMORY;
+	}
+	ZeroMemory(Batch.pStats, sizeof(DXTBandStats) * dwBands);
+	Batch.dwStartTime = GetTickCount();
+	Batch.dwTimeBudget = dwTimeBudget;
+	DXTPoolRun(pPool, CompressBandTask, &Batch, dwBands);
+
+	// Add up the bands of each job in order, so the result doesn't depend
+	// on which thread finished first
+	for (i = 0; i < dwJobs; ++i) {
+		DXTBandStats Total;
+
+		ZeroMemory(&Total, sizeof(Total));
+		for (j = Batch.pFirstBands[i]; j < Batch.pFirstBands[i + 1]; ++j) {
+			Total.dColorError += Batch.pStats[j].dColorError;
+			Total.dAlphaError += Batch.pStats[j].dAlphaError;
+			Total.dwColorSamples += Batch.pStats[j].dwColorSamples;
+			Total.dwAlphaTexels += Batch.pStats[j].dwAlphaTexels;
+			Total.dwLateRows += Batch.pStats[j].dwLateRows;
+		}
+		pJobs[i].fColorRMSE = Total.dwColorSamples ?
+			(float)sqrt(Total.dColorError / Total.dwColorSamples) : 0.0f;
+		pJobs[i].fAlphaRMSE = Total.dwAlphaTexels ?
+			(float)sqrt(Total.dAlphaError / Total.dwAlphaTexels) : 0.0f;
+		pJobs[i].dwLateRows = Total.dwLateRows;
+	}
+	delete[] Batch.pStats;
+	delete[] Batch.pFirstBands;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DecodeColorPalettes()
+// Desc: Rebuild the palettes of up to 8 consecutive color blocks. Blocks of
+//       DXT2 through DXT5 are always four color, pass bForceFour for them.
+//-----------------------------------------------------------------------------
+static void DecodeColorPalettes(const BYTE* pBlocks, UINT uStride,
+	UINT uBlocks, BOOL bForceFour, DWORD (*pPalettes)[4])
+{
+#if defined(DXTC_SSE2)
+	WORD Colors0[8];
+	WORD Colors1[8];
+	DWORD Entries[4][8];
+	__m128i vColor0;
+	__m128i vColor1;
+	__m128i vFour;
+	__m128i Red[4];
+	__m128i Green[4];
+	__m128i Blue[4];
+	__m128i vFive = _mm_set1_epi16(31);
+	__m128i vSix = _mm_set1_epi16(63);
+	__m128i vOne = _mm_set1_epi16(1);
+	__m128i vThird = _mm_set1_epi16(21846); // x * 21846 >> 16 == x / 3, x < 768
+	__m128i vOpaque = _mm_set1_epi16(0xFF00);
+	UINT i;
+	UINT j;
+
+	for (i = 0; i < 8; ++i) {
+		const BYTE* pBlock = pBlocks + (i < uBlocks ? i : 0) * uStride;
+		Colors0[i] = (WORD)(pBlock[0] | (pBlock[1] << 8));
+		Colors1[i] = (WORD)(pBlock[2] | (pBlock[3] << 8));
+	}
+	vColor0 = _mm_loadu_si128((const __m128i*)Colors0);
+	vColor1 = _mm_loadu_si128((const __m128i*)Colors1);
+	if (bForceFour) {
+		vFour = _mm_cmpeq_epi16(vColor0, vColor0);
+	} else {
+		__m128i vBias = _mm_set1_epi16((short)0x8000);
+		vFour = _mm_cmpgt_epi16(_mm_xor_si128(vColor0, vBias),
+			_mm_xor_si128(vColor1, vBias));
+	}
+
+	Red[0] = _mm_srli_epi16(vColor0, 11);
+	Green[0] = _mm_and_si128(_mm_srli_epi16(vColor0, 5), vSix);
+	Blue[0] = _mm_and_si128(vColor0, vFive);
+	Red[1] = _mm_srli_epi16(vColor1, 11);
+	Green[1] = _mm_and_si128(_mm_srli_epi16(vColor1, 5), vSix);
+	Blue[1] = _mm_and_si128(vColor1, vFive);
+	for (i = 0; i < 2; ++i) {
+		Red[i] = _mm_or_si128(_mm_slli_epi16(Red[i], 3), _mm_srli_epi16(Red[i], 2));
+		Green[i] = _mm_or_si128(_mm_slli_epi16(Green[i], 2), _mm_srli_epi16(Green[i], 4));
+		Blue[i] = _mm_or_si128(_mm_slli_epi16(Blue[i], 3), _mm_srli_epi16(Blue[i], 2));
+	}
+
+#define DXTC_BLEND_CHANNEL(Channel) \
+	{ \
+		__m128i vFour2 = _mm_mulhi_epu16(_mm_add_epi16(_mm_add_epi16( \
+			_mm_slli_epi16(Channel[0], 1), Channel[1]), vOne), vThird); \
+		__m128i vFour3 = _mm_mulhi_epu16(_mm_add_epi16(_mm_add_epi16( \
+			Channel[0], _mm_slli_epi16(Channel[1], 1)), vOne), vThird); \
+		__m128i vThree2 = _mm_srli_epi16(_mm_add_epi16( \
+			_mm_add_epi16(Channel[0], Channel[1]), vOne), 1); \
+		Channel[2] = _mm_or_si128(_mm_and_si128(vFour, vFour2), \
+			_mm_andnot_si128(vFour, vThree2)); \
+		Channel[3] = _mm_and_si128(vFour, vFour3); \
+	}
+	DXTC_BLEND_CHANNEL(Red)
+	DXTC_BLEND_CHANNEL(Green)
+	DXTC_BLEND_CHANNEL(Blue)
+#undef DXTC_BLEND_CHANNEL
+
+	// Pack to ARGB, entry 3 of three color blocks is transparent black
+	for (j = 0; j < 4; ++j) {
+		__m128i vAlpha = j == 3 ? _mm_and_si128(vFour, vOpaque) : vOpaque;
+		__m128i vAlphaRed = _mm_or_si128(vAlpha, Red[j]);
+		__m128i vGreenBlue = _mm_or_si128(_mm_slli_epi16(Green[j], 8), Blue[j]);
+		_mm_storeu_si128((__m128i*)&Entries[j][0],
+			_mm_unpacklo_epi16(vGreenBlue, vAlphaRed));
+		_mm_storeu_si128((__m128i*)&Entries[j][4],
+			_mm_unpackhi_epi16(vGreenBlue, vAlphaRed));
+	}
+	for (i = 0; i < uBlocks; ++i) {
+		for (j = 0; j < 4; ++j) {
+			pPalettes[i][j] = Entries[j][i];
+		}
+	}
+#else
+	UINT i;
+
+	for (i = 0; i < uBlocks; ++i) {
+		const BYTE* pBlock = pBlocks + i * uStride;
+		UINT uColor0 = pBlock[0] | (pBlock[1] << 8);
+		UINT uColor1 = pBlock[2] | (pBlock[3] << 8);
+		BuildPalette(uColor0, uColor1, bForceFour || uColor0 > uColor1,
+			pPalettes[i]);
+	}
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Name: DecodeAlphaPalettes()
+// Desc: Rebuild the eight values of up to 8 consecutive interpolated alpha
+//       blocks
+//-----------------------------------------------------------------------------
+static void DecodeAlphaPalettes(
+	const BYTE* pBlocks, UINT uStride, UINT uBlocks, BYTE (*pPalettes)[8])
+{
+#if defined(DXTC_SSE2)
+	WORD Alphas0[8];
+	WORD Alphas1[8];
+	WORD Entries[8][8];
+	__m128i vAlpha0;
+	__m128i vAlpha1;
+	__m128i vEight;
+	__m128i vSeventh = _mm_set1_epi16(9363); // x * 9363 >> 16 == x / 7, x < 1792
+	__m128i vFifth = _mm_set1_epi16(13108);  // x * 13108 >> 16 == x / 5, x < 1280
+	UINT i;
+	UINT j;
+
+	for (i = 0; i < 8; ++i) {
+		const BYTE* pBlock = pBlocks + (i < uBlocks ? i : 0) * uStride;
+		Alphas0[i] = pBlock[0];
+		Alphas1[i] = pBlock[1];
+	}
+	vAlpha0 = _mm_loadu_si128((const __m128i*)Alphas0);
+	vAlpha1 = _mm_loadu_si128((const __m128i*)Alphas1);
+	vEight = _mm_cmpgt_epi16(vAlpha0, vAlpha1);
+	_mm_storeu_si128((__m128i*)Entries[0], vAlpha0);
+	_mm_storeu_si128((__m128i*)Entries[1], vAlpha1);
+	for (j = 1; j < 7; ++j) {
+		__m128i vSeven = _mm_mulhi_epu16(_mm_add_epi16(_mm_add_epi16(
+			_mm_mullo_epi16(vAlpha0, _mm_set1_epi16((short)(7 - j))),
+			_mm_mullo_epi16(vAlpha1, _mm_set1_epi16((short)j))),
+			_mm_set1_epi16(3)), vSeventh);
+		__m128i vFive;
+		if (j < 5) {
+			vFive = _mm_mulhi_epu16(_mm_add_epi16(_mm_add_epi16(
+				_mm_mullo_epi16(vAlpha0, _mm_set1_epi16((short)(5 - j))),
+				_mm_mullo_epi16(vAlpha1, _mm_set1_epi16((short)j))),
+				_mm_set1_epi16(2)), vFifth);
+		} else {
+			vFive = _mm_set1_epi16(j == 5 ? 0 : 255);
+		}
+		_mm_storeu_si128((__m128i*)Entries[j + 1],
+			_mm_or_si128(_mm_and_si128(vEight, vSeven),
+				_mm_andnot_si128(vEight, vFive)));
+	}
+	for (i = 0; i < uBlocks; ++i) {
+		for (j = 0; j < 8; ++j) {
+			pPalettes[i][j] = (BYTE)Entries[j][i];
+		}
+	}
+#else
+	UINT i;
+
+	for (i = 0; i < uBlocks; ++i) {
+		const BYTE* pBlock = pBlocks + i * uStride;
+		BuildAlphaPalette(pBlock[0], pBlock[1], pPalettes[i]);
+	}
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Name: DecodeChannelBlocks()
+// Desc: Decode up to 8 consecutive ATI1 or ATI2 blocks to 16 opaque texels
+//       each, reusing the alpha palette decoder for every channel
+//-----------------------------------------------------------------------------
+static void DecodeChannelBlocks(DWORD dwFourCC, const BYTE* pBlocks,
+	UINT uBlocks, DWORD dwFlags, DWORD (*pTexels)[16])
+{
+	BYTE RedPalettes[8][8];
+	BYTE GreenPalettes[8][8];
+	UINT uStride = DXTGetBlockBytes(dwFourCC);
+	BOOL bGreen = dwFourCC == FOURCC_ATI2;
+	UINT i;
+	UINT j;
+
+	DecodeAlphaPalettes(pBlocks, uStride, uBlocks, RedPalettes);
+	if (bGreen) {
+		DecodeAlphaPalettes(pBlocks + 8, uStride, uBlocks, GreenPalettes);
+	}
+
+	for (i = 0; i < uBlocks; ++i) {
+		const BYTE* pBlock = pBlocks + i * uStride;
+		DWORD* pOut = pTexels[i];
+
+		// Alpha only views of these formats are plain white
+		if (dwFlags & DXTD_ALPHAONLY) {
+			for (j = 0; j < 16; ++j) {
+				pOut[j] = 0xFFFFFFFFUL;
+			}
+			continue;
+		}
+		for (j = 0; j < 16; ++j) {
+			const BYTE* pIndices = pBlock + 2 + (j >> 3) * 3;
+			DWORD dwIndices = pIndices[0] | (pIndices[1] << 8) |
+				(pIndices[2] << 16);
+			DWORD dwRed = RedPalettes[i][(dwIndices >> ((j & 7) * 3)) & 7];
+			if (bGreen) {
+				DWORD dwGreen;
+				pIndices += 8;
+				dwIndices = pIndices[0] | (pIndices[1] << 8) |
+					(pIndices[2] << 16);
+				dwGreen = GreenPalettes[i][(dwIndices >> ((j & 7) * 3)) & 7];
+				pOut[j] = 0xFF000000UL | (dwRed << 16) | (dwGreen << 8);
+			} else {
+				pOut[j] = 0xFF000000UL | (dwRed << 16) | (dwRed << 8) | dwRed;
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DecodeBlocks()
+// Desc: Decode up to 8 consecutive blocks to 16 ARGB texels each
+//-----------------------------------------------------------------------------
+static void DecodeBlocks(DWORD dwFourCC, const BYTE* pBlocks, UINT uBlocks,
+	DWORD dwFlags, DWORD (*pTexels)[16])
+{
+	DWORD ColorPalettes[8][4];
+	BYTE AlphaPalettes[8][8];
+	UINT uStride = DXTGetBlockBytes(dwFourCC);
+	UINT uColorOffset = dwFourCC == FOURCC_DXT1 ? 0 : 8;
+	BOOL bInterpolated = dwFourCC == FOURCC_DXT4 || dwFourCC == FOURCC_DXT5;
+	UINT i;
+	UINT j;
+
+	if (dwFourCC == FOURCC_ATI1 || dwFourCC == FOURCC_ATI2) {
+		DecodeChannelBlocks(dwFourCC, pBlocks, uBlocks, dwFlags, pTexels);
+		return;
+	}
+	if (dwFourCC == FOURCC_BC7) {
+		for (i = 0; i < uBlocks; ++i) {
+			BC7DecompressBlock(pBlocks + i * uStride, pTexels[i]);
+			if (dwFlags & DXTD_ALPHAONLY) {
+				for (j = 0; j < 16; ++j) {
+					DWORD dwAlpha = pTexels[i][j] >> 24;
+					pTexels[i][j] = 0xFF000000UL | (dwAlpha << 16) |
+						(dwAlpha << 8) | dwAlpha;
+				}
+			}
+		}
+		return;
+	}
+	DecodeColorPalettes(pBlocks + uColorOffset, uStride, uBlocks,
+		dwFourCC != FOURCC_DXT1, ColorPalettes);
+	if (bInterpolated) {
+		DecodeAlphaPalettes(pBlocks, uStride, uBlocks, AlphaPalettes);
+	}
+
+	for (i = 0; i < uBlocks; ++i) {
+		const BYTE* pBlock = pBlocks + i * uStride;
+		const BYTE* pColor = pBlock + uColorOffset;
+		DWORD dwIndices = pColor[4] | (pColor[5] << 8) | (pColor[6] << 16) |
+			((DWORD)pColor[7] << 24);
+		DWORD* pOut = pTexels[i];
+
+		for (j = 0; j < 16; ++j) {
+			pOut[j] = ColorPalettes[i][(dwIndices >> (j * 2)) & 3];
+		}
+		if (bInterpolated) {
+			DWORD dwAlpha0 = pBlock[2] | (pBlock[3] << 8) | (pBlock[4] << 16);
+			DWORD dwAlpha1 = pBlock[5] | (pBlock[6] << 8) | (pBlock[7] << 16);
+			for (j = 0; j < 8; ++j) {
+				pOut[j] = (pOut[j] & 0x00FFFFFFUL) |
+					((DWORD)AlphaPalettes[i][(dwAlpha0 >> (j * 3)) & 7] << 24);
+				pOut[j + 8] = (pOut[j + 8] & 0x00FFFFFFUL) |
+					((DWORD)AlphaPalettes[i][(dwAlpha1 >> (j * 3)) & 7] << 24);
+			}
+		} else if (uColorOffset) {
+			for (j = 0; j < 16; ++j) {
+				DWORD dwAlpha = (pBlock[j >> 1] >> ((j & 1) * 4)) & 15;
+				pOut[j] = (pOut[j] & 0x00FFFFFFUL) | ((dwAlpha * 17) << 24);
+			}
+		}
+		if (dwFlags & DXTD_ALPHAONLY) {
+			for (j = 0; j < 16; ++j) {
+				DWORD dwAlpha = pOut[j] >> 24;
+				pOut[j] = 0xFF000000UL | (dwAlpha << 16) | (dwAlpha << 8) | dwAlpha;
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTDecompressImage()
+// Desc: Decode a DXTn, ATI1, ATI2 or BC7 image, or just the prcSrc part of
+//       it, to ARGB8888. The top left of the decoded area lands at the start
+//       of pDest. DXT2 and DXT4 color stays premultiplied.
+//-----------------------------------------------------------------------------
+HRESULT DXTDecompressImage(DWORD dwFourCC, const void* pSrc, LONG lSrcPitch,
+	DWORD dwWidth, DWORD dwHeight, const RECT* prcSrc, void* pDest,
+	LONG lDestPitch, DWORD dwFlags)
+{
+	RECT rcSrc;
+	DWORD dwBlockBytes;
+	LONG lBlockY;
+
+	if (!pSrc || !pDest || !dwWidth || !dwHeight) {
+		return DDERR_INVALIDPARAMS;
+	}
+	dwBlockBytes = DXTGetBlockBytes(dwFourCC);
+	if (!dwBlockBytes) {
+		return DDERR_UNSUPPORTEDFORMAT;
+	}
+	if (prcSrc) {
+		rcSrc = *prcSrc;
+		if (rcSrc.left < 0 || rcSrc.top < 0 || rcSrc.left >= rcSrc.right ||
+			rcSrc.top >= rcSrc.bottom || rcSrc.right > (LONG)dwWidth ||
+			rcSrc.bottom > (LONG)dwHeight) {
+			return DDERR_INVALIDRECT;
+		}
+	} else {
+		rcSrc.left = 0;
+		rcSrc.top = 0;
+		rcSrc.right = (LONG)dwWidth;
+		rcSrc.bottom = (LONG)dwHeight;
+	}
+
+	for (lBlockY = rcSrc.top >> 2; lBlockY <= (rcSrc.bottom - 1) >> 2;
+		 ++lBlockY) {
+		const BYTE* pRow = (const BYTE*)pSrc + lBlockY * lSrcPitch;
+		LONG lTop = lBlockY * 4 < rcSrc.top ? rcSrc.top - lBlockY * 4 : 0;
+		LONG lBottom = lBlockY * 4 + 4 > rcSrc.bottom ?
+			rcSrc.bottom - lBlockY * 4 : 4;
+		LONG lBlockX = rcSrc.left >> 2;
+		LONG lLastX = (rcSrc.right - 1) >> 2;
+
+		while (lBlockX <= lLastX) {
+			DWORD Texels[8][16];
+			UINT uBlocks = (UINT)(lLastX - lBlockX + 1);
+			UINT i;
+
+			uBlocks = uBlocks > 8 ? 8 : uBlocks;
+			DecodeBlocks(dwFourCC, pRow + lBlockX * (LONG)dwBlockBytes,
+				uBlocks, dwFlags, Texels);
+
+			for (i = 0; i < uBlocks; ++i, ++lBlockX) {
+				LONG lLeft = lBlockX * 4 < rcSrc.left ?
+					rcSrc.left - lBlockX * 4 : 0;
+				LONG lRight = lBlockX * 4 + 4 > rcSrc.right ?
+					rcSrc.right - lBlockX * 4 : 4;
+				LONG y;
+				for (y = lTop; y < lBottom; ++y) {
+					DWORD* pOut = (DWORD*)((BYTE*)pDest +
+						(lBlockY * 4 + y - rcSrc.top) * lDestPitch) +
+						(lBlockX * 4 + lLeft - rcSrc.left);
+					memcpy(pOut, &Texels[i][y * 4 + lLeft],
+						(lRight - lLeft) * sizeof(DWORD));
+				}
+			}
+		}
+	}
+	return DD_OK;
+}
@@ -0,0 +1,153 @@
+/***************************************
+
+	DXTn block compression
+
+	Encodes ARGB8888 pixels into DXTn blocks and decodes them back without
+	going through a DirectDraw Blt(), so compressed textures come out the
+	same no matter which driver or reference rasterizer is installed.
+	Nothing in here touches DirectDraw or MFC, the caller hands over locked
+	pixels.
+
+***************************************/
+
+#ifndef __DXTCODEC_H__
+#define __DXTCODEC_H__
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include "dxtpool.h"
+#include <ddraw.h>
+
+/***************************************
+
+	Single and dual channel formats
+
+	ATI1 (BC4) is one DXT5 alpha block holding red. ATI2 (BC5) is two of
+	them, red then green. They decode to grey and to red and green with no
+	blue. ddraw.h only names the DXTn codes.
+
+***************************************/
+
+#ifndef FOURCC_ATI1
+#define FOURCC_ATI1 MAKEFOURCC('A', 'T', 'I', '1')
+#endif
+#ifndef FOURCC_ATI2
+#define FOURCC_ATI2 MAKEFOURCC('A', 'T', 'I', '2')
+#endif
+
+/***************************************
+
+	BC7
+
+	BC7 has no FourCC of its own, DDS files name it with a DXGI format in
+	the DX10 extension header. This code stands in for it everywhere else.
+
+***************************************/
+
+#define FOURCC_BC7 MAKEFOURCC('B', 'C', '7', ' ')
+
+/***************************************
+
+	Flags for DXTCompressImage() and the block encoders
+
+	With no fit flag set the cluster fit is used. If several are set the
+	slowest one wins.
+
+***************************************/
+
+#define DXTC_FIT_RANGE 0x00000001UL     // Endpoints from the principal axis
+#define DXTC_FIT_CLUSTER 0x00000002UL   // Search all ordered clusterings
+#define DXTC_BC1_ALPHA 0x00000004UL     // DXT1 texels with alpha < 128 are transparent
+#define DXTC_PERCEPTUAL 0x00000008UL    // Weight color error by luminance
+#define DXTC_FIT_BOX 0x00000010UL       // Endpoints from the bounding box corners
+#define DXTC_FIT_REFINE 0x00000020UL    // Cluster fit, repeated along the fitted axis
+#define DXTC_MEASURE_ERROR 0x00000040UL // DXTCompressImages() fills in the RMSE
+#define DXTC_FIT_MASK \
+	(DXTC_FIT_RANGE | DXTC_FIT_CLUSTER | DXTC_FIT_BOX | DXTC_FIT_REFINE)
+
+/***************************************
+
+	Quality tiers, from quickest to best
+
+***************************************/
+
+#define DXTC_QUALITY_FAST DXTC_FIT_BOX
+#define DXTC_QUALITY_NORMAL DXTC_FIT_RANGE
+#define DXTC_QUALITY_BEST DXTC_FIT_REFINE
+
+/***************************************
+
+	Flags for DXTDecompressImage()
+
+***************************************/
+
+#define DXTD_ALPHAONLY 0x00000001UL // Write alpha as opaque grey
+
+/***************************************
+
+	One image for DXTCompressImages()
+
+	Each job is cut into bands of DXTC_BAND_ROWS block rows and the bands
+	of all jobs are spread over the pool's threads together. Jobs with
+	DXTC_MEASURE_ERROR have every band decoded again once written, and
+	their root mean square error is filled in on the 0 to 255 scale. The
+	error is 0 for other jobs.
+
+	A nonzero time budget, in milliseconds, covers the whole batch. Block
+	rows started after it runs out skip the cluster fit and use the range
+	fit, so pass one texture per batch for a per texture budget.
+
+***************************************/
+
+#define DXTC_BAND_ROWS 4
+
+typedef struct _DXTCOMPRESSJOB {
+	DWORD dwFourCC;   // DXTn, ATI1, ATI2 or BC7 format to write
+	const void* pSrc; // ARGB8888 pixels
+	LONG lSrcPitch;   // Bytes between rows of pSrc
+	DWORD dwWidth;    // Size in pixels
+	DWORD dwHeight;
+	void* pDest;      // First row of blocks
+	LONG lDestPitch;  // Bytes between rows of blocks
+	DWORD dwFlags;    // DXTC_ flags
+	float fColorRMSE; // Out: RGB error, premultiplied for DXT2 and DXT4,
+	                  // just the stored channels for ATI1 and ATI2
+	float fAlphaRMSE; // Out: alpha error, 0 for DXT1 without DXTC_BC1_ALPHA
+	                  // and for ATI1 and ATI2
+	DWORD dwLateRows; // Out: block rows range fitted once over budget
+} DXTCOMPRESSJOB, *LPDXTCOMPRESSJOB;
+
+/* Assume C declarations for C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern DWORD DXTGetBlockBytes(DWORD dwFourCC);
+extern DWORD DXTGetPitch(DWORD dwFourCC, DWORD dwWidth);
+extern DWORD DXTGetImageBytes(DWORD dwFourCC, DWORD dwWidth, DWORD dwHeight);
+extern BOOL DXTIsBlockRect(
+	const RECT* prcRect, DWORD dwWidth, DWORD dwHeight);
+extern void DXTCopyBlocks(DWORD dwFourCC, const void* pSrc, LONG lSrcPitch,
+	void* pDest, LONG lDestPitch, DWORD dwWidth, DWORD dwHeight);
+extern void DXTCompressBlockBC1(
+	const DWORD* pdwTexels, DWORD dwMask, DWORD dwFlags, void* pBlock);
+extern void DXTCompressBlock(DWORD dwFourCC, const DWORD* pdwTexels,
+	DWORD dwMask, DWORD dwFlags, void* pBlock);
+extern HRESULT DXTCompressImage(DWORD dwFourCC, const void* pSrc,
+	LONG lSrcPitch, DWORD dwWidth, DWORD dwHeight, void* pDest,
+	LONG lDestPitch, DWORD dwFlags);
+extern HRESULT DXTCompressImages(DXTWorkPool* pPool, DXTCOMPRESSJOB* pJobs,
+	DWORD dwJobs, DWORD dwTimeBudget);
+extern HRESULT DXTDecompressImage(DWORD dwFourCC, const void* pSrc,
+	LONG lSrcPitch, DWORD dwWidth, DWORD dwHeight, const RECT* prcSrc,
+	void* pDest, LONG lDestPitch, DWORD dwFlags);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -0,0 +1,299 @@
+//-----------------------------------------------------------------------------
+// File: dxtpool.cpp
+//
+// Desc: Work stealing thread pool.
+//
+//       Every worker owns a range of task numbers. The owner takes tasks
+//       from the front of its range, a thief takes the back half of a
+//       victim's range and makes it its own. Tasks never spawn more tasks,
+//       so once a worker finds every range empty it's done for the batch.
+//       Ranges are guarded by a critical section each, which is only
+//       contended while stealing.
+//
+//       Threads are started with CreateThread(), tasks must not rely on
+//       per thread C runtime state.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include "dxtpool.h"
+
+//-----------------------------------------------------------------------------
+// One worker, entry 0 of a pool is the thread calling DXTPoolRun()
+//-----------------------------------------------------------------------------
+struct DXTWorker {
+	CRITICAL_SECTION csLock; // Guards dwNext and dwEnd
+	DWORD dwNext;            // Next task the owner runs
+	DWORD dwEnd;             // One past the last task in the range
+	DXTWorkPool* pPool;      // Pool this worker belongs to
+	DWORD dwIndex;           // Position in the pool
+	HANDLE hThread;          // Helper thread, NULL for entry 0
+	HANDLE hWake;            // Set when a batch is ready or on shutdown
+	BYTE Padding[64];        // Keep neighbours off each other's cache lines
+};
+
+//-----------------------------------------------------------------------------
+// The pool
+//-----------------------------------------------------------------------------
+struct DXTWorkPool {
+	DWORD dwThreads;         // Workers, including the caller
+	DXTWorker* pWorkers;     // dwThreads entries
+	HANDLE hDone;            // Set when the last helper finishes a batch
+	LPDXTTASKPROC pProc;     // Task of the current batch
+	void* pContext;          // Passed to pProc
+	volatile LONG lBusy;     // Helpers still working on the batch
+	volatile LONG lQuit;     // Nonzero when the pool is shutting down
+};
+
+//-----------------------------------------------------------------------------
+// Name: TakeTask()
+// Desc: Get the next task for a worker, stealing if its own range is empty.
+//       Returns FALSE once there is nothing left anywhere.
+//-----------------------------------------------------------------------------
+static BOOL TakeTask(DXTWorkPool* pPool, DWORD dwIndex, DWORD* pdwTask)
+{
+	DXTWorker* pSelf = &pPool->pWorkers[dwIndex];
+	DWORD i;
+
+	EnterCriticalSection(&pSelf->csLock);
+	if (pSelf->dwNext < pSelf->dwEnd) {
+		*pdwTask = pSelf->dwNext++;
+		LeaveCriticalSection(&pSelf->csLock);
+		return TRUE;
+	}
+	LeaveCriticalSection(&pSelf->csLock);
+
+	// Visit the others starting with the next one so thieves spread out
+	for (i = 1; i < pPool->dwThreads; ++i) {
+		DXTWorker* pVictim =
+			&pPool->pWorkers[(dwIndex + i) % pPool->dwThreads];
+		DWORD dwFirst;
+		DWORD dwEnd;
+
+		EnterCriticalSection(&pVictim->csLock);
+		dwEnd = pVictim->dwEnd;
+		dwFirst = dwEnd - ((dwEnd - pVictim->dwNext + 1) >> 1);
+		if (dwFirst >= dwEnd) {
+			LeaveCriticalSection(&pVictim->csLock);
+			continue;
+		}
+		pVictim->dwEnd = dwFirst;
+		LeaveCriticalSection(&pVictim->csLock);
+
+		// Run the first stolen task, the rest can be stolen back
+		EnterCriticalSection(&pSelf->csLock);
+		pSelf->dwNext = dwFirst + 1;
+		pSelf->dwEnd = dwEnd;
+		LeaveCriticalSection(&pSelf->csLock);
+		*pdwTask = dwFirst;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: WorkBatch()
+// Desc: Run tasks until the batch is exhausted
+//-----------------------------------------------------------------------------
+static void WorkBatch(DXTWorkPool* pPool, DWORD dwIndex)
+{
+	DWORD dwTask;
+
+	while (TakeTask(pPool, dwIndex, &dwTask)) {
+		pPool->pProc(pPool->pContext, dwTask);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: WorkerThread()
+// Desc: Helper thread, works on each batch it's woken for
+//-----------------------------------------------------------------------------
+static DWORD WINAPI WorkerThread(LPVOID pParameter)
+{
+	DXTWorker* pWorker = (DXTWorker*)pParameter;
+	DXTWorkPool* pPool = pWorker->pPool;
+
+	for (;;) {
+		WaitForSingleObject(pWorker->hWake, INFINITE);
+		if (pPool->lQuit) {
+			break;
+		}
+		WorkBatch(pPool, pWorker->dwIndex);
+		if (!InterlockedDecrement(&pPool->lBusy)) {
+			SetEvent(pPool->hDone);
+		}
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTPoolGetProcessorCount()
+// Desc: Number of logical processors, capped at DXTPOOL_MAXTHREADS
+//-----------------------------------------------------------------------------
+DWORD DXTPoolGetProcessorCount(void)
+{
+	SYSTEM_INFO SystemInfo;
+
+	GetSystemInfo(&SystemInfo);
+	if (!SystemInfo.dwNumberOfProcessors) {
+		return 1;
+	}
+	if (SystemInfo.dwNumberOfProcessors > DXTPOOL_MAXTHREADS) {
+		return DXTPOOL_MAXTHREADS;
+	}
+	return SystemInfo.dwNumberOfProcessors;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTPoolCreate()
+// Desc: Create a pool of dwThreads workers, counting the thread that will
+//       call DXTPoolRun(). Zero means one per logical processor.
+//-----------------------------------------------------------------------------
+HRESULT DXTPoolCreate(DWORD dwThreads, DXTWorkPool** ppPool)
+{
+	DXTWorkPool* pPool;
+	DWORD i;
+
+	if (ppPool == NULL) {
+		return DDERR_INVALIDPARAMS;
+	}
+	*ppPool = NULL;
+	if (!dwThreads) {
+		dwThreads = DXTPoolGetProcessorCount();
+	} else if (dwThreads > DXTPOOL_MAXTHREADS) {
+		dwThreads = DXTPOOL_MAXTHREADS;
+	}
+
+	pPool = new DXTWorkPool;
+	if (pPool == NULL) {
+		return DDERR_OUTOFMEMORY;
+	}
+	ZeroMemory(pPool, sizeof(DXTWorkPool));
+	pPool->pWorkers = new DXTWorker[dwThreads];
+	pPool->hDone = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if ((pPool->pWorkers == NULL) || (pPool->hDone == NULL)) {
+		if (pPool->hDone) {
+			CloseHandle(pPool->hDone);
+		}
+		delete[] pPool->pWorkers;
+		delete pPool;
+		return DDERR_OUTOFMEMORY;
+	}
+	ZeroMemory(pPool->pWorkers, sizeof(DXTWorker) * dwThreads);
+	for (i = 0; i < dwThreads; ++i) {
+		InitializeCriticalSection(&pPool->pWorkers[i].csLock);
+		pPool->pWorkers[i].pPool = pPool;
+		pPool->pWorkers[i].dwIndex = i;
+	}
+
+	// Start the helpers, settle for fewer if the system runs out
+	pPool->dwThreads = 1;
+	for (i = 1; i < dwThreads; ++i) {
+		DXTWorker* pWorker = &pPool->pWorkers[i];
+		DWORD dwThreadID;
+
+		pWorker->hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (pWorker->hWake == NULL) {
+			break;
+		}
+		pWorker->hThread =
+			CreateThread(NULL, 0, WorkerThread, pWorker, 0, &dwThreadID);
+		if (pWorker->hThread == NULL) {
+			CloseHandle(pWorker->hWake);
+			pWorker->hWake = NULL;
+			break;
+		}
+		pPool->dwThreads = i + 1;
+	}
+	for (i = pPool->dwThreads; i < dwThreads; ++i) {
+		DeleteCriticalSection(&pPool->pWorkers[i].csLock);
+	}
+	*ppPool = pPool;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTPoolDestroy()
+// Desc: Stop the helper threads and release the pool. Must not be called
+//       while a batch is running.
+//-----------------------------------------------------------------------------
+void DXTPoolDestroy(DXTWorkPool* pPool)
+{
+	DWORD i;
+
+	if (pPool == NULL) {
+		return;
+	}
+	pPool->lQuit = TRUE;
+	for (i = 1; i < pPool->dwThreads; ++i) {
+		SetEvent(pPool->pWorkers[i].hWake);
+	}
+	for (i = 1; i < pPool->dwThreads; ++i) {
+		WaitForSingleObject(pPool->pWorkers[i].hThread, INFINITE);
+		CloseHandle(pPool->pWorkers[i].hThread);
+		CloseHandle(pPool->pWorkers[i].hWake);
+	}
+	for (i = 0; i < pPool->dwThreads; ++i) {
+		DeleteCriticalSection(&pPool->pWorkers[i].csLock);
+	}
+	CloseHandle(pPool->hDone);
+	delete[] pPool->pWorkers;
+	delete pPool;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTPoolGetThreadCount()
+// Desc: Number of workers actually running, including the caller
+//-----------------------------------------------------------------------------
+DWORD DXTPoolGetThreadCount(const DXTWorkPool* pPool)
+{
+	return pPool ? pPool->dwThreads : 1;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTPoolRun()
+// Desc: Call pProc once for every task number below dwTasks and return
+//       when all of them are done. Tasks run in no particular order. With
+//       a NULL pool everything runs on the calling thread.
+//-----------------------------------------------------------------------------
+void DXTPoolRun(
+	DXTWorkPool* pPool, LPDXTTASKPROC pProc, void* pContext, DWORD dwTasks)
+{
+	DWORD dwThreads;
+	DWORD i;
+
+	if (!dwTasks) {
+		return;
+	}
+	if (pPool == NULL) {
+		for (i = 0; i < dwTasks; ++i) {
+			pProc(pContext, i);
+		}
+		return;
+	}
+
+	// Deal out contiguous shares, neighbouring tasks touch neighbouring
+	// memory
+	dwThreads = pPool->dwThreads;
+	for (i = 0; i < dwThreads; ++i) {
+		DXTWorker* pWorker = &pPool->pWorkers[i];
+		pWorker->dwNext = (DWORD)(((ULONGLONG)dwTasks * i) / dwThreads);
+		pWorker->dwEnd = (DWORD)(((ULONGLONG)dwTasks * (i + 1)) / dwThreads);
+	}
+	pPool->pProc = pProc;
+	pPool->pContext = pContext;
+	pPool->lBusy = (LONG)(dwThreads - 1);
+	for (i = 1; i < dwThreads; ++i) {
+		SetEvent(pPool->pWorkers[i].hWake);
+	}
+
+	WorkBatch(pPool, 0);
+	if (dwThreads > 1) {
+		WaitForSingleObject(pPool->hDone, INFINITE);
+	}
+}
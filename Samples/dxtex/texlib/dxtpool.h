@@ -0,0 +1,64 @@
+/***************************************
+
+	Work stealing thread pool
+
+	Runs a batch of independent tasks, numbered 0 to count - 1, on a fixed
+	set of Win32 threads. Each thread starts on its own contiguous share of
+	the batch and steals half of another thread's remaining share when it
+	runs dry, so uneven tasks (large and small mip levels) still keep every
+	core busy. The calling thread works too.
+
+***************************************/
+
+#ifndef __DXTPOOL_H__
+#define __DXTPOOL_H__
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include <ddraw.h>
+
+/***************************************
+
+	Most threads a pool will run
+
+***************************************/
+
+#define DXTPOOL_MAXTHREADS 64
+
+/***************************************
+
+	Opaque pool object
+
+***************************************/
+
+typedef struct DXTWorkPool DXTWorkPool;
+
+/***************************************
+
+	A task, called once for each task number of a batch
+
+***************************************/
+
+typedef void (*LPDXTTASKPROC)(void* pContext, DWORD dwTask);
+
+/* Assume C declarations for C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern DWORD DXTPoolGetProcessorCount(void);
+extern HRESULT DXTPoolCreate(DWORD dwThreads, DXTWorkPool** ppPool);
+extern void DXTPoolDestroy(DXTWorkPool* pPool);
+extern DWORD DXTPoolGetThreadCount(const DXTWorkPool* pPool);
+extern void DXTPoolRun(DXTWorkPool* pPool, LPDXTTASKPROC pProc,
+	void* pContext, DWORD dwTasks);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
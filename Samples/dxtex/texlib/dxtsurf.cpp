@@ -0,0 +1,274 @@
+//-----------------------------------------------------------------------------
+// File: dxtsurf.cpp
+//
+// Desc: Block copies and partial locks on compressed surfaces.
+//
+//       DirectDraw only locks a compressed surface as a whole, so a block
+//       aligned rectangle is found by stepping the locked pitch once per
+//       row of blocks, see DXTSurfaceGetPitch(). Blts lock both surfaces
+//       whole and copy block rows with DXTCopyBlocks(), once if the source
+//       and destination are the same surface.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include "dxtsurf.h"
+#include "dxtcodec.h"
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// Blt() and BltFast() flags the block copy can honor, the rest go to
+// DirectDraw
+//-----------------------------------------------------------------------------
+#define DXTSURF_BLT_FLAGS (DDBLT_WAIT | DDBLT_DONOTWAIT)
+#define DXTSURF_BLTFAST_FLAGS (DDBLTFAST_WAIT | DDBLTFAST_DONOTWAIT)
+
+//-----------------------------------------------------------------------------
+// Name: GetBlockDesc()
+// Desc: Read the surface description and return its FourCC if it's one
+//       DXTCopyBlocks() can handle, 0 otherwise
+//-----------------------------------------------------------------------------
+static DWORD GetBlockDesc(IDirectDrawSurface7* pdds, DDSURFACEDESC2* pddsd)
+{
+	ZeroMemory(pddsd, sizeof(DDSURFACEDESC2));
+	pddsd->dwSize = sizeof(DDSURFACEDESC2);
+	if (FAILED(pdds->GetSurfaceDesc(pddsd)) ||
+		!(pddsd->ddpfPixelFormat.dwFlags & DDPF_FOURCC) ||
+		!DXTGetBlockBytes(pddsd->ddpfPixelFormat.dwFourCC)) {
+		return 0;
+	}
+	return pddsd->ddpfPixelFormat.dwFourCC;
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetRect()
+// Desc: Copy prcRect, or the whole surface if it's NULL
+//-----------------------------------------------------------------------------
+static void GetRect(const RECT* prcRect, const DDSURFACEDESC2* pddsd,
+	RECT* prcOut)
+{
+	if (prcRect) {
+		*prcOut = *prcRect;
+	} else {
+		prcOut->left = 0;
+		prcOut->top = 0;
+		prcOut->right = (LONG)pddsd->dwWidth;
+		prcOut->bottom = (LONG)pddsd->dwHeight;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetBlockPointer()
+// Desc: Address of the block holding texel (lX, lY) of a locked surface
+//-----------------------------------------------------------------------------
+static BYTE* GetBlockPointer(
+	DWORD dwFourCC, const DDSURFACEDESC2* pddsd, LONG lX, LONG lY)
+{
+	return (BYTE*)pddsd->lpSurface +
+		(lY >> 2) * DXTSurfaceGetPitch(pddsd, dwFourCC) +
+		(lX >> 2) * (LONG)DXTGetBlockBytes(dwFourCC);
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTSurfaceGetPitch()
+// Desc: Bytes between rows of pixels, or rows of blocks if dwFourCC isn't
+//       0, of a surface described by Lock(). A compressed surface can lock
+//       with DDSD_LINEARSIZE instead of DDSD_PITCH. dwLinearSize shares its
+//       field with lPitch, so the block rows are then taken as packed.
+//-----------------------------------------------------------------------------
+LONG DXTSurfaceGetPitch(const DDSURFACEDESC2* pddsd, DWORD dwFourCC)
+{
+	if (dwFourCC && (pddsd->dwFlags & DDSD_LINEARSIZE)) {
+		return (LONG)DXTGetPitch(dwFourCC, pddsd->dwWidth);
+	}
+	return pddsd->lPitch;
+}
+
+//-----------------------------------------------------------------------------
+// Name: CopyBlockRect()
+// Desc: Copy prcSrc of one compressed surface to prcDest of another of the
+//       same format. Both rectangles are the same size and cover whole
+//       blocks. The surfaces may be the same one.
+//-----------------------------------------------------------------------------
+static HRESULT CopyBlockRect(IDirectDrawSurface7* pddsDest,
+	const RECT* prcDest, IDirectDrawSurface7* pddsSrc, const RECT* prcSrc,
+	DWORD dwFourCC, BOOL bWait)
+{
+	HRESULT hr;
+	DDSURFACEDESC2 ddsdSrc;
+	DDSURFACEDESC2 ddsdDest;
+	DWORD dwLockFlags = bWait ? DDLOCK_WAIT : DDLOCK_DONOTWAIT;
+
+	ZeroMemory(&ddsdSrc, sizeof(ddsdSrc));
+	ddsdSrc.dwSize = sizeof(ddsdSrc);
+	if (pddsSrc == pddsDest) {
+		if (FAILED(hr = pddsDest->Lock(NULL, &ddsdSrc, dwLockFlags, NULL))) {
+			return hr;
+		}
+		ddsdDest = ddsdSrc;
+	} else {
+		ZeroMemory(&ddsdDest, sizeof(ddsdDest));
+		ddsdDest.dwSize = sizeof(ddsdDest);
+		if (FAILED(hr = pddsSrc->Lock(
+					   NULL, &ddsdSrc, dwLockFlags | DDLOCK_READONLY, NULL))) {
+			return hr;
+		}
+		if (FAILED(hr = pddsDest->Lock(
+					   NULL, &ddsdDest, dwLockFlags | DDLOCK_WRITEONLY, NULL))) {
+			pddsSrc->Unlock(NULL);
+			return hr;
+		}
+	}
+
+	DXTCopyBlocks(dwFourCC,
+		GetBlockPointer(dwFourCC, &ddsdSrc, prcSrc->left, prcSrc->top),
+		DXTSurfaceGetPitch(&ddsdSrc, dwFourCC),
+		GetBlockPointer(dwFourCC, &ddsdDest, prcDest->left, prcDest->top),
+		DXTSurfaceGetPitch(&ddsdDest, dwFourCC),
+		(DWORD)(prcSrc->right - prcSrc->left),
+		(DWORD)(prcSrc->bottom - prcSrc->top));
+
+	pddsDest->Unlock(NULL);
+	if (pddsSrc != pddsDest) {
+		pddsSrc->Unlock(NULL);
+	}
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTSurfaceLock()
+// Desc: Lock prcRect of a surface, or all of it if prcRect is NULL. On a
+//       compressed surface the rectangle has to cover whole blocks, see
+//       DXTIsBlockRect(), and the whole surface is locked underneath. Other
+//       surfaces are passed on to Lock(). dwFlags are DDLOCK_ flags.
+//-----------------------------------------------------------------------------
+HRESULT DXTSurfaceLock(IDirectDrawSurface7* pdds, const RECT* prcRect,
+	DWORD dwFlags, LPDXTLOCKEDRECT pLocked)
+{
+	HRESULT hr;
+	DDSURFACEDESC2 ddsd;
+
+	if (!pdds || !pLocked) {
+		return DDERR_INVALIDPARAMS;
+	}
+	ZeroMemory(pLocked, sizeof(DXTLOCKEDRECT));
+	pLocked->dwFourCC = GetBlockDesc(pdds, &ddsd);
+	GetRect(prcRect, &ddsd, &pLocked->rcRect);
+
+	if (!pLocked->dwFourCC) {
+		ZeroMemory(&ddsd, sizeof(ddsd));
+		ddsd.dwSize = sizeof(ddsd);
+		pLocked->bSubRect = prcRect != NULL;
+		if (FAILED(hr = pdds->Lock(
+					   pLocked->bSubRect ? &pLocked->rcRect : NULL, &ddsd,
+					   dwFlags, NULL))) {
+			return hr;
+		}
+		pLocked->lpBits = ddsd.lpSurface;
+		pLocked->lPitch = ddsd.lPitch;
+		return DD_OK;
+	}
+
+	if (!DXTIsBlockRect(&pLocked->rcRect, ddsd.dwWidth, ddsd.dwHeight)) {
+		return DDERR_INVALIDRECT;
+	}
+	if (FAILED(hr = pdds->Lock(NULL, &ddsd, dwFlags, NULL))) {
+		return hr;
+	}
+	pLocked->lpBits = GetBlockPointer(pLocked->dwFourCC, &ddsd,
+		pLocked->rcRect.left, pLocked->rcRect.top);
+	pLocked->lPitch = DXTSurfaceGetPitch(&ddsd, pLocked->dwFourCC);
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTSurfaceUnlock()
+// Desc: Undo a DXTSurfaceLock()
+//-----------------------------------------------------------------------------
+HRESULT DXTSurfaceUnlock(
+	IDirectDrawSurface7* pdds, const DXTLOCKEDRECT* pLocked)
+{
+	if (!pdds || !pLocked) {
+		return DDERR_INVALIDPARAMS;
+	}
+	RECT rcRect = pLocked->rcRect;
+	return pdds->Unlock(pLocked->bSubRect ? &rcRect : NULL);
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTSurfaceBlt()
+// Desc: Blt() that copies blocks when both surfaces have the same block
+//       compressed format, the rectangles are the same size and cover
+//       whole blocks, and no flags beyond waiting are given. Otherwise
+//       it's the surface's own Blt(). NULL rectangles mean the whole
+//       surface.
+//-----------------------------------------------------------------------------
+HRESULT DXTSurfaceBlt(IDirectDrawSurface7* pddsDest, const RECT* prcDest,
+	IDirectDrawSurface7* pddsSrc, const RECT* prcSrc, DWORD dwFlags,
+	LPDDBLTFX pddbltfx)
+{
+	if (!pddsDest) {
+		return DDERR_INVALIDPARAMS;
+	}
+	if (pddsSrc && !(dwFlags & ~DXTSURF_BLT_FLAGS)) {
+		DDSURFACEDESC2 ddsdSrc;
+		DDSURFACEDESC2 ddsdDest;
+		DWORD dwFourCC = GetBlockDesc(pddsSrc, &ddsdSrc);
+		if (dwFourCC && (GetBlockDesc(pddsDest, &ddsdDest) == dwFourCC)) {
+			RECT rcSrc;
+			RECT rcDest;
+			GetRect(prcSrc, &ddsdSrc, &rcSrc);
+			GetRect(prcDest, &ddsdDest, &rcDest);
+			if ((rcSrc.right - rcSrc.left == rcDest.right - rcDest.left) &&
+				(rcSrc.bottom - rcSrc.top == rcDest.bottom - rcDest.top) &&
+				DXTIsBlockRect(&rcSrc, ddsdSrc.dwWidth, ddsdSrc.dwHeight) &&
+				DXTIsBlockRect(&rcDest, ddsdDest.dwWidth, ddsdDest.dwHeight)) {
+				return CopyBlockRect(pddsDest, &rcDest, pddsSrc, &rcSrc,
+					dwFourCC, (dwFlags & DDBLT_WAIT) != 0);
+			}
+		}
+	}
+	return pddsDest->Blt(const_cast<LPRECT>(prcDest), pddsSrc,
+		const_cast<LPRECT>(prcSrc), dwFlags, pddbltfx);
+}
+
+//-----------------------------------------------------------------------------
+// Name: DXTSurfaceBltFast()
+// Desc: BltFast() that copies blocks under the same conditions as
+//       DXTSurfaceBlt(), when no color key is asked for. Otherwise it's the
+//       surface's own BltFast().
+//-----------------------------------------------------------------------------
+HRESULT DXTSurfaceBltFast(IDirectDrawSurface7* pddsDest, DWORD dwX,
+	DWORD dwY, IDirectDrawSurface7* pddsSrc, const RECT* prcSrc,
+	DWORD dwTrans)
+{
+	if (!pddsDest) {
+		return DDERR_INVALIDPARAMS;
+	}
+	if (pddsSrc && !(dwTrans & ~DXTSURF_BLTFAST_FLAGS)) {
+		DDSURFACEDESC2 ddsdSrc;
+		DDSURFACEDESC2 ddsdDest;
+		DWORD dwFourCC = GetBlockDesc(pddsSrc, &ddsdSrc);
+		if (dwFourCC && (GetBlockDesc(pddsDest, &ddsdDest) == dwFourCC)) {
+			RECT rcSrc;
+			RECT rcDest;
+			GetRect(prcSrc, &ddsdSrc, &rcSrc);
+			rcDest.left = (LONG)dwX;
+			rcDest.top = (LONG)dwY;
+			rcDest.right = rcDest.left + (rcSrc.right - rcSrc.left);
+			rcDest.bottom = rcDest.top + (rcSrc.bottom - rcSrc.top);
+			if (DXTIsBlockRect(&rcSrc, ddsdSrc.dwWidth, ddsdSrc.dwHeight) &&
+				DXTIsBlockRect(&rcDest, ddsdDest.dwWidth, ddsdDest.dwHeight)) {
+				return CopyBlockRect(pddsDest, &rcDest, pddsSrc, &rcSrc,
+					dwFourCC, (dwTrans & DDBLTFAST_WAIT) != 0);
+			}
+		}
+	}
+	return pddsDest->BltFast(
+		dwX, dwY, pddsSrc, const_cast<LPRECT>(prcSrc), dwTrans);
+}
@@ -0,0 +1,64 @@
+/***************************************
+
+	Block copies and partial locks on compressed surfaces
+
+	Blt() between two DXTn surfaces, or locking part of one, normally means
+	the runtime decodes to ARGB and encodes again, or the call simply fails.
+	When the format matches and the rectangles fall on 4x4 block boundaries
+	the blocks can be copied as they are, a memcpy per block row, which is
+	what these do. Anything else is handed to DirectDraw unchanged, so they
+	can stand in for Blt(), BltFast() and Lock() everywhere.
+
+***************************************/
+
+#ifndef __DXTSURF_H__
+#define __DXTSURF_H__
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include <ddraw.h>
+
+/***************************************
+
+	A rectangle locked by DXTSurfaceLock()
+
+	For compressed surfaces lpBits points at the rectangle's top left block
+	and lPitch steps one row of blocks. For others they're what Lock()
+	returned for the rectangle.
+
+***************************************/
+
+typedef struct _DXTLOCKEDRECT {
+	LPVOID lpBits;  // First block or pixel of the rectangle
+	LONG lPitch;    // Bytes between rows of blocks or pixels
+	DWORD dwFourCC; // Surface FourCC, 0 if it isn't block compressed
+	RECT rcRect;    // Rectangle that was locked
+	BOOL bSubRect;  // TRUE if DirectDraw itself locked only rcRect
+} DXTLOCKEDRECT, *LPDXTLOCKEDRECT;
+
+/* Assume C declarations for C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern LONG DXTSurfaceGetPitch(const DDSURFACEDESC2* pddsd, DWORD dwFourCC);
+extern HRESULT DXTSurfaceLock(IDirectDrawSurface7* pdds, const RECT* prcRect,
+	DWORD dwFlags, LPDXTLOCKEDRECT pLocked);
+extern HRESULT DXTSurfaceUnlock(
+	IDirectDrawSurface7* pdds, const DXTLOCKEDRECT* pLocked);
+extern HRESULT DXTSurfaceBlt(IDirectDrawSurface7* pddsDest,
+	const RECT* prcDest, IDirectDrawSurface7* pddsSrc, const RECT* prcSrc,
+	DWORD dwFlags, LPDDBLTFX pddbltfx);
+extern HRESULT DXTSurfaceBltFast(IDirectDrawSurface7* pddsDest, DWORD dwX,
+	DWORD dwY, IDirectDrawSurface7* pddsSrc, const RECT* prcSrc,
+	DWORD dwTrans);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -0,0 +1,595 @@
+//-----------------------------------------------------------------------------
+// File: texatlas.cpp
+//
+// Desc: Texture atlas packing.
+//
+//       Sprites are placed with MaxRects, which keeps a list of the largest
+//       free rectangles left in the atlas, possibly overlapping, and puts
+//       each sprite in the one it fits most snugly along its shorter side.
+//       Each sprite is grown by the padding and rounded up to the alignment
+//       before it's placed, so every free rectangle starts on a multiple of
+//       the alignment and every sprite with it. The bin is the padding
+//       larger than the atlas, so a sprite against the far edge doesn't
+//       waste it.
+//
+//       Sprites go in largest first. Atlas sizes are width and height pairs,
+//       not just squares, big enough for the largest sprite and the total
+//       area, and they're tried shortest longer side first, then least
+//       area, until every sprite fits. Only the free rectangles a placement
+//       split are checked for containment in the others, which keeps the
+//       list short without comparing every pair after every sprite.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include "texatlas.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// A rectangle in the bin, a dwWidth of 0 marks a dead free rectangle
+//-----------------------------------------------------------------------------
+struct AtlasRect {
+	DWORD dwX;
+	DWORD dwY;
+	DWORD dwWidth;
+	DWORD dwHeight;
+};
+
+//-----------------------------------------------------------------------------
+// A sprite as it's placed, grown by the padding and alignment
+//-----------------------------------------------------------------------------
+struct AtlasItem {
+	DWORD dwSprite; // Index into the caller's sprites
+	DWORD dwWidth;
+	DWORD dwHeight;
+};
+
+//-----------------------------------------------------------------------------
+// An atlas size to try
+//-----------------------------------------------------------------------------
+struct AtlasSize {
+	DWORD dwWidth;
+	DWORD dwHeight;
+};
+
+//-----------------------------------------------------------------------------
+// Free rectangles of one packing attempt
+//-----------------------------------------------------------------------------
+struct AtlasBin {
+	AtlasRect* pFree;
+	DWORD dwFree;
+	DWORD dwMaxFree;
+};
+
+//-----------------------------------------------------------------------------
+// Name: AlignUp()
+// Desc: Round dwValue up to a multiple of dwAlign
+//-----------------------------------------------------------------------------
+static inline DWORD AlignUp(DWORD dwValue, DWORD dwAlign)
+{
+	return ((dwValue + dwAlign - 1) / dwAlign) * dwAlign;
+}
+
+//-----------------------------------------------------------------------------
+// Name: AddFree()
+// Desc: Append a free rectangle, growing the list as needed
+//-----------------------------------------------------------------------------
+static BOOL AddFree(
+	AtlasBin* pBin, DWORD dwX, DWORD dwY, DWORD dwWidth, DWORD dwHeight)
+{
+	if (pBin->dwFree == pBin->dwMaxFree) {
+		DWORD dwMax = pBin->dwMaxFree ? pBin->dwMaxFree * 2 : 64;
+		AtlasRect* pFree = new AtlasRect[dwMax];
+		if (!pFree) {
+			return FALSE;
+		}
+		if (pBin->pFree) {
+			memcpy(pFree, pBin->pFree, sizeof(AtlasRect) * pBin->dwFree);
+			delete[] pBin->pFree;
+		}
+		pBin->pFree = pFree;
+		pBin->dwMaxFree = dwMax;
+	}
+	AtlasRect* pRect = &pBin->pFree[pBin->dwFree++];
+	pRect->dwX = dwX;
+	pRect->dwY = dwY;
+	pRect->dwWidth = dwWidth;
+	pRect->dwHeight = dwHeight;
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: Contains()
+// Desc: TRUE if pOuter covers all of pInner
+//-----------------------------------------------------------------------------
+static inline BOOL Contains(const AtlasRect* pOuter, const AtlasRect* pInner)
+{
+	return (pInner->dwX >= pOuter->dwX) && (pInner->dwY >= pOuter->dwY) &&
+		(pInner->dwX + pInner->dwWidth <= pOuter->dwX + pOuter->dwWidth) &&
+		(pInner->dwY + pInner->dwHeight <= pOuter->dwY + pOuter->dwHeight);
+}
+
+//-----------------------------------------------------------------------------
+// Name: Compact()
+// Desc: Squeeze the dead rectangles out of the list
+//-----------------------------------------------------------------------------
+static void Compact(AtlasBin* pBin)
+{
+	DWORD dwOut = 0;
+	DWORD i;
+	for (i = 0; i < pBin->dwFree; ++i) {
+		if (pBin->pFree[i].dwWidth) {
+			pBin->pFree[dwOut++] = pBin->pFree[i];
+		}
+	}
+	pBin->dwFree = dwOut;
+}
+
+//-----------------------------------------------------------------------------
+// Name: PlaceRect()
+// Desc: Find the best short side fit for a dwWidth by dwHeight rectangle,
+//       then split every free rectangle it lands on into the pieces left
+//       around it. Returns FALSE in *pbPlaced if nothing fits.
+//-----------------------------------------------------------------------------
+static BOOL PlaceRect(AtlasBin* pBin, DWORD dwWidth, DWORD dwHeight,
+	AtlasRect* pPlaced, BOOL* pbPlaced)
+{
+	DWORD dwBestShort = 0xFFFFFFFF;
+	DWORD dwBestLong = 0xFFFFFFFF;
+	DWORD dwBest = 0xFFFFFFFF;
+	DWORD i;
+	for (i = 0; i < pBin->dwFree; ++i) {
+		const AtlasRect* pFree = &pBin->pFree[i];
+		if ((pFree->dwWidth < dwWidth) || (pFree->dwHeight < dwHeight)) {
+			continue;
+		}
+		DWORD dwLeftX = pFree->dwWidth - dwWidth;
+		DWORD dwLeftY = pFree->dwHeight - dwHeight;
+		DWORD dwShort = (dwLeftX < dwLeftY) ? dwLeftX : dwLeftY;
+		DWORD dwLong = (dwLeftX < dwLeftY) ? dwLeftY : dwLeftX;
+		if ((dwShort < dwBestShort) ||
+			((dwShort == dwBestShort) && (dwLong < dwBestLong))) {
+			dwBestShort = dwShort;
+			dwBestLong = dwLong;
+			dwBest = i;
+		}
+	}
+	*pbPlaced = (dwBest != 0xFFFFFFFF);
+	if (!*pbPlaced) {
+		return TRUE;
+	}
+	pPlaced->dwX = pBin->pFree[dwBest].dwX;
+	pPlaced->dwY = pBin->pFree[dwBest].dwY;
+	pPlaced->dwWidth = dwWidth;
+	pPlaced->dwHeight = dwHeight;
+	DWORD dwRight = pPlaced->dwX + dwWidth;
+	DWORD dwBottom = pPlaced->dwY + dwHeight;
+
+	// Split, the pieces go on the end and the split rectangles die
+	DWORD dwOld = pBin->dwFree;
+	for (i = 0; i < dwOld; ++i) {
+		AtlasRect Free = pBin->pFree[i];
+		DWORD dwFreeRight = Free.dwX + Free.dwWidth;
+		DWORD dwFreeBottom = Free.dwY + Free.dwHeight;
+		if ((pPlaced->dwX >= dwFreeRight) || (dwRight <= Free.dwX) ||
+			(pPlaced->dwY >= dwFreeBottom) || (dwBottom <= Free.dwY)) {
+			continue;
+		}
+		pBin->pFree[i].dwWidth = 0;
+		if ((pPlaced->dwX > Free.dwX) &&
+			!AddFree(pBin, Free.dwX, Free.dwY, pPlaced->dwX - Free.dwX,
+				Free.dwHeight)) {
+			return FALSE;
+		}
+		if ((dwRight < dwFreeRight) &&
+			!AddFree(pBin, dwRight, Free.dwY, dwFreeRight - dwRight,
+				Free.dwHeight)) {
+			return FALSE;
+		}
+		if ((pPlaced->dwY > Free.dwY) &&
+			!AddFree(pBin, Free.dwX, Free.dwY, Free.dwWidth,
+				pPlaced->dwY - Free.dwY)) {
+			return FALSE;
+		}
+		if ((dwBottom < dwFreeBottom) &&
+			!AddFree(pBin, Free.dwX, dwBottom, Free.dwWidth,
+				dwFreeBottom - dwBottom)) {
+			return FALSE;
+		}
+	}
+
+	// Drop the new pieces another free rectangle already covers. The old
+	// survivors never covered each other, so they stay.
+	DWORD j;
+	for (i = dwOld; i < pBin->dwFree; ++i) {
+		const AtlasRect* pPiece = &pBin->pFree[i];
+		for (j = 0; j < pBin->dwFree; ++j) {
+			if ((j != i) && pBin->pFree[j].dwWidth &&
+				Contains(&pBin->pFree[j], pPiece)) {
+				pBin->pFree[i].dwWidth = 0;
+				break;
+			}
+		}
+	}
+	Compact(pBin);
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: PackBin()
+// Desc: Place every item in a dwWidth by dwHeight bin, in order. Returns
+//       FALSE in *pbFits if one doesn't fit.
+//-----------------------------------------------------------------------------
+static BOOL PackBin(AtlasBin* pBin, const AtlasItem* pItems, DWORD dwItems,
+	DWORD dwWidth, DWORD dwHeight, TEXATLASSPRITE* pSprites, BOOL* pbFits)
+{
+	pBin->dwFree = 0;
+	if (!AddFree(pBin, 0, 0, dwWidth, dwHeight)) {
+		return FALSE;
+	}
+	DWORD i;
+	for (i = 0; i < dwItems; ++i) {
+		AtlasRect Placed;
+		if (!PlaceRect(pBin, pItems[i].dwWidth, pItems[i].dwHeight, &Placed,
+				pbFits)) {
+			return FALSE;
+		}
+		if (!*pbFits) {
+			return TRUE;
+		}
+		pSprites[pItems[i].dwSprite].dwX = Placed.dwX;
+		pSprites[pItems[i].dwSprite].dwY = Placed.dwY;
+	}
+	*pbFits = TRUE;
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: CompareItems()
+// Desc: qsort() order for items, longest side first, then the other side,
+//       then the order they were given so the result never changes
+//-----------------------------------------------------------------------------
+static int CompareItems(const void* p1, const void* p2)
+{
+	const AtlasItem* pItem1 = static_cast<const AtlasItem*>(p1);
+	const AtlasItem* pItem2 = static_cast<const AtlasItem*>(p2);
+	DWORD dwLong1 = (pItem1->dwWidth > pItem1->dwHeight) ? pItem1->dwWidth :
+		pItem1->dwHeight;
+	DWORD dwLong2 = (pItem2->dwWidth > pItem2->dwHeight) ? pItem2->dwWidth :
+		pItem2->dwHeight;
+	if (dwLong1 != dwLong2) {
+		return (dwLong1 > dwLong2) ? -1 : 1;
+	}
+	DWORD dwShort1 = pItem1->dwWidth + pItem1->dwHeight - dwLong1;
+	DWORD dwShort2 = pItem2->dwWidth + pItem2->dwHeight - dwLong2;
+	if (dwShort1 != dwShort2) {
+		return (dwShort1 > dwShort2) ? -1 : 1;
+	}
+	return (pItem1->dwSprite < pItem2->dwSprite) ? -1 : 1;
+}
+
+//-----------------------------------------------------------------------------
+// Name: CompareSizes()
+// Desc: qsort() order for atlas sizes, shortest longer side first so the
+//       atlas stays close to square, then least area, then the wider
+//-----------------------------------------------------------------------------
+static int CompareSizes(const void* p1, const void* p2)
+{
+	const AtlasSize* pSize1 = static_cast<const AtlasSize*>(p1);
+	const AtlasSize* pSize2 = static_cast<const AtlasSize*>(p2);
+	DWORD dwLong1 = (pSize1->dwWidth > pSize1->dwHeight) ? pSize1->dwWidth :
+		pSize1->dwHeight;
+	DWORD dwLong2 = (pSize2->dwWidth > pSize2->dwHeight) ? pSize2->dwWidth :
+		pSize2->dwHeight;
+	if (dwLong1 != dwLong2) {
+		return (dwLong1 < dwLong2) ? -1 : 1;
+	}
+	ULONGLONG uArea1 = static_cast<ULONGLONG>(pSize1->dwWidth) *
+		pSize1->dwHeight;
+	ULONGLONG uArea2 = static_cast<ULONGLONG>(pSize2->dwWidth) *
+		pSize2->dwHeight;
+	if (uArea1 != uArea2) {
+		return (uArea1 < uArea2) ? -1 : 1;
+	}
+	return (pSize1->dwWidth > pSize2->dwWidth) ? -1 :
+		(pSize1->dwWidth < pSize2->dwWidth) ? 1 : 0;
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetSideSizes()
+// Desc: The widths or heights an atlas may have, up to dwMaxSize. Powers of
+//       2, or with TEX_ATLAS_ANYSIZE multiples of dwAlign about a quarter
+//       apart, since the result is cropped anyway. Returns the count.
+//-----------------------------------------------------------------------------
+static DWORD GetSideSizes(
+	DWORD dwAlign, DWORD dwMaxSize, DWORD dwFlags, DWORD* pdwSizes)
+{
+	DWORD dwCount = 0;
+	DWORD dwSize;
+	if (!(dwFlags & TEX_ATLAS_ANYSIZE)) {
+		for (dwSize = 1; dwSize <= dwMaxSize; dwSize <<= 1) {
+			if (!(dwSize % dwAlign)) {
+				pdwSizes[dwCount++] = dwSize;
+			}
+			if (dwSize & 0x80000000) {
+				break;
+			}
+		}
+		return dwCount;
+	}
+	DWORD dwLast = (dwMaxSize / dwAlign) * dwAlign;
+	for (dwSize = dwAlign; dwSize < dwLast;) {
+		pdwSizes[dwCount++] = dwSize;
+		DWORD dwStep = AlignUp((dwSize < 4) ? 1 : (dwSize / 4), dwAlign);
+		if (dwSize > dwLast - dwStep) {
+			break;
+		}
+		dwSize += dwStep;
+	}
+	if (dwLast) {
+		pdwSizes[dwCount++] = dwLast;
+	}
+	return dwCount;
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXTrimSprite()
+// Desc: Fill in the source size and the trimmed rectangle of a dwWidth by
+//       dwHeight ARGB8888 frame, the smallest one holding every pixel whose
+//       alpha isn't 0. An empty frame gets a size of 0. The atlas position
+//       is left alone.
+//-----------------------------------------------------------------------------
+void TEXTrimSprite(const void* pSrc, LONG lSrcPitch, DWORD dwWidth,
+	DWORD dwHeight, TEXATLASSPRITE* pSprite)
+{
+	DWORD dwLeft = dwWidth;
+	DWORD dwRight = 0;
+	DWORD dwTop = dwHeight;
+	DWORD dwBottom = 0;
+	DWORD x;
+	DWORD y;
+	for (y = 0; y < dwHeight; ++y) {
+		const DWORD* pRow = reinterpret_cast<const DWORD*>(
+			static_cast<const BYTE*>(pSrc) + static_cast<LONG>(y) * lSrcPitch);
+
+		// Once a row has a pixel, only the ones right of the box can grow it
+		for (x = 0; (x < dwWidth) && !(pRow[x] & 0xFF000000); ++x) {
+		}
+		if (x == dwWidth) {
+			continue;
+		}
+		if (x < dwLeft) {
+			dwLeft = x;
+		}
+		for (x = dwWidth; (x > dwRight) && !(pRow[x - 1] & 0xFF000000); --x) {
+		}
+		if (x > dwRight) {
+			dwRight = x;
+		}
+		if (y < dwTop) {
+			dwTop = y;
+		}
+		dwBottom = y + 1;
+	}
+	pSprite->dwSourceWidth = dwWidth;
+	pSprite->dwSourceHeight = dwHeight;
+	if (dwBottom) {
+		pSprite->dwTrimX = dwLeft;
+		pSprite->dwTrimY = dwTop;
+		pSprite->dwWidth = dwRight - dwLeft;
+		pSprite->dwHeight = dwBottom - dwTop;
+	} else {
+		pSprite->dwTrimX = 0;
+		pSprite->dwTrimY = 0;
+		pSprite->dwWidth = 0;
+		pSprite->dwHeight = 0;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXPackAtlas()
+// Desc: Set dwX and dwY of every sprite so they all fit in one atlas, at
+//       least dwPadding pixels apart and on multiples of dwAlign, and return
+//       its size, no larger than dwMaxSize on either side. The atlas is the
+//       smallest power of 2 size found that fits, or with TEX_ATLAS_ANYSIZE
+//       cropped to the sprites and rounded up to dwAlign. Empty sprites are
+//       put at 0, 0. Returns DDERR_TOOBIGSIZE if they don't fit.
+//-----------------------------------------------------------------------------
+HRESULT TEXPackAtlas(TEXATLASSPRITE* pSprites, DWORD dwCount,
+	DWORD dwPadding, DWORD dwAlign, DWORD dwMaxSize, DWORD dwFlags,
+	DWORD* pdwWidth, DWORD* pdwHeight)
+{
+	if (!pSprites || !dwAlign || !dwMaxSize || !pdwWidth || !pdwHeight) {
+		return DDERR_INVALIDPARAMS;
+	}
+	AtlasItem* pItems = new AtlasItem[dwCount + 1];
+	if (!pItems) {
+		return DDERR_OUTOFMEMORY;
+	}
+
+	// Grow the sprites and find what any atlas must hold
+	DWORD dwItems = 0;
+	DWORD dwMaxWidth = 0;
+	DWORD dwMaxHeight = 0;
+	ULONGLONG uArea = 0;
+	DWORD i;
+	for (i = 0; i < dwCount; ++i) {
+		pSprites[i].dwX = 0;
+		pSprites[i].dwY = 0;
+		if (!pSprites[i].dwWidth || !pSprites[i].dwHeight) {
+			continue;
+		}
+		if ((pSprites[i].dwWidth > dwMaxSize) ||
+			(pSprites[i].dwHeight > dwMaxSize)) {
+			delete[] pItems;
+			return DDERR_TOOBIGSIZE;
+		}
+		AtlasItem* pItem = &pItems[dwItems++];
+		pItem->dwSprite = i;
+		pItem->dwWidth = AlignUp(pSprites[i].dwWidth + dwPadding, dwAlign);
+		pItem->dwHeight = AlignUp(pSprites[i].dwHeight + dwPadding, dwAlign);
+		if (pItem->dwWidth > dwMaxWidth) {
+			dwMaxWidth = pItem->dwWidth;
+		}
+		if (pItem->dwHeight > dwMaxHeight) {
+			dwMaxHeight = pItem->dwHeight;
+		}
+		uArea += static_cast<ULONGLONG>(pItem->dwWidth) * pItem->dwHeight;
+	}
+	if (!dwItems) {
+		delete[] pItems;
+		*pdwWidth = dwAlign;
+		*pdwHeight = dwAlign;
+		return DD_OK;
+	}
+	qsort(pItems, dwItems, sizeof(AtlasItem), CompareItems);
+
+	// Every pair of side sizes the sprites could fit in, smallest first
+	DWORD dwSides[256];
+	DWORD dwSideCount = GetSideSizes(dwAlign, dwMaxSize, dwFlags, dwSides);
+	AtlasSize* pSizes = new AtlasSize[dwSideCount * dwSideCount + 1];
+	if (!pSizes) {
+		delete[] pItems;
+		return DDERR_OUTOFMEMORY;
+	}
+	DWORD dwSizes = 0;
+	DWORD j;
+	for (i = 0; i < dwSideCount; ++i) {
+		if (dwSides[i] + dwPadding < dwMaxWidth) {
+			continue;
+		}
+		for (j = 0; j < dwSideCount; ++j) {
+			if ((dwSides[j] + dwPadding >= dwMaxHeight) &&
+				(static_cast<ULONGLONG>(dwSides[i] + dwPadding) *
+						(dwSides[j] + dwPadding) >= uArea)) {
+				pSizes[dwSizes].dwWidth = dwSides[i];
+				pSizes[dwSizes].dwHeight = dwSides[j];
+				++dwSizes;
+			}
+		}
+	}
+	qsort(pSizes, dwSizes, sizeof(AtlasSize), CompareSizes);
+
+	// The bin is the padding larger than the atlas, so the padding of a
+	// sprite against the right or bottom edge may hang off it
+	AtlasBin Bin;
+	Bin.pFree = NULL;
+	Bin.dwFree = 0;
+	Bin.dwMaxFree = 0;
+	HRESULT hResult = DDERR_TOOBIGSIZE;
+	for (i = 0; i < dwSizes; ++i) {
+		BOOL bFits;
+		if (!PackBin(&Bin, pItems, dwItems, pSizes[i].dwWidth + dwPadding,
+				pSizes[i].dwHeight + dwPadding, pSprites, &bFits)) {
+			hResult = DDERR_OUTOFMEMORY;
+			break;
+		}
+		if (bFits) {
+			*pdwWidth = pSizes[i].dwWidth;
+			*pdwHeight = pSizes[i].dwHeight;
+			hResult = DD_OK;
+			break;
+		}
+	}
+	delete[] Bin.pFree;
+	delete[] pSizes;
+
+	if (hResult != DD_OK) {
+		for (i = 0; i < dwCount; ++i) {
+			pSprites[i].dwX = 0;
+			pSprites[i].dwY = 0;
+		}
+	} else if (dwFlags & TEX_ATLAS_ANYSIZE) {
+		DWORD dwUsedWidth = 0;
+		DWORD dwUsedHeight = 0;
+		for (i = 0; i < dwItems; ++i) {
+			const TEXATLASSPRITE* pSprite = &pSprites[pItems[i].dwSprite];
+			if (pSprite->dwX + pSprite->dwWidth > dwUsedWidth) {
+				dwUsedWidth = pSprite->dwX + pSprite->dwWidth;
+			}
+			if (pSprite->dwY + pSprite->dwHeight > dwUsedHeight) {
+				dwUsedHeight = pSprite->dwY + pSprite->dwHeight;
+			}
+		}
+		*pdwWidth = AlignUp(dwUsedWidth, dwAlign);
+		*pdwHeight = AlignUp(dwUsedHeight, dwAlign);
+	}
+	delete[] pItems;
+	return hResult;
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXWriteAtlasTable()
+// Desc: Save where the sprites went in a dwWidth by dwHeight atlas, with
+//       their texture coordinates and names. ppNames may be NULL, or hold
+//       NULL names, to save empty ones.
+//-----------------------------------------------------------------------------
+HRESULT TEXWriteAtlasTable(const char* pFileName, DWORD dwWidth,
+	DWORD dwHeight, const TEXATLASSPRITE* pSprites,
+	const char* const* ppNames, DWORD dwCount)
+{
+	if (!pFileName || !dwWidth || !dwHeight || (dwCount && !pSprites)) {
+		return DDERR_INVALIDPARAMS;
+	}
+	TEXATLASENTRY* pEntries = new TEXATLASENTRY[dwCount + 1];
+	if (!pEntries) {
+		return DDERR_OUTOFMEMORY;
+	}
+	float fWidth = static_cast<float>(dwWidth);
+	float fHeight = static_cast<float>(dwHeight);
+	DWORD dwNameBytes = 0;
+	DWORD i;
+	for (i = 0; i < dwCount; ++i) {
+		const TEXATLASSPRITE* pSprite = &pSprites[i];
+		TEXATLASENTRY* pEntry = &pEntries[i];
+		pEntry->Sprite = *pSprite;
+		pEntry->fU0 = static_cast<float>(pSprite->dwX) / fWidth;
+		pEntry->fV0 = static_cast<float>(pSprite->dwY) / fHeight;
+		pEntry->fU1 =
+			static_cast<float>(pSprite->dwX + pSprite->dwWidth) / fWidth;
+		pEntry->fV1 =
+			static_cast<float>(pSprite->dwY + pSprite->dwHeight) / fHeight;
+		pEntry->dwName = dwNameBytes;
+		const char* pName = (ppNames && ppNames[i]) ? ppNames[i] : "";
+		dwNameBytes += static_cast<DWORD>(strlen(pName)) + 1;
+	}
+
+	TEXATLASFILEHEADER Header;
+	Header.dwMagic = TEXATLAS_MAGIC;
+	Header.dwVersion = TEXATLAS_VERSION;
+	Header.dwWidth = dwWidth;
+	Header.dwHeight = dwHeight;
+	Header.dwCount = dwCount;
+	Header.dwNameBytes = dwNameBytes;
+
+	FILE* fp = fopen(pFileName, "wb");
+	if (!fp) {
+		delete[] pEntries;
+		return DDERR_GENERIC;
+	}
+	BOOL bOk = fwrite(&Header, sizeof(Header), 1, fp) == 1;
+	if (bOk && dwCount) {
+		bOk = fwrite(pEntries, sizeof(TEXATLASENTRY), dwCount, fp) == dwCount;
+	}
+	for (i = 0; bOk && (i < dwCount); ++i) {
+		const char* pName = (ppNames && ppNames[i]) ? ppNames[i] : "";
+		size_t uLength = strlen(pName) + 1;
+		bOk = fwrite(pName, 1, uLength, fp) == uLength;
+	}
+	if (fclose(fp)) {
+		bOk = FALSE;
+	}
+	delete[] pEntries;
+	if (!bOk) {
+		remove(pFileName);
+		return DDERR_GENERIC;
+	}
+	return DD_OK;
+}
@@ -0,0 +1,98 @@
+/***************************************
+
+	Texture atlas packing
+
+	Trims the transparent border off sprites, places them in one texture
+	with the MaxRects algorithm, keeping them a few pixels apart and on
+	block boundaries so DXTn blocks never mix two sprites, and saves where
+	each one went, with its texture coordinates, in a small binary table
+	that a game can read straight into memory.
+
+***************************************/
+
+#ifndef __TEXATLAS_H__
+#define __TEXATLAS_H__
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include <ddraw.h>
+
+/***************************************
+
+	TEXPackAtlas() flags
+
+***************************************/
+
+#define TEX_ATLAS_ANYSIZE 0x00000001 // Crop to the sprites, not a power of 2
+
+/***************************************
+
+	Where one sprite came from and where it went
+
+***************************************/
+
+typedef struct _TEXATLASSPRITE {
+	DWORD dwSourceWidth;  // Size of the frame before trimming
+	DWORD dwSourceHeight;
+	DWORD dwTrimX;        // Where the trimmed sprite starts in the frame
+	DWORD dwTrimY;
+	DWORD dwWidth;        // Size after trimming, 0 if the frame is empty
+	DWORD dwHeight;
+	DWORD dwX;            // Where the trimmed sprite is in the atlas
+	DWORD dwY;
+} TEXATLASSPRITE, *LPTEXATLASSPRITE;
+
+/***************************************
+
+	The table file
+
+	A TEXATLASFILEHEADER, dwCount TEXATLASENTRY records in the order the
+	sprites were given, then dwNameBytes of NUL terminated names. The
+	texture coordinates are of the edges of the trimmed sprite.
+
+***************************************/
+
+#define TEXATLAS_MAGIC MAKEFOURCC('A', 'T', 'L', 'S')
+#define TEXATLAS_VERSION 1
+
+typedef struct _TEXATLASFILEHEADER {
+	DWORD dwMagic;     // TEXATLAS_MAGIC
+	DWORD dwVersion;   // TEXATLAS_VERSION
+	DWORD dwWidth;     // Size of the atlas texture
+	DWORD dwHeight;
+	DWORD dwCount;     // Sprites in the table
+	DWORD dwNameBytes; // Size of the names after the entries
+} TEXATLASFILEHEADER, *LPTEXATLASFILEHEADER;
+
+typedef struct _TEXATLASENTRY {
+	TEXATLASSPRITE Sprite;
+	float fU0;         // Left, top, right and bottom texture coordinates
+	float fV0;
+	float fU1;
+	float fV1;
+	DWORD dwName;      // Offset of the name from the start of the names
+} TEXATLASENTRY, *LPTEXATLASENTRY;
+
+/* Assume C declarations for C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern void TEXTrimSprite(const void* pSrc, LONG lSrcPitch, DWORD dwWidth,
+	DWORD dwHeight, TEXATLASSPRITE* pSprite);
+extern HRESULT TEXPackAtlas(TEXATLASSPRITE* pSprites, DWORD dwCount,
+	DWORD dwPadding, DWORD dwAlign, DWORD dwMaxSize, DWORD dwFlags,
+	DWORD* pdwWidth, DWORD* pdwHeight);
+extern HRESULT TEXWriteAtlasTable(const char* pFileName, DWORD dwWidth,
+	DWORD dwHeight, const TEXATLASSPRITE* pSprites,
+	const char* const* ppNames, DWORD dwCount);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -0,0 +1,1982 @@
+//-----------------------------------------------------------------------------
+// File: teximage.cpp
+//
+// Desc: Bitmap loading, alpha merging and mip generation on plain memory.
+//
+//       Bitmaps are parsed straight from the file instead of going through
+//       LoadImage() and a device context. Uncompressed 1, 4, 8, 16, 24 and
+//       32 bit files are read, top down or bottom up, with or without bit
+//       field masks. Alpha in the bitmap itself is ignored, every pixel
+//       comes out opaque, the same as a GDI blit to an ARGB surface. RLE
+//       bitmaps aren't supported.
+//
+//       The box filter for mip levels is a 2x2 average that rounds down,
+//       four pixels at a time with SSE2. Odd widths and heights drop the
+//       last row or column of the source, and a side of one pixel is
+//       averaged with itself. The sRGB variant looks each color channel up
+//       as 16 bit linear light, averages with rounding and finds the
+//       nearest sRGB value again, so mips don't come out darker than the
+//       top level. Volume textures use a 2x2x2 average of two slices,
+//       one slice of the next level at a time, so a caller can build the
+//       slices of a level on as many threads as it likes.
+//
+//       The Kaiser, Lanczos and Mitchell filters are separable and work for
+//       any pair of sizes. Each axis gets a table of source indices and
+//       weights per output pixel, and the image is cut into bands of output
+//       rows for the thread pool. A band filters the source rows it needs
+//       across into floats, then sums them down into its output rows.
+//
+//       Images too large for memory go through a reader that decodes a
+//       band of bitmap rows at a time, with 64 bit file offsets, and a mip
+//       stream. The stream keeps a window of rows per level that slides
+//       down as bands are filtered into the level below and sent on, so
+//       each level holds a few bands however tall the image is.
+//-----------------------------------------------------------------------------
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+//-----------------------------------------------------------------------------
+// Include files
+//-----------------------------------------------------------------------------
+#include "teximage.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define TEX_SSE2
+#include <emmintrin.h>
+#endif
+
+//-----------------------------------------------------------------------------
+// Bitmap layout, read a byte at a time so structure packing doesn't matter
+//-----------------------------------------------------------------------------
+#define BMP_FILEHEADER_BYTES 14   // BITMAPFILEHEADER
+#define BMP_COREHEADER_BYTES 12   // BITMAPCOREHEADER, OS/2 style
+#define BMP_INFOHEADER_BYTES 40   // BITMAPINFOHEADER and larger
+#define BMP_MASKS_OFFSET 54       // Bit field masks, in or after the header
+#define BMP_RGB 0                 // BI_RGB
+#define BMP_BITFIELDS 3           // BI_BITFIELDS
+#define BMP_MAX_SIZE 32768        // Largest width or height accepted
+#define BMP_HEADER_READ 4096      // Enough for any header and palette
+
+//-----------------------------------------------------------------------------
+// sRGB to 16 bit linear light, the linear value halfway between each sRGB
+// value and the one below it, and the sRGB value at the start of each of
+// the 4096 buckets of 16 linear values. Built by InitSRGBTables().
+//-----------------------------------------------------------------------------
+#define TEX_SRGB_SHIFT 4
+#define TEX_SRGB_BUCKETS (65536 >> TEX_SRGB_SHIFT)
+
+static WORD s_wSRGBToLinear[256];
+static WORD s_wSRGBThreshold[256];
+static BYTE s_bLinearToSRGB[TEX_SRGB_BUCKETS];
+static volatile LONG s_lSRGBReady;
+
+//-----------------------------------------------------------------------------
+// Name: GetWord() / GetDword()
+// Desc: Little endian values from a byte buffer
+//-----------------------------------------------------------------------------
+static DWORD GetWord(const BYTE* pData)
+{
+	return (DWORD)pData[0] | ((DWORD)pData[1] << 8);
+}
+
+static DWORD GetDword(const BYTE* pData)
+{
+	return (DWORD)pData[0] | ((DWORD)pData[1] << 8) |
+		((DWORD)pData[2] << 16) | ((DWORD)pData[3] << 24);
+}
+
+//-----------------------------------------------------------------------------
+// Name: ReadFileData()
+// Desc: Read a whole file into a buffer allocated with new[]
+//-----------------------------------------------------------------------------
+static HRESULT ReadFileData(
+	const char* pFileName, BYTE** ppData, DWORD* pdwSize)
+{
+	*ppData = NULL;
+	*pdwSize = 0;
+	FILE* fp = fopen(pFileName, "rb");
+	if (!fp) {
+		return DDERR_NOTFOUND;
+	}
+	long lSize = -1;
+	if (fseek(fp, 0, SEEK_END) == 0) {
+		lSize = ftell(fp);
+	}
+	if (lSize < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+		fclose(fp);
+		return DDERR_GENERIC;
+	}
+	BYTE* pData = new BYTE[(DWORD)lSize + 1];
+	if (!pData) {
+		fclose(fp);
+		return DDERR_OUTOFMEMORY;
+	}
+	if (fread(pData, 1, (size_t)lSize, fp) != (size_t)lSize) {
+		delete[] pData;
+		fclose(fp);
+		return DDERR_GENERIC;
+	}
+	fclose(fp);
+	*ppData = pData;
+	*pdwSize = (DWORD)lSize;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// A bit field mask turned into a shift and a scale up to 8 bits
+//-----------------------------------------------------------------------------
+struct BmpChannel {
+	DWORD dwMask;
+	UINT uShift;
+	DWORD dwMax; // Largest value after the shift, 0 if the mask is empty
+};
+
+static void InitChannel(BmpChannel* pChannel, DWORD dwMask)
+{
+	pChannel->dwMask = dwMask;
+	pChannel->uShift = 0;
+	pChannel->dwMax = 0;
+	if (dwMask) {
+		while (!(dwMask & 1)) {
+			dwMask >>= 1;
+			++pChannel->uShift;
+		}
+		pChannel->dwMax = dwMask;
+	}
+}
+
+static DWORD GetChannel(const BmpChannel* pChannel, DWORD dwValue)
+{
+	if (!pChannel->dwMax) {
+		return 0;
+	}
+	dwValue = (dwValue & pChannel->dwMask) >> pChannel->uShift;
+	return ((dwValue * 255) + (pChannel->dwMax >> 1)) / pChannel->dwMax;
+}
+
+//-----------------------------------------------------------------------------
+// Everything about a bitmap's layout needed to decode its rows
+//-----------------------------------------------------------------------------
+struct BmpFormat {
+	DWORD dwWidth;
+	DWORD dwHeight;
+	DWORD dwBits;
+	DWORD dwStride;    // Bytes per row, padded to 4
+	DWORD dwOffBits;   // Where the first row in the file starts
+	BOOL bTopDown;
+	DWORD Palette[256];
+	BmpChannel Channels[3];
+};
+
+//-----------------------------------------------------------------------------
+// Name: ParseBmpHeader()
+// Desc: Read the headers, masks and palette at the start of a bitmap file.
+//       pData only has to hold the file up to the end of the palette.
+//-----------------------------------------------------------------------------
+static HRESULT ParseBmpHeader(
+	const BYTE* pData, DWORD dwSize, BmpFormat* pFormat)
+{
+	DWORD dwHeaderBytes;
+	DWORD dwWidth;
+	DWORD dwHeight;
+	DWORD dwBits;
+	DWORD dwCompression = BMP_RGB;
+	DWORD dwColors = 0;
+	DWORD dwPaletteOffset;
+	DWORD dwEntryBytes = 4;
+	BOOL bTopDown = FALSE;
+	DWORD i;
+
+	if (dwSize < BMP_FILEHEADER_BYTES + BMP_COREHEADER_BYTES ||
+		pData[0] != 'B' || pData[1] != 'M') {
+		return DDERR_INVALIDPIXELFORMAT;
+	}
+	pFormat->dwOffBits = GetDword(pData + 10);
+	dwHeaderBytes = GetDword(pData + 14);
+	if (dwHeaderBytes == BMP_COREHEADER_BYTES) {
+		dwWidth = GetWord(pData + 18);
+		dwHeight = GetWord(pData + 20);
+		dwBits = GetWord(pData + 24);
+		dwEntryBytes = 3;
+	} else if (dwHeaderBytes >= BMP_INFOHEADER_BYTES &&
+		dwSize >= BMP_FILEHEADER_BYTES + BMP_INFOHEADER_BYTES) {
+		LONG lHeight = (LONG)GetDword(pData + 22);
+		dwWidth = GetDword(pData + 18);
+		if (lHeight < 0) {
+			bTopDown = TRUE;
+			lHeight = -lHeight;
+		}
+		dwHeight = (DWORD)lHeight;
+		dwBits = GetWord(pData + 28);
+		dwCompression = GetDword(pData + 30);
+		dwColors = GetDword(pData + 46);
+	} else {
+		return DDERR_INVALIDPIXELFORMAT;
+	}
+	if (!dwWidth || !dwHeight || dwWidth > BMP_MAX_SIZE ||
+		dwHeight > BMP_MAX_SIZE) {
+		return DDERR_INVALIDPARAMS;
+	}
+
+	// Bit field masks, in the header for V4 and V5, after it otherwise
+	BmpChannel* pChannels = pFormat->Channels;
+	dwPaletteOffset = BMP_FILEHEADER_BYTES + dwHeaderBytes;
+	if (dwCompression == BMP_BITFIELDS) {
+		if ((dwBits != 16 && dwBits != 32) ||
+			dwSize < BMP_MASKS_OFFSET + 12) {
+			return DDERR_INVALIDPIXELFORMAT;
+		}
+		for (i = 0; i < 3; ++i) {
+			InitChannel(
+				&pChannels[i], GetDword(pData + BMP_MASKS_OFFSET + (i * 4)));
+		}
+		if (dwHeaderBytes == BMP_INFOHEADER_BYTES) {
+			dwPaletteOffset += 12;
+		}
+	} else if (dwCompression != BMP_RGB) {
+		return DDERR_INVALIDPIXELFORMAT;
+	} else if (dwBits == 16) {
+		InitChannel(&pChannels[0], 0x7C00);
+		InitChannel(&pChannels[1], 0x03E0);
+		InitChannel(&pChannels[2], 0x001F);
+	} else if (dwBits == 32) {
+		InitChannel(&pChannels[0], 0x00FF0000);
+		InitChannel(&pChannels[1], 0x0000FF00);
+		InitChannel(&pChannels[2], 0x000000FF);
+	} else if (dwBits != 1 && dwBits != 4 && dwBits != 8 && dwBits != 24) {
+		return DDERR_INVALIDPIXELFORMAT;
+	}
+
+	// Palette, entries past the end of a short one are black
+	for (i = 0; i < 256; ++i) {
+		pFormat->Palette[i] = 0xFF000000;
+	}
+	if (dwBits <= 8) {
+		if (!dwColors || dwColors > (1UL << dwBits)) {
+			dwColors = 1UL << dwBits;
+		}
+		if (dwPaletteOffset > dwSize ||
+			dwColors > (dwSize - dwPaletteOffset) / dwEntryBytes) {
+			return DDERR_INVALIDPIXELFORMAT;
+		}
+		for (i = 0; i < dwColors; ++i) {
+			const BYTE* pEntry = pData + dwPaletteOffset + (i * dwEntryBytes);
+			pFormat->Palette[i] = 0xFF000000 | ((DWORD)pEntry[2] << 16) |
+				((DWORD)pEntry[1] << 8) | pEntry[0];
+		}
+	}
+
+	pFormat->dwWidth = dwWidth;
+	pFormat->dwHeight = dwHeight;
+	pFormat->dwBits = dwBits;
+	// Rows are padded to 4 bytes
+	pFormat->dwStride = (((dwWidth * dwBits) + 31) >> 5) << 2;
+	pFormat->bTopDown = bTopDown;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: DecodeBmpRow()
+// Desc: Convert one row of a bitmap to ARGB8888
+//-----------------------------------------------------------------------------
+static void DecodeBmpRow(
+	const BmpFormat* pFormat, const BYTE* pRow, DWORD* pdwOut)
+{
+	DWORD dwWidth = pFormat->dwWidth;
+	DWORD dwBits = pFormat->dwBits;
+	DWORD x;
+	switch (dwBits) {
+	case 1:
+	case 4:
+	case 8: {
+		DWORD dwPerByte = 8 / dwBits;
+		DWORD dwIndexMask = (1UL << dwBits) - 1;
+		for (x = 0; x < dwWidth; ++x) {
+			UINT uShift = (UINT)((dwPerByte - 1 - (x % dwPerByte)) * dwBits);
+			pdwOut[x] = pFormat->Palette[
+				(pRow[x / dwPerByte] >> uShift) & dwIndexMask];
+		}
+		break;
+	}
+	case 16:
+	case 32:
+		for (x = 0; x < dwWidth; ++x) {
+			DWORD dwValue = (dwBits == 16) ? GetWord(pRow + (x * 2)) :
+											 GetDword(pRow + (x * 4));
+			pdwOut[x] = 0xFF000000 |
+				(GetChannel(&pFormat->Channels[0], dwValue) << 16) |
+				(GetChannel(&pFormat->Channels[1], dwValue) << 8) |
+				GetChannel(&pFormat->Channels[2], dwValue);
+		}
+		break;
+	default:
+		for (x = 0; x < dwWidth; ++x) {
+			const BYTE* pPixel = pRow + (x * 3);
+			pdwOut[x] = 0xFF000000 | ((DWORD)pPixel[2] << 16) |
+				((DWORD)pPixel[1] << 8) | pPixel[0];
+		}
+		break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: DecodeBmp()
+// Desc: Convert a bitmap file in memory to ARGB8888
+//-----------------------------------------------------------------------------
+static HRESULT DecodeBmp(const BYTE* pData, DWORD dwSize, TEXIMAGE* pImage)
+{
+	BmpFormat Format;
+	HRESULT hr = ParseBmpHeader(pData, dwSize, &Format);
+	if (FAILED(hr)) {
+		return hr;
+	}
+	DWORD dwHeight = Format.dwHeight;
+	DWORD dwStride = Format.dwStride;
+	if (Format.dwOffBits > dwSize ||
+		dwStride > (dwSize - Format.dwOffBits) / dwHeight) {
+		return DDERR_INVALIDPIXELFORMAT;
+	}
+	hr = TEXCreateImage(Format.dwWidth, dwHeight, pImage);
+	if (FAILED(hr)) {
+		return hr;
+	}
+	for (DWORD y = 0; y < dwHeight; ++y) {
+		DecodeBmpRow(&Format,
+			pData + Format.dwOffBits +
+				(dwStride * (Format.bTopDown ? y : dwHeight - 1 - y)),
+			pImage->pdwPixels + (y * Format.dwWidth));
+	}
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXCreateImage()
+// Desc: Allocate an image, its pixels aren't cleared
+//-----------------------------------------------------------------------------
+HRESULT TEXCreateImage(DWORD dwWidth, DWORD dwHeight, TEXIMAGE* pImage)
+{
+	pImage->dwWidth = 0;
+	pImage->dwHeight = 0;
+	pImage->pdwPixels = NULL;
+	if (!dwWidth || !dwHeight || dwWidth > BMP_MAX_SIZE ||
+		dwHeight > BMP_MAX_SIZE) {
+		return DDERR_INVALIDPARAMS;
+	}
+	pImage->pdwPixels = new DWORD[dwWidth * dwHeight];
+	if (!pImage->pdwPixels) {
+		return DDERR_OUTOFMEMORY;
+	}
+	pImage->dwWidth = dwWidth;
+	pImage->dwHeight = dwHeight;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXFreeImage()
+// Desc: Release the pixels of an image, safe to call twice
+//-----------------------------------------------------------------------------
+void TEXFreeImage(TEXIMAGE* pImage)
+{
+	delete[] pImage->pdwPixels;
+	pImage->pdwPixels = NULL;
+	pImage->dwWidth = 0;
+	pImage->dwHeight = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXLoadBmp()
+// Desc: Load a bitmap file as opaque ARGB8888
+//-----------------------------------------------------------------------------
+HRESULT TEXLoadBmp(const char* pFileName, TEXIMAGE* pImage)
+{
+	BYTE* pData;
+	DWORD dwSize;
+	pImage->dwWidth = 0;
+	pImage->dwHeight = 0;
+	pImage->pdwPixels = NULL;
+	HRESULT hr = ReadFileData(pFileName, &pData, &dwSize);
+	if (SUCCEEDED(hr)) {
+		hr = DecodeBmp(pData, dwSize, pImage);
+		delete[] pData;
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXLoadAlphaBmp()
+// Desc: Replace the alpha of pImage with the blue channel of a bitmap file.
+//       The bitmap must be the same size as the image.
+//-----------------------------------------------------------------------------
+HRESULT TEXLoadAlphaBmp(const char* pFileName, TEXIMAGE* pImage)
+{
+	TEXIMAGE Alpha;
+	HRESULT hr = TEXLoadBmp(pFileName, &Alpha);
+	if (FAILED(hr)) {
+		return hr;
+	}
+	if (Alpha.dwWidth != pImage->dwWidth ||
+		Alpha.dwHeight != pImage->dwHeight) {
+		hr = DDERR_INVALIDPARAMS;
+	} else {
+		TEXCopyAlpha(Alpha.pdwPixels, (LONG)(Alpha.dwWidth * 4),
+			pImage->pdwPixels, (LONG)(pImage->dwWidth * 4), pImage->dwWidth,
+			pImage->dwHeight);
+	}
+	TEXFreeImage(&Alpha);
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXCopyAlpha()
+// Desc: Put the blue channel of each source pixel in the alpha channel of
+//       the destination pixel, keeping the destination's color
+//-----------------------------------------------------------------------------
+void TEXCopyAlpha(const void* pSrc, LONG lSrcPitch, void* pDest,
+	LONG lDestPitch, DWORD dwWidth, DWORD dwHeight)
+{
+	const BYTE* pbRowSrc = static_cast<const BYTE*>(pSrc);
+	BYTE* pbRowDest = static_cast<BYTE*>(pDest);
+	for (DWORD y = 0; y < dwHeight; ++y) {
+		const DWORD* pdwPixelSrc = reinterpret_cast<const DWORD*>(pbRowSrc);
+		DWORD* pdwPixelDest = reinterpret_cast<DWORD*>(pbRowDest);
+		for (DWORD x = 0; x < dwWidth; ++x) {
+			pdwPixelDest[x] =
+				(pdwPixelDest[x] & 0x00FFFFFF) | (pdwPixelSrc[x] << 24);
+		}
+		pbRowSrc += lSrcPitch;
+		pbRowDest += lDestPitch;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// A bitmap file open for reading a band of rows at a time
+//-----------------------------------------------------------------------------
+struct TEXBmpReader {
+	HANDLE hFile;
+	BmpFormat Format;
+	DWORD dwNextRow;    // Next row TEXReadBmpRows() returns, from the top
+	BYTE* pbBuffer;     // Raw rows of the last band read
+	DWORD dwBufferRows;
+};
+
+//-----------------------------------------------------------------------------
+// Name: TEXOpenBmp()
+// Desc: Open a bitmap file and read its header, but none of its pixels.
+//       Rows are read with Win32 calls and 64 bit offsets, so the file can
+//       be larger than the address space.
+//-----------------------------------------------------------------------------
+HRESULT TEXOpenBmp(const char* pFileName, TEXBmpReader** ppReader)
+{
+	BYTE Header[BMP_HEADER_READ];
+	DWORD dwRead = 0;
+	DWORD dwSizeHigh;
+
+	*ppReader = NULL;
+	TEXBmpReader* pReader = new TEXBmpReader;
+	if (!pReader) {
+		return DDERR_OUTOFMEMORY;
+	}
+	memset(pReader, 0, sizeof(TEXBmpReader));
+	pReader->hFile = CreateFileA(pFileName, GENERIC_READ, FILE_SHARE_READ,
+		NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (pReader->hFile == INVALID_HANDLE_VALUE) {
+		delete pReader;
+		return DDERR_NOTFOUND;
+	}
+	HRESULT hr = DDERR_GENERIC;
+	DWORD dwSizeLow = GetFileSize(pReader->hFile, &dwSizeHigh);
+	if (dwSizeLow != INVALID_FILE_SIZE || GetLastError() == NO_ERROR) {
+		if (ReadFile(pReader->hFile, Header, sizeof(Header), &dwRead, NULL)) {
+			hr = ParseBmpHeader(Header, dwRead, &pReader->Format);
+		}
+	}
+	if (SUCCEEDED(hr)) {
+		const BmpFormat* pFormat = &pReader->Format;
+		ULONGLONG uFileSize = ((ULONGLONG)dwSizeHigh << 32) | dwSizeLow;
+		ULONGLONG uNeeded = (ULONGLONG)pFormat->dwOffBits +
+			(ULONGLONG)pFormat->dwStride * pFormat->dwHeight;
+		if (uNeeded > uFileSize) {
+			hr = DDERR_INVALIDPIXELFORMAT;
+		}
+	}
+	if (FAILED(hr)) {
+		TEXCloseBmp(pReader);
+		return hr;
+	}
+	*ppReader = pReader;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXCloseBmp()
+// Desc: Close a bitmap opened with TEXOpenBmp(), NULL is ignored
+//-----------------------------------------------------------------------------
+void TEXCloseBmp(TEXBmpReader* pReader)
+{
+	if (pReader) {
+		CloseHandle(pReader->hFile);
+		delete[] pReader->pbBuffer;
+		delete pReader;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXGetBmpSize()
+// Desc: Size in pixels of an open bitmap
+//-----------------------------------------------------------------------------
+void TEXGetBmpSize(
+	const TEXBmpReader* pReader, DWORD* pdwWidth, DWORD* pdwHeight)
+{
+	*pdwWidth = pReader->Format.dwWidth;
+	*pdwHeight = pReader->Format.dwHeight;
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXReadBmpRows()
+// Desc: Decode the next dwRows rows, top down, to ARGB8888. A band of a
+//       bottom up bitmap is still one run in the file, read in one call
+//       and decoded last row first.
+//-----------------------------------------------------------------------------
+HRESULT TEXReadBmpRows(
+	TEXBmpReader* pReader, DWORD dwRows, void* pDest, LONG lDestPitch)
+{
+	const BmpFormat* pFormat = &pReader->Format;
+	DWORD dwStride = pFormat->dwStride;
+	DWORD y;
+
+	if (dwRows > pFormat->dwHeight - pReader->dwNextRow) {
+		return DDERR_INVALIDPARAMS;
+	}
+	if (!dwRows) {
+		return DD_OK;
+	}
+	if (dwRows > pReader->dwBufferRows) {
+		delete[] pReader->pbBuffer;
+		pReader->dwBufferRows = 0;
+		pReader->pbBuffer = new BYTE[dwStride * dwRows];
+		if (!pReader->pbBuffer) {
+			return DDERR_OUTOFMEMORY;
+		}
+		pReader->dwBufferRows = dwRows;
+	}
+
+	// Row of the file the band starts at
+	DWORD dwFileRow = pFormat->bTopDown ? pReader->dwNextRow :
+		pFormat->dwHeight - pReader->dwNextRow - dwRows;
+	ULONGLONG uOffset =
+		(ULONGLONG)pFormat->dwOffBits + (ULONGLONG)dwStride * dwFileRow;
+	LONG lOffsetHigh = (LONG)(uOffset >> 32);
+	DWORD dwBytes = dwStride * dwRows;
+	DWORD dwRead = 0;
+	if ((SetFilePointer(pReader->hFile, (LONG)(DWORD)uOffset, &lOffsetHigh,
+			 FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+			GetLastError() != NO_ERROR) ||
+		!ReadFile(pReader->hFile, pReader->pbBuffer, dwBytes, &dwRead, NULL) ||
+		dwRead != dwBytes) {
+		return DDERR_GENERIC;
+	}
+
+	BYTE* pbDest = static_cast<BYTE*>(pDest);
+	for (y = 0; y < dwRows; ++y) {
+		DecodeBmpRow(pFormat,
+			pReader->pbBuffer +
+				dwStride * (pFormat->bTopDown ? y : dwRows - 1 - y),
+			reinterpret_cast<DWORD*>(pbDest + lDestPitch * (LONG)y));
+	}
+	pReader->dwNextRow += dwRows;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXGetMipCount()
+// Desc: Number of levels in a full mip chain, down to 1x1
+//-----------------------------------------------------------------------------
+DWORD TEXGetMipCount(DWORD dwWidth, DWORD dwHeight)
+{
+	DWORD dwCount = 1;
+	while (dwWidth > 1 || dwHeight > 1) {
+		dwWidth >>= 1;
+		dwHeight >>= 1;
+		++dwCount;
+	}
+	return dwCount;
+}
+
+//-----------------------------------------------------------------------------
+// Name: AverageQuad()
+// Desc: Round down average of four ARGB8888 pixels, two channels at a time.
+//       Four 8 bit values sum to at most 10 bits, so the lanes can't carry
+//       into each other.
+//-----------------------------------------------------------------------------
+static DWORD AverageQuad(DWORD dwPixel1, DWORD dwPixel2, DWORD dwPixel3,
+	DWORD dwPixel4)
+{
+	DWORD dwRB = (dwPixel1 & 0x00FF00FF) + (dwPixel2 & 0x00FF00FF) +
+		(dwPixel3 & 0x00FF00FF) + (dwPixel4 & 0x00FF00FF);
+	DWORD dwAG = ((dwPixel1 >> 8) & 0x00FF00FF) +
+		((dwPixel2 >> 8) & 0x00FF00FF) + ((dwPixel3 >> 8) & 0x00FF00FF) +
+		((dwPixel4 >> 8) & 0x00FF00FF);
+	return ((dwRB >> 2) & 0x00FF00FF) | (((dwAG >> 2) & 0x00FF00FF) << 8);
+}
+
+//-----------------------------------------------------------------------------
+// Name: BoxRow()
+// Desc: One row of the 2x2 box filter. With SSE2 each pass widens eight
+//       source pixels from both rows to 16 bits, adds the rows and then
+//       the neighboring columns, and packs four pixels back down. The
+//       result is the same as AverageQuad() to the bit.
+//-----------------------------------------------------------------------------
+static void BoxRow(const DWORD* pdwRow1, const DWORD* pdwRow2,
+	DWORD dwSrcWidth, DWORD* pdwDest, DWORD dwDestWidth)
+{
+	DWORD x = 0;
+	if (dwSrcWidth == 1) {
+		pdwDest[0] = AverageQuad(
+			pdwRow1[0], pdwRow1[0], pdwRow2[0], pdwRow2[0]);
+		return;
+	}
+#if defined(TEX_SSE2)
+	const __m128i vZero = _mm_setzero_si128();
+	for (; x + 4 <= dwDestWidth; x += 4) {
+		const __m128i* pSrc1 =
+			reinterpret_cast<const __m128i*>(pdwRow1 + x * 2);
+		const __m128i* pSrc2 =
+			reinterpret_cast<const __m128i*>(pdwRow2 + x * 2);
+		__m128i vA1 = _mm_loadu_si128(pSrc1);
+		__m128i vB1 = _mm_loadu_si128(pSrc1 + 1);
+		__m128i vA2 = _mm_loadu_si128(pSrc2);
+		__m128i vB2 = _mm_loadu_si128(pSrc2 + 1);
+
+		// Pixels 0 and 1, 2 and 3 and so on, both rows summed
+		__m128i v01 = _mm_add_epi16(_mm_unpacklo_epi8(vA1, vZero),
+			_mm_unpacklo_epi8(vA2, vZero));
+		__m128i v23 = _mm_add_epi16(_mm_unpackhi_epi8(vA1, vZero),
+			_mm_unpackhi_epi8(vA2, vZero));
+		__m128i v45 = _mm_add_epi16(_mm_unpacklo_epi8(vB1, vZero),
+			_mm_unpacklo_epi8(vB2, vZero));
+		__m128i v67 = _mm_add_epi16(_mm_unpackhi_epi8(vB1, vZero),
+			_mm_unpackhi_epi8(vB2, vZero));
+
+		// Even columns plus odd columns
+		__m128i vLow = _mm_add_epi16(_mm_unpacklo_epi64(v01, v23),
+			_mm_unpackhi_epi64(v01, v23));
+		__m128i vHigh = _mm_add_epi16(_mm_unpacklo_epi64(v45, v67),
+			_mm_unpackhi_epi64(v45, v67));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pdwDest + x),
+			_mm_packus_epi16(
+				_mm_srli_epi16(vLow, 2), _mm_srli_epi16(vHigh, 2)));
+	}
+#endif
+	for (; x < dwDestWidth; ++x) {
+		pdwDest[x] = AverageQuad(pdwRow1[x * 2], pdwRow1[x * 2 + 1],
+			pdwRow2[x * 2], pdwRow2[x * 2 + 1]);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: InitSRGBTables()
+// Desc: Build the sRGB tables the first time they're needed. Two threads
+//       building them at once write the same values, so there's no lock.
+//-----------------------------------------------------------------------------
+static void InitSRGBTables(void)
+{
+	if (s_lSRGBReady) {
+		return;
+	}
+	DWORD i;
+	for (i = 0; i < 256; ++i) {
+		double dValue = i / 255.0;
+		if (dValue <= 0.04045) {
+			dValue = dValue / 12.92;
+		} else {
+			dValue = pow((dValue + 0.055) / 1.055, 2.4);
+		}
+		s_wSRGBToLinear[i] = (WORD)(dValue * 65535.0 + 0.5);
+	}
+	s_wSRGBThreshold[0] = 0;
+	for (i = 1; i < 256; ++i) {
+		s_wSRGBThreshold[i] = (WORD)(
+			(s_wSRGBToLinear[i - 1] + s_wSRGBToLinear[i] + 1) >> 1);
+	}
+	DWORD dwCode = 0;
+	for (i = 0; i < TEX_SRGB_BUCKETS; ++i) {
+		while (dwCode < 255 &&
+			(i << TEX_SRGB_SHIFT) >= s_wSRGBThreshold[dwCode + 1]) {
+			++dwCode;
+		}
+		s_bLinearToSRGB[i] = (BYTE)dwCode;
+	}
+	InterlockedExchange(&s_lSRGBReady, 1);
+}
+
+//-----------------------------------------------------------------------------
+// Name: LinearToSRGB()
+// Desc: Nearest sRGB value to a 16 bit linear one. Thresholds are at least
+//       19 apart and a bucket covers 16 values, so the bucket's first
+//       value is off by one step at most.
+//-----------------------------------------------------------------------------
+static DWORD LinearToSRGB(DWORD dwLinear)
+{
+	DWORD dwCode = s_bLinearToSRGB[dwLinear >> TEX_SRGB_SHIFT];
+	if (dwCode < 255 && dwLinear >= s_wSRGBThreshold[dwCode + 1]) {
+		++dwCode;
+	}
+	return dwCode;
+}
+
+//-----------------------------------------------------------------------------
+// Name: SRGBRow()
+// Desc: One row of the 2x2 box filter averaging red, green and blue as
+//       linear light. Alpha isn't gamma encoded and is averaged as is.
+//-----------------------------------------------------------------------------
+static void SRGBRow(const DWORD* pdwRow1, const DWORD* pdwRow2,
+	DWORD dwSrcWidth, DWORD* pdwDest, DWORD dwDestWidth)
+{
+	for (DWORD x = 0; x < dwDestWidth; ++x) {
+		DWORD x1 = x * 2;
+		DWORD x2 = (x1 + 1 < dwSrcWidth) ? x1 + 1 : x1;
+		DWORD dwPixel[4];
+		dwPixel[0] = pdwRow1[x1];
+		dwPixel[1] = pdwRow1[x2];
+		dwPixel[2] = pdwRow2[x1];
+		dwPixel[3] = pdwRow2[x2];
+
+		DWORD dwResult = AverageQuad(
+			dwPixel[0], dwPixel[1], dwPixel[2], dwPixel[3]) & 0xFF000000;
+		DWORD dwShift;
+		for (dwShift = 0; dwShift < 24; dwShift += 8) {
+			DWORD dwSum = s_wSRGBToLinear[(dwPixel[0] >> dwShift) & 0xFF] +
+				s_wSRGBToLinear[(dwPixel[1] >> dwShift) & 0xFF] +
+				s_wSRGBToLinear[(dwPixel[2] >> dwShift) & 0xFF] +
+				s_wSRGBToLinear[(dwPixel[3] >> dwShift) & 0xFF];
+			dwResult |= LinearToSRGB((dwSum + 2) >> 2) << dwShift;
+		}
+		pdwDest[x] = dwResult;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXGenerateMip()
+// Desc: Shrink an ARGB8888 image to the next mip level, half the size in
+//       each direction but never below 1. With TEX_MIP_SRGB the colors are
+//       taken to be sRGB and averaged as linear light.
+//-----------------------------------------------------------------------------
+void TEXGenerateMip(const void* pSrc, LONG lSrcPitch, DWORD dwSrcWidth,
+	DWORD dwSrcHeight, void* pDest, LONG lDestPitch, DWORD dwFlags)
+{
+	DWORD dwDestWidth = dwSrcWidth > 1 ? dwSrcWidth >> 1 : 1;
+	DWORD dwDestHeight = dwSrcHeight > 1 ? dwSrcHeight >> 1 : 1;
+	const BYTE* pbSrc = static_cast<const BYTE*>(pSrc);
+	BYTE* pbRowDest = static_cast<BYTE*>(pDest);
+
+	if (!dwSrcWidth || !dwSrcHeight) {
+		return;
+	}
+	if (dwFlags & TEX_MIP_SRGB) {
+		InitSRGBTables();
+	}
+	for (DWORD y = 0; y < dwDestHeight; ++y) {
+		DWORD y1 = y * 2;
+		DWORD y2 = (y1 + 1 < dwSrcHeight) ? y1 + 1 : y1;
+		const DWORD* pdwRow1 =
+			reinterpret_cast<const DWORD*>(pbSrc + (lSrcPitch * (LONG)y1));
+		const DWORD* pdwRow2 =
+			reinterpret_cast<const DWORD*>(pbSrc + (lSrcPitch * (LONG)y2));
+		DWORD* pdwPixelDest = reinterpret_cast<DWORD*>(pbRowDest);
+		if (dwFlags & TEX_MIP_SRGB) {
+			SRGBRow(pdwRow1, pdwRow2, dwSrcWidth, pdwPixelDest, dwDestWidth);
+		} else {
+			BoxRow(pdwRow1, pdwRow2, dwSrcWidth, pdwPixelDest, dwDestWidth);
+		}
+		pbRowDest += lDestPitch;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: AverageOctet()
+// Desc: Round down average of eight ARGB8888 pixels, the 2x2 squares of two
+//       slices. Eight 8 bit values sum to at most 11 bits, so the lanes
+//       still can't carry into each other.
+//-----------------------------------------------------------------------------
+static DWORD AverageOctet(const DWORD* pdwPixels)
+{
+	DWORD dwRB = 0;
+	DWORD dwAG = 0;
+	for (DWORD i = 0; i < 8; ++i) {
+		dwRB += pdwPixels[i] & 0x00FF00FF;
+		dwAG += (pdwPixels[i] >> 8) & 0x00FF00FF;
+	}
+	return ((dwRB >> 3) & 0x00FF00FF) | (((dwAG >> 3) & 0x00FF00FF) << 8);
+}
+
+//-----------------------------------------------------------------------------
+// Name: VolumeRow()
+// Desc: One row of the 2x2x2 box filter, from two rows of each of two
+//       slices. SSE2 works like BoxRow(), with four rows summed instead of
+//       two, and matches AverageOctet() to the bit.
+//-----------------------------------------------------------------------------
+static void VolumeRow(const DWORD* const* ppdwRows, DWORD dwSrcWidth,
+	DWORD* pdwDest, DWORD dwDestWidth)
+{
+	DWORD x = 0;
+#if defined(TEX_SSE2)
+	const __m128i vZero = _mm_setzero_si128();
+	for (; dwSrcWidth > 1 && x + 4 <= dwDestWidth; x += 4) {
+		__m128i v01 = vZero;
+		__m128i v23 = vZero;
+		__m128i v45 = vZero;
+		__m128i v67 = vZero;
+		for (DWORD i = 0; i < 4; ++i) {
+			const __m128i* pSrc =
+				reinterpret_cast<const __m128i*>(ppdwRows[i] + x * 2);
+			__m128i vA = _mm_loadu_si128(pSrc);
+			__m128i vB = _mm_loadu_si128(pSrc + 1);
+			v01 = _mm_add_epi16(v01, _mm_unpacklo_epi8(vA, vZero));
+			v23 = _mm_add_epi16(v23, _mm_unpackhi_epi8(vA, vZero));
+			v45 = _mm_add_epi16(v45, _mm_unpacklo_epi8(vB, vZero));
+			v67 = _mm_add_epi16(v67, _mm_unpackhi_epi8(vB, vZero));
+		}
+		__m128i vLow = _mm_add_epi16(_mm_unpacklo_epi64(v01, v23),
+			_mm_unpackhi_epi64(v01, v23));
+		__m128i vHigh = _mm_add_epi16(_mm_unpacklo_epi64(v45, v67),
+			_mm_unpackhi_epi64(v45, v67));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pdwDest + x),
+			_mm_packus_epi16(
+				_mm_srli_epi16(vLow, 3), _mm_srli_epi16(vHigh, 3)));
+	}
+#endif
+	for (; x < dwDestWidth; ++x) {
+		DWORD x1 = x * 2;
+		DWORD x2 = (x1 + 1 < dwSrcWidth) ? x1 + 1 : x1;
+		DWORD dwPixel[8];
+		for (DWORD i = 0; i < 4; ++i) {
+			dwPixel[i * 2] = ppdwRows[i][x1];
+			dwPixel[i * 2 + 1] = ppdwRows[i][x2];
+		}
+		pdwDest[x] = AverageOctet(dwPixel);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: VolumeSRGBRow()
+// Desc: One row of the 2x2x2 box filter averaging red, green and blue as
+//       linear light, like SRGBRow()
+//-----------------------------------------------------------------------------
+static void VolumeSRGBRow(const DWORD* const* ppdwRows, DWORD dwSrcWidth,
+	DWORD* pdwDest, DWORD dwDestWidth)
+{
+	for (DWORD x = 0; x < dwDestWidth; ++x) {
+		DWORD x1 = x * 2;
+		DWORD x2 = (x1 + 1 < dwSrcWidth) ? x1 + 1 : x1;
+		DWORD dwPixel[8];
+		DWORD i;
+		for (i = 0; i < 4; ++i) {
+			dwPixel[i * 2] = ppdwRows[i][x1];
+			dwPixel[i * 2 + 1] = ppdwRows[i][x2];
+		}
+
+		DWORD dwResult = AverageOctet(dwPixel) & 0xFF000000;
+		DWORD dwShift;
+		for (dwShift = 0; dwShift < 24; dwShift += 8) {
+			DWORD dwSum = 0;
+			for (i = 0; i < 8; ++i) {
+				dwSum += s_wSRGBToLinear[(dwPixel[i] >> dwShift) & 0xFF];
+			}
+			dwResult |= LinearToSRGB((dwSum + 4) >> 3) << dwShift;
+		}
+		pdwDest[x] = dwResult;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXGenerateVolumeMip()
+// Desc: Build one slice of the next mip level of a volume texture from the
+//       two slices above it, averaging 2x2x2 cubes of pixels. Sizes round
+//       down like TEXGenerateMip(), and once the volume is one slice deep
+//       pass the same slice twice, which gives the same pixels as
+//       TEXGenerateMip(). Both slices share lSrcPitch.
+//-----------------------------------------------------------------------------
+void TEXGenerateVolumeMip(const void* pSrc1, const void* pSrc2,
+	LONG lSrcPitch, DWORD dwSrcWidth, DWORD dwSrcHeight, void* pDest,
+	LONG lDestPitch, DWORD dwFlags)
+{
+	DWORD dwDestWidth = dwSrcWidth > 1 ? dwSrcWidth >> 1 : 1;
+	DWORD dwDestHeight = dwSrcHeight > 1 ? dwSrcHeight >> 1 : 1;
+	const BYTE* pbSrc1 = static_cast<const BYTE*>(pSrc1);
+	const BYTE* pbSrc2 = static_cast<const BYTE*>(pSrc2);
+	BYTE* pbRowDest = static_cast<BYTE*>(pDest);
+
+	if (!dwSrcWidth || !dwSrcHeight) {
+		return;
+	}
+	if (dwFlags & TEX_MIP_SRGB) {
+		InitSRGBTables();
+	}
+	for (DWORD y = 0; y < dwDestHeight; ++y) {
+		DWORD y1 = y * 2;
+		DWORD y2 = (y1 + 1 < dwSrcHeight) ? y1 + 1 : y1;
+		const DWORD* pdwRows[4];
+		pdwRows[0] =
+			reinterpret_cast<const DWORD*>(pbSrc1 + (lSrcPitch * (LONG)y1));
+		pdwRows[1] =
+			reinterpret_cast<const DWORD*>(pbSrc1 + (lSrcPitch * (LONG)y2));
+		pdwRows[2] =
+			reinterpret_cast<const DWORD*>(pbSrc2 + (lSrcPitch * (LONG)y1));
+		pdwRows[3] =
+			reinterpret_cast<const DWORD*>(pbSrc2 + (lSrcPitch * (LONG)y2));
+		DWORD* pdwPixelDest = reinterpret_cast<DWORD*>(pbRowDest);
+		if (dwFlags & TEX_MIP_SRGB) {
+			VolumeSRGBRow(pdwRows, dwSrcWidth, pdwPixelDest, dwDestWidth);
+		} else {
+			VolumeRow(pdwRows, dwSrcWidth, pdwPixelDest, dwDestWidth);
+		}
+		pbRowDest += lDestPitch;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: MitchellFilter() / LanczosFilter() / KaiserFilter() / BoxFilter()
+// Desc: Filter kernels, x in source pixels at a scale of 1. Each one is
+//       zero from its s_dSupport entry on.
+//-----------------------------------------------------------------------------
+static double Sinc(double x)
+{
+	if (x < 1e-6 && x > -1e-6) {
+		return 1.0;
+	}
+	x *= 3.14159265358979323846;
+	return sin(x) / x;
+}
+
+static double MitchellFilter(double x)
+{
+	// B = C = 1/3
+	x = fabs(x);
+	if (x < 1.0) {
+		return (7.0 * x * x * x - 12.0 * x * x + 16.0 / 3.0) / 6.0;
+	}
+	if (x < 2.0) {
+		return (-7.0 / 3.0 * x * x * x + 12.0 * x * x - 20.0 * x +
+				   32.0 / 3.0) /
+			6.0;
+	}
+	return 0.0;
+}
+
+static double LanczosFilter(double x)
+{
+	x = fabs(x);
+	if (x < 3.0) {
+		return Sinc(x) * Sinc(x / 3.0);
+	}
+	return 0.0;
+}
+
+static double BesselI0(double x)
+{
+	// Power series, converges quickly for the small alpha used here
+	double dSum = 1.0;
+	double dTerm = 1.0;
+	double dHalf = x * 0.5;
+	DWORD k;
+	for (k = 1; k < 32; ++k) {
+		dTerm *= (dHalf / k) * (dHalf / k);
+		dSum += dTerm;
+		if (dTerm < dSum * 1e-12) {
+			break;
+		}
+	}
+	return dSum;
+}
+
+static double KaiserFilter(double x)
+{
+	// Sinc windowed over 3 pixels, alpha 4
+	x = fabs(x);
+	if (x < 3.0) {
+		double dRatio = x / 3.0;
+		return Sinc(x) * BesselI0(4.0 * sqrt(1.0 - dRatio * dRatio)) /
+			BesselI0(4.0);
+	}
+	return 0.0;
+}
+
+static double BoxFilter(double x)
+{
+	return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+}
+
+//-----------------------------------------------------------------------------
+// Kernels by TEX_FILTER_ value, and how far out each one reaches
+//-----------------------------------------------------------------------------
+typedef double (*LPTEXKERNEL)(double x);
+
+static const LPTEXKERNEL s_pKernels[TEX_FILTER_COUNT] = {
+	BoxFilter, KaiserFilter, LanczosFilter, MitchellFilter};
+static const double s_dSupport[TEX_FILTER_COUNT] = {0.5, 3.0, 3.0, 2.0};
+
+//-----------------------------------------------------------------------------
+// Output pixels per band, the unit of work handed to the pool
+//-----------------------------------------------------------------------------
+#define TEX_BAND_ROWS 16
+
+//-----------------------------------------------------------------------------
+// Weights for one axis. Every output pixel has dwTaps source indices, already
+// clamped to the edge, and as many weights that add up to 1. For a 2:1 mip
+// level there are only two phases, but keeping a set per output pixel lets
+// odd sizes, where every pixel lands on a different phase, use the same
+// loops.
+//-----------------------------------------------------------------------------
+struct FilterAxis {
+	DWORD dwTaps;
+	DWORD* pdwIndex; // dwTaps per output pixel
+	float* pfWeight; // dwTaps per output pixel
+};
+
+//-----------------------------------------------------------------------------
+// Name: InitAxis()
+// Desc: Work out the weights for shrinking dwSrc pixels to dwDest
+//-----------------------------------------------------------------------------
+static HRESULT InitAxis(
+	FilterAxis* pAxis, DWORD dwSrc, DWORD dwDest, DWORD dwFilter)
+{
+	double dScale = (double)dwSrc / dwDest;
+	double dStretch = dScale > 1.0 ? dScale : 1.0;
+	double dReach = s_dSupport[dwFilter] * dStretch;
+	LPTEXKERNEL pKernel = s_pKernels[dwFilter];
+
+	pAxis->dwTaps = (DWORD)ceil(dReach * 2.0) + 1;
+	pAxis->pdwIndex = new DWORD[dwDest * pAxis->dwTaps];
+	pAxis->pfWeight = new float[dwDest * pAxis->dwTaps];
+	if (!pAxis->pdwIndex || !pAxis->pfWeight) {
+		return DDERR_OUTOFMEMORY;
+	}
+	for (DWORD i = 0; i < dwDest; ++i) {
+		DWORD* pdwIndex = pAxis->pdwIndex + i * pAxis->dwTaps;
+		float* pfWeight = pAxis->pfWeight + i * pAxis->dwTaps;
+		double dCenter = (i + 0.5) * dScale;
+		LONG lFirst = (LONG)floor(dCenter - dReach);
+		double dTotal = 0.0;
+		double dWeights[64];
+		DWORD t;
+		for (t = 0; t < pAxis->dwTaps; ++t) {
+			LONG j = lFirst + (LONG)t;
+			dWeights[t] = pKernel((j + 0.5 - dCenter) / dStretch);
+			dTotal += dWeights[t];
+			pdwIndex[t] = j < 0 ? 0 : ((DWORD)j >= dwSrc ? dwSrc - 1 : j);
+		}
+		for (t = 0; t < pAxis->dwTaps; ++t) {
+			pfWeight[t] = (float)(dWeights[t] / dTotal);
+		}
+	}
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: FreeAxis()
+// Desc: Release what InitAxis() allocated
+//-----------------------------------------------------------------------------
+static void FreeAxis(FilterAxis* pAxis)
+{
+	delete[] pAxis->pdwIndex;
+	delete[] pAxis->pfWeight;
+	pAxis->pdwIndex = NULL;
+	pAxis->pfWeight = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Everything a band needs, shared by all of them
+//-----------------------------------------------------------------------------
+struct ResampleJob {
+	const BYTE* pbSrc;
+	LONG lSrcPitch;
+	DWORD dwSrcWidth;
+	DWORD dwSrcHeight;
+	DWORD dwSrcFirstRow;   // Source row pbSrc points at, 0 for a whole image
+	BYTE* pbDest;
+	LONG lDestPitch;
+	DWORD dwDestFirstRow;  // Output row pbDest points at
+	DWORD dwDestWidth;
+	DWORD dwDestHeight;
+	DWORD dwFlags;
+	FilterAxis Horizontal;
+	FilterAxis Vertical;
+	volatile LONG lFailed; // Set by a band that ran out of memory
+};
+
+//-----------------------------------------------------------------------------
+// Name: LoadRow()
+// Desc: Expand a row of ARGB8888 pixels to four floats each, B, G, R, A.
+//       sRGB colors become linear light from 0 to 1, everything else stays
+//       on a 0 to 255 scale.
+//-----------------------------------------------------------------------------
+static void LoadRow(
+	const DWORD* pdwSrc, DWORD dwWidth, DWORD dwFlags, float* pfDest)
+{
+	DWORD x;
+	if (dwFlags & TEX_MIP_SRGB) {
+		const float fScale = 1.0f / 65535.0f;
+		for (x = 0; x < dwWidth; ++x) {
+			DWORD dwPixel = pdwSrc[x];
+			pfDest[0] = s_wSRGBToLinear[dwPixel & 0xFF] * fScale;
+			pfDest[1] = s_wSRGBToLinear[(dwPixel >> 8) & 0xFF] * fScale;
+			pfDest[2] = s_wSRGBToLinear[(dwPixel >> 16) & 0xFF] * fScale;
+			pfDest[3] = (float)(dwPixel >> 24) * (1.0f / 255.0f);
+			pfDest += 4;
+		}
+		return;
+	}
+	for (x = 0; x < dwWidth; ++x) {
+		DWORD dwPixel = pdwSrc[x];
+		pfDest[0] = (float)(dwPixel & 0xFF);
+		pfDest[1] = (float)((dwPixel >> 8) & 0xFF);
+		pfDest[2] = (float)((dwPixel >> 16) & 0xFF);
+		pfDest[3] = (float)(dwPixel >> 24);
+		pfDest += 4;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: ClampByte() / ClampLinear() / StoreRow()
+// Desc: Clamp a row of floats from LoadRow()'s scale back to ARGB8888. The
+//       negative lobes of the sharper filters overshoot at hard edges.
+//-----------------------------------------------------------------------------
+static DWORD ClampByte(float f)
+{
+	if (f <= 0.0f) {
+		return 0;
+	}
+	if (f >= 255.0f) {
+		return 255;
+	}
+	return (DWORD)(f + 0.5f);
+}
+
+static DWORD ClampLinear(float f)
+{
+	if (f <= 0.0f) {
+		return 0;
+	}
+	if (f >= 1.0f) {
+		return 255;
+	}
+	return LinearToSRGB((DWORD)(f * 65535.0f + 0.5f));
+}
+
+static void StoreRow(
+	const float* pfSrc, DWORD dwWidth, DWORD dwFlags, DWORD* pdwDest)
+{
+	DWORD x;
+	if (dwFlags & TEX_MIP_SRGB) {
+		for (x = 0; x < dwWidth; ++x) {
+			pdwDest[x] = ClampLinear(pfSrc[0]) |
+				(ClampLinear(pfSrc[1]) << 8) |
+				(ClampLinear(pfSrc[2]) << 16) |
+				(ClampByte(pfSrc[3] * 255.0f) << 24);
+			pfSrc += 4;
+		}
+		return;
+	}
+	for (x = 0; x < dwWidth; ++x) {
+		pdwDest[x] = ClampByte(pfSrc[0]) | (ClampByte(pfSrc[1]) << 8) |
+			(ClampByte(pfSrc[2]) << 16) | (ClampByte(pfSrc[3]) << 24);
+		pfSrc += 4;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: FilterRow()
+// Desc: Horizontal pass over one expanded row. With SSE2 a pixel's four
+//       channels are one register, so each tap is one multiply and add.
+//-----------------------------------------------------------------------------
+static void FilterRow(const FilterAxis* pAxis, const float* pfSrc,
+	DWORD dwDestWidth, float* pfDest)
+{
+	const DWORD* pdwIndex = pAxis->pdwIndex;
+	const float* pfWeight = pAxis->pfWeight;
+	DWORD dwTaps = pAxis->dwTaps;
+	for (DWORD x = 0; x < dwDestWidth; ++x) {
+		DWORD t;
+#if defined(TEX_SSE2)
+		__m128 vSum = _mm_setzero_ps();
+		for (t = 0; t < dwTaps; ++t) {
+			vSum = _mm_add_ps(vSum,
+				_mm_mul_ps(_mm_set1_ps(pfWeight[t]),
+					_mm_loadu_ps(pfSrc + pdwIndex[t] * 4)));
+		}
+		_mm_storeu_ps(pfDest, vSum);
+#else
+		float fSum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+		for (t = 0; t < dwTaps; ++t) {
+			const float* pfPixel = pfSrc + pdwIndex[t] * 4;
+			fSum[0] += pfWeight[t] * pfPixel[0];
+			fSum[1] += pfWeight[t] * pfPixel[1];
+			fSum[2] += pfWeight[t] * pfPixel[2];
+			fSum[3] += pfWeight[t] * pfPixel[3];
+		}
+		pfDest[0] = fSum[0];
+		pfDest[1] = fSum[1];
+		pfDest[2] = fSum[2];
+		pfDest[3] = fSum[3];
+#endif
+		pdwIndex += dwTaps;
+		pfWeight += dwTaps;
+		pfDest += 4;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: AccumulateRow()
+// Desc: pfDest += fWeight * pfSrc over dwFloats floats, the vertical pass.
+//       The whole row is one straight run, four floats at a time.
+//-----------------------------------------------------------------------------
+static void AccumulateRow(
+	float* pfDest, const float* pfSrc, float fWeight, DWORD dwFloats)
+{
+	DWORD i = 0;
+#if defined(TEX_SSE2)
+	__m128 vWeight = _mm_set1_ps(fWeight);
+	for (; i + 4 <= dwFloats; i += 4) {
+		_mm_storeu_ps(pfDest + i,
+			_mm_add_ps(_mm_loadu_ps(pfDest + i),
+				_mm_mul_ps(vWeight, _mm_loadu_ps(pfSrc + i))));
+	}
+#endif
+	for (; i < dwFloats; ++i) {
+		pfDest[i] += fWeight * pfSrc[i];
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: ResampleBand()
+// Desc: Filter output rows dwFirstRow up to dwEndRow. The source rows under
+//       the band's vertical taps are filtered across first, then the output
+//       rows are summed down from them, so a band only keeps its own rows
+//       around.
+//-----------------------------------------------------------------------------
+static void ResampleBand(ResampleJob* pJob, DWORD dwFirstRow, DWORD dwEndRow)
+{
+	const FilterAxis* pVertical = &pJob->Vertical;
+
+	// Indices climb with the output row, so the band's first and last
+	// taps bound every source row it reads
+	DWORD dwTaps = pVertical->dwTaps;
+	DWORD dwLow = pVertical->pdwIndex[dwFirstRow * dwTaps];
+	DWORD dwHigh = pVertical->pdwIndex[dwEndRow * dwTaps - 1];
+	DWORD dwRows = dwHigh - dwLow + 1;
+	DWORD dwRowFloats = pJob->dwDestWidth * 4;
+
+	float* pfExpanded = new float[pJob->dwSrcWidth * 4];
+	float* pfAcross = new float[dwRows * dwRowFloats];
+	float* pfDown = new float[dwRowFloats];
+	if (!pfExpanded || !pfAcross || !pfDown) {
+		InterlockedExchange(&pJob->lFailed, 1);
+	} else {
+		DWORD y;
+		for (y = 0; y < dwRows; ++y) {
+			const BYTE* pbRow = pJob->pbSrc +
+				pJob->lSrcPitch * (LONG)(dwLow + y - pJob->dwSrcFirstRow);
+			LoadRow(reinterpret_cast<const DWORD*>(pbRow),
+				pJob->dwSrcWidth, pJob->dwFlags, pfExpanded);
+			FilterRow(&pJob->Horizontal, pfExpanded, pJob->dwDestWidth,
+				pfAcross + y * dwRowFloats);
+		}
+		for (y = dwFirstRow; y < dwEndRow; ++y) {
+			const DWORD* pdwIndex = pVertical->pdwIndex + y * dwTaps;
+			const float* pfWeight = pVertical->pfWeight + y * dwTaps;
+			memset(pfDown, 0, dwRowFloats * sizeof(float));
+			for (DWORD t = 0; t < dwTaps; ++t) {
+				AccumulateRow(pfDown,
+					pfAcross + (pdwIndex[t] - dwLow) * dwRowFloats,
+					pfWeight[t], dwRowFloats);
+			}
+			StoreRow(pfDown, pJob->dwDestWidth, pJob->dwFlags,
+				reinterpret_cast<DWORD*>(pJob->pbDest +
+					pJob->lDestPitch * (LONG)(y - pJob->dwDestFirstRow)));
+		}
+	}
+	delete[] pfExpanded;
+	delete[] pfAcross;
+	delete[] pfDown;
+}
+
+//-----------------------------------------------------------------------------
+// Name: ResampleBandTask()
+// Desc: Pool task, filter band dwTask of TEX_BAND_ROWS output rows
+//-----------------------------------------------------------------------------
+static void ResampleBandTask(void* pContext, DWORD dwTask)
+{
+	ResampleJob* pJob = static_cast<ResampleJob*>(pContext);
+	DWORD dwFirstRow = dwTask * TEX_BAND_ROWS;
+	DWORD dwEndRow = dwFirstRow + TEX_BAND_ROWS;
+	if (dwEndRow > pJob->dwDestHeight) {
+		dwEndRow = pJob->dwDestHeight;
+	}
+	ResampleBand(pJob, dwFirstRow, dwEndRow);
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXResample()
+// Desc: Shrink, or stretch, an ARGB8888 image to any size with a separable
+//       TEX_FILTER_ kernel. Bands of output rows run on pPool, which may be
+//       NULL to do them all on this thread. TEX_MIP_SRGB in dwFlags filters
+//       the colors as linear light.
+//-----------------------------------------------------------------------------
+HRESULT TEXResample(const void* pSrc, LONG lSrcPitch, DWORD dwSrcWidth,
+	DWORD dwSrcHeight, void* pDest, LONG lDestPitch, DWORD dwDestWidth,
+	DWORD dwDestHeight, DWORD dwFilter, DWORD dwFlags, DXTWorkPool* pPool)
+{
+	ResampleJob Job;
+	HRESULT hr;
+
+	if (!dwSrcWidth || !dwSrcHeight || !dwDestWidth || !dwDestHeight ||
+		dwFilter >= TEX_FILTER_COUNT ||
+		dwSrcWidth > dwDestWidth * TEX_MAX_SHRINK ||
+		dwSrcHeight > dwDestHeight * TEX_MAX_SHRINK) {
+		return DDERR_INVALIDPARAMS;
+	}
+	if (dwFlags & TEX_MIP_SRGB) {
+		InitSRGBTables();
+	}
+	memset(&Job, 0, sizeof(Job));
+	Job.pbSrc = static_cast<const BYTE*>(pSrc);
+	Job.lSrcPitch = lSrcPitch;
+	Job.dwSrcWidth = dwSrcWidth;
+	Job.dwSrcHeight = dwSrcHeight;
+	Job.pbDest = static_cast<BYTE*>(pDest);
+	Job.lDestPitch = lDestPitch;
+	Job.dwDestWidth = dwDestWidth;
+	Job.dwDestHeight = dwDestHeight;
+	Job.dwFlags = dwFlags;
+	hr = InitAxis(&Job.Horizontal, dwSrcWidth, dwDestWidth, dwFilter);
+	if (SUCCEEDED(hr)) {
+		hr = InitAxis(&Job.Vertical, dwSrcHeight, dwDestHeight, dwFilter);
+	}
+	if (SUCCEEDED(hr)) {
+		DXTPoolRun(pPool, ResampleBandTask, &Job,
+			(dwDestHeight + TEX_BAND_ROWS - 1) / TEX_BAND_ROWS);
+		if (Job.lFailed) {
+			hr = DDERR_OUTOFMEMORY;
+		}
+	}
+	FreeAxis(&Job.Horizontal);
+	FreeAxis(&Job.Vertical);
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXFilterMip()
+// Desc: Build the next mip level, half the size rounded down but never below
+//       1, with a TEX_FILTER_ kernel. The box filter goes through
+//       TEXGenerateMip() so it's bit for bit what it always was.
+//-----------------------------------------------------------------------------
+HRESULT TEXFilterMip(const void* pSrc, LONG lSrcPitch, DWORD dwSrcWidth,
+	DWORD dwSrcHeight, void* pDest, LONG lDestPitch, DWORD dwFilter,
+	DWORD dwFlags, DXTWorkPool* pPool)
+{
+	if (dwFilter == TEX_FILTER_BOX) {
+		TEXGenerateMip(pSrc, lSrcPitch, dwSrcWidth, dwSrcHeight, pDest,
+			lDestPitch, dwFlags);
+		return DD_OK;
+	}
+	return TEXResample(pSrc, lSrcPitch, dwSrcWidth, dwSrcHeight, pDest,
+		lDestPitch, dwSrcWidth > 1 ? dwSrcWidth >> 1 : 1,
+		dwSrcHeight > 1 ? dwSrcHeight >> 1 : 1, dwFilter, dwFlags, pPool);
+}
+
+//-----------------------------------------------------------------------------
+// Name: GetBandSource()
+// Desc: First and last source rows that output rows dwFirstRow up to
+//       dwEndRow read. The box filter's last band also takes an odd row
+//       left over at the bottom.
+//-----------------------------------------------------------------------------
+static void GetBandSource(const ResampleJob* pJob, DWORD dwFilter,
+	DWORD dwFirstRow, DWORD dwEndRow, DWORD* pdwFirstSrc, DWORD* pdwLastSrc)
+{
+	if (dwFilter == TEX_FILTER_BOX) {
+		*pdwFirstSrc = dwFirstRow * 2;
+		*pdwLastSrc = dwEndRow == pJob->dwDestHeight ?
+			pJob->dwSrcHeight - 1 : dwEndRow * 2 - 1;
+	} else {
+		DWORD dwTaps = pJob->Vertical.dwTaps;
+		*pdwFirstSrc = pJob->Vertical.pdwIndex[dwFirstRow * dwTaps];
+		*pdwLastSrc = pJob->Vertical.pdwIndex[dwEndRow * dwTaps - 1];
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: FilterBand()
+// Desc: Build output rows dwFirstRow up to dwEndRow of the next mip level,
+//       with TEXGenerateMip() for the box filter
+//-----------------------------------------------------------------------------
+static void FilterBand(
+	ResampleJob* pJob, DWORD dwFilter, DWORD dwFirstRow, DWORD dwEndRow)
+{
+	if (dwFilter == TEX_FILTER_BOX) {
+		DWORD dwFirstSrc;
+		DWORD dwLastSrc;
+		GetBandSource(
+			pJob, dwFilter, dwFirstRow, dwEndRow, &dwFirstSrc, &dwLastSrc);
+		TEXGenerateMip(pJob->pbSrc +
+				pJob->lSrcPitch * (LONG)(dwFirstSrc - pJob->dwSrcFirstRow),
+			pJob->lSrcPitch, pJob->dwSrcWidth, dwLastSrc - dwFirstSrc + 1,
+			pJob->pbDest +
+				pJob->lDestPitch * (LONG)(dwFirstRow - pJob->dwDestFirstRow),
+			pJob->lDestPitch, pJob->dwFlags);
+	} else {
+		ResampleBand(pJob, dwFirstRow, dwEndRow);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// One level of one chain in TEXBuildMipChains(), filtered from the level
+// above. Each band raises its flag in plDone once its rows are written.
+//-----------------------------------------------------------------------------
+struct MipStage {
+	ResampleJob Job;          // Vertical is unused by the box filter
+	DWORD dwChain;
+	DWORD dwFirstTask;        // Task number of band 0
+	DWORD dwBands;
+	volatile LONG* plDone;    // One flag per band
+	const MipStage* pAbove;   // Stage that writes the source, NULL for level 0
+};
+
+struct MipPipeline {
+	MipStage* pStages;        // By level, then chain
+	DWORD dwStages;
+	DWORD dwFilter;
+	volatile LONG lFailed;
+};
+
+//-----------------------------------------------------------------------------
+// Name: MipBandTask()
+// Desc: Pool task, one band of one stage. Tasks are numbered level by level,
+//       so every band a task waits on has a lower number. The pool hands
+//       each thread its tasks in rising order, so the lowest unfinished task
+//       can always run and the wait never deadlocks.
+//-----------------------------------------------------------------------------
+static void MipBandTask(void* pContext, DWORD dwTask)
+{
+	MipPipeline* pPipeline = static_cast<MipPipeline*>(pContext);
+
+	// Find the stage, the last one starting at or before dwTask
+	DWORD dwLow = 0;
+	DWORD dwHigh = pPipeline->dwStages;
+	while (dwHigh - dwLow > 1) {
+		DWORD dwMiddle = (dwLow + dwHigh) >> 1;
+		if (pPipeline->pStages[dwMiddle].dwFirstTask <= dwTask) {
+			dwLow = dwMiddle;
+		} else {
+			dwHigh = dwMiddle;
+		}
+	}
+	MipStage* pStage = &pPipeline->pStages[dwLow];
+	ResampleJob* pJob = &pStage->Job;
+	DWORD dwBand = dwTask - pStage->dwFirstTask;
+	DWORD dwFirstRow = dwBand * TEX_BAND_ROWS;
+	DWORD dwEndRow = dwFirstRow + TEX_BAND_ROWS;
+	if (dwEndRow > pJob->dwDestHeight) {
+		dwEndRow = pJob->dwDestHeight;
+	}
+
+	// Source rows the band reads
+	DWORD dwFirstSrc;
+	DWORD dwLastSrc;
+	GetBandSource(pJob, pPipeline->dwFilter, dwFirstRow, dwEndRow,
+		&dwFirstSrc, &dwLastSrc);
+
+	// Wait for the bands of the level above that write them
+	if (pStage->pAbove) {
+		for (DWORD i = dwFirstSrc / TEX_BAND_ROWS;
+			i <= dwLastSrc / TEX_BAND_ROWS; ++i) {
+			while (!pStage->pAbove->plDone[i]) {
+				Sleep(0);
+			}
+		}
+	}
+
+	FilterBand(pJob, pPipeline->dwFilter, dwFirstRow, dwEndRow);
+	if (pJob->lFailed) {
+		InterlockedExchange(&pPipeline->lFailed, 1);
+	}
+
+	// Raised even after a failure, so nothing waits forever
+	InterlockedExchange(&pStage->plDone[dwBand], 1);
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXBuildMipChains()
+// Desc: Fill in every level below the top of dwChains mip chains, such as
+//       the faces of a cube map, in one batch on pPool. Chains run side by
+//       side, and a band of a level starts as soon as the bands above it
+//       that it reads are done instead of waiting for the whole level. Each
+//       band allocates its own scratch rows. pPool may be NULL to do it all
+//       on this thread. The levels are what TEXFilterMip() builds.
+//-----------------------------------------------------------------------------
+HRESULT TEXBuildMipChains(const TEXMIPCHAIN* pChains, DWORD dwChains,
+	DWORD dwFilter, DWORD dwFlags, DXTWorkPool* pPool)
+{
+	MipPipeline Pipeline;
+	DWORD dwMaxLevels = 0;
+	DWORD dwTasks = 0;
+	DWORD dwLevel;
+	DWORD i;
+	HRESULT hr = DD_OK;
+
+	if (dwFilter >= TEX_FILTER_COUNT) {
+		return DDERR_INVALIDPARAMS;
+	}
+	memset(&Pipeline, 0, sizeof(Pipeline));
+	Pipeline.dwFilter = dwFilter;
+	for (i = 0; i < dwChains; ++i) {
+		if (!pChains[i].dwWidth || !pChains[i].dwHeight ||
+			pChains[i].dwLevels > TEX_MAX_LEVELS) {
+			return DDERR_INVALIDPARAMS;
+		}
+		if (pChains[i].dwLevels > 1) {
+			Pipeline.dwStages += pChains[i].dwLevels - 1;
+		}
+		if (pChains[i].dwLevels > dwMaxLevels) {
+			dwMaxLevels = pChains[i].dwLevels;
+		}
+	}
+	if (!Pipeline.dwStages) {
+		return DD_OK;
+	}
+	if (dwFlags & TEX_MIP_SRGB) {
+		InitSRGBTables();
+	}
+	Pipeline.pStages = new MipStage[Pipeline.dwStages];
+	if (!Pipeline.pStages) {
+		return DDERR_OUTOFMEMORY;
+	}
+	memset(Pipeline.pStages, 0, sizeof(MipStage) * Pipeline.dwStages);
+
+	// Level by level, then chain by chain, so every band's task number is
+	// above those of the bands it reads
+	MipStage* pStage = Pipeline.pStages;
+	for (dwLevel = 1; dwLevel < dwMaxLevels; ++dwLevel) {
+		for (i = 0; i < dwChains; ++i) {
+			const TEXMIPCHAIN* pChain = &pChains[i];
+			if (dwLevel >= pChain->dwLevels) {
+				continue;
+			}
+			DWORD dwSrcWidth = pChain->dwWidth >> (dwLevel - 1);
+			DWORD dwSrcHeight = pChain->dwHeight >> (dwLevel - 1);
+			dwSrcWidth = dwSrcWidth ? dwSrcWidth : 1;
+			dwSrcHeight = dwSrcHeight ? dwSrcHeight : 1;
+			ResampleJob* pJob = &pStage->Job;
+			pJob->pbSrc =
+				static_cast<const BYTE*>(pChain->pLevels[dwLevel - 1]);
+			pJob->lSrcPitch = pChain->lPitch[dwLevel - 1];
+			pJob->dwSrcWidth = dwSrcWidth;
+			pJob->dwSrcHeight = dwSrcHeight;
+			pJob->pbDest = static_cast<BYTE*>(pChain->pLevels[dwLevel]);
+			pJob->lDestPitch = pChain->lPitch[dwLevel];
+			pJob->dwDestWidth = dwSrcWidth > 1 ? dwSrcWidth >> 1 : 1;
+			pJob->dwDestHeight = dwSrcHeight > 1 ? dwSrcHeight >> 1 : 1;
+			pJob->dwFlags = dwFlags;
+			pStage->dwChain = i;
+			pStage->dwFirstTask = dwTasks;
+			pStage->dwBands =
+				(pJob->dwDestHeight + TEX_BAND_ROWS - 1) / TEX_BAND_ROWS;
+			// The same chain's stage a level up is dwChains or fewer back
+			if (dwLevel > 1) {
+				const MipStage* pAbove = pStage;
+				do {
+					--pAbove;
+				} while (pAbove->dwChain != i);
+				pStage->pAbove = pAbove;
+			}
+			if (SUCCEEDED(hr) && dwFilter != TEX_FILTER_BOX) {
+				hr = InitAxis(&pJob->Horizontal, dwSrcWidth, pJob->dwDestWidth,
+					dwFilter);
+				if (SUCCEEDED(hr)) {
+					hr = InitAxis(&pJob->Vertical, dwSrcHeight,
+						pJob->dwDestHeight, dwFilter);
+				}
+			}
+			dwTasks += pStage->dwBands;
+			++pStage;
+		}
+	}
+
+	LONG* plDone = NULL;
+	if (SUCCEEDED(hr)) {
+		plDone = new LONG[dwTasks];
+		if (!plDone) {
+			hr = DDERR_OUTOFMEMORY;
+		}
+	}
+	if (SUCCEEDED(hr)) {
+		memset(plDone, 0, sizeof(LONG) * dwTasks);
+		for (i = 0; i < Pipeline.dwStages; ++i) {
+			Pipeline.pStages[i].plDone =
+				plDone + Pipeline.pStages[i].dwFirstTask;
+		}
+		DXTPoolRun(pPool, MipBandTask, &Pipeline, dwTasks);
+		if (Pipeline.lFailed) {
+			hr = DDERR_OUTOFMEMORY;
+		}
+	}
+	delete[] plDone;
+	for (i = 0; i < Pipeline.dwStages; ++i) {
+		FreeAxis(&Pipeline.pStages[i].Job.Horizontal);
+		FreeAxis(&Pipeline.pStages[i].Job.Vertical);
+	}
+	delete[] Pipeline.pStages;
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// One level of a TEXMipStream, a window of rows sliding down the level. Rows
+// before dwFirstRow are gone and rows from dwEndRow on aren't made yet.
+//-----------------------------------------------------------------------------
+struct MipWindow {
+	DWORD dwWidth;
+	DWORD dwHeight;
+	DWORD* pdwRows;     // dwCapacity rows, row dwFirstRow first
+	DWORD dwCapacity;
+	DWORD dwFirstRow;
+	DWORD dwEndRow;
+	DWORD dwSentRow;    // Rows before this went to the band callback
+	DWORD dwBands;      // Bands of the level below, 0 on the last level
+	DWORD dwNextBand;   // Next of them to filter
+	ResampleJob Job;    // Filters this level into the one below
+};
+
+struct TEXMipStream {
+	DWORD dwLevels;
+	DWORD dwBandRows;
+	DWORD dwFilter;
+	LPTEXBANDPROC pBandProc;
+	void* pContext;
+	DXTWorkPool* pPool;
+	HRESULT hr;         // First failure, returned from then on
+	DWORD dwRunLevel;   // Level and first band of the bands on the pool
+	DWORD dwRunBand;
+	MipWindow Levels[TEX_MAX_LEVELS];
+};
+
+//-----------------------------------------------------------------------------
+// Name: SlideWindow()
+// Desc: Drop the rows of a level that the band callback has had and the
+//       level below doesn't read any more, making room at the end
+//-----------------------------------------------------------------------------
+static void SlideWindow(TEXMipStream* pStream, DWORD dwLevel)
+{
+	MipWindow* pWindow = &pStream->Levels[dwLevel];
+	DWORD dwKeep = pWindow->dwSentRow;
+	if (pWindow->dwNextBand < pWindow->dwBands) {
+		DWORD dwFirstRow = pWindow->dwNextBand * TEX_BAND_ROWS;
+		DWORD dwEndRow = dwFirstRow + TEX_BAND_ROWS;
+		DWORD dwFirstSrc;
+		DWORD dwLastSrc;
+		if (dwEndRow > pWindow->Job.dwDestHeight) {
+			dwEndRow = pWindow->Job.dwDestHeight;
+		}
+		GetBandSource(&pWindow->Job, pStream->dwFilter, dwFirstRow, dwEndRow,
+			&dwFirstSrc, &dwLastSrc);
+		if (dwFirstSrc < dwKeep) {
+			dwKeep = dwFirstSrc;
+		}
+	}
+	if (dwKeep > pWindow->dwFirstRow) {
+		if (pWindow->dwEndRow > dwKeep) {
+			memmove(pWindow->pdwRows,
+				pWindow->pdwRows +
+					(dwKeep - pWindow->dwFirstRow) * pWindow->dwWidth,
+				(pWindow->dwEndRow - dwKeep) * pWindow->dwWidth * 4);
+		}
+		pWindow->dwFirstRow = dwKeep;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: MipStreamTask()
+// Desc: Pool task, filter one band of the level below dwRunLevel
+//-----------------------------------------------------------------------------
+static void MipStreamTask(void* pContext, DWORD dwTask)
+{
+	TEXMipStream* pStream = static_cast<TEXMipStream*>(pContext);
+	ResampleJob* pJob = &pStream->Levels[pStream->dwRunLevel].Job;
+	DWORD dwFirstRow = (pStream->dwRunBand + dwTask) * TEX_BAND_ROWS;
+	DWORD dwEndRow = dwFirstRow + TEX_BAND_ROWS;
+	if (dwEndRow > pJob->dwDestHeight) {
+		dwEndRow = pJob->dwDestHeight;
+	}
+	FilterBand(pJob, pStream->dwFilter, dwFirstRow, dwEndRow);
+}
+
+//-----------------------------------------------------------------------------
+// Name: SendBands()
+// Desc: Hand every whole band of a level to the callback, and the short
+//       last one once the level is done. FALSE if there was nothing to send.
+//-----------------------------------------------------------------------------
+static BOOL SendBands(TEXMipStream* pStream, DWORD dwLevel)
+{
+	MipWindow* pWindow = &pStream->Levels[dwLevel];
+	BOOL bSent = FALSE;
+	while (SUCCEEDED(pStream->hr) && pWindow->dwSentRow < pWindow->dwEndRow) {
+		DWORD dwRows = pWindow->dwEndRow - pWindow->dwSentRow;
+		if (dwRows > pStream->dwBandRows) {
+			dwRows = pStream->dwBandRows;
+		} else if (dwRows < pStream->dwBandRows &&
+			pWindow->dwEndRow < pWindow->dwHeight) {
+			break;
+		}
+		pStream->hr = pStream->pBandProc(pStream->pContext, dwLevel,
+			pWindow->dwSentRow, dwRows,
+			pWindow->pdwRows +
+				(pWindow->dwSentRow - pWindow->dwFirstRow) * pWindow->dwWidth,
+			(LONG)(pWindow->dwWidth * 4));
+		pWindow->dwSentRow += dwRows;
+		bSent = TRUE;
+	}
+	return bSent;
+}
+
+//-----------------------------------------------------------------------------
+// Name: FilterBands()
+// Desc: Filter, on the pool, every band of the level below dwLevel whose
+//       source rows are all in and that fits in the window below. FALSE if
+//       no band was ready.
+//-----------------------------------------------------------------------------
+static BOOL FilterBands(TEXMipStream* pStream, DWORD dwLevel)
+{
+	MipWindow* pWindow = &pStream->Levels[dwLevel];
+	ResampleJob* pJob = &pWindow->Job;
+	if (FAILED(pStream->hr) || pWindow->dwNextBand >= pWindow->dwBands) {
+		return FALSE;
+	}
+	MipWindow* pBelow = pWindow + 1;
+	SlideWindow(pStream, dwLevel + 1);
+
+	DWORD dwBand = pWindow->dwNextBand;
+	DWORD dwEndRow = pBelow->dwEndRow;
+	while (dwBand < pWindow->dwBands) {
+		DWORD dwFirstRow = dwBand * TEX_BAND_ROWS;
+		DWORD dwBandEnd = dwFirstRow + TEX_BAND_ROWS;
+		DWORD dwFirstSrc;
+		DWORD dwLastSrc;
+		if (dwBandEnd > pJob->dwDestHeight) {
+			dwBandEnd = pJob->dwDestHeight;
+		}
+		GetBandSource(pJob, pStream->dwFilter, dwFirstRow, dwBandEnd,
+			&dwFirstSrc, &dwLastSrc);
+		if (dwLastSrc >= pWindow->dwEndRow ||
+			dwBandEnd - pBelow->dwFirstRow > pBelow->dwCapacity) {
+			break;
+		}
+		dwEndRow = dwBandEnd;
+		++dwBand;
+	}
+	if (dwBand == pWindow->dwNextBand) {
+		return FALSE;
+	}
+
+	pJob->pbSrc = reinterpret_cast<const BYTE*>(pWindow->pdwRows);
+	pJob->dwSrcFirstRow = pWindow->dwFirstRow;
+	pJob->pbDest = reinterpret_cast<BYTE*>(pBelow->pdwRows);
+	pJob->dwDestFirstRow = pBelow->dwFirstRow;
+	pStream->dwRunLevel = dwLevel;
+	pStream->dwRunBand = pWindow->dwNextBand;
+	DXTPoolRun(pStream->pPool, MipStreamTask, pStream,
+		dwBand - pWindow->dwNextBand);
+	if (pJob->lFailed) {
+		pStream->hr = DDERR_OUTOFMEMORY;
+	}
+	pWindow->dwNextBand = dwBand;
+	pBelow->dwEndRow = dwEndRow;
+	return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXCreateMipStream()
+// Desc: Start building dwLevels mip levels of a dwWidth by dwHeight image
+//       that arrives a band of rows at a time through TEXLockMipStream().
+//       Each level only keeps a window of rows, about twice dwBandRows or
+//       the rows one band of the level below reads, whichever is more, so
+//       the memory used doesn't grow with the height. Every level, the top
+//       one included, is handed to pBandProc in bands of dwBandRows rows,
+//       rounded up to a multiple of 16, as soon as they're done. The levels
+//       come out bit for bit the same as TEXFilterMip() makes them, with the
+//       bands filtered on pPool, which may be NULL.
+//-----------------------------------------------------------------------------
+HRESULT TEXCreateMipStream(DWORD dwWidth, DWORD dwHeight, DWORD dwLevels,
+	DWORD dwBandRows, DWORD dwFilter, DWORD dwFlags,
+	LPTEXBANDPROC pBandProc, void* pContext, DXTWorkPool* pPool,
+	TEXMipStream** ppStream)
+{
+	*ppStream = NULL;
+	if (!dwWidth || !dwHeight || dwWidth > BMP_MAX_SIZE ||
+		dwHeight > BMP_MAX_SIZE || !dwLevels ||
+		dwLevels > TEXGetMipCount(dwWidth, dwHeight) ||
+		dwFilter >= TEX_FILTER_COUNT || !pBandProc) {
+		return DDERR_INVALIDPARAMS;
+	}
+	if (dwFlags & TEX_MIP_SRGB) {
+		InitSRGBTables();
+	}
+	TEXMipStream* pStream = new TEXMipStream;
+	if (!pStream) {
+		return DDERR_OUTOFMEMORY;
+	}
+	memset(pStream, 0, sizeof(TEXMipStream));
+	// Whole bands of filtered rows, so whole rows of blocks too
+	dwBandRows = ((dwBandRows + TEX_BAND_ROWS - 1) / TEX_BAND_ROWS) *
+		TEX_BAND_ROWS;
+	pStream->dwLevels = dwLevels;
+	pStream->dwBandRows = dwBandRows ? dwBandRows : TEX_BAND_ROWS;
+	pStream->dwFilter = dwFilter;
+	pStream->pBandProc = pBandProc;
+	pStream->pContext = pContext;
+	pStream->pPool = pPool;
+
+	HRESULT hr = DD_OK;
+	for (DWORD i = 0; SUCCEEDED(hr) && (i < dwLevels); ++i) {
+		MipWindow* pWindow = &pStream->Levels[i];
+		ResampleJob* pJob = &pWindow->Job;
+		DWORD dwSpan = 0;
+		pWindow->dwWidth = dwWidth >> i ? dwWidth >> i : 1;
+		pWindow->dwHeight = dwHeight >> i ? dwHeight >> i : 1;
+		if (i + 1 < dwLevels) {
+			pJob->lSrcPitch = (LONG)(pWindow->dwWidth * 4);
+			pJob->dwSrcWidth = pWindow->dwWidth;
+			pJob->dwSrcHeight = pWindow->dwHeight;
+			pJob->dwDestWidth =
+				pWindow->dwWidth > 1 ? pWindow->dwWidth >> 1 : 1;
+			pJob->dwDestHeight =
+				pWindow->dwHeight > 1 ? pWindow->dwHeight >> 1 : 1;
+			pJob->lDestPitch = (LONG)(pJob->dwDestWidth * 4);
+			pJob->dwFlags = dwFlags;
+			pWindow->dwBands =
+				(pJob->dwDestHeight + TEX_BAND_ROWS - 1) / TEX_BAND_ROWS;
+			if (dwFilter != TEX_FILTER_BOX) {
+				hr = InitAxis(&pJob->Horizontal, pJob->dwSrcWidth,
+					pJob->dwDestWidth, dwFilter);
+				if (SUCCEEDED(hr)) {
+					hr = InitAxis(&pJob->Vertical, pJob->dwSrcHeight,
+						pJob->dwDestHeight, dwFilter);
+				}
+			}
+			// Most source rows any band of the level below reads
+			for (DWORD j = 0; SUCCEEDED(hr) && (j < pWindow->dwBands); ++j) {
+				DWORD dwEndRow = (j + 1) * TEX_BAND_ROWS;
+				DWORD dwFirstSrc;
+				DWORD dwLastSrc;
+				if (dwEndRow > pJob->dwDestHeight) {
+					dwEndRow = pJob->dwDestHeight;
+				}
+				GetBandSource(pJob, dwFilter, j * TEX_BAND_ROWS, dwEndRow,
+					&dwFirstSrc, &dwLastSrc);
+				if (dwLastSrc - dwFirstSrc + 1 > dwSpan) {
+					dwSpan = dwLastSrc - dwFirstSrc + 1;
+				}
+			}
+		}
+		// Once nothing more can be sent or filtered, what's kept is under
+		// a band or under one band's source rows, leave a band past that
+		pWindow->dwCapacity = pStream->dwBandRows +
+			(dwSpan > pStream->dwBandRows ? dwSpan : pStream->dwBandRows);
+		if (pWindow->dwCapacity > pWindow->dwHeight) {
+			pWindow->dwCapacity = pWindow->dwHeight;
+		}
+		if (SUCCEEDED(hr)) {
+			pWindow->pdwRows =
+				new DWORD[pWindow->dwWidth * pWindow->dwCapacity];
+			if (!pWindow->pdwRows) {
+				hr = DDERR_OUTOFMEMORY;
+			}
+		}
+	}
+	if (FAILED(hr)) {
+		TEXDestroyMipStream(pStream);
+		return hr;
+	}
+	*ppStream = pStream;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXDestroyMipStream()
+// Desc: Release a stream, finished or not, NULL is ignored
+//-----------------------------------------------------------------------------
+void TEXDestroyMipStream(TEXMipStream* pStream)
+{
+	if (pStream) {
+		for (DWORD i = 0; i < TEX_MAX_LEVELS; ++i) {
+			FreeAxis(&pStream->Levels[i].Job.Horizontal);
+			FreeAxis(&pStream->Levels[i].Job.Vertical);
+			delete[] pStream->Levels[i].pdwRows;
+		}
+		delete pStream;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXLockMipStream()
+// Desc: Get room for the next rows of the top level. Up to *pdwRows rows
+//       can be written at *ppRows, none once the whole level is in. The
+//       pointer is good until TEXUnlockMipStream().
+//-----------------------------------------------------------------------------
+HRESULT TEXLockMipStream(
+	TEXMipStream* pStream, void** ppRows, LONG* plPitch, DWORD* pdwRows)
+{
+	MipWindow* pTop = &pStream->Levels[0];
+	*ppRows = NULL;
+	*plPitch = 0;
+	*pdwRows = 0;
+	if (FAILED(pStream->hr)) {
+		return pStream->hr;
+	}
+	SlideWindow(pStream, 0);
+	DWORD dwRows = pTop->dwCapacity - (pTop->dwEndRow - pTop->dwFirstRow);
+	if (dwRows > pTop->dwHeight - pTop->dwEndRow) {
+		dwRows = pTop->dwHeight - pTop->dwEndRow;
+	}
+	*ppRows =
+		pTop->pdwRows + (pTop->dwEndRow - pTop->dwFirstRow) * pTop->dwWidth;
+	*plPitch = (LONG)(pTop->dwWidth * 4);
+	*pdwRows = dwRows;
+	return DD_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Name: TEXUnlockMipStream()
+// Desc: Add the dwRows rows written since TEXLockMipStream(), then filter
+//       and send every band that can be done with them
+//-----------------------------------------------------------------------------
+HRESULT TEXUnlockMipStream(TEXMipStream* pStream, DWORD dwRows)
+{
+	MipWindow* pTop = &pStream->Levels[0];
+	if (FAILED(pStream->hr)) {
+		return pStream->hr;
+	}
+	if (dwRows > pTop->dwCapacity - (pTop->dwEndRow - pTop->dwFirstRow) ||
+		dwRows > pTop->dwHeight - pTop->dwEndRow) {
+		return DDERR_INVALIDPARAMS;
+	}
+	pTop->dwEndRow += dwRows;
+
+	// Sending and filtering each free up room for the other, so go round
+	// until neither has anything left to do
+	BOOL bBusy;
+	do {
+		bBusy = FALSE;
+		for (DWORD i = 0; i < pStream->dwLevels; ++i) {
+			if (SendBands(pStream, i)) {
+				bBusy = TRUE;
+			}
+			if (FilterBands(pStream, i)) {
+				bBusy = TRUE;
+			}
+		}
+	} while (bBusy && SUCCEEDED(pStream->hr));
+	return pStream->hr;
+}
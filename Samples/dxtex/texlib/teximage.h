@@ -0,0 +1,157 @@
+/***************************************
+
+	Images in plain memory
+
+	Loads Windows bitmaps into 32-bit ARGB pixels, merges a separate alpha
+	bitmap into them and builds mip levels, of volume textures too, all
+	without GDI, DirectDraw or MFC. Files are read with stdio, so batch
+	tools can run these on any number of threads at once. Bitmaps too
+	large to hold can be read a band of rows at a time and their mip
+	levels built the same way.
+
+***************************************/
+
+#ifndef __TEXIMAGE_H__
+#define __TEXIMAGE_H__
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+
+#include "dxtpool.h"
+#include <ddraw.h>
+
+/***************************************
+
+	An ARGB8888 image, rows packed with no padding
+
+***************************************/
+
+typedef struct _TEXIMAGE {
+	DWORD dwWidth;     // Size in pixels
+	DWORD dwHeight;
+	DWORD* pdwPixels;  // dwWidth * dwHeight pixels, top row first
+} TEXIMAGE, *LPTEXIMAGE;
+
+/***************************************
+
+	TEXGenerateMip() flags
+
+***************************************/
+
+#define TEX_MIP_SRGB 0x00000001 // Colors are sRGB, average them as linear
+
+/***************************************
+
+	Resampling filters
+
+	Box is the plain 2x2 average. Kaiser is a sinc windowed over 3
+	pixels, Lanczos the 3 lobe Lanczos and Mitchell the B = C = 1/3 cubic,
+	from sharpest with some ringing to softest.
+
+***************************************/
+
+#define TEX_FILTER_BOX 0
+#define TEX_FILTER_KAISER 1
+#define TEX_FILTER_LANCZOS 2
+#define TEX_FILTER_MITCHELL 3
+#define TEX_FILTER_COUNT 4
+
+#define TEX_MAX_SHRINK 8 // Most TEXResample() shrinks an axis by
+
+/***************************************
+
+	A mip chain for TEXBuildMipChains()
+
+	Level 0 is read and every level below it written, each ARGB8888 and
+	half the size of the one above, rounded down but never below 1.
+
+***************************************/
+
+#define TEX_MAX_LEVELS 16 // Enough for 32768 by 32768
+
+typedef struct _TEXMIPCHAIN {
+	DWORD dwWidth;                 // Size of level 0
+	DWORD dwHeight;
+	DWORD dwLevels;                // Including level 0
+	void* pLevels[TEX_MAX_LEVELS]; // First row of each level
+	LONG lPitch[TEX_MAX_LEVELS];   // Bytes from one row to the next
+} TEXMIPCHAIN, *LPTEXMIPCHAIN;
+
+/***************************************
+
+	Opaque bitmap reader and mip stream
+
+	A reader decodes a bitmap a band of rows at a time. A mip stream takes
+	the top level of an image a band at a time and hands every mip level
+	back the same way, so an image far larger than memory can be converted
+	with only a few bands of each level held at once.
+
+***************************************/
+
+typedef struct TEXBmpReader TEXBmpReader;
+typedef struct TEXMipStream TEXMipStream;
+
+/***************************************
+
+	Mip stream band callback
+
+	Gets dwRows rows of level dwLevel from row dwFirstRow on, as ARGB8888.
+	dwFirstRow is a multiple of the stream's band size, and so of 4, and the
+	rows are only there during the call. A failure stops the stream and is
+	returned by every call on it from then on.
+
+***************************************/
+
+typedef HRESULT (*LPTEXBANDPROC)(void* pContext, DWORD dwLevel,
+	DWORD dwFirstRow, DWORD dwRows, const void* pRows, LONG lPitch);
+
+/* Assume C declarations for C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+extern HRESULT TEXCreateImage(DWORD dwWidth, DWORD dwHeight, TEXIMAGE* pImage);
+extern void TEXFreeImage(TEXIMAGE* pImage);
+extern HRESULT TEXLoadBmp(const char* pFileName, TEXIMAGE* pImage);
+extern HRESULT TEXLoadAlphaBmp(const char* pFileName, TEXIMAGE* pImage);
+extern void TEXCopyAlpha(const void* pSrc, LONG lSrcPitch, void* pDest,
+	LONG lDestPitch, DWORD dwWidth, DWORD dwHeight);
+extern HRESULT TEXOpenBmp(const char* pFileName, TEXBmpReader** ppReader);
+extern void TEXCloseBmp(TEXBmpReader* pReader);
+extern void TEXGetBmpSize(
+	const TEXBmpReader* pReader, DWORD* pdwWidth, DWORD* pdwHeight);
+extern HRESULT TEXReadBmpRows(
+	TEXBmpReader* pReader, DWORD dwRows, void* pDest, LONG lDestPitch);
+extern DWORD TEXGetMipCount(DWORD dwWidth, DWORD dwHeight);
+extern void TEXGenerateMip(const void* pSrc, LONG lSrcPitch,
+	DWORD dwSrcWidth, DWORD dwSrcHeight, void* pDest, LONG lDestPitch,
+	DWORD dwFlags);
+extern void TEXGenerateVolumeMip(const void* pSrc1, const void* pSrc2,
+	LONG lSrcPitch, DWORD dwSrcWidth, DWORD dwSrcHeight, void* pDest,
+	LONG lDestPitch, DWORD dwFlags);
+extern HRESULT TEXResample(const void* pSrc, LONG lSrcPitch,
+	DWORD dwSrcWidth, DWORD dwSrcHeight, void* pDest, LONG lDestPitch,
+	DWORD dwDestWidth, DWORD dwDestHeight, DWORD dwFilter, DWORD dwFlags,
+	DXTWorkPool* pPool);
+extern HRESULT TEXFilterMip(const void* pSrc, LONG lSrcPitch,
+	DWORD dwSrcWidth, DWORD dwSrcHeight, void* pDest, LONG lDestPitch,
+	DWORD dwFilter, DWORD dwFlags, DXTWorkPool* pPool);
+extern HRESULT TEXBuildMipChains(const TEXMIPCHAIN* pChains, DWORD dwChains,
+	DWORD dwFilter, DWORD dwFlags, DXTWorkPool* pPool);
+extern HRESULT TEXCreateMipStream(DWORD dwWidth, DWORD dwHeight,
+	DWORD dwLevels, DWORD dwBandRows, DWORD dwFilter, DWORD dwFlags,
+	LPTEXBANDPROC pBandProc, void* pContext, DXTWorkPool* pPool,
+	TEXMipStream** ppStream);
+extern void TEXDestroyMipStream(TEXMipStream* pStream);
+extern HRESULT TEXLockMipStream(
+	TEXMipStream* pStream, void** ppRows, LONG* plPitch, DWORD* pdwRows);
+extern HRESULT TEXUnlockMipStream(TEXMipStream* pStream, DWORD dwRows);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -11,6 +11,8 @@
 //     copies of the image data.
 //   Creating a system-memory sprite that spans multiple screens using a shared
 //     copy of the image data.
+//   Recycling sprite surfaces through a per-screen surface pool so they
+//     survive surface loss without being recreated.
 //
 // Copyright (c) 1998-1999 Microsoft Corporation. All rights reserved.
 //-----------------------------------------------------------------------------
@@ -26,6 +28,7 @@
 #define COMPILE_MULTIMON_STUBS
 #include <multimon.h>
 
+#include "ddpool.h"
 #include "resource.h"
 #include <ddraw.h>
 #include <stdio.h>
@@ -34,6 +37,9 @@
 #define NAME "MultiMon DirectDraw Sample"
 #define TITLE "MultiMon DirectDraw Sample"
 
+// Most idle surface memory each Screen's pool keeps for reuse
+#define POOL_MAX_IDLE_BYTES (4 * 1024 * 1024)
+
 // Structures for this sample:
 
 // An EnumInfo contains extra enumeration information that is passed
@@ -51,7 +57,8 @@ struct Screen {
 	LPDIRECTDRAW7 pdd;
 	LPDIRECTDRAWSURFACE7 pddsFront;
 	LPDIRECTDRAWSURFACE7 pddsBack;
-	Screen* pScreenNext; // For linked list
+	DDSurfacePool* pPool; // Recycles ScreenSurface surfaces
+	Screen* pScreenNext;  // For linked list
 };
 
 // A ScreenSurface holds a DirectDrawSurface that can be used on a
@@ -59,6 +66,7 @@ struct Screen {
 struct ScreenSurface {
 	Screen* pScreen;
 	LPDIRECTDRAWSURFACE7 pdds;
+	BOOL bPooled; // If TRUE, pdds goes back to the Screen's pool
 	ScreenSurface* pScreenSurfaceNext; // For linked list
 	// Could add a "last used time" field, which could be used to
 	// determine whether this ScreenSurface should be
@@ -101,7 +109,8 @@ static BOOL s_bActive = TRUE;
 // Name: DestroyScreenSurfaces()
 // Desc: Destroys all ScreenSurfaces attached to the given Sprite.  This is
 //       called after restoring all surfaces (since image data may be lost) and
-//       when preparing to exit the program.
+//       when preparing to exit the program.  Surfaces that own their memory
+//       are handed back to the Screen's pool so rebuilding them is cheap.
 //-----------------------------------------------------------------------------
 static void DestroyScreenSurfaces(Sprite* pSprite)
 {
@@ -110,7 +119,11 @@ static void DestroyScreenSurfaces(Sprite* pSprite)
 	while (pScreenSurface != NULL) {
 
 		ScreenSurface* pScreenSurfaceNext = pScreenSurface->pScreenSurfaceNext;
-		pScreenSurface->pdds->Release();
+		if (pScreenSurface->bPooled) {
+			DDPoolRelease(pScreenSurface->pScreen->pPool, pScreenSurface->pdds);
+		} else {
+			pScreenSurface->pdds->Release();
+		}
 		delete pScreenSurface;
 		pScreenSurface = pScreenSurfaceNext;
 	}
@@ -136,6 +149,18 @@ static void Cleanup(VOID)
 	while (pScreen != NULL) {
 		Screen* pScreenNext = pScreen->pScreenNext;
 
+		if (pScreen->pPool != NULL) {
+			DDPOOLSTATS stats;
+			stats.dwSize = sizeof(stats);
+			if (SUCCEEDED(DDPoolGetStats(pScreen->pPool, &stats))) {
+				char sz[200];
+				sprintf(sz, "%s: %lu surface requests, %lu.%lu%% reused\n",
+					pScreen->szDesc, stats.dwAcquires, stats.dwReuseRate / 10,
+					stats.dwReuseRate % 10);
+				OutputDebugStringA(sz);
+			}
+			DDPoolDestroy(pScreen->pPool);
+		}
 		pScreen->pddsBack->Release();
 		pScreen->pddsFront->Release();
 		pScreen->pdd->RestoreDisplayMode();
@@ -399,6 +424,11 @@ static HRESULT InitScreens(VOID)
 				return hr;
 			}
 		}
+
+		if (FAILED(hr = DDPoolCreate(
+					   pScreen->pdd, POOL_MAX_IDLE_BYTES, &pScreen->pPool))) {
+			return hr;
+		}
 	}
 
 	// Note: It is recommended that programs call SetDisplayMode on all screens
@@ -561,16 +591,17 @@ static HRESULT SetupScreenSurfaceDDS(
 	// Try to create the surface in video memory, unless the bForceSystem flag
 	// is set on the Sprite.
 	if (pSprite->bForceSystem ||
-		FAILED(hr = pScreen->pdd->CreateSurface(
-				   &ddsd, &pScreenSurface->pdds, NULL))) {
+		FAILED(hr = DDPoolAcquire(
+				   pScreen->pPool, &ddsd, &pScreenSurface->pdds))) {
 		// Either this sprite has the bForceSystem flag, or creation in video
 		// memory failed, so try to create the surface in system memory.
 		ddsd.ddsCaps.dwCaps = DDSCAPS_SYSTEMMEMORY;
-		if (FAILED(hr = pScreen->pdd->CreateSurface(
-					   &ddsd, &pScreenSurface->pdds, NULL))) {
+		if (FAILED(hr = DDPoolAcquire(
+					   pScreen->pPool, &ddsd, &pScreenSurface->pdds))) {
 			return hr;
 		}
 	}
+	pScreenSurface->bPooled = TRUE;
 
 	if (ddsd.ddsCaps.dwCaps == DDSCAPS_SYSTEMMEMORY &&
 		pSprite->pImageData != NULL) {
@@ -590,6 +621,8 @@ static HRESULT SetupScreenSurfaceDDS(
 			ddsd.ddpfPixelFormat.dwBBitMask ==
 				pSprite->ddsd.ddpfPixelFormat.dwBBitMask) {
 			// Make the DDS use the Sprite's pImageData for its surface contents
+			// Once it points at shared memory it can't be pooled any more.
+			pScreenSurface->bPooled = FALSE;
 			if (FAILED(hr = pScreenSurface->pdds->SetSurfaceDesc(
 						   &pSprite->ddsd, 0))) {
 				return hr;
@@ -659,6 +692,7 @@ static HRESULT SetupScreenSurfaceDDS(
 			if (pSprite->pImageData != NULL) {
 				// May as well make this ScreenSurface use the sharable copy
 				// too:
+				pScreenSurface->bPooled = FALSE;
 				if (FAILED(hr = pScreenSurface->pdds->SetSurfaceDesc(
 							   &pSprite->ddsd, 0))) {
 					return hr;
@@ -711,6 +745,9 @@ static HRESULT FindOrBuildScreenSurface(
 	ZeroMemory(pScreenSurface, sizeof(ScreenSurface));
 	pScreenSurface->pScreen = pScreen;
 	if (FAILED(hr = SetupScreenSurfaceDDS(pSprite, pScreenSurface))) {
+		if (pScreenSurface->pdds != NULL) {
+			pScreenSurface->pdds->Release();
+		}
 		delete pScreenSurface;
 		return hr;
 	}